@@ -0,0 +1,187 @@
+"""
+Benchmarks of each stage of an equilibrium calculation, and of binary phase diagram mapping.
+
+Every stage is timed (``time_*``) and its peak memory is measured
+(``peakmem_*``) separately. The inputs of a stage are computed in ``setup``,
+which is not timed. Caches of compiled callables and sampled points are
+cleared before each sample, so the timings do not depend on the order the
+benchmarks run in.
+"""
+import copy
+import os
+import pickle
+import tempfile
+from pycalphad import Database, variables as v
+from pycalphad.core.eqsolver import _solve_eq_at_conditions
+from pycalphad.core.calculate import _sample_phase_constitution
+from pycalphad.core.solver import Solver
+from pycalphad.core.starting_point import starting_point
+from pycalphad.core.utils import instantiate_models
+from pycalphad.plot.binary.map import map_binary
+from .common import GRID_SIZES, SYSTEMS, Pipeline, build_parameter_index, clear_caches, require, \
+    skip_unless_benchmarked
+
+# Pipelines are shared by the benchmarks run in one process.
+# Stages never modify the results of earlier stages, except the solver, which is given a copy.
+_pipelines = {}
+
+
+def get_pipeline(system, grid_size, until):
+    key = (system, grid_size, until)
+    if key not in _pipelines:
+        _pipelines[key] = Pipeline(system, grid_size=grid_size, until=until)
+    return _pipelines[key]
+
+
+class StageBenchmark(object):
+    "Each sample calls the stage once, after a fresh setup."
+    number = 1
+    repeat = (1, 10, 60.0)
+    warmup_time = 0
+    timeout = 1200
+
+
+class ReadDatabase(StageBenchmark):
+    params = [list(SYSTEMS)]
+    param_names = ['system']
+
+    def setup(self, system):
+        self.path = SYSTEMS[system].path
+
+    def time_read_database(self, system):
+        build_parameter_index(Database(self.path))
+
+    def peakmem_read_database(self, system):
+        Database(self.path)
+
+
+class ReadDatabaseSnapshot(StageBenchmark):
+    "Loading a snapshot, compared with the parse in ReadDatabase and a plain pickle."
+    params = [list(SYSTEMS)]
+    param_names = ['system']
+
+    def setup(self, system):
+        write_snapshot = require('pycalphad.io.snapshot', 'write_snapshot')
+        self.snapshot_dir = tempfile.TemporaryDirectory()
+        self.snapshot = os.path.join(self.snapshot_dir.name, 'database.tdbc')
+        self.pickle = os.path.join(self.snapshot_dir.name, 'database.pkl')
+        dbf = Database(SYSTEMS[system].path)
+        with open(self.snapshot, 'wb') as fd:
+            write_snapshot(dbf, fd)
+        with open(self.pickle, 'wb') as fd:
+            pickle.dump(dbf, fd, protocol=pickle.HIGHEST_PROTOCOL)
+
+    def teardown(self, system):
+        self.snapshot_dir.cleanup()
+
+    # Both include the parameter index that the first Model built from the Database needs
+    def time_read_snapshot(self, system):
+        build_parameter_index(Database(self.snapshot))
+
+    def time_read_pickle(self, system):
+        with open(self.pickle, 'rb') as fd:
+            build_parameter_index(pickle.load(fd))
+
+
+class InstantiateModels(StageBenchmark):
+    params = [list(SYSTEMS)]
+    param_names = ['system']
+
+    def setup(self, system):
+        self.pipeline = get_pipeline(system, 1, 'database')
+
+    def time_instantiate_models(self, system):
+        instantiate_models(self.pipeline.dbf, self.pipeline.comps, self.pipeline.phases)
+
+    def peakmem_instantiate_models(self, system):
+        instantiate_models(self.pipeline.dbf, self.pipeline.comps, self.pipeline.phases)
+
+
+class BuildPhaseRecords(StageBenchmark):
+    params = [list(SYSTEMS)]
+    param_names = ['system']
+
+    def setup(self, system):
+        self.pipeline = get_pipeline(system, 1, 'models')
+        clear_caches()
+
+    def time_build_phase_records(self, system):
+        self.pipeline.run_phase_records()
+
+    def peakmem_build_phase_records(self, system):
+        self.pipeline.run_phase_records()
+
+
+class Calculate(StageBenchmark):
+    params = [list(SYSTEMS), GRID_SIZES]
+    param_names = ['system', 'grid_size']
+
+    def setup(self, system, grid_size):
+        skip_unless_benchmarked(system, grid_size)
+        self.pipeline = get_pipeline(system, grid_size, 'phase_records')
+        _sample_phase_constitution.cache_clear()
+
+    def time_calculate(self, system, grid_size):
+        self.pipeline.run_grid()
+
+    def peakmem_calculate(self, system, grid_size):
+        self.pipeline.run_grid()
+
+
+class StartingPoint(StageBenchmark):
+    params = [list(SYSTEMS), GRID_SIZES]
+    param_names = ['system', 'grid_size']
+
+    def setup(self, system, grid_size):
+        skip_unless_benchmarked(system, grid_size)
+        self.pipeline = get_pipeline(system, grid_size, 'grid')
+
+    def time_starting_point(self, system, grid_size):
+        p = self.pipeline
+        starting_point(p.conds, p.state_variables, p.phase_records, p.grid)
+
+    def peakmem_starting_point(self, system, grid_size):
+        p = self.pipeline
+        starting_point(p.conds, p.state_variables, p.phase_records, p.grid)
+
+
+class SolveEquilibrium(StageBenchmark):
+    params = [list(SYSTEMS), GRID_SIZES]
+    param_names = ['system', 'grid_size']
+
+    def setup(self, system, grid_size):
+        skip_unless_benchmarked(system, grid_size)
+        self.pipeline = get_pipeline(system, grid_size, 'starting_point')
+        # The solver writes its result into the starting point
+        self.properties = copy.deepcopy(self.pipeline.properties)
+
+    def _solve(self):
+        p = self.pipeline
+        _solve_eq_at_conditions(self.properties, p.phase_records, p.grid, list(p.str_conds.keys()),
+                                p.state_variables, False, solver=Solver())
+
+    def time_solve_eq_at_conditions(self, system, grid_size):
+        self._solve()
+
+    def peakmem_solve_eq_at_conditions(self, system, grid_size):
+        self._solve()
+
+
+class MapBinary(StageBenchmark):
+    # Step sizes of T and X(AL)
+    params = [[(100, 0.1), (20, 0.02)]]
+    param_names = ['steps']
+
+    def setup(self, steps):
+        self.pipeline = get_pipeline('Al-Ni', 1, 'database')
+        T_step, X_step = steps
+        self.conds = {v.N: 1, v.P: 101325, v.T: (1000, 1800, T_step), v.X('AL'): (0, 1, X_step)}
+        clear_caches()
+
+    def time_map_binary(self, steps):
+        p = self.pipeline
+        map_binary(p.dbf, p.system.comps, p.phases, self.conds)
+
+    def peakmem_map_binary(self, steps):
+        p = self.pipeline
+        map_binary(p.dbf, p.system.comps, p.phases, self.conds)
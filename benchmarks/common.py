@@ -0,0 +1,181 @@
+"""
+Systems and condition grids shared by the benchmarks.
+
+Each system is calculated on condition grids of increasing size. A grid of
+N points sweeps T and the mole fraction of one component over
+sqrt(N) x sqrt(N) values, with the other compositions fixed, so the grids of
+all systems have the same shape.
+
+Only APIs of every benchmarked version are imported here, so the core
+benchmarks also run against versions of pycalphad that predate the newer
+features. Benchmarks of those features import them where they are used and
+are skipped (by raising NotImplementedError, as asv expects) without them.
+"""
+from collections import OrderedDict
+import inspect
+from importlib_resources import files
+import numpy as np
+import pycalphad.tests.databases
+from pycalphad import Database, calculate, variables as v
+from pycalphad.codegen.callables import build_phase_records
+from pycalphad.codegen.sympydiff_utils import build_constraint_functions, build_functions
+from pycalphad.core.calculate import _sample_phase_constitution
+from pycalphad.core.equilibrium import _adjust_conditions
+from pycalphad.core.starting_point import starting_point
+from pycalphad.core.utils import filter_phases, get_state_variables, instantiate_models, unpack_components
+
+GRID_SIZES = [1, 100, 10000]
+
+
+class BenchmarkSystem(object):
+    """
+    A set of components and phases of a database, with the conditions it is calculated at.
+
+    Parameters
+    ----------
+    database : str
+        File name of a database in pycalphad.tests.databases.
+    comps : List[str]
+    phases : Optional[List[str]]
+        Phases to consider. Defaults to every phase of the database.
+    fixed_conditions : dict
+        Conditions held constant, e.g. the mole fractions of all but one component.
+    swept_condition : v.StateVariable
+        Composition condition that is swept together with T.
+    swept_range : Tuple[float, float]
+    temperature_range : Tuple[float, float]
+    max_grid_size : int
+        Largest condition grid the system is benchmarked on.
+    """
+    def __init__(self, database, comps, phases, fixed_conditions, swept_condition, swept_range,
+                 temperature_range, max_grid_size):
+        self.database = database
+        self.comps = comps
+        self.phases = phases
+        self.fixed_conditions = fixed_conditions
+        self.swept_condition = swept_condition
+        self.swept_range = swept_range
+        self.temperature_range = temperature_range
+        self.max_grid_size = max_grid_size
+
+    @property
+    def path(self):
+        return str(files(pycalphad.tests.databases).joinpath(self.database))
+
+    def conditions(self, grid_size):
+        "Return the conditions of a grid of grid_size points."
+        num_values = int(round(np.sqrt(grid_size)))
+        if num_values ** 2 != grid_size:
+            raise ValueError('Grid size must be a perfect square, got {}'.format(grid_size))
+        conds = {v.N: 1, v.P: 101325}
+        conds.update(self.fixed_conditions)
+        conds[v.T] = np.linspace(*self.temperature_range, num_values)
+        conds[self.swept_condition] = np.linspace(*self.swept_range, num_values)
+        return conds
+
+
+SYSTEMS = OrderedDict([
+    ('Al-Ni', BenchmarkSystem('alnipt.tdb', ['AL', 'NI', 'VA'], None, {},
+                              v.X('AL'), (0.1, 0.9), (1000, 1800), 10000)),
+    ('Al-Ni-Pt', BenchmarkSystem('alnipt.tdb', ['AL', 'NI', 'PT', 'VA'], None, {v.X('PT'): 0.1},
+                                 v.X('AL'), (0.1, 0.5), (1000, 1800), 10000)),
+    ('Al-Co-Cr-Ni', BenchmarkSystem('alcocrni.tdb', ['AL', 'CO', 'CR', 'NI', 'VA'], None,
+                                    {v.X('CO'): 0.2, v.X('CR'): 0.2},
+                                    v.X('AL'), (0.05, 0.3), (1000, 1600), 100)),
+    ('Co-Cr-Fe-Nb-Ti', BenchmarkSystem('mc_fecocrnbti.tdb', ['CO', 'CR', 'FE', 'NB', 'TI', 'VA'], None,
+                                       {v.X('FE'): 0.22, v.X('NB'): 0.01, v.X('TI'): 0.015},
+                                       v.X('CR'), (0.2, 0.35), (900, 1300), 100)),
+    # MQMQA liquid from a ChemSage DAT file
+    ('K-F-Ni', BenchmarkSystem('Ocadiz-Flores.dat', ['K', 'F', 'NI'],
+                               ['F2(G)', 'KF_S1(S)', 'NIF2_S1(S)', 'NIK2F4_S1(S)', 'LIQUID2', 'NIKF3_S1(S)'],
+                               {v.X('NI'): 0.16667}, v.X('F'), (0.55, 0.6), (1300, 1500), 100)),
+])
+
+
+def clear_caches():
+    """
+    Clear the in-memory caches of compiled callables and sampled points, and
+    disable the on-disk cache, so every stage is timed from scratch.
+    """
+    funcs = [build_functions, build_constraint_functions, _sample_phase_constitution]
+    try:
+        from pycalphad.codegen import disk_cache
+        from pycalphad.codegen.sympydiff_utils import build_fused_function
+    except ImportError:
+        # Versions without an on-disk cache or fused functions
+        pass
+    else:
+        disk_cache.set_cache_dir(None)
+        funcs.append(build_fused_function)
+    for func in funcs:
+        func.cache_clear()
+
+
+def require(module_name, name):
+    """
+    Return the attribute name of a module, raising NotImplementedError (so asv
+    skips the benchmark) if this version of pycalphad does not have it.
+    """
+    try:
+        module = __import__(module_name, fromlist=[name])
+        return getattr(module, name)
+    except (ImportError, AttributeError):
+        raise NotImplementedError('{}.{} is not available in this version'.format(module_name, name))
+
+
+def build_parameter_index(dbf):
+    "Build the parameter index that the first Model of dbf needs, in versions that have one."
+    if hasattr(dbf, '_parameter_index'):
+        dbf._parameter_index()
+    return dbf
+
+
+def skip_unless_benchmarked(system, grid_size):
+    "Skip (by raising NotImplementedError, as asv expects) grids larger than the system is benchmarked on."
+    if grid_size > SYSTEMS[system].max_grid_size:
+        raise NotImplementedError('{} is not benchmarked on {} points'.format(system, grid_size))
+
+
+class Pipeline(object):
+    """
+    Intermediate results of an equilibrium calculation, computed up to a stage.
+
+    The stages (in order) are 'database', 'models', 'phase_records', 'grid' and
+    'starting_point', matching the steps of ``equilibrium``.
+    """
+    STAGES = ('database', 'models', 'phase_records', 'grid', 'starting_point')
+
+    def __init__(self, system, grid_size=1, until='starting_point'):
+        self.system = SYSTEMS[system]
+        self.grid_size = grid_size
+        stages = self.STAGES[:self.STAGES.index(until) + 1]
+        for stage in stages:
+            getattr(self, 'run_' + stage)()
+
+    def run_database(self):
+        self.dbf = Database(self.system.path)
+        self.comps = sorted(unpack_components(self.dbf, self.system.comps))
+        self.phases = filter_phases(self.dbf, self.comps, self.system.phases or sorted(self.dbf.phases.keys()))
+        self.conds = _adjust_conditions(self.system.conditions(self.grid_size))
+        self.str_conds = OrderedDict((str(key), value) for key, value in self.conds.items())
+
+    def run_models(self):
+        self.models = instantiate_models(self.dbf, self.comps, self.phases)
+        self.state_variables = sorted(get_state_variables(models=self.models, conds=self.conds), key=str)
+
+    def run_phase_records(self):
+        self.phase_records = build_phase_records(self.dbf, self.comps, self.phases, self.conds, self.models,
+                                                 output='GM', build_gradients=True, build_hessians=True)
+
+    def run_grid(self):
+        statevar_strings = [str(x) for x in self.state_variables]
+        grid_opts = {key: value for key, value in self.str_conds.items() if key in statevar_strings}
+        if 'compact' in inspect.signature(calculate).parameters:
+            # Use the same compact grid as equilibrium, in versions that have one
+            grid_opts['compact'] = True
+        self.grid = calculate(self.dbf, self.comps, self.phases, model=self.models, fake_points=True,
+                              phase_records=self.phase_records, output='GM', to_xarray=False,
+                              pdens=60, **grid_opts)
+
+    def run_starting_point(self):
+        self.properties = starting_point(self.conds, self.state_variables, self.phase_records, self.grid)
@@ -1,16 +1,40 @@
 import pycalphad.variables as v
-from pycalphad.codegen.sympydiff_utils import build_functions
+from pycalphad.codegen.sympydiff_utils import build_functions, build_fused_function
 from pycalphad.core.utils import get_pure_elements, unpack_components, \
     extract_parameters, get_state_variables, wrap_symbol
 from pycalphad.core.phase_rec import PhaseRecord
-from pycalphad.core.constraints import build_constraints
+from pycalphad.core.constraints import scaled_internal_constraints
+from pycalphad.codegen import disk_cache
+from pycalphad.codegen.sympydiff_utils import build_constraint_functions
+from concurrent.futures import ProcessPoolExecutor
 from itertools import repeat
 import warnings
 
 
+class _CompiledResult(object):
+    "Result of a compilation that was not submitted to an executor, with the result() method of a Future."
+    def __init__(self, value):
+        self._value = value
+
+    def result(self):
+        return self._value
+
+
+def _compile(executor, func, *args, **kwargs):
+    "Call a compilation function now, or submit it to the executor if one is given."
+    if executor is None:
+        return _CompiledResult(func(*args, **kwargs))
+    return executor.submit(func, *args, **kwargs)
+
+
+def _init_compile_worker(cache_dir):
+    "Share the on-disk callable cache of the parent process with a compilation worker."
+    disk_cache.set_cache_dir(cache_dir)
+
+
 def build_callables(dbf, comps, phases, models, parameter_symbols=None,
                     output='GM', build_gradients=True, build_hessians=False,
-                    additional_statevars=None):
+                    additional_statevars=None, fused_derivatives=False, executor=None):
     """
     Create a compiled callables dictionary.
 
@@ -34,6 +58,14 @@ def build_callables(dbf, comps, phases, models, parameter_symbols=None,
         Whether or not to build Hessian functions. Defaults to False.
     additional_statevars : set, optional
         State variables to include in the callables that may not be in the models (e.g. from conditions)
+    fused_derivatives : bool, optional
+        If True and both gradients and Hessians are built, build one callable returning
+        the output, its gradient and its Hessian (see `build_fused_function`) instead
+        of separate gradient and Hessian callables. Defaults to False.
+    executor : concurrent.futures.Executor, optional
+        If given, callables are compiled concurrently by the executor. Callables
+        are sent back from worker processes by pickling, so the backend must be
+        picklable (the default LLVM backend is).
     verbose : bool, optional
         Print the name of the phase when its callables are built
 
@@ -83,6 +115,7 @@ def build_callables(dbf, comps, phases, models, parameter_symbols=None,
         'callables': {},
         'grad_callables': {},
         'hess_callables': {},
+        'fused_callables': {},
         'internal_cons_func': {},
         'internal_cons_jac': {},
         'internal_cons_hess': {},
@@ -97,6 +130,9 @@ def build_callables(dbf, comps, phases, models, parameter_symbols=None,
                       "`additional_statevars` argument.".format(state_variables))
     state_variables = sorted(state_variables, key=str)
 
+    # Compilations are submitted for every phase before waiting for any of them,
+    # so they run concurrently if an executor is given
+    pending = {}
     for name in phases:
         mod = models[name]
         site_fracs = mod.site_fractions
@@ -111,35 +147,49 @@ def build_callables(dbf, comps, phases, models, parameter_symbols=None,
         undefs = {x for x in out.free_symbols if not isinstance(x, v.StateVariable)} - set(parameter_symbols)
         undef_vals = repeat(0., len(undefs))
         out = out.xreplace(dict(zip(undefs, undef_vals)))
-        build_output = build_functions(out, tuple(state_variables + site_fracs), parameters=parameter_symbols,
-                                       include_grad=build_gradients, include_hess=build_hessians)
-        cf, gf, hf = build_output.func, build_output.grad, build_output.hess
-        _callables['callables'][name] = cf
-        _callables['grad_callables'][name] = gf
-        _callables['hess_callables'][name] = hf
+        fused = fused_derivatives and build_gradients and build_hessians
+        build_output = _compile(executor, build_functions, out, tuple(state_variables + site_fracs),
+                                parameters=parameter_symbols,
+                                include_grad=build_gradients and not fused,
+                                include_hess=build_hessians and not fused)
+        fused_output = None
+        if fused:
+            fused_output = _compile(executor, build_fused_function, out, tuple(state_variables + site_fracs),
+                                    parameters=parameter_symbols)
 
         # Build the callables for mass
         # TODO: In principle, we should also check for undefs in mod.moles()
-        mcf, mgf, mhf = zip(*[build_functions(mod.moles(el), state_variables + site_fracs,
-                                              include_obj=True,
-                                              include_grad=build_gradients,
-                                              include_hess=build_hessians,
-                                              parameters=parameter_symbols)
-                              for el in pure_elements])
+        mass_outputs = [_compile(executor, build_functions, mod.moles(el), state_variables + site_fracs,
+                                 include_obj=True,
+                                 include_grad=build_gradients,
+                                 include_hess=build_hessians,
+                                 parameters=parameter_symbols)
+                        for el in pure_elements]
+
+        # Build the callables for moles per formula unit
+        # TODO: In principle, we should also check for undefs in mod.moles()
+        formulamole_outputs = [_compile(executor, build_functions, mod.moles(el, per_formula_unit=True),
+                                        state_variables + site_fracs,
+                                        include_obj=True,
+                                        include_grad=build_gradients,
+                                        include_hess=build_hessians,
+                                        parameters=parameter_symbols)
+                               for el in pure_elements]
+        pending[name] = (build_output, fused_output, mass_outputs, formulamole_outputs)
+
+    for name, (build_output, fused_output, mass_outputs, formulamole_outputs) in pending.items():
+        build_output = build_output.result()
+        _callables['callables'][name] = build_output.func
+        _callables['grad_callables'][name] = build_output.grad
+        _callables['hess_callables'][name] = build_output.hess
+        _callables['fused_callables'][name] = fused_output.result() if fused_output is not None else None
 
+        mcf, mgf, mhf = zip(*[mass_output.result() for mass_output in mass_outputs])
         _callables['massfuncs'][name] = mcf
         _callables['massgradfuncs'][name] = mgf
         _callables['masshessfuncs'][name] = mhf
 
-        # Build the callables for moles per formula unit
-        # TODO: In principle, we should also check for undefs in mod.moles()
-        fmcf, fmgf, fmhf = zip(*[build_functions(mod.moles(el, per_formula_unit=True), state_variables + site_fracs,
-                                                 include_obj=True,
-                                                 include_grad=build_gradients,
-                                                 include_hess=build_hessians,
-                                                 parameters=parameter_symbols)
-                                 for el in pure_elements])
-
+        fmcf, fmgf, fmhf = zip(*[formulamole_output.result() for formulamole_output in formulamole_outputs])
         _callables['formulamolefuncs'][name] = fmcf
         _callables['formulamolegradfuncs'][name] = fmgf
         _callables['formulamolehessfuncs'][name] = fmhf
@@ -148,8 +198,8 @@ def build_callables(dbf, comps, phases, models, parameter_symbols=None,
 
 def build_phase_records(dbf, comps, phases, state_variables, models, output='GM',
                         callables=None, parameters=None, verbose=False,
-                        build_gradients=True, build_hessians=True
-                        ):
+                        build_gradients=True, build_hessians=True, fused_derivatives=False,
+                        workers=None):
     """
     Combine compiled callables and callables from conditions into PhaseRecords.
 
@@ -180,6 +230,16 @@ def build_phase_records(dbf, comps, phases, state_variables, models, output='GM'
     build_hessians : bool
         Whether or not to build Hessian functions. Defaults to False. Only
         takes effect if callables are not passed.
+    fused_derivatives : bool
+        If True, the energy per formula unit, its gradient and its Hessian are
+        compiled into one function with common subexpressions shared between them,
+        instead of separate gradient and Hessian functions. The gradient and Hessian
+        are then taken from the fused function. This is much cheaper to build for
+        phases with many internal degrees of freedom. Only takes effect if
+        build_gradients and build_hessians are True. Defaults to False.
+    workers : Optional[int]
+        Number of worker processes compiling the callables of all phases concurrently.
+        None (default) compiles in the current process and -1 uses one process per CPU.
 
     Returns
     -------
@@ -202,23 +262,53 @@ def build_phase_records(dbf, comps, phases, state_variables, models, output='GM'
         'internal_cons_func': {},
         'internal_cons_jac': {},
         'internal_cons_hess': {},
+        'num_internal_cons': {},
     }
     phase_records = {}
     state_variables = sorted(get_state_variables(models=models, conds=state_variables), key=str)
     param_symbols, param_values = extract_parameters(parameters)
 
-    if callables.get(output) is None:
-        callables = build_callables(dbf, comps, phases, models,
-                                    parameter_symbols=parameters.keys(), output=output,
-                                    additional_statevars=state_variables,
-                                    build_gradients=False,
-                                    build_hessians=False)
-    # Temporary solution. PhaseRecord needs rework: https://github.com/pycalphad/pycalphad/pull/329#discussion_r634579356
-    formulacallables = build_callables(dbf, comps, phases, models,
-                                       parameter_symbols=parameters.keys(), output='G',
-                                       additional_statevars=state_variables,
-                                       build_gradients=build_gradients,
-                                       build_hessians=build_hessians)
+    # Local import, since the parallel module imports the solver
+    from pycalphad.core.parallel import resolve_workers
+    workers = resolve_workers(workers)
+    executor = None
+    if workers > 1:
+        executor = ProcessPoolExecutor(max_workers=workers, initializer=_init_compile_worker,
+                                       initargs=(disk_cache.get_cache_dir(),))
+    try:
+        if callables.get(output) is None:
+            callables = build_callables(dbf, comps, phases, models,
+                                        parameter_symbols=parameters.keys(), output=output,
+                                        additional_statevars=state_variables,
+                                        build_gradients=False,
+                                        build_hessians=False,
+                                        executor=executor)
+        # Temporary solution. PhaseRecord needs rework: https://github.com/pycalphad/pycalphad/pull/329#discussion_r634579356
+        formulacallables = build_callables(dbf, comps, phases, models,
+                                           parameter_symbols=parameters.keys(), output='G',
+                                           additional_statevars=state_variables,
+                                           build_gradients=build_gradients,
+                                           build_hessians=build_hessians,
+                                           fused_derivatives=fused_derivatives,
+                                           executor=executor)
+        # build constraint functions
+        pending_constraints = {}
+        for name in phases:
+            mod = models[name]
+            internal_constraints = scaled_internal_constraints(mod)
+            pending_constraints[name] = (_compile(executor, build_constraint_functions,
+                                                  state_variables + mod.site_fractions, internal_constraints,
+                                                  parameters=param_symbols),
+                                         len(internal_constraints))
+        for name, (cf_output, num_internal_cons) in pending_constraints.items():
+            cf_output = cf_output.result()
+            _constraints['internal_cons_func'][name] = cf_output.cons_func
+            _constraints['internal_cons_jac'][name] = cf_output.cons_jac
+            _constraints['internal_cons_hess'][name] = cf_output.cons_hess
+            _constraints['num_internal_cons'][name] = num_internal_cons
+    finally:
+        if executor is not None:
+            executor.shutdown()
 
     # If a vector of parameters is specified, only pass the first row to the PhaseRecord
     # Future callers of PhaseRecord.obj_parameters_2d() can pass the full param_values array as an argument
@@ -228,12 +318,7 @@ def build_phase_records(dbf, comps, phases, state_variables, models, output='GM'
     for name in phases:
         mod = models[name]
         site_fracs = mod.site_fractions
-        # build constraint functions
-        cfuncs = build_constraints(mod, state_variables + site_fracs, parameters=param_symbols)
-        _constraints['internal_cons_func'][name] = cfuncs.internal_cons_func
-        _constraints['internal_cons_jac'][name] = cfuncs.internal_cons_jac
-        _constraints['internal_cons_hess'][name] = cfuncs.internal_cons_hess
-        num_internal_cons = cfuncs.num_internal_cons
+        num_internal_cons = _constraints['num_internal_cons'][name]
 
         phase_records[name.upper()] = PhaseRecord(comps, state_variables, site_fracs, param_values,
                                                   callables[output]['callables'][name],
@@ -247,8 +332,62 @@ def build_phase_records(dbf, comps, phases, state_variables, models, output='GM'
                                                   _constraints['internal_cons_func'][name],
                                                   _constraints['internal_cons_jac'][name],
                                                   _constraints['internal_cons_hess'][name],
-                                                  num_internal_cons)
+                                                  num_internal_cons,
+                                                  formulafusedfunc=formulacallables['G']['fused_callables'][name])
 
         if verbose:
             print(name + ' ')
     return phase_records
+
+
+def build_output_phase_records(phase_records, models, output, parameters=None, callables=None, executor=None):
+    """
+    Build PhaseRecords computing another output from existing PhaseRecords.
+
+    Only the objective function of each phase is compiled. The mass, formula and
+    constraint functions are shared with phase_records.
+
+    Parameters
+    ----------
+    phase_records : Mapping[str, PhaseRecord]
+        PhaseRecords of any output, e.g., those built for an equilibrium calculation.
+    models : Mapping[str, Model]
+        Mapping of phase names to model instances
+    output : str
+        Output property of the particular Model to compute
+    parameters : dict, optional
+        Maps SymEngine Symbol to numbers. Must be the parameters phase_records were built with.
+    callables : dict, optional
+        Pre-computed callables of output for some or all phases, in the format of `build_callables`.
+    executor : concurrent.futures.Executor, optional
+        If given, the objective functions of all phases are compiled concurrently by the executor.
+
+    Returns
+    -------
+    dict
+        Dictionary mapping phase names to PhaseRecord instances.
+    """
+    parameters = parameters if parameters is not None else {}
+    parameter_symbols = sorted([wrap_symbol(x) for x in parameters.keys()], key=str)
+    output_callables = (callables or {}).get(output, {}).get('callables', {})
+    pending = {}
+    precompiled = {}
+    for name, phase_record in phase_records.items():
+        if output_callables.get(name) is not None:
+            precompiled[name] = output_callables[name]
+            continue
+        mod = models[name]
+        try:
+            out = getattr(mod, output)
+        except AttributeError:
+            raise AttributeError('Missing Model attribute {0} specified for {1}'
+                                 .format(output, mod.__class__))
+        # Only force undefineds to zero if we're not overriding them
+        undefs = {x for x in out.free_symbols if not isinstance(x, v.StateVariable)} - set(parameter_symbols)
+        out = out.xreplace(dict(zip(undefs, repeat(0., len(undefs)))))
+        pending[name] = _compile(executor, build_functions, out,
+                                 tuple(list(phase_record.state_variables) + mod.site_fractions),
+                                 parameters=parameter_symbols, include_grad=False, include_hess=False)
+    for name, build_output in pending.items():
+        precompiled[name] = build_output.result().func
+    return {name: phase_records[name].with_objective(func) for name, func in precompiled.items()}
@@ -0,0 +1,171 @@
+"""
+The disk_cache module persists compiled callables across processes.
+
+Compiling the LLVM callables of a multicomponent database can take minutes,
+and the in-memory ``cacheit`` cache only helps within one process. When a
+cache directory is set, ``build_functions`` and ``build_constraint_functions``
+store their (pickled) results in it and reuse them in later processes.
+
+The cache is opt-in. Enable it by calling ``set_cache_dir`` or by setting the
+environment variable named by ``CACHE_DIR_ENV_VAR`` before importing pycalphad::
+
+    from pycalphad.codegen.disk_cache import set_cache_dir
+    set_cache_dir('~/.cache/pycalphad')
+
+Entries are keyed by a hash of the expressions, variables, parameters and
+``lambdify`` options, together with the SymEngine and cache format versions.
+Any change to a model therefore produces a new key and never reuses a stale
+entry. Entries that can no longer be read are deleted when they are found.
+Only picklable callables (i.e., from the LLVM backend) are stored.
+"""
+import hashlib
+import os
+import pickle
+import tempfile
+import symengine
+
+CACHE_DIR_ENV_VAR = 'PYCALPHAD_CALLABLE_CACHE_DIR'
+# Increment when the layout of the cached objects changes
+CACHE_FORMAT_VERSION = 1
+_CACHE_FILE_SUFFIX = '.pkl'
+
+_cache_dir = None
+
+
+def set_cache_dir(path):
+    """
+    Set the directory used to store compiled callables.
+
+    Parameters
+    ----------
+    path : Optional[str]
+        Cache directory. It is created if it does not exist. None disables the cache.
+    """
+    global _cache_dir
+    if path is None:
+        _cache_dir = None
+        return
+    path = os.path.abspath(os.path.expanduser(str(path)))
+    os.makedirs(path, exist_ok=True)
+    _cache_dir = path
+
+
+def _set_cache_dir_from_env():
+    "Set the cache directory from the environment, as set_cache_dir does, without failing the import."
+    global _cache_dir
+    path = os.environ.get(CACHE_DIR_ENV_VAR) or None
+    try:
+        set_cache_dir(path)
+    except OSError:
+        # The directory cannot be created (e.g., read-only); entries are then silently not cached
+        _cache_dir = os.path.abspath(os.path.expanduser(path))
+
+
+_set_cache_dir_from_env()
+
+
+def get_cache_dir():
+    "Return the directory used to store compiled callables, or None if the cache is disabled."
+    return _cache_dir
+
+
+def make_key(*parts):
+    """
+    Compute a stable key of the inputs to a compilation.
+
+    Parameters
+    ----------
+    parts
+        SymEngine expressions, sequences and mappings of them, or plain Python values.
+        Their string representations, which are deterministic for SymEngine objects, are hashed.
+
+    Returns
+    -------
+    str
+    """
+    digest = hashlib.sha256()
+    digest.update('{}:{}'.format(CACHE_FORMAT_VERSION, symengine.__version__).encode('utf-8'))
+    for part in parts:
+        digest.update(b'\x00')
+        digest.update(_canonical_str(part).encode('utf-8'))
+    return digest.hexdigest()
+
+
+def _canonical_str(obj):
+    if isinstance(obj, dict):
+        return '{' + ','.join('{}:{}'.format(_canonical_str(k), _canonical_str(v))
+                              for k, v in sorted(obj.items(), key=lambda kv: str(kv[0]))) + '}'
+    if isinstance(obj, (list, tuple)):
+        return '[' + ','.join(_canonical_str(x) for x in obj) + ']'
+    return str(obj)
+
+
+def _entry_path(key):
+    return os.path.join(_cache_dir, key + _CACHE_FILE_SUFFIX)
+
+
+def load(key):
+    """
+    Return the cached object for the key, or None if there is none.
+
+    Entries that cannot be loaded (e.g., truncated or written by an incompatible
+    version of a dependency) are removed.
+    """
+    if _cache_dir is None:
+        return None
+    path = _entry_path(key)
+    try:
+        with open(path, 'rb') as fp:
+            return pickle.load(fp)
+    except FileNotFoundError:
+        return None
+    except Exception:
+        try:
+            os.remove(path)
+        except OSError:
+            pass
+        return None
+
+
+def store(key, obj):
+    """
+    Store an object in the cache under the key.
+
+    The entry is written atomically, so concurrent processes never see partial files.
+    Objects that cannot be pickled are silently not cached.
+    """
+    if _cache_dir is None:
+        return
+    try:
+        data = pickle.dumps(obj, protocol=pickle.HIGHEST_PROTOCOL)
+    except Exception:
+        return
+    try:
+        fd, tmp_path = tempfile.mkstemp(dir=_cache_dir, suffix='.tmp')
+    except OSError:
+        return
+    try:
+        with os.fdopen(fd, 'wb') as fp:
+            fp.write(data)
+        os.replace(tmp_path, _entry_path(key))
+    except OSError:
+        try:
+            os.remove(tmp_path)
+        except OSError:
+            pass
+
+
+def clear():
+    "Remove every entry from the cache directory."
+    if _cache_dir is None:
+        return
+    try:
+        names = os.listdir(_cache_dir)
+    except OSError:
+        return
+    for name in names:
+        if name.endswith(_CACHE_FILE_SUFFIX):
+            try:
+                os.remove(os.path.join(_cache_dir, name))
+            except OSError:
+                pass
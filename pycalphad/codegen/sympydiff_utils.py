@@ -26,8 +26,16 @@ functions or PhaseRecords. The following issues track this behavior:
 * SymEngine: https://github.com/symengine/symengine/issues/1394
 * SymEngine.py: https://github.com/symengine/symengine.py/issues/294
 
+Compiled callables can also be stored on disk and reused by later processes;
+see ``pycalphad.codegen.disk_cache``.
+
+``build_fused_function`` compiles the function, gradient and Hessian into a
+single callable, so common subexpressions are shared between all three
+outputs and only one function is compiled.
+
 """
 from pycalphad.core.cache import cacheit
+from pycalphad.codegen import disk_cache
 from pycalphad.core.utils import wrap_symbol
 from symengine import sympify, lambdify, zoo, oo
 from collections import namedtuple
@@ -40,6 +48,16 @@ LAMBDIFY_DEFAULT_CSE = True
 LAMBDIFY_DEFAULT_LLVM_OPT_LEVEL = 0
 
 
+def _hessian_graphs(grad_graphs, wrt):
+    "Differentiate the gradient to get the Hessian, only computing the upper triangle since it is symmetric."
+    num_wrt = len(wrt)
+    hess_graphs = [[None] * num_wrt for _ in range(num_wrt)]
+    for i, g in enumerate(grad_graphs):
+        for j in range(i, num_wrt):
+            hess_graphs[i][j] = hess_graphs[j][i] = g.diff(wrt[j]).xreplace({zoo: oo})
+    return hess_graphs
+
+
 def _get_lambidfy_options(user_options):
     user_options = user_options if user_options is not None else {}
     user_options.setdefault('cse', LAMBDIFY_DEFAULT_CSE)
@@ -111,15 +129,85 @@ def build_functions(symengine_graph, variables, parameters=None, wrt=None,
     # complex values and pay the minor time penalty.
     inp = sympify(variables + parameters)
     graph = sympify(symengine_graph).xreplace({zoo: oo})
-    func = lambdify(inp, [graph], **_get_lambidfy_options(func_options))
+    func_options = _get_lambidfy_options(func_options)
+    grad_options = _get_lambidfy_options(grad_options)
+    hess_options = _get_lambidfy_options(hess_options)
+    cache_key = None
+    if disk_cache.get_cache_dir() is not None:
+        cache_key = disk_cache.make_key('build_functions', graph, inp, wrt, include_grad, include_hess,
+                                        func_options, grad_options, hess_options)
+        result = disk_cache.load(cache_key)
+        if result is not None:
+            return result
+    func = lambdify(inp, [graph], **func_options)
     if include_grad or include_hess:
         grad_graphs = list(graph.diff(w).xreplace({zoo: oo}) for w in wrt)
         if include_grad:
-            grad = lambdify(inp, grad_graphs, **_get_lambidfy_options(grad_options))
+            grad = lambdify(inp, grad_graphs, **grad_options)
         if include_hess:
-            hess_graphs = list(list(g.diff(w).xreplace({zoo: oo}) for w in wrt) for g in grad_graphs)
-            hess = lambdify(inp, hess_graphs, **_get_lambidfy_options(hess_options))
-    return BuildFunctionsResult(func=func, grad=grad, hess=hess)
+            hess = lambdify(inp, _hessian_graphs(grad_graphs, wrt), **hess_options)
+    result = BuildFunctionsResult(func=func, grad=grad, hess=hess)
+    if cache_key is not None:
+        disk_cache.store(cache_key, result)
+    return result
+
+
+@cacheit
+def build_fused_function(symengine_graph, variables, parameters=None, wrt=None, options=None):
+    """Build one callable returning the function, gradient and Hessian of the symengine_graph.
+
+    Parameters
+    ----------
+    symengine_graph : symengine.Basic
+        symengine expression to compile, which will corresponds to
+        ``symengine_graph(variables+parameters)``
+    variables : List[symengine.Symbol]
+        Free variables in the symengine_graph. By convention these are usually all
+        instances of StateVariables.
+    parameters : Optional[List[symengine.Symbol]]
+        Free variables in the symengine_graph. These are typically external
+        parameters that are controlled by the user.
+    wrt : Optional[List[symengine.Symbol]]
+        Variables to differentiate *with respect to* for the gradient and
+        Hessian. If None, will fall back to ``variables``.
+    options : Optional[Dict[str, str]]
+        Options to pass to ``lambdify``.
+
+    Returns
+    -------
+    Callable
+        Output is a flat array of length ``1 + n + n*n``, where ``n = len(wrt)``:
+        the function, then the gradient, then the Hessian in row-major order.
+
+    Notes
+    -----
+    With CSE (the default, see ``_get_lambdify_options``), subexpressions
+    are shared between the function, gradient and Hessian, and each entry of
+    the symmetric Hessian is only generated once.
+
+    """
+    if wrt is None:
+        wrt = sympify(tuple(variables))
+    if parameters is None:
+        parameters = []
+    else:
+        parameters = [wrap_symbol(p) for p in parameters]
+    inp = sympify(tuple(variables) + tuple(parameters))
+    graph = sympify(symengine_graph).xreplace({zoo: oo})
+    options = _get_lambidfy_options(options)
+    cache_key = None
+    if disk_cache.get_cache_dir() is not None:
+        cache_key = disk_cache.make_key('build_fused_function', graph, inp, wrt, options)
+        result = disk_cache.load(cache_key)
+        if result is not None:
+            return result
+    grad_graphs = list(graph.diff(w).xreplace({zoo: oo}) for w in wrt)
+    hess_graphs = _hessian_graphs(grad_graphs, wrt)
+    outputs = [graph] + grad_graphs + [h for row in hess_graphs for h in row]
+    result = lambdify(inp, outputs, **options)
+    if cache_key is not None:
+        disk_cache.store(cache_key, result)
+    return result
 
 
 @cacheit
@@ -167,11 +255,24 @@ def build_constraint_functions(variables, constraints, parameters=None, func_opt
     # complex values and pay the minor time penalty.
     inp = sympify(variables + parameters)
     graph = sympify([sympify(f).xreplace({zoo: oo}) for f in constraints])
-    constraint_func = lambdify(inp, [graph], **_get_lambidfy_options(func_options))
+    func_options = _get_lambidfy_options(func_options)
+    jac_options = _get_lambidfy_options(jac_options)
+    hess_options = _get_lambidfy_options(hess_options)
+    cache_key = None
+    if disk_cache.get_cache_dir() is not None:
+        cache_key = disk_cache.make_key('build_constraint_functions', graph, inp,
+                                        func_options, jac_options, hess_options)
+        result = disk_cache.load(cache_key)
+        if result is not None:
+            return result
+    constraint_func = lambdify(inp, [graph], **func_options)
 
     grad_graphs = list(list(c.diff(w).xreplace({zoo: oo}) for w in wrt) for c in graph)
-    jacobian_func = lambdify(inp, grad_graphs, **_get_lambidfy_options(jac_options))
+    jacobian_func = lambdify(inp, grad_graphs, **jac_options)
 
     hess_graphs = list(list(list(g.diff(w).xreplace({zoo: oo}) for w in wrt) for g in c) for c in grad_graphs)
-    hessian_func = lambdify(inp, hess_graphs, **_get_lambidfy_options(hess_options))
-    return ConstraintFunctions(cons_func=constraint_func, cons_jac=jacobian_func, cons_hess=hessian_func)
+    hessian_func = lambdify(inp, hess_graphs, **hess_options)
+    result = ConstraintFunctions(cons_func=constraint_func, cons_jac=jacobian_func, cons_hess=hessian_func)
+    if cache_key is not None:
+        disk_cache.store(cache_key, result)
+    return result
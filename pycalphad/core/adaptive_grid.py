@@ -0,0 +1,224 @@
+"""
+The adaptive_grid module finds the starting point of an equilibrium calculation
+on a grid that is refined only where it matters.
+
+A uniform grid fine enough for accurate starting points samples every phase
+densely, including phases that are never stable. Instead, a coarse grid is
+sampled and its lower convex hull is computed. Points are then added, by
+hit-and-run sampling, in the neighborhood of the constitutions of the phases
+on the hull, with a radius that is halved each iteration, until the energy of
+the hull stops changing. Only the added points are calculated in each
+iteration; the energies of the earlier points are kept.
+"""
+import numpy as np
+from pycalphad.core.calculate import calculate, hr_point_sample, _linear_site_fraction_constraints, \
+    _sample_phase_constitution, _species_charge
+from pycalphad.core.compact_grid import CompactGrid
+from pycalphad.core.starting_point import starting_point
+from pycalphad.core.utils import point_sample, unpack_kwarg
+
+# Default number of points per degree of freedom of the coarse grid
+ADAPTIVE_INITIAL_PDENS = 20
+# Maximum number of refinement iterations
+ADAPTIVE_MAX_ITERATIONS = 6
+# The hull is stable when the energy of no condition changes by more than this (J/mol-atom)
+ADAPTIVE_GM_TOLERANCE = 1e-2
+# Radius of the neighborhood sampled in the first iteration, in site fraction units
+ADAPTIVE_INITIAL_RADIUS = 0.05
+# Points sampled around each hull vertex, per internal degree of freedom
+ADAPTIVE_POINTS_PER_DOF = 5
+# At most this many distinct vertices of a phase are refined in one iteration
+ADAPTIVE_MAX_VERTICES_PER_PHASE = 100
+
+
+def _hull_vertices(properties, phase_dofs):
+    """
+    Return the distinct site fractions of each phase on the lower convex hull.
+
+    Parameters
+    ----------
+    properties : LightDataset
+        Result of `starting_point`.
+    phase_dofs : Dict[str, int]
+        Number of internal degrees of freedom of each phase.
+
+    Returns
+    -------
+    Dict[str, ndarray]
+    """
+    phases = properties.Phase.reshape(-1)
+    amounts = properties.NP.reshape(-1)
+    site_fractions = properties.Y.reshape(-1, properties.Y.shape[-1])
+    vertices = {}
+    for phase_name, phase_dof in phase_dofs.items():
+        phase_mask = (phases == phase_name) & (amounts > 0)
+        if not np.any(phase_mask):
+            continue
+        phase_y = site_fractions[phase_mask, :phase_dof]
+        phase_y = np.unique(np.round(phase_y, 10), axis=0)
+        if phase_y.shape[0] > ADAPTIVE_MAX_VERTICES_PER_PHASE:
+            phase_y = phase_y[np.linspace(0, phase_y.shape[0] - 1, ADAPTIVE_MAX_VERTICES_PER_PHASE).astype(int)]
+        vertices[phase_name] = phase_y
+    return vertices
+
+
+def _sample_neighborhood(constraint_jac, constraint_rhs, vertices, radius, seed):
+    "Sample points within radius of each vertex, returning an array of the new points."
+    num_free_dof = constraint_jac.shape[1] - np.linalg.matrix_rank(constraint_jac)
+    if num_free_dof < 1:
+        return np.empty((0, constraint_jac.shape[1]))
+    num_points = ADAPTIVE_POINTS_PER_DOF * num_free_dof
+    # Samples of each vertex are written into one buffer, then the unwritten rows are dropped
+    new_points = np.empty((len(vertices) * num_points, constraint_jac.shape[1]))
+    num_written = 0
+    for vertex_idx, vertex in enumerate(vertices):
+        # The hull may touch the bounds of site fractions, which hit-and-run cannot start from
+        vertex = np.maximum(vertex, 0)
+        try:
+            vertex_points = hr_point_sample(constraint_jac, constraint_rhs, vertex, num_points,
+                                            max_step=radius, seed=seed + vertex_idx,
+                                            out=new_points[num_written:num_written + num_points])
+        except ValueError:
+            # No feasible direction to sample in from this vertex
+            continue
+        num_written += vertex_points.shape[0]
+    return new_points[:num_written]
+
+
+def _append_points(grid, new_grid, phase_points):
+    """
+    Return a CompactGrid of the points of grid, each phase followed by its points in new_grid.
+
+    The energies and compositions are copied instead of calculated again.
+
+    Parameters
+    ----------
+    grid : CompactGrid
+        Grid with fictitious points.
+    new_grid : CompactGrid
+        Grid of the added points of some phases of grid, without fictitious points.
+    phase_points : Dict[str, ndarray]
+        Site fractions of all points of each phase, i.e., those of grid followed by those of new_grid.
+
+    Returns
+    -------
+    CompactGrid
+    """
+    # Fictitious points are first, and '_FAKE_' is the last phase name
+    phase_names = [str(name) for name in grid.phase_names[:-1]]
+    phase_indices = grid.attrs['phase_indices']
+    fp_offset = min(phase_indices[name].start for name in phase_names)
+    points_axis = grid.X.ndim - 2
+    def points_of(arr, axis, indices):
+        return arr[(slice(None),) * axis + (indices,)]
+    energy_parts = [points_of(grid.GM, points_axis, slice(0, fp_offset))]
+    composition_parts = [grid.X[..., :fp_offset, :]]
+    for phase_name in phase_names:
+        energy_parts.append(points_of(grid.GM, points_axis, phase_indices[phase_name]))
+        composition_parts.append(grid.X[..., phase_indices[phase_name], :])
+        new_indices = new_grid.attrs['phase_indices'].get(phase_name)
+        if new_indices is not None:
+            energy_parts.append(points_of(new_grid.GM, points_axis, new_indices))
+            composition_parts.append(new_grid.X[..., new_indices, :])
+    all_phase_points = [phase_points[phase_name] for phase_name in phase_names]
+    num_points = fp_offset + sum(points.shape[0] for points in all_phase_points)
+    energy_shape = grid.GM.shape[:points_axis] + (num_points,) + grid.GM.shape[points_axis+1:]
+    composition_shape = grid.X.shape[:-2] + (num_points, grid.X.shape[-1])
+    result = CompactGrid.allocate(energy_shape, composition_shape, all_phase_points, phase_names, fp_offset,
+                                  grid.coords, attrs=dict(grid.attrs))
+    np.concatenate(energy_parts, axis=points_axis, out=result.GM)
+    np.concatenate(composition_parts, axis=-2, out=result.X)
+    phase_stops = fp_offset + np.cumsum([points.shape[0] for points in all_phase_points])
+    result.attrs['phase_indices'] = {phase_name: slice(int(phase_stop - points.shape[0]), int(phase_stop), None)
+                                     for phase_name, phase_stop, points in zip(phase_names, phase_stops, all_phase_points)}
+    return result
+
+
+def adaptive_starting_point(dbf, comps, phases, conditions, state_variables, models, phase_records,
+                            parameters=None, grid_opts=None, max_iterations=ADAPTIVE_MAX_ITERATIONS,
+                            tolerance=ADAPTIVE_GM_TOLERANCE):
+    """
+    Find a starting point for the solution on an adaptively refined sample of the system energy surface.
+
+    Parameters
+    ----------
+    dbf : Database
+        Thermodynamic database containing the relevant parameters.
+    comps : list
+        Names of components to consider in the calculation.
+    phases : list
+        Names of the active phases.
+    conditions : OrderedDict
+        Mapping of StateVariable to array of condition values.
+    state_variables : list
+        A list of the state variables (e.g., N, P, T) used in this calculation.
+    models : Dict[str, Model]
+        Instantiated models of every active phase.
+    phase_records : Dict[str, PhaseRecord]
+        PhaseRecords with 'GM' output of every active phase.
+    parameters : dict, optional
+        Maps SymEngine Symbol to numbers, for overriding the values of parameters in the Database.
+    grid_opts : dict, optional
+        Keyword arguments of `calculate`, including the state variables. 'pdens',
+        'sampler' and 'grid_points' define the coarse grid. 'points' is not supported.
+    max_iterations : int, optional
+        Maximum number of refinement iterations.
+    tolerance : float, optional
+        The refinement stops when the energy of the hull changes by less than
+        this at every condition.
+
+    Returns
+    -------
+    Tuple[CompactGrid, LightDataset]
+        Refined grid and the starting point found on it.
+    """
+    grid_opts = dict(grid_opts) if grid_opts is not None else dict()
+    if 'points' in grid_opts:
+        raise ValueError('Adaptive grids cannot be used with fixed points')
+    pdens_dict = unpack_kwarg(grid_opts.pop('pdens', ADAPTIVE_INITIAL_PDENS), default_arg=ADAPTIVE_INITIAL_PDENS)
+    sampler_dict = unpack_kwarg(grid_opts.pop('sampler', None), default_arg=None)
+    fixedgrid_dict = unpack_kwarg(grid_opts.pop('grid_points', True), default_arg=True)
+    phase_points = {}
+    constraints = {}
+    for phase_name in sorted(phases):
+        mod = models[phase_name]
+        phase_points[phase_name] = _sample_phase_constitution(mod, sampler_dict[phase_name] or point_sample,
+                                                              fixedgrid_dict[phase_name], pdens_dict[phase_name])
+        sublattice_dof = [len(subl) for subl in mod.constituents]
+        if sum(sublattice_dof) > len(sublattice_dof):
+            constraints[phase_name] = _linear_site_fraction_constraints(sublattice_dof, _species_charge(mod))
+    phase_dofs = {phase_name: phase_records[phase_name].phase_dof for phase_name in constraints.keys()}
+    radius = ADAPTIVE_INITIAL_RADIUS
+    previous_GM = None
+    grid = calculate(dbf, comps, phases, model=models, fake_points=True, phase_records=phase_records,
+                     output='GM', parameters=parameters, to_xarray=False, compact=True,
+                     points=phase_points, **grid_opts)
+    for iteration in range(max_iterations + 1):
+        properties = starting_point(conditions, state_variables, phase_records, grid)
+        if previous_GM is not None:
+            # Conditions that are infeasible have NaN energies
+            changes = np.abs(properties.GM - previous_GM)
+            changes = changes[~np.isnan(changes)]
+            if (changes.size == 0) or (np.max(changes) < tolerance):
+                break
+        if iteration == max_iterations:
+            break
+        previous_GM = np.array(properties.GM)
+        vertices = _hull_vertices(properties, phase_dofs)
+        new_phase_points = {}
+        for phase_name, phase_vertices in vertices.items():
+            constraint_jac, constraint_rhs = constraints[phase_name]
+            new_points = _sample_neighborhood(constraint_jac, constraint_rhs, phase_vertices, radius,
+                                              seed=1769 + 1000 * iteration)
+            if new_points.shape[0] > 0:
+                new_phase_points[phase_name] = new_points
+                phase_points[phase_name] = np.concatenate((phase_points[phase_name], new_points))
+        if len(new_phase_points) == 0:
+            # The grid, and so the starting point, would not change
+            break
+        new_grid = calculate(dbf, comps, sorted(new_phase_points.keys()), model=models, fake_points=False,
+                             phase_records=phase_records, output='GM', parameters=parameters, to_xarray=False,
+                             compact=True, points=new_phase_points, **grid_opts)
+        grid = _append_points(grid, new_grid, phase_points)
+        radius /= 2
+    return grid, properties
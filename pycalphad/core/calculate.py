@@ -13,6 +13,7 @@ import pycalphad.variables as v
 from pycalphad import ConditionError
 from pycalphad.codegen.callables import build_phase_records
 from pycalphad.core.cache import cacheit
+from pycalphad.core.compact_grid import CompactGrid
 from pycalphad.core.light_dataset import LightDataset
 from pycalphad.model import Model
 from pycalphad.core.phase_rec import PhaseRecord
@@ -20,16 +21,69 @@ from pycalphad.core.utils import endmember_matrix, extract_parameters, \
     get_pure_elements, filter_phases, instantiate_models, point_sample, \
     unpack_components, unpack_condition, unpack_kwarg
 from pycalphad.core.constants import MIN_SITE_FRACTION
+from pycalphad.core.hr_sampler import hit_and_run
 
+# Default number of independent hit-and-run chains used to sample a phase
+HR_NUM_CHAINS = 8
 
-def hr_point_sample(constraint_jac, constraint_rhs, initial_point, num_points):
-    "Hit-and-run sampling of linearly-constrained site fraction spaces"
+
+@cacheit
+def _cached_null_space_basis(shape, jac_bytes):
+    "Orthonormal basis of the null space of a constraint Jacobian, keyed by its shape and contents."
+    constraint_jac = np.frombuffer(jac_bytes, dtype=np.float64).reshape(shape)
     q, r = np.linalg.qr(constraint_jac.T, mode='complete')
-    q1 = q[:, :constraint_jac.shape[0]]
-    q2 = q[:, constraint_jac.shape[0]:]
-    r1 = r[:constraint_jac.shape[0], :]
+    basis = np.ascontiguousarray(q[:, constraint_jac.shape[0]:])
+    basis.flags.writeable = False
+    return basis
+
+
+def _null_space_basis(constraint_jac):
+    """
+    Return an orthonormal basis of the null space of constraint_jac.
+
+    The QR factorization is only computed once for each distinct Jacobian, since
+    every phase with the same sublattice model shares the same constraints.
+    """
+    constraint_jac = np.ascontiguousarray(constraint_jac, dtype=np.float64)
+    return _cached_null_space_basis(constraint_jac.shape, constraint_jac.tobytes())
+
+
+def hr_point_sample(constraint_jac, constraint_rhs, initial_point, num_points, max_step=None, seed=1769,
+                    num_chains=None, out=None):
+    """
+    Hit-and-run sampling of linearly-constrained site fraction spaces
+
+    Parameters
+    ----------
+    constraint_jac : ndarray
+        Jacobian of the linear constraints. Shape of (constraints, site fractions)
+    constraint_rhs : ndarray
+        Right-hand side of the linear constraints.
+    initial_point : Optional[ndarray]
+        Feasible starting point. If None, the minimum norm solution of the constraints is used.
+    num_points : int
+        Number of points to sample.
+    max_step : Optional[float]
+        If given, the length of each step is limited to max_step, so that
+        points are sampled in the neighborhood of initial_point.
+    seed : int, optional
+        Seed of the random number generator.
+    num_chains : Optional[int]
+        Number of independent chains started from initial_point, which share
+        the points evenly. Defaults to HR_NUM_CHAINS, or to a single chain if
+        max_step is given, so that consecutive points are within max_step.
+    out : Optional[ndarray]
+        C-contiguous float64 buffer of shape (num_points, site fractions) the
+        points are written into, e.g., a slice of a larger array of points.
+
+    Returns
+    -------
+    ndarray
+        Shape of (num_points, site fractions), or fewer points if sampling makes poor progress.
+        If out is given, this is a view of its first rows.
+    """
     if initial_point is not None:
-        z_bar = initial_point
+        z_bar = np.ascontiguousarray(initial_point, dtype=np.float64)
     else:
         # minimum norm solution to underdetermined system of equations
         # may not be feasible if it fails the non-negativity constraint
@@ -38,37 +92,79 @@ def hr_point_sample(constraint_jac, constraint_rhs, initial_point, num_points):
     if (solution_norm > 1e-4) or np.any(z_bar < 0):
         # initial point does not satisfy constraints; give up
         return np.empty((0, z_bar.shape[0]))
-    # Hit-and-Run sampling
-    new_feasible_z = np.zeros((num_points, constraint_jac.shape[1]))
-    current_z = np.array(z_bar)
-    min_z = MIN_SITE_FRACTION
-    rng = np.random.RandomState(1769)
-    for iteration in range(num_points):
-        # generate unit direction in null space
-        d = rng.normal(size=(constraint_jac.shape[1] - constraint_jac.shape[0]))
-        d /= np.linalg.norm(d, axis=0)
-        proj = np.dot(q2, d)
-        # find extent of step direction possible while staying within bounds (0 <= z)
-        with np.errstate(divide='ignore'):
-            alphas = (min_z - current_z) / proj
-        # Need to use small value to prevent constraints binding one sublattice (with proj ~ 0) from binding all dof
-        max_alpha_candidates = alphas[np.logical_and(proj > 1e-6, np.isfinite(alphas))]
-        min_alpha_candidates = alphas[np.logical_and(proj < -1e-6, np.isfinite(alphas))]
-        alpha_min = np.min(min_alpha_candidates)
-        alpha_max = np.max(max_alpha_candidates)
-        # Poor progress; give up on sampling
-        if np.abs(alpha_max - alpha_min) < 1e-4:
-            new_feasible_z = new_feasible_z[:iteration, :]
-            break
-        # choose a random step size within the feasible interval
-        new_alpha = rng.uniform(low=alpha_min, high=alpha_max)
-        current_z += new_alpha * proj
-        new_feasible_z[iteration, :] = current_z
+    if out is None:
+        out = np.empty((num_points, constraint_jac.shape[1]))
+    elif out.shape != (num_points, constraint_jac.shape[1]):
+        raise ValueError('Output buffer must have shape {}, got {}'.format((num_points, constraint_jac.shape[1]),
+                                                                            out.shape))
+    if num_chains is None:
+        num_chains = HR_NUM_CHAINS if max_step is None else 1
+    max_step = np.inf if max_step is None else float(max_step)
+    num_written = hit_and_run(_null_space_basis(constraint_jac), z_bar, out, num_chains, max_step,
+                              MIN_SITE_FRACTION, seed)
+    new_feasible_z = out[:num_written]
     if np.any(new_feasible_z < 0):
         raise ValueError('Constrained sampling generated negative site fractions')
     return new_feasible_z
 
 
+def _linear_site_fraction_constraints(sublattice_dof, species_charge=None):
+    """
+    Construct the linear constraints on the site fractions of a phase.
+
+    Parameters
+    ----------
+    sublattice_dof : List[int]
+        Number of species in each sublattice.
+    species_charge : Optional[ndarray]
+        Charge of each species times its site ratio. If given, charge balance is constrained.
+
+    Returns
+    -------
+    Tuple[ndarray, ndarray]
+        Constraint Jacobian and right-hand side: the site fraction balance of
+        each sublattice, followed by charge balance.
+    """
+    num_constraints = len(sublattice_dof) + (species_charge is not None)
+    constraint_jac = np.zeros((num_constraints, sum(sublattice_dof)))
+    constraint_rhs = np.zeros(num_constraints)
+    # site fraction balance
+    dof_idx = 0
+    constraint_idx = 0
+    for subl_dof in sublattice_dof:
+        constraint_jac[constraint_idx, dof_idx:dof_idx + subl_dof] = 1
+        constraint_rhs[constraint_idx] = 1
+        constraint_idx += 1
+        dof_idx += subl_dof
+    # charge balance
+    if species_charge is not None:
+        constraint_jac[constraint_idx, :] = species_charge
+        constraint_rhs[constraint_idx] = 0
+    return constraint_jac, constraint_rhs
+
+
+def _species_charge(model):
+    """
+    Return the charge of each species times its site ratio, or None if
+    the site fractions of the phase are not constrained by charge balance.
+    """
+    # The only implementation with variable site ratios is the two-sublattice ionic liquid.
+    # This check is convenient for detecting 2SL ionic liquids without keeping other state.
+    for sr in model.site_ratios:
+        try:
+            float(sr)
+        except (TypeError, RuntimeError):
+            return None
+    species_charge = []
+    for sublattice in range(len(model.constituents)):
+        for species in sorted(model.constituents[sublattice]):
+            species_charge.append(species.charge*model.site_ratios[sublattice])
+    species_charge = np.array(species_charge)
+    if np.any(species_charge != 0):
+        return species_charge
+    return None
+
+
 @cacheit
 def _sample_phase_constitution(model, sampler, fixed_grid, pdens):
     """
@@ -100,21 +196,8 @@ def _sample_phase_constitution(model, sampler, fixed_grid, pdens):
     sublattice_dof = [len(subl) for subl in model.constituents]
     # Add all endmembers to guarantee their presence
     points = endmember_matrix(sublattice_dof, vacancy_indices=vacancy_indices)
-    site_ratios = model.site_ratios
-    constant_site_ratios = True
-    # The only implementation with variable site ratios is the two-sublattice ionic liquid.
-    # This check is convenient for detecting 2SL ionic liquids without keeping other state.
-    for sr in site_ratios:
-        try:
-            float(sr)
-        except (TypeError, RuntimeError):
-            constant_site_ratios = False
-    species_charge = []
-    for sublattice in range(len(model.constituents)):
-        for species in sorted(model.constituents[sublattice]):
-            species_charge.append(species.charge*site_ratios[sublattice])
-    species_charge = np.array(species_charge)
-    charge_constrained_space = constant_site_ratios and np.any(species_charge != 0)
+    species_charge = _species_charge(model)
+    charge_constrained_space = species_charge is not None
     # We differentiate between (specifically) charge balance and general linear constraints for future use
     # This simplifies adding future constraints, such as disordered configuration sampling, or site fraction conditions
     # Note that if a phase only consists of site fraction balance constraints,
@@ -161,27 +244,17 @@ def _sample_phase_constitution(model, sampler, fixed_grid, pdens):
         if linearly_constrained_space:
             # construct constraint Jacobian for this phase
             # Model technically already does this so it would be better to reuse that functionality
-            # number of sublattices, plus charge balance
-            num_constraints = len(sublattice_dof) + 1
-            constraint_jac = np.zeros((num_constraints, points.shape[-1]))
-            constraint_rhs = np.zeros(num_constraints)
-            # site fraction balance
-            dof_idx = 0
-            constraint_idx = 0
-            for subl_dof in sublattice_dof:
-                constraint_jac[constraint_idx, dof_idx:dof_idx + subl_dof] = 1
-                constraint_rhs[constraint_idx] = 1
-                constraint_idx += 1
-                dof_idx += subl_dof
-            # charge balance
-            constraint_jac[constraint_idx, :] = species_charge
-            constraint_rhs[constraint_idx] = 0
+            constraint_jac, constraint_rhs = _linear_site_fraction_constraints(sublattice_dof, species_charge)
             # Sample additional points which obey the constraints
             # Mean of pseudo-endmembers is feasible by convexity of the space
             initial_point = np.mean(points, axis=0)
             num_points = (pdens ** 2) * (constraint_jac.shape[1] - constraint_jac.shape[0])
-            extra_points = hr_point_sample(constraint_jac, constraint_rhs, initial_point, num_points)
-            points = np.concatenate((points, extra_points))
+            # Sampled points are written directly after the pseudo-endmembers
+            all_points = np.empty((points.shape[0] + num_points, constraint_jac.shape[1]))
+            all_points[:points.shape[0]] = points
+            extra_points = hr_point_sample(constraint_jac, constraint_rhs, initial_point, num_points,
+                                           out=all_points[points.shape[0]:])
+            points = all_points[:points.shape[0] + extra_points.shape[0]]
             assert np.max(np.abs(constraint_jac.dot(points.T).T - constraint_rhs)) < 1e-6
             if points.shape[0] == 0:
                 warnings.warn(f'{model.phase_name} has zero feasible configurations under the given conditions')
@@ -199,7 +272,7 @@ def _sample_phase_constitution(model, sampler, fixed_grid, pdens):
 def _compute_phase_values(components, statevar_dict,
                           points, phase_record, output, maximum_internal_dof, broadcast=True,
                           parameters=None, fake_points=False,
-                          largest_energy=None):
+                          largest_energy=None, compact=False):
     """
     Calculate output values for a particular phase.
 
@@ -228,6 +301,11 @@ def _compute_phase_values(components, statevar_dict,
         If True, the first few points of the output surface will be fictitious
         points used to define an equilibrium hyperplane guaranteed to be above
         all the other points. This is used for convex hull computations.
+    largest_energy : float, optional
+        Energy of the fictitious points.
+    compact : bool, optional (Default: False)
+        If True, omit the padded 'Y' and 'Phase' variables. A CompactGrid
+        stores them once for all state variables instead.
 
     Returns
     -------
@@ -299,6 +377,9 @@ def _compute_phase_values(components, statevar_dict,
         else:
             concat_axis = -1
         phase_output = np.concatenate((broadcast_to(largest_energy, output_shape), phase_output), axis=concat_axis)
+    if compact:
+        phase_names = None
+    elif fake_points:
         phase_names = np.concatenate((broadcast_to('_FAKE_', points.shape[:-2] + (max_tieline_vertices,)),
                                       np.full(points.shape[:-1], phase_record.phase_name, dtype='U' + str(len(phase_record.phase_name)))), axis=-1)
     else:
@@ -313,7 +394,9 @@ def _compute_phase_values(components, statevar_dict,
     # Waste of memory? Yes, but the alternatives are unclear.
     # In each case, first check if we need to do this...
     # It can be expensive for many points (~14s for 500M points)
-    if fake_points:
+    if compact:
+        expanded_points = None
+    elif fake_points:
         desired_shape = points.shape[:-2] + (max_tieline_vertices + points.shape[-2], maximum_internal_dof)
         expanded_points = np.full(desired_shape, np.nan)
         expanded_points[..., len(pure_elements):, :points.shape[-1]] = points
@@ -342,6 +425,9 @@ def _compute_phase_values(components, statevar_dict,
                    'Y': (output_columns + ['internal_dof'], expanded_points),
                    output: (['dim_'+str(i) for i in range(len(phase_output.shape) - (len(output_columns)+len(parameter_column)))] + output_columns + parameter_column, phase_output)
                    }
+    if compact:
+        del data_arrays['Phase']
+        del data_arrays['Y']
     if not broadcast:
         # Add state variables as data variables rather than as coordinates
         for sym, vals in zip(statevar_dict.keys(), statevars):
@@ -351,7 +437,112 @@ def _compute_phase_values(components, statevar_dict,
     return LightDataset(data_arrays, coords=coordinate_dict)
 
 
-def calculate(dbf, comps, phases, mode=None, output='GM', fake_points=False, broadcast=True, parameters=None, to_xarray=True, phase_records=None, **kwargs):
+def _concatenate_phase_values(all_phase_data, phase_names, fp_offset):
+    """
+    Concatenate the per-phase results of _compute_phase_values along the points axis.
+
+    Parameters
+    ----------
+    all_phase_data : List[LightDataset]
+        Results of _compute_phase_values, in the order of phase_names.
+    phase_names : List[str]
+        Sorted names of the phases.
+    fp_offset : int
+        Number of fictitious points at the start of the first phase's points.
+
+    Returns
+    -------
+    LightDataset
+        Concatenated dataset. The 'phase_indices' attribute maps phase names to their slice of points.
+    """
+    running_total = [fp_offset] + list(np.cumsum([phase_ds['X'].shape[-2] for phase_ds in all_phase_data]))
+    islice_by_phase = {phase_name: slice(running_total[phase_idx], running_total[phase_idx+1], None)
+                       for phase_idx, phase_name in enumerate(phase_names)}
+    # speedup for single-phase case (found by profiling)
+    if len(all_phase_data) > 1:
+        concatenated_coords = all_phase_data[0].coords
+
+        data_vars = all_phase_data[0].data_vars
+        concatenated_data_vars = {}
+        for var in data_vars.keys():
+            data_coords = data_vars[var][0]
+            points_idx = data_coords.index('points')  # concatenation axis
+            arrs = []
+            for phase_data in all_phase_data:
+                arrs.append(getattr(phase_data, var))
+            concat_data = np.concatenate(arrs, axis=points_idx)
+            concatenated_data_vars[var] = (data_coords, concat_data)
+        final_ds = LightDataset(data_vars=concatenated_data_vars, coords=concatenated_coords)
+    else:
+        final_ds = all_phase_data[0]
+    final_ds.attrs['phase_indices'] = islice_by_phase
+    return final_ds
+
+
+def _compute_compact_grid(components, statevar_dict, all_phase_points, phase_records, phase_names, output,
+                          maximum_internal_dof, parameters, fake_points, largest_energy, fp_offset, memmap_dir=None):
+    """
+    Calculate output values of every phase directly into a CompactGrid.
+
+    Only the values of one phase are held in memory at a time, so with
+    memmap_dir the size of the grid is limited by disk space.
+
+    Parameters
+    ----------
+    components : list
+        Names of components to consider in the calculation.
+    statevar_dict : OrderedDict {str -> float or sequence}
+        Mapping of state variables to desired values. They are broadcast against each other.
+    all_phase_points : List[ndarray]
+        Site fractions of the points of each phase, in the order of phase_names.
+    phase_records : Dict[str, PhaseRecord]
+    phase_names : List[str]
+        Sorted names of the phases.
+    output : string
+        Desired name of the output result.
+    maximum_internal_dof : int
+        Largest number of internal degrees of freedom of any phase.
+    parameters : OrderedDict {str -> float or sequence}, optional
+    fake_points : bool
+        If True, fictitious points are added before the points of the first phase.
+    largest_energy : float
+        Energy of the fictitious points.
+    fp_offset : int
+        Number of fictitious points.
+    memmap_dir : Optional[str]
+        Directory of the memory-mapped arrays, or None to keep them in memory.
+
+    Returns
+    -------
+    CompactGrid
+    """
+    num_points = fp_offset + sum(points.shape[0] for points in all_phase_points)
+    grid = None
+    start = 0
+    for phase_idx, (phase_name, points) in enumerate(zip(phase_names, all_phase_points)):
+        phase_ds = _compute_phase_values(components, statevar_dict, points, phase_records[phase_name], output,
+                                         maximum_internal_dof, parameters=parameters, largest_energy=largest_energy,
+                                         fake_points=fake_points and (phase_idx == 0), compact=True)
+        phase_output = getattr(phase_ds, output)
+        points_axis = phase_ds.data_vars[output][0].index('points')
+        if grid is None:
+            energy_shape = phase_output.shape[:points_axis] + (num_points,) + phase_output.shape[points_axis+1:]
+            composition_shape = phase_ds.X.shape[:-2] + (num_points, phase_ds.X.shape[-1])
+            grid = CompactGrid.allocate(energy_shape, composition_shape, all_phase_points, phase_names,
+                                        fp_offset, phase_ds.coords, directory=memmap_dir)
+        stop = start + phase_ds.X.shape[-2]
+        grid.GM[(slice(None),) * points_axis + (slice(start, stop),)] = phase_output
+        grid.X[..., start:stop, :] = phase_ds.X
+        start = stop
+    phase_stops = fp_offset + np.cumsum([points.shape[0] for points in all_phase_points])
+    grid.attrs['phase_indices'] = {phase_name: slice(int(phase_stops[phase_idx] - all_phase_points[phase_idx].shape[0]),
+                                                     int(phase_stops[phase_idx]), None)
+                                   for phase_idx, phase_name in enumerate(phase_names)}
+    grid.flush()
+    return grid
+
+
+def calculate(dbf, comps, phases, mode=None, output='GM', fake_points=False, broadcast=True, parameters=None, to_xarray=True, phase_records=None, compact=False, memmap_dir=None, **kwargs):
     """
     Sample the property surface of 'output' containing the specified
     components and phases. Model parameters are taken from 'dbf' and any
@@ -397,6 +588,15 @@ def calculate(dbf, comps, phases, mode=None, output='GM', fake_points=False, bro
         The `model` argument must be a mapping of phase names to instances of Model
         objects. Callers must take care that the PhaseRecord objects were created with
         the same `output` as passed to `calculate`.
+    compact : bool, optional (Default: False)
+        If True, return a CompactGrid, which stores the site fractions and phase
+        names of the points once instead of padded for every set of state variables.
+        Requires broadcast=True and to_xarray=False.
+    memmap_dir : Optional[str]
+        If given with compact=True, the arrays of the CompactGrid are written
+        to memory-mapped files in this directory instead of being held in memory.
+        Existing grid files in the directory are overwritten. Processes on other
+        hosts can only use the grid if the directory is on a shared filesystem.
 
     Returns
     -------
@@ -422,6 +622,10 @@ def calculate(dbf, comps, phases, mode=None, output='GM', fake_points=False, bro
     if isinstance(comps, (str, v.Species)):
         comps = [comps]
     comps = sorted(unpack_components(dbf, comps))
+    if compact and (to_xarray or not broadcast):
+        raise ValueError('compact=True requires broadcast=True and to_xarray=False')
+    if (memmap_dir is not None) and not compact:
+        raise ValueError('memmap_dir requires compact=True')
     if points_dict is None and broadcast is False:
         raise ValueError('The \'points\' keyword argument must be specified if broadcast=False is also given.')
     nonvacant_components = [x for x in sorted(comps) if x.number_of_atoms > 0]
@@ -477,15 +681,22 @@ def calculate(dbf, comps, phases, mode=None, output='GM', fake_points=False, bro
             raise ValueError(f"model must contain a Model instance for every active phase. Missing Model objects for {sorted(active_phases_without_models)}")
 
     maximum_internal_dof = max(len(models[phase_name].site_fractions) for phase_name in active_phases)
+    all_phase_points = []
     for phase_name in sorted(active_phases):
         mod = models[phase_name]
-        phase_record = phase_records[phase_name]
         points = points_dict[phase_name]
         if points is None:
             points = _sample_phase_constitution(mod, sampler_dict[phase_name] or point_sample,
                                                 fixedgrid_dict[phase_name], pdens_dict[phase_name])
-        points = np.atleast_2d(points)
+        all_phase_points.append(np.atleast_2d(points))
 
+    fp_offset = len(nonvacant_elements) if fake_points else 0
+    if compact:
+        return _compute_compact_grid(nonvacant_components, str_statevar_dict, all_phase_points, phase_records,
+                                     sorted(active_phases), output, maximum_internal_dof, parameters,
+                                     fake_points, float(largest_energy), fp_offset, memmap_dir=memmap_dir)
+    for phase_name, points in zip(sorted(active_phases), all_phase_points):
+        phase_record = phase_records[phase_name]
         fp = fake_points and (phase_name == sorted(active_phases)[0])
         phase_ds = _compute_phase_values(nonvacant_components, str_statevar_dict,
                                          points, phase_record, output,
@@ -493,28 +704,7 @@ def calculate(dbf, comps, phases, mode=None, output='GM', fake_points=False, bro
                                          largest_energy=float(largest_energy), fake_points=fp)
         all_phase_data.append(phase_ds)
 
-    fp_offset = len(nonvacant_elements) if fake_points else 0
-    running_total = [fp_offset] + list(np.cumsum([phase_ds['X'].shape[-2] for phase_ds in all_phase_data]))
-    islice_by_phase = {phase_name: slice(running_total[phase_idx], running_total[phase_idx+1], None)
-                       for phase_idx, phase_name in enumerate(sorted(active_phases))}
-    # speedup for single-phase case (found by profiling)
-    if len(all_phase_data) > 1:
-        concatenated_coords = all_phase_data[0].coords
-
-        data_vars = all_phase_data[0].data_vars
-        concatenated_data_vars = {}
-        for var in data_vars.keys():
-            data_coords = data_vars[var][0]
-            points_idx = data_coords.index('points')  # concatenation axis
-            arrs = []
-            for phase_data in all_phase_data:
-                arrs.append(getattr(phase_data, var))
-            concat_data = np.concatenate(arrs, axis=points_idx)
-            concatenated_data_vars[var] = (data_coords, concat_data)
-        final_ds = LightDataset(data_vars=concatenated_data_vars, coords=concatenated_coords)
-    else:
-        final_ds = all_phase_data[0]
-    final_ds.attrs['phase_indices'] = islice_by_phase
+    final_ds = _concatenate_phase_values(all_phase_data, sorted(active_phases), fp_offset)
     if to_xarray:
         return final_ds.get_dataset()
     else:
@@ -0,0 +1,330 @@
+"""
+The compact_grid module contains a representation of the sampled energy
+surface of a system that stores site fractions without padding.
+
+The dense grid returned by ``calculate`` pads the site fractions of every
+phase to the largest number of internal degrees of freedom of any phase and
+repeats them (and the phase names) for every combination of state variables.
+When a phase with many degrees of freedom is sampled next to line compounds,
+most of that array is NaN. ``CompactGrid`` keeps a single flat buffer of site
+fractions with per-point offsets and phase ids, which do not depend on the
+state variables. Phases are identified by a fixed-width integer id rather
+than by a string, so all arrays of a ``CompactGrid`` can be memory-mapped.
+"""
+import os
+import uuid
+import numpy as np
+
+# Arrays that are memory-mapped, each to a .npy file of the same name
+_ARRAY_NAMES = ('GM', 'X', 'site_fractions', 'offsets', 'phase_ids')
+# File identifying the grid whose arrays are in a memory-mapped directory
+_GRID_ID_NAME = 'grid_id'
+
+
+def _read_grid_id(directory):
+    "Return the id of the grid stored in directory, or None if it cannot be read."
+    try:
+        with open(os.path.join(directory, _GRID_ID_NAME), 'r') as fp:
+            return fp.read().strip()
+    except OSError:
+        return None
+
+
+def _allocate_array(directory, name, shape, dtype):
+    "Allocate an uninitialized array in memory, or as a memory-mapped .npy file in directory."
+    if directory is None:
+        return np.empty(shape, dtype=dtype)
+    return np.lib.format.open_memmap(os.path.join(directory, name + '.npy'), mode='w+', dtype=dtype, shape=shape)
+
+
+class CompactGrid(object):
+    """
+    Sample of the energy surface of a system with ragged (CSR-style) site fraction storage.
+
+    Parameters
+    ----------
+    GM : ndarray
+        Energies of the points. Shape of (state variables..., points)
+    X : ndarray
+        Compositions of the points. Shape of (state variables..., points, component)
+    site_fractions : ndarray
+        Site fractions of all points, concatenated.
+    offsets : ndarray
+        Site fractions of point i are site_fractions[offsets[i]:offsets[i+1]]. Shape of (points+1,)
+    phase_ids : ndarray
+        Index into phase_names of the phase of each point. Shape of (points,)
+    phase_names : ndarray
+        Names of the phases.
+    coords : dict
+        Mapping of {Dimension: Values}, as in LightDataset.
+    attrs : dict, optional
+        The 'phase_indices' entry maps phase names to their slice of points.
+
+    Attributes
+    ----------
+    GM : ndarray
+    X : ndarray
+    site_fractions : ndarray
+    offsets : ndarray
+    phase_ids : ndarray
+    phase_names : ndarray
+    coords : dict
+    attrs : dict
+    memmap_dir : Optional[str]
+        Directory of the memory-mapped arrays, or None if the grid is in memory.
+
+    Notes
+    -----
+    A memory-mapped grid is pickled by the name of its directory, and the receiving
+    process opens the same files. Sending it to processes on other hosts (e.g.,
+    with the Dask or MPI equilibrium executors) requires memmap_dir to be on a
+    filesystem shared by every host. Unpickling raises an error if the directory
+    cannot be read or holds another grid.
+    """
+    def __init__(self, GM, X, site_fractions, offsets, phase_ids, phase_names, coords, attrs=None):
+        self.GM = GM
+        self.X = X
+        self.site_fractions = site_fractions
+        self.offsets = offsets
+        self.phase_ids = phase_ids
+        self.phase_names = np.asarray(phase_names)
+        self.coords = coords
+        self.attrs = attrs or dict()
+        self._point_phases = None
+        self.memmap_dir = None
+        self._memmap_id = None
+        if self.offsets.shape[0] != self.phase_ids.shape[0] + 1:
+            raise ValueError('Number of offsets ({}) must be one more than the number of points ({})'
+                             .format(self.offsets.shape[0], self.phase_ids.shape[0]))
+
+    @classmethod
+    def allocate(cls, energy_shape, composition_shape, phase_points, phase_names, fp_offset, coords,
+                 attrs=None, directory=None):
+        """
+        Create a CompactGrid for the given points, with uninitialized energies and compositions.
+
+        Parameters
+        ----------
+        energy_shape : Tuple[int]
+            Shape of GM.
+        composition_shape : Tuple[int]
+            Shape of X.
+        phase_points : List[ndarray]
+            Site fractions of the points of each phase, in the order of phase_names.
+        phase_names : List[str]
+            Sorted names of the phases.
+        fp_offset : int
+            Number of fictitious points at the start of the grid.
+        coords : dict
+        attrs : dict, optional
+        directory : Optional[str]
+            If given, every array is a memory-mapped .npy file in this directory,
+            so the size of the grid is limited by disk space rather than memory.
+
+        Returns
+        -------
+        CompactGrid
+        """
+        if directory is not None:
+            directory = os.path.abspath(os.path.expanduser(str(directory)))
+            os.makedirs(directory, exist_ok=True)
+        num_points = fp_offset + sum(points.shape[0] for points in phase_points)
+        num_site_fractions = sum(points.size for points in phase_points)
+        offsets = _allocate_array(directory, 'offsets', (num_points + 1,), np.int64)
+        phase_ids = _allocate_array(directory, 'phase_ids', (num_points,), np.int32)
+        site_fractions = _allocate_array(directory, 'site_fractions', (num_site_fractions,), np.float64)
+        offsets[:fp_offset+1] = 0
+        # '_FAKE_' is always last so phase ids of real phases match phase_indices order
+        phase_ids[:fp_offset] = len(phase_names)
+        point_idx = fp_offset
+        for phase_idx, points in enumerate(phase_points):
+            start = offsets[point_idx]
+            site_fractions[start:start+points.size] = np.asarray(points, dtype=np.float64).ravel()
+            offsets[point_idx+1:point_idx+points.shape[0]+1] = start + points.shape[1] * np.arange(1, points.shape[0] + 1)
+            phase_ids[point_idx:point_idx+points.shape[0]] = phase_idx
+            point_idx += points.shape[0]
+        grid = cls(_allocate_array(directory, 'GM', energy_shape, np.float64),
+                   _allocate_array(directory, 'X', composition_shape, np.float64),
+                   site_fractions, offsets, phase_ids, list(phase_names) + ['_FAKE_'], coords, attrs=attrs)
+        grid.memmap_dir = directory
+        if directory is not None:
+            grid._memmap_id = uuid.uuid4().hex
+            with open(os.path.join(directory, _GRID_ID_NAME), 'w') as fp:
+                fp.write(grid._memmap_id)
+        return grid
+
+    def flush(self):
+        "Write any changes of a memory-mapped grid to disk."
+        if self.memmap_dir is None:
+            return
+        for name in _ARRAY_NAMES:
+            arr = getattr(self, name)
+            if isinstance(arr, np.memmap):
+                arr.flush()
+
+    def __getstate__(self):
+        state = dict(self.__dict__)
+        state['_point_phases'] = None
+        if self.memmap_dir is not None:
+            # Reopen the files instead of copying the arrays, e.g., when sent to other processes
+            self.flush()
+            for name in _ARRAY_NAMES:
+                state[name] = None
+        return state
+
+    def __setstate__(self, state):
+        self.__dict__.update(state)
+        if self.memmap_dir is not None:
+            if _read_grid_id(self.memmap_dir) != getattr(self, '_memmap_id', None):
+                raise ValueError('Memory-mapped grid directory {} cannot be read or holds another grid. '
+                                 'Grids sent to other hosts must be in a directory on a filesystem shared '
+                                 'by every host.'.format(self.memmap_dir))
+            for name in _ARRAY_NAMES:
+                # Copy-on-write keeps the arrays writeable without modifying the files
+                setattr(self, name, np.load(os.path.join(self.memmap_dir, name + '.npy'), mmap_mode='c'))
+
+    @property
+    def num_points(self):
+        "Number of points in the grid, including fictitious points."
+        return self.phase_ids.shape[0]
+
+    def point_phases(self, point_indices=None):
+        """
+        Return the phase names of the given points, or of every point if point_indices is None.
+
+        Parameters
+        ----------
+        point_indices : Optional[ArrayLike]
+            Indices of points, of any shape.
+
+        Returns
+        -------
+        ndarray
+            Same shape as point_indices.
+        """
+        if point_indices is None:
+            if self._point_phases is None:
+                self._point_phases = self.phase_names[self.phase_ids]
+            return self._point_phases
+        return self.phase_names[self.phase_ids[np.asarray(point_indices)]]
+
+    def point_site_fractions(self, point_index):
+        """
+        Return the site fractions of a point, without padding.
+
+        Parameters
+        ----------
+        point_index : int
+
+        Returns
+        -------
+        ndarray
+            A view into site_fractions. Empty for fictitious points.
+        """
+        return self.site_fractions[self.offsets[point_index]:self.offsets[point_index+1]]
+
+    def padded_site_fractions(self, point_indices, num_dof):
+        """
+        Return the site fractions of the given points, padded with NaN to num_dof columns.
+
+        Parameters
+        ----------
+        point_indices : ArrayLike
+            Indices of points, of any shape.
+        num_dof : int
+            Number of columns of the result. Must be at least the number of
+            internal degrees of freedom of every phase in the grid.
+
+        Returns
+        -------
+        ndarray
+            Shape of point_indices.shape + (num_dof,)
+        """
+        point_indices = np.asarray(point_indices)
+        flat_indices = point_indices.ravel()
+        starts = self.offsets[flat_indices]
+        lengths = self.offsets[flat_indices + 1] - starts
+        result = np.full((flat_indices.shape[0], num_dof), np.nan)
+        columns = np.arange(num_dof)
+        mask = columns[np.newaxis, :] < lengths[:, np.newaxis]
+        result[mask] = self.site_fractions[(starts[:, np.newaxis] + columns[np.newaxis, :])[mask]]
+        return result.reshape(point_indices.shape + (num_dof,))
+
+    def select_state(self, **indexers):
+        """
+        Return the grid at one value of some state variables.
+
+        The energies and compositions are views of this grid's arrays, and the
+        site fractions, offsets and phase ids are shared, so nothing is copied.
+
+        Parameters
+        ----------
+        indexers : int
+            Maps names of state variables (e.g., T=3) to an index into their coordinate.
+            Their dimensions are kept, with a length of one.
+
+        Returns
+        -------
+        CompactGrid
+        """
+        # Coordinates of state variables are in the order of the leading dimensions of GM and X
+        statevar_dims = [dim for dim in self.coords.keys() if dim != 'component']
+        unknown_dims = set(indexers.keys()) - set(statevar_dims)
+        if len(unknown_dims) > 0:
+            raise ValueError('Grid has no state variables {}'.format(sorted(unknown_dims)))
+        slices = tuple(slice(indexers[dim], indexers[dim] + 1) if dim in indexers else slice(None)
+                       for dim in statevar_dims)
+        coords = dict(self.coords)
+        for dim, index in indexers.items():
+            coords[dim] = np.atleast_1d(self.coords[dim])[index:index+1]
+        grid = CompactGrid(self.GM[slices], self.X[slices], self.site_fractions, self.offsets, self.phase_ids,
+                           self.phase_names, coords, attrs=self.attrs)
+        grid._point_phases = self._point_phases
+        return grid
+
+    @property
+    def nbytes(self):
+        "Total number of bytes of the arrays of the grid."
+        return sum(arr.nbytes for arr in (self.GM, self.X, self.site_fractions, self.offsets, self.phase_ids))
+
+
+def grid_point_phases(grid, state_index):
+    """
+    Return the phase names of every point of a dense or compact grid at the given state variables.
+
+    Parameters
+    ----------
+    grid : Union[LightDataset, CompactGrid]
+    state_index : Sequence[int]
+        Index into the state variable dimensions of the grid.
+
+    Returns
+    -------
+    ndarray
+    """
+    if isinstance(grid, CompactGrid):
+        return grid.point_phases()
+    return grid.Phase[tuple(state_index)]
+
+
+def grid_point_site_fractions(grid, state_index, point_index):
+    """
+    Return the site fractions of a point of a dense or compact grid at the given state variables.
+
+    The site fractions of a dense grid are padded with NaN, while those of a
+    compact grid are not, so callers should only use the first phase_dof values.
+
+    Parameters
+    ----------
+    grid : Union[LightDataset, CompactGrid]
+    state_index : Sequence[int]
+        Index into the state variable dimensions of the grid.
+    point_index : int
+
+    Returns
+    -------
+    ndarray
+    """
+    if isinstance(grid, CompactGrid):
+        return grid.point_site_fractions(point_index)
+    return grid.Y[tuple(state_index) + (point_index,)]
@@ -6,9 +6,13 @@ ConstraintTuple = namedtuple('ConstraintTuple', ['internal_cons_func', 'internal
                                                  'num_internal_cons'])
 
 
+def scaled_internal_constraints(mod):
+    "Return the internal constraints of a Model, scaled for the solver."
+    return [INTERNAL_CONSTRAINT_SCALING*x for x in mod.get_internal_constraints()]
+
+
 def build_constraints(mod, variables, parameters=None):
-    internal_constraints = mod.get_internal_constraints()
-    internal_constraints = [INTERNAL_CONSTRAINT_SCALING*x for x in internal_constraints]
+    internal_constraints = scaled_internal_constraints(mod)
 
     cf_output = build_constraint_functions(variables, internal_constraints,
                                            parameters=parameters)
@@ -1,11 +1,13 @@
 # distutils: language = c++
 from collections import OrderedDict
+from time import perf_counter
 import numpy as np
 cimport numpy as np
 cimport cython
 cdef extern from "_isnan.h":
     bint isnan (double) nogil
-from pycalphad.core.solver import Solver
+from pycalphad.core.solver import Solver, SOLVER_DIAGNOSTICS, add_diagnostic_variables
+from pycalphad.core.compact_grid import grid_point_phases, grid_point_site_fractions
 from pycalphad.core.composition_set cimport CompositionSet
 from pycalphad.core.phase_rec cimport PhaseRecord
 from pycalphad.core.constants import *
@@ -24,9 +26,8 @@ cdef bint add_new_phases(object composition_sets, object removed_compsets, objec
     cdef int df_idx = 0
     cdef double largest_df = -np.inf
     cdef double[:] df_comp
-    cdef double[:,::1] current_grid_Y = grid.Y[*current_idx, ...]
     cdef double[:,::1] current_grid_X = grid.X[*current_idx, ...]
-    cdef np.ndarray current_grid_Phase = grid.Phase[*current_idx, ...]
+    cdef np.ndarray current_grid_Phase = grid_point_phases(grid, current_idx)
     cdef unicode df_phase_name
     cdef CompositionSet compset = composition_sets[0]
     cdef int num_statevars = len(compset.phase_record.state_variables)
@@ -34,7 +35,7 @@ cdef bint add_new_phases(object composition_sets, object removed_compsets, objec
     driving_forces = np.dot(current_grid_X, chemical_potentials) - grid.GM[*current_idx, ...]
     for i in range(driving_forces.shape[0]):
         if driving_forces[i] > largest_df:
-            df_comp = current_grid_Y[i]
+            df_comp = grid_point_site_fractions(grid, current_idx, i)
             df_phase_name = <unicode>current_grid_Phase[i]
             distinct = True
             for compset in removed_compsets:
@@ -73,7 +74,7 @@ cdef bint add_new_phases(object composition_sets, object removed_compsets, objec
                     print('Candidate composition set ' + df_phase_name + ' at ' + str(np.array(df_comp)) + ' is not distinct')
                 return False
         compset = CompositionSet(phase_records[df_phase_name])
-        compset.update(current_grid_Y[df_idx, :compset.phase_record.phase_dof], 1e-6,
+        compset.update(grid_point_site_fractions(grid, current_idx, df_idx)[:compset.phase_record.phase_dof], 1e-6,
                        state_variables)
         composition_sets.append(compset)
         if verbose:
@@ -96,7 +97,6 @@ def add_nearly_stable(object composition_sets, dict phase_records,
                       object grid, object current_idx, np.ndarray[ndim=1, dtype=np.float64_t] chemical_potentials,
                       double[::1] state_variables, double minimum_df, bint verbose):
     cdef double[::1] driving_forces, driving_forces_for_phase
-    cdef double[:,::1] current_grid_Y = grid.Y[*current_idx, ...]
     cdef double[:,::1] current_grid_X = grid.X[*current_idx, ...]
     cdef double[::1] current_grid_GM = grid.GM[*current_idx, ...]
     cdef unicode phase_name
@@ -120,7 +120,8 @@ def add_nearly_stable(object composition_sets, dict phase_records,
             phases_added = True
             df_idx = phase_indices.start + minimum_df_idx
             compset = CompositionSet(phase_record)
-            compset.update(current_grid_Y[df_idx, :phase_record.phase_dof], 0.0, state_variables)
+            compset.update(grid_point_site_fractions(grid, current_idx, df_idx)[:phase_record.phase_dof], 0.0,
+                           state_variables)
             if verbose:
                 print('Adding metastable ' + repr(compset) + ' Driving force: ' + str(driving_forces_for_phase[minimum_df_idx]))
             composition_sets.append(compset)
@@ -183,9 +184,34 @@ cpdef solve_and_update(composition_sets, conditions, solver, remove_metastable=T
     return result
 
 
-def _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_variables, verbose, solver=None):
+def _accumulate_diagnostics(point_diagnostics, result):
+    "Add the diagnostics of a SolverResult to the diagnostics of a point."
+    point_diagnostics['solver_calls'] += 1
+    if result.diagnostics is None:
+        return
+    for key, value in result.diagnostics.items():
+        if 'solver_' + key in point_diagnostics:
+            point_diagnostics['solver_' + key] += value
+
+
+def _converged_neighbor(converged_points, multi_index):
+    """
+    Return the index of a converged point adjacent to multi_index in the condition grid, or None.
+    Neighbors along the fastest-varying (last) axis are preferred, since they were solved most recently.
+    """
+    for axis in reversed(range(len(multi_index))):
+        for offset in (-1, 1):
+            neighbor_index = list(multi_index)
+            neighbor_index[axis] += offset
+            if (0 <= neighbor_index[axis] < converged_points.shape[axis]) and converged_points[tuple(neighbor_index)]:
+                return tuple(neighbor_index)
+    return None
+
+
+def _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_variables, verbose, solver=None,
+                            point_indices=None, continuation=False, condition_offset=None):
     """
-        _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_variables, verbose, solver=None)
+        _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_variables, verbose, solver=None, point_indices=None, continuation=False, condition_offset=None)
 
     Compute equilibrium for the given conditions.
     This private function is meant to be called from a worker subprocess.
@@ -208,6 +234,19 @@ def _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_v
         Print details.
     solver : pycalphad.core.solver.SolverBase
         Instance of a SolverBase subclass. If None is supplied, defaults to a Solver.
+    point_indices : Optional[ArrayLike[int]]
+        Flat (C-order) indices into the condition grid of the points to solve.
+        If None is supplied, every point in the condition grid is solved.
+    continuation : Optional[bool]
+        If True, start each point from the converged solution of an adjacent point
+        solved earlier in this call, instead of from its starting point in `properties`.
+        The starting point is used if there is no such neighbor, and the point is solved
+        again from it if the warm-started solution does not converge or is found to miss
+        a phase with positive driving force.
+    condition_offset : Optional[Sequence[int]]
+        If `properties` is a box of a larger condition grid, the index of its first point
+        in that grid along each condition dimension. It is used to look up the points of
+        `grid`, which was sampled on the larger grid. Defaults to no offset.
 
     Returns
     -------
@@ -227,7 +266,12 @@ def _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_v
     cdef np.ndarray[ndim=1, dtype=np.float64_t] site_fracs, l_multipliers, phase_fracs
     cdef np.ndarray[ndim=2, dtype=np.float64_t] constraint_jac
     iter_solver = solver if solver is not None else Solver(verbose=verbose)
+    cdef bint diagnostics = iter_solver.diagnostics
+    cdef double point_start_time = 0, add_phases_start_time = 0
 
+    if diagnostics:
+        add_diagnostic_variables(properties, conds_keys)
+        diagnostic_values = {var: properties.data_vars[var][1] for var in SOLVER_DIAGNOSTICS}
     # Factored out via profiling
     prop_MU_values = properties.MU
     prop_NP_values = properties.NP
@@ -236,17 +280,26 @@ def _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_v
     prop_Y_values = properties.Y
     prop_GM_values = properties.GM
     str_state_variables = [str(k) for k in state_variables if str(k) in grid.coords.keys()]
-    it = np.nditer(prop_GM_values, flags=['multi_index'])
+    converged_points = np.zeros(prop_GM_values.shape, dtype=np.bool_)
+    if condition_offset is None:
+        condition_offset = (0,) * len(conds_keys)
+    if point_indices is None:
+        multi_indices = np.ndindex(prop_GM_values.shape)
+    else:
+        multi_indices = zip(*np.unravel_index(np.asarray(point_indices, dtype=np.intp), prop_GM_values.shape))
 
-    while not it.finished:
+    for multi_index in multi_indices:
         # A lot of this code relies on cur_conds being ordered!
         converged = False
         changed_phases = False
+        if diagnostics:
+            point_start_time = perf_counter()
+            point_diagnostics = dict.fromkeys(SOLVER_DIAGNOSTICS, 0)
         cur_conds = OrderedDict(zip(conds_keys,
                                     [np.asarray(properties.coords[b][a], dtype=np.float_)
-                                     for a, b in zip(it.multi_index, conds_keys)]))
+                                     for a, b in zip(multi_index, conds_keys)]))
         # assume 'points' and other dimensions (internal dof, etc.) always follow
-        curr_idx = [it.multi_index[i] for i, key in enumerate(conds_keys) if key in str_state_variables]
+        curr_idx = [multi_index[i] + condition_offset[i] for i, key in enumerate(conds_keys) if key in str_state_variables]
         state_variable_values = [cur_conds[key] for key in str_state_variables]
         state_variable_values = np.array(state_variable_values)
         # sum of independently specified components
@@ -255,96 +308,130 @@ def _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_v
             # Sum of independent component mole fractions greater than one
             # Skip this condition set
             # We silently allow this to make 2-D composition mapping easier
-            prop_MU_values[it.multi_index] = np.nan
-            prop_NP_values[it.multi_index + np.index_exp[:]] = np.nan
-            prop_Phase_values[it.multi_index + np.index_exp[:]] = ''
-            prop_X_values[it.multi_index + np.index_exp[:]] = np.nan
-            prop_Y_values[it.multi_index] = np.nan
-            prop_GM_values[it.multi_index] = np.nan
-            it.iternext()
+            prop_MU_values[multi_index] = np.nan
+            prop_NP_values[multi_index + np.index_exp[:]] = np.nan
+            prop_Phase_values[multi_index + np.index_exp[:]] = ''
+            prop_X_values[multi_index + np.index_exp[:]] = np.nan
+            prop_Y_values[multi_index] = np.nan
+            prop_GM_values[multi_index] = np.nan
             continue
 
-        composition_sets = []
-        removed_compsets = []
-        for phase_idx, phase_name in enumerate(prop_Phase_values[it.multi_index]):
-            if phase_name == '' or phase_name == '_FAKE_':
-                continue
-            phase_record = phase_records[phase_name]
-            sfx = prop_Y_values[it.multi_index + np.index_exp[phase_idx, :phase_record.phase_dof]]
-            phase_amt = prop_NP_values[it.multi_index + np.index_exp[phase_idx]]
-            phase_amt = max(phase_amt, MIN_PHASE_FRACTION)
-            compset = CompositionSet(phase_record)
-            compset.update(sfx, phase_amt, state_variable_values)
-            composition_sets.append(compset)
-        chemical_potentials = prop_MU_values[it.multi_index]
-        energy = prop_GM_values[it.multi_index]
-        add_nearly_stable(composition_sets, phase_records, grid, curr_idx, chemical_potentials,
-                          state_variable_values, -1000, verbose)
-        #print('Composition Sets', composition_sets)
-        phase_amt_sum = 0.0
-        for compset in composition_sets:
-            phase_amt_sum += compset.NP
-        for compset in composition_sets:
-            compset.NP /= phase_amt_sum
-        iterations = 0
-        history = []
-        while (iterations < 10) and (not iter_solver.ignore_convergence):
-            if len(composition_sets) == 0:
-                changed_phases = False
-                break
-            result = solve_and_update(composition_sets, cur_conds, iter_solver)
+        start_index = None
+        if continuation:
+            start_index = _converged_neighbor(converged_points, multi_index)
+        while True:
+            composition_sets = []
+            removed_compsets = []
+            if start_index is None:
+                start_index = multi_index
+                warm_started = False
+                chemical_potentials = prop_MU_values[multi_index]
+            else:
+                warm_started = True
+                # Copy, so the starting point of this point is kept in case we need to fall back to it
+                chemical_potentials = np.array(prop_MU_values[start_index])
+            for phase_idx, phase_name in enumerate(prop_Phase_values[start_index]):
+                if phase_name == '' or phase_name == '_FAKE_':
+                    continue
+                phase_record = phase_records[phase_name]
+                sfx = prop_Y_values[start_index + np.index_exp[phase_idx, :phase_record.phase_dof]]
+                phase_amt = prop_NP_values[start_index + np.index_exp[phase_idx]]
+                phase_amt = max(phase_amt, MIN_PHASE_FRACTION)
+                compset = CompositionSet(phase_record)
+                compset.update(sfx, phase_amt, state_variable_values)
+                composition_sets.append(compset)
+            add_nearly_stable(composition_sets, phase_records, grid, curr_idx, chemical_potentials,
+                              state_variable_values, -1000, verbose)
+            #print('Composition Sets', composition_sets)
+            phase_amt_sum = 0.0
+            for compset in composition_sets:
+                phase_amt_sum += compset.NP
+            for compset in composition_sets:
+                compset.NP /= phase_amt_sum
+            iterations = 0
+            while (iterations < 10) and (not iter_solver.ignore_convergence):
+                if len(composition_sets) == 0:
+                    changed_phases = False
+                    break
+                result = solve_and_update(composition_sets, cur_conds, iter_solver)
 
-            chemical_potentials[:] = result.chemical_potentials
-            changed_phases = add_new_phases(composition_sets, removed_compsets, phase_records,
-                                            grid, curr_idx, chemical_potentials, state_variable_values,
-                                            1e-4, verbose)
-            iterations += 1
-            if not changed_phases:
-                break
-        if changed_phases:
-            result = solve_and_update(composition_sets, cur_conds, iter_solver)
-            chemical_potentials[:] = result.chemical_potentials
-        if not iter_solver.ignore_convergence:
-            converged = result.converged
-        else:
-            converged = True
+                chemical_potentials[:] = result.chemical_potentials
+                if diagnostics:
+                    _accumulate_diagnostics(point_diagnostics, result)
+                    add_phases_start_time = perf_counter()
+                changed_phases = add_new_phases(composition_sets, removed_compsets, phase_records,
+                                                grid, curr_idx, chemical_potentials, state_variable_values,
+                                                1e-4, verbose)
+                if diagnostics:
+                    point_diagnostics['solver_add_new_phases_time'] += perf_counter() - add_phases_start_time
+                    point_diagnostics['solver_phase_changes'] += changed_phases
+                iterations += 1
+                if not changed_phases:
+                    break
+                if warm_started:
+                    # A phase is missing from the neighbor's solution; restart from the starting point
+                    break
+            if warm_started and changed_phases:
+                if verbose:
+                    print('Driving force violation after warm start; restarting from the starting point')
+                start_index = None
+                continue
+            if changed_phases:
+                result = solve_and_update(composition_sets, cur_conds, iter_solver)
+                chemical_potentials[:] = result.chemical_potentials
+                if diagnostics:
+                    _accumulate_diagnostics(point_diagnostics, result)
+            if not iter_solver.ignore_convergence:
+                converged = result.converged
+            else:
+                converged = True
+            if warm_started and not converged:
+                if verbose:
+                    print('No convergence after warm start; restarting from the starting point')
+                start_index = None
+                continue
+            break
         if converged:
             if verbose:
                 print('Composition Sets', composition_sets)
-            prop_MU_values[it.multi_index] = chemical_potentials
-            prop_Phase_values[it.multi_index] = ''
-            prop_NP_values[it.multi_index + np.index_exp[:len(composition_sets)]] = [compset.NP for compset in composition_sets]
-            prop_NP_values[it.multi_index + np.index_exp[len(composition_sets):]] = np.nan
-            prop_Y_values[it.multi_index] = np.nan
-            prop_X_values[it.multi_index + np.index_exp[:]] = 0
-            prop_GM_values[it.multi_index] = 0
+            converged_points[multi_index] = True
+            prop_MU_values[multi_index] = chemical_potentials
+            prop_Phase_values[multi_index] = ''
+            prop_NP_values[multi_index + np.index_exp[:len(composition_sets)]] = [compset.NP for compset in composition_sets]
+            prop_NP_values[multi_index + np.index_exp[len(composition_sets):]] = np.nan
+            prop_Y_values[multi_index] = np.nan
+            prop_X_values[multi_index + np.index_exp[:]] = 0
+            prop_GM_values[multi_index] = 0
             # Copy out any free state variables (P, T, etc.)
             # All CompositionSets should have equal state variable values, so we copy from the first one
             for sv_idx, ssv in enumerate(str_state_variables):
                 # If the state variable is listed as a free variable in our results
                 # The LightDataset interface is not clear here
                 if properties.data_vars.get(ssv, None) is not None:
-                    properties.data_vars[ssv][1][it.multi_index] = composition_sets[0].dof[sv_idx]
+                    properties.data_vars[ssv][1][multi_index] = composition_sets[0].dof[sv_idx]
             for phase_idx in range(len(composition_sets)):
-                prop_Phase_values[it.multi_index + np.index_exp[phase_idx]] = composition_sets[phase_idx].phase_record.phase_name
+                prop_Phase_values[multi_index + np.index_exp[phase_idx]] = composition_sets[phase_idx].phase_record.phase_name
             for phase_idx in range(len(composition_sets), prop_Phase_values.shape[-1]):
-                prop_Phase_values[it.multi_index + np.index_exp[phase_idx]] = ''
-                prop_X_values[it.multi_index + np.index_exp[phase_idx, :]] = np.nan
+                prop_Phase_values[multi_index + np.index_exp[phase_idx]] = ''
+                prop_X_values[multi_index + np.index_exp[phase_idx, :]] = np.nan
             var_offset = 0
             total_comp = np.zeros(prop_X_values.shape[-1])
             for phase_idx in range(len(composition_sets)):
                 compset = composition_sets[phase_idx]
-                prop_Y_values[it.multi_index + np.index_exp[phase_idx, :compset.phase_record.phase_dof]] = \
+                prop_Y_values[multi_index + np.index_exp[phase_idx, :compset.phase_record.phase_dof]] = \
                     compset.dof[len(compset.phase_record.state_variables):]
-                prop_X_values[it.multi_index + np.index_exp[phase_idx, :]] = compset.X
-                prop_GM_values[it.multi_index] += compset.NP * compset.energy
+                prop_X_values[multi_index + np.index_exp[phase_idx, :]] = compset.X
+                prop_GM_values[multi_index] += compset.NP * compset.energy
                 var_offset += compset.phase_record.phase_dof
         else:
-            prop_MU_values[it.multi_index] = np.nan
-            prop_NP_values[it.multi_index] = np.nan
-            prop_X_values[it.multi_index] = np.nan
-            prop_Y_values[it.multi_index] = np.nan
-            prop_GM_values[it.multi_index] = np.nan
-            prop_Phase_values[it.multi_index] = ''
-        it.iternext()
+            prop_MU_values[multi_index] = np.nan
+            prop_NP_values[multi_index] = np.nan
+            prop_X_values[multi_index] = np.nan
+            prop_Y_values[multi_index] = np.nan
+            prop_GM_values[multi_index] = np.nan
+            prop_Phase_values[multi_index] = ''
+        if diagnostics:
+            point_diagnostics['solver_point_time'] = perf_counter() - point_start_time
+            for var, values in diagnostic_values.items():
+                values[multi_index] = point_diagnostics[var]
     return properties
@@ -10,10 +10,13 @@ import pycalphad.variables as v
 from pycalphad.core.utils import unpack_components, unpack_condition, unpack_phases, filter_phases, instantiate_models, get_state_variables
 from pycalphad import calculate
 from pycalphad.core.errors import EquilibriumError, ConditionError
-from pycalphad.core.starting_point import starting_point
-from pycalphad.codegen.callables import build_phase_records
+from pycalphad.core.starting_point import empty_result, starting_point
+from pycalphad.core.adaptive_grid import ADAPTIVE_INITIAL_PDENS, adaptive_starting_point
+from pycalphad.codegen.callables import build_output_phase_records, build_phase_records
 from pycalphad.core.eqsolver import _solve_eq_at_conditions
+from pycalphad.core.parallel import _gather_points, _scatter_points, _solve_eq_at_conditions_parallel
 from pycalphad.core.phase_rec import PhaseRecord
+from pycalphad.core.result_cache import system_fingerprint
 from pycalphad.core.solver import Solver
 from pycalphad.core.light_dataset import LightDataset
 from pycalphad.model import Model
@@ -39,110 +42,80 @@ def _adjust_conditions(conds):
     return new_conds
 
 
-def _eqcalculate(dbf, comps, phases, conditions, output, data=None, per_phase=False, callables=None, model=None,
-                 parameters=None, **kwargs):
+def _eqcalculate_outputs(outputs, data, models, phase_records, parameters=None, callables=None, calc_opts=None):
     """
-    WARNING: API/calling convention not finalized.
-    Compute the *equilibrium value* of a property.
-    This function differs from `calculate` in that it computes
-    thermodynamic equilibrium instead of randomly sampling the
-    internal degrees of freedom of a phase.
-    Because of that, it's slower than `calculate`.
-    This plugs in the equilibrium phase and site fractions
-    to compute a thermodynamic property defined in a Model.
+    Compute the *equilibrium values* of several properties in one pass over the stable phases.
+
+    `calculate` is not called. Only the objective of each property is compiled for
+    phases that are stable somewhere. The inputs (state variables and site fractions)
+    of each phase are then gathered once and every property is evaluated on them.
 
     Parameters
     ----------
-    dbf : Database
-        Thermodynamic database containing the relevant parameters.
-    comps : list
-        Names of components to consider in the calculation.
-    phases : list or dict
-        Names of phases to consider in the calculation.
-    conditions : dict or (list of dict)
-        StateVariables and their corresponding value.
-    output : str
-        Equilibrium model property (e.g., CPM, HM, etc.) to compute.
-        This must be defined as an attribute in the Model class of each phase.
-    data : Dataset
-        Previous result of call to `equilibrium`.
-        Should contain the equilibrium configurations at the conditions of interest.
-        If the databases are not the same as in the original calculation,
-        the results may be meaningless.
-    per_phase : bool, optional
-        If True, compute and return the property for each phase present.
-        If False, return the total system value, weighted by the phase fractions.
-    callables : dict
-        Callable functions to compute 'output' for each phase.
-    model : a dict of phase names to Model
-        Model class to use for each phase.
+    outputs : Sequence[Tuple[str, bool]]
+        Model properties (e.g., CPM, HM, etc.) to compute, and whether each is
+        computed per phase (True), or for the system, weighted by the phase fractions (False).
+    data : LightDataset
+        Equilibrium result to compute the properties at.
+    models : Dict[str, Model]
+        Instantiated models of every active phase.
+    phase_records : Dict[str, PhaseRecord]
+        PhaseRecords that data was calculated with.
     parameters : dict, optional
         Maps SymEngine Symbol to numbers, for overriding the values of parameters in the Database.
-    kwargs
-        Passed to `calculate`.
+    callables : dict, optional
+        Pre-computed callables of the properties, in the format of `build_callables`.
+    calc_opts : dict, optional
+        Keyword arguments of `calculate` that data was computed with. Its callables are
+        used when callables is not given. The sampling options (e.g., pdens, points,
+        fake_points) only select the starting grid, so they do not change the values,
+        which are computed at the equilibrium configurations in data.
 
     Returns
     -------
-    Dataset of property as a function of equilibrium conditions
+    LightDataset
+        Properties as a function of equilibrium conditions, and also of vertex for per phase properties.
     """
-    if data is None:
-        raise ValueError('Required kwarg "data" is not specified')
-    if model is None:
-        raise ValueError('Required kwarg "model" is not specified')
-    active_phases = unpack_phases(phases)
-    conds = _adjust_conditions(conditions)
-    indep_vars = ['N', 'P', 'T']
-    # TODO: Rewrite this to use the coord dict from 'data'
-    str_conds = OrderedDict((str(key), value) for key, value in conds.items())
-    indep_vals = list([float(x) for x in np.atleast_1d(val)]
-                      for key, val in str_conds.items() if key in indep_vars)
-    coord_dict = str_conds.copy()
-    components = [x for x in sorted(comps)]
-    desired_active_pure_elements = [list(x.constituents.keys()) for x in components]
-    desired_active_pure_elements = [el.upper() for constituents in desired_active_pure_elements for el in constituents]
-    pure_elements = sorted(set([x for x in desired_active_pure_elements if x != 'VA']))
-    coord_dict['vertex'] = np.arange(len(pure_elements) + 1)  # +1 is to accommodate the degenerate degree of freedom at the invariant reactions
-    grid_shape = np.meshgrid(*coord_dict.values(),
-                             indexing='ij', sparse=False)[0].shape
-    prop_shape = grid_shape
-    prop_dims = list(str_conds.keys()) + ['vertex']
-
-    result = LightDataset({output: (prop_dims, np.full(prop_shape, np.nan))}, coords=coord_dict)
-    # For each phase select all conditions where that phase exists
-    # Perform the appropriate calculation and then write the result back
-    for phase in active_phases:
-        dof = len(model[phase].site_fractions)
-        current_phase_indices = (data.Phase == phase)
-        if ~np.any(current_phase_indices):
-            continue
-        points = data.Y[np.nonzero(current_phase_indices)][..., :dof]
-        statevar_indices = np.nonzero(current_phase_indices)[:len(indep_vals)]
-        statevars = {key: np.take(np.asarray(vals), idx)
-                     for key, vals, idx in zip(indep_vars, indep_vals, statevar_indices)}
-        statevars.update(kwargs)
-        if statevars.get('mode', None) is None:
-            statevars['mode'] = 'numpy'
-        calcres = calculate(dbf, comps, [phase], output=output, points=points, broadcast=False,
-                            callables=callables, parameters=parameters, model=model, **statevars)
-        result[output][np.nonzero(current_phase_indices)] = calcres[output].values
-    if not per_phase:
-        out = np.nansum(result[output] * data['NP'], axis=-1)
-        dv_output = result.data_vars[output]
-        result.remove(output)
-        # remove the vertex coordinate because we summed over it
-        result.add_variable(output, dv_output[0][:-1], out)
-    else:
-        dv_phase = data.data_vars['Phase']
-        dv_np = data.data_vars['NP']
-        result.add_variable('Phase', dv_phase[0], dv_phase[1])
-        result.add_variable('NP', dv_np[0], dv_np[1])
+    calc_opts = calc_opts if calc_opts is not None else {}
+    if callables is None:
+        callables = calc_opts.get('callables', None)
+    phase_dims = list(data.data_vars['Phase'][0])
+    cond_dims = phase_dims[:-1]
+    stable_phases = [name for name in sorted(phase_records.keys()) if np.any(data.Phase == name)]
+    stable_records = {name: phase_records[name] for name in stable_phases}
+    output_records = {out: build_output_phase_records(stable_records, models, out, parameters=parameters,
+                                                      callables=callables)
+                      for out, _ in outputs}
+    values = {out: np.full(data.Phase.shape, np.nan) for out, _ in outputs}
+    for name in stable_phases:
+        phase_record = phase_records[name]
+        phase_indices = np.nonzero(data.Phase == name)
+        num_statevars = phase_record.num_statevars
+        dof = np.empty((phase_indices[0].shape[0], num_statevars + phase_record.phase_dof))
+        for statevar_idx, statevar in enumerate(phase_record.state_variables):
+            if str(statevar) not in cond_dims:
+                raise ValueError('State variable {} of {} is not a condition of the result'.format(statevar, name))
+            cond_axis = cond_dims.index(str(statevar))
+            dof[:, statevar_idx] = np.asarray(data.coords[str(statevar)], dtype=np.float64)[phase_indices[cond_axis]]
+        dof[:, num_statevars:] = data.Y[phase_indices][:, :phase_record.phase_dof]
+        phase_output = np.empty(dof.shape[0])
+        for out, _ in outputs:
+            output_records[out][name].obj_2d(phase_output, dof)
+            values[out][phase_indices] = phase_output
+    result = LightDataset({}, coords={dim: data.coords[dim] for dim in phase_dims})
+    for out, per_phase in outputs:
+        if per_phase:
+            result.add_variable(out, phase_dims, values[out])
+        else:
+            result.add_variable(out, cond_dims, np.nansum(values[out] * data.NP, axis=-1))
     return result
 
 
 def equilibrium(dbf, comps, phases, conditions, output=None, model=None,
                 verbose=False, broadcast=True, calc_opts=None, to_xarray=True,
                 scheduler='sync', parameters=None, solver=None, callables=None,
-                phase_records=None, **kwargs):
+                phase_records=None, workers=None, continuation=False, diagnostics=False,
+                adaptive_grid=False, executor=None, result_cache=None, **kwargs):
     """
     Calculate the equilibrium state of a system containing the specified
     components and phases, under the specified conditions.
@@ -171,6 +144,7 @@ def equilibrium(dbf, comps, phases, conditions, output=None, model=None,
         when those conditions don't comprise a grid.
     calc_opts : dict, optional
         Keyword arguments to pass to `calculate`, the energy/property calculation routine.
+        Pass `memmap_dir` to keep the sampled grid in memory-mapped files instead of memory.
     to_xarray : bool
         Whether to return an xarray Dataset (True, default) or an EquilibriumResult.
     scheduler : Dask scheduler, optional
@@ -187,6 +161,38 @@ def equilibrium(dbf, comps, phases, conditions, output=None, model=None,
         Mapping of phase names to PhaseRecord objects with `'GM'` output. Must include
         all active phases. The `model` argument must be a mapping of phase names to
         instances of Model objects.
+    workers : Optional[int]
+        Number of worker processes used to solve the condition grid. The grid is split
+        into chunks that are solved concurrently. If None (the default) or 1, the
+        calculation is performed serially. If -1, one worker per CPU is used.
+        The solver and PhaseRecords must be picklable. PhaseRecords that are
+        not passed are also compiled by this many worker processes.
+    executor : pycalphad.core.parallel.EquilibriumExecutor, optional
+        Backend that solves the condition grid concurrently, such as
+        `DaskEquilibriumExecutor` or `MPIEquilibriumExecutor` for clusters.
+        The PhaseRecords, grid and starting point are sent to each worker once,
+        and the grid is split into tasks of similar cost. Overrides `workers` for the solve.
+    continuation : bool, optional
+        If True, start each point of the condition grid from the converged solution of an
+        adjacent point, instead of from the lower convex hull of the grid. The hull start is
+        still used when no neighbor has converged, and the point is solved again from it when
+        the warm-started solution does not converge or is missing a phase with positive driving
+        force. Useful for dense sweeps of conditions.
+    diagnostics : bool, optional
+        If True, the result has data variables recording, for each point of the condition grid,
+        the solver calls, Newton iterations, phase changes and step reductions, and the time
+        spent solving the equilibrium system, recomputing the composition sets, adding phases
+        from the grid and on the point in total (see `pycalphad.core.solver.SOLVER_DIAGNOSTICS`).
+        A `solver` that is passed must have been created with diagnostics enabled.
+    adaptive_grid : bool, optional
+        If True, the starting point is found on a coarse grid (`pdens` of 20 unless given in
+        `calc_opts`) that is refined around the phase constitutions on its lower convex hull
+        until the hull energy converges, instead of on a uniformly dense grid.
+        See `pycalphad.core.adaptive_grid`.
+    result_cache : pycalphad.core.result_cache.EquilibriumResultCache, optional
+        If given, points of the condition grid that the cache holds for the same
+        system (models, parameters, solver and grid options) are not solved again,
+        and the newly solved points are added to it. Cannot be used with `diagnostics`.
 
     Returns
     -------
@@ -212,7 +218,11 @@ def equilibrium(dbf, comps, phases, conditions, output=None, model=None,
         raise EquilibriumError('Components not found in database: {}'
                                .format(','.join([c.name for c in (set(comps) - set(dbf.species))])))
     calc_opts = calc_opts if calc_opts is not None else dict()
-    solver = solver if solver is not None else Solver(verbose=verbose)
+    solver = solver if solver is not None else Solver(verbose=verbose, diagnostics=diagnostics)
+    if diagnostics and not solver.diagnostics:
+        raise ValueError('diagnostics=True requires a solver with diagnostics enabled, e.g., Solver(diagnostics=True)')
+    if (result_cache is not None) and solver.diagnostics:
+        raise ValueError('Solver diagnostics cannot be reported for points taken from a result_cache')
     parameters = parameters if parameters is not None else dict()
     if isinstance(parameters, dict):
         parameters = OrderedDict(sorted(parameters.items(), key=str))
@@ -241,12 +251,10 @@ def equilibrium(dbf, comps, phases, conditions, output=None, model=None,
     output = set(output)
     output |= {'GM'}
     output = sorted(output)
-    if phase_records is None:
+    # PhaseRecords are only built once they are needed, so calls answered by a result_cache do not compile them
+    build_records = phase_records is None
+    if build_records:
         models = instantiate_models(dbf, comps, active_phases, model=model, parameters=parameters)
-        phase_records = build_phase_records(dbf, comps, active_phases, conds, models,
-                                            output='GM', callables=callables,
-                                            parameters=parameters, verbose=verbose,
-                                            build_gradients=True, build_hessians=True)
     else:
         # phase_records were provided, instantiated models must also be provided by the caller
         models = model
@@ -259,9 +267,6 @@ def equilibrium(dbf, comps, phases, conditions, output=None, model=None,
         if len(active_phases_without_models) > 0:
             raise ValueError(f"model must contain a Model instance for every active phase. Missing Model objects for {sorted(active_phases_without_models)}")
 
-    if verbose:
-        print('[done]', end='\n')
-
     state_variables = sorted(get_state_variables(models=models, conds=conds), key=str)
 
     # 'calculate' accepts conditions through its keyword arguments
@@ -270,34 +275,74 @@ def equilibrium(dbf, comps, phases, conditions, output=None, model=None,
     grid_opts.update({key: value for key, value in str_conds.items() if key in statevar_strings})
 
     if 'pdens' not in grid_opts:
-        grid_opts['pdens'] = 60
-    grid = calculate(dbf, comps, active_phases, model=models, fake_points=True,
-                     phase_records=phase_records, output='GM', parameters=parameters,
-                     to_xarray=False, **grid_opts)
+        grid_opts['pdens'] = ADAPTIVE_INITIAL_PDENS if adaptive_grid else 60
     coord_dict = str_conds.copy()
     coord_dict['vertex'] = np.arange(len(pure_elements) + 1)  # +1 is to accommodate the degenerate degree of freedom at the invariant reactions
     coord_dict['component'] = pure_elements
-    properties = starting_point(conds, state_variables, phase_records, grid)
-    properties = _solve_eq_at_conditions(properties, phase_records, grid,
-                                         list(str_conds.keys()), state_variables,
-                                         verbose, solver=solver)
+    unsolved_points = None
+    if result_cache is not None:
+        fingerprint = system_fingerprint(comps, active_phases, models, list(str_conds.keys()),
+                                         parameters=parameters, solver=solver, calc_opts=calc_opts,
+                                         phase_records=None if build_records else phase_records,
+                                         adaptive_grid=adaptive_grid, continuation=continuation)
+        # The keys of the points only depend on the conditions, so they are looked up before the grid is computed,
+        # in a result with the same layout as the one of starting_point
+        if build_records:
+            result_phases = sorted(active_phases)
+            maximum_internal_dof = max(len(models[name].site_fractions) for name in result_phases)
+        else:
+            result_phases = sorted(phase_records.keys())
+            maximum_internal_dof = max(prx.phase_dof for prx in phase_records.values())
+        properties = empty_result(conds, state_variables, result_phases, pure_elements, maximum_internal_dof)
+        unsolved_points = result_cache.lookup(fingerprint, properties, list(str_conds.keys()))
+    if (unsolved_points is None) or (len(unsolved_points) > 0):
+        if build_records:
+            phase_records = build_phase_records(dbf, comps, active_phases, conds, models,
+                                                output='GM', callables=callables,
+                                                parameters=parameters, verbose=verbose,
+                                                build_gradients=True, build_hessians=True, workers=workers)
+            build_records = False
+            if verbose:
+                print('[done]', end='\n')
+        if adaptive_grid:
+            grid, starting_properties = adaptive_starting_point(dbf, comps, active_phases, conds, state_variables,
+                                                                models, phase_records, parameters=parameters,
+                                                                grid_opts=grid_opts)
+        else:
+            grid = calculate(dbf, comps, active_phases, model=models, fake_points=True,
+                             phase_records=phase_records, output='GM', parameters=parameters,
+                             to_xarray=False, compact=True, **grid_opts)
+            starting_properties = starting_point(conds, state_variables, phase_records, grid)
+        if unsolved_points is not None:
+            # Points found in the cache keep their cached values; only the others start from the grid
+            cached_points = np.setdiff1d(np.arange(properties.GM.size, dtype=np.intp), unsolved_points)
+            _scatter_points(starting_properties, cached_points, _gather_points(properties, cached_points))
+        properties = starting_properties
+        properties = _solve_eq_at_conditions_parallel(properties, phase_records, grid,
+                                                      list(str_conds.keys()), state_variables,
+                                                      verbose, solver=solver, workers=workers,
+                                                      continuation=continuation, executor=executor,
+                                                      point_indices=unsolved_points)
+    if result_cache is not None:
+        result_cache.store(fingerprint, properties, list(str_conds.keys()), point_indices=unsolved_points)
 
     # Compute equilibrium values of any additional user-specified properties
     # We already computed these properties so don't recompute them
+    # All of them are evaluated together, so each one only costs the compilation of its objective
     output = sorted(set(output) - {'GM', 'MU'})
-    for out in output:
-        if (out is None) or (len(out) == 0):
-            continue
-        # TODO: How do we know if a specified property should be per_phase or not?
-        # For now, we make a best guess
-        if (out == 'degree_of_ordering') or (out == 'DOO'):
-            per_phase = True
-        else:
-            per_phase = False
-        eqcal = _eqcalculate(dbf, comps, active_phases, conditions, out,
-                             data=properties, per_phase=per_phase, model=models,
-                             callables=callables, parameters=parameters, **calc_opts)
-        properties = properties.merge(eqcal, inplace=True, compat='equals')
+    # TODO: How do we know if a specified property should be per_phase or not?
+    # For now, we make a best guess
+    output = [(out, out in ('degree_of_ordering', 'DOO')) for out in output if (out is not None) and (len(out) > 0)]
+    if len(output) > 0:
+        if build_records:
+            phase_records = build_phase_records(dbf, comps, active_phases, conds, models,
+                                                output='GM', callables=callables,
+                                                parameters=parameters, verbose=verbose,
+                                                build_gradients=True, build_hessians=True, workers=workers)
+        eqcal = _eqcalculate_outputs(output, properties, models, phase_records,
+                                     parameters=parameters, callables=callables, calc_opts=calc_opts)
+        # The outputs were computed on the conditions of properties, so only (cheap) coordinate checks are needed
+        properties = properties.merge(eqcal, inplace=True, compat='override')
     if to_xarray:
         properties = properties.get_dataset()
     properties.attrs['created'] = datetime.utcnow().isoformat()
@@ -0,0 +1,164 @@
+"""
+Compiled hit-and-run sampling of linearly-constrained site fraction spaces.
+
+Chains are independent random walks started from the same feasible point.
+Each step picks a uniformly random direction in the null space of the
+constraints and a uniformly random step length within the bounds of the site
+fractions. Random numbers come from a xoshiro256** generator per chain,
+seeded by splitmix64, so the samples do not depend on NumPy's global state.
+"""
+import numpy as np
+cimport cython
+from libc.math cimport sqrt, log, cos, INFINITY
+from libc.stdint cimport uint64_t
+
+# Components of the step direction smaller than this do not bound the step, so that
+# constraints binding one sublattice (with a direction component ~0) do not bind all dof
+cdef double MIN_DIRECTION_COMPONENT = 1e-6
+# A chain stops when the feasible interval of its step is shorter than this (poor progress)
+cdef double MIN_STEP_INTERVAL = 1e-4
+cdef double TWO_PI = 6.283185307179586
+
+
+cdef struct RNGState:
+    uint64_t s0, s1, s2, s3
+
+
+cdef inline uint64_t rotl(uint64_t x, int k) nogil:
+    return (x << k) | (x >> (64 - k))
+
+
+cdef inline uint64_t splitmix64(uint64_t* x) nogil:
+    cdef uint64_t z
+    x[0] += 0x9E3779B97F4A7C15ULL
+    z = x[0]
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL
+    return z ^ (z >> 31)
+
+
+cdef inline void rng_seed(RNGState* state, uint64_t seed) nogil:
+    state.s0 = splitmix64(&seed)
+    state.s1 = splitmix64(&seed)
+    state.s2 = splitmix64(&seed)
+    state.s3 = splitmix64(&seed)
+
+
+cdef inline uint64_t rng_next(RNGState* state) nogil:
+    "Next value of a xoshiro256** generator."
+    cdef uint64_t result = rotl(state.s1 * 5, 7) * 9
+    cdef uint64_t t = state.s1 << 17
+    state.s2 ^= state.s0
+    state.s3 ^= state.s1
+    state.s1 ^= state.s2
+    state.s0 ^= state.s3
+    state.s2 ^= t
+    state.s3 = rotl(state.s3, 45)
+    return result
+
+
+cdef inline double rng_uniform(RNGState* state) nogil:
+    "Uniform double in [0, 1)."
+    return (rng_next(state) >> 11) * (1.0 / 9007199254740992.0)
+
+
+cdef inline double rng_normal(RNGState* state) nogil:
+    "Standard normal double, by the Box-Muller transform."
+    # 1 - uniform is in (0, 1], so the logarithm is finite
+    return sqrt(-2.0 * log(1.0 - rng_uniform(state))) * cos(TWO_PI * rng_uniform(state))
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+cdef Py_ssize_t sample_chains(const double[:, ::1] basis, const double[::1] initial_point, double[:, ::1] out,
+                              int num_chains, double max_step, double min_z, uint64_t seed,
+                              double[::1] z, double[::1] direction, double[::1] proj) nogil:
+    cdef Py_ssize_t num_dof = basis.shape[0]
+    cdef Py_ssize_t num_free = basis.shape[1]
+    cdef Py_ssize_t num_points = out.shape[0]
+    cdef Py_ssize_t num_written = 0
+    cdef Py_ssize_t chain_idx, step_idx, chain_steps, i, j
+    cdef double norm, alpha, lower, upper
+    cdef RNGState rng
+    for chain_idx in range(num_chains):
+        # Points that earlier chains did not write (by stopping early) are given to later chains
+        chain_steps = (num_points - num_written) // (num_chains - chain_idx)
+        rng_seed(&rng, seed + <uint64_t>chain_idx * 0xD1B54A32D192ED03ULL)
+        for i in range(num_dof):
+            z[i] = initial_point[i]
+        for step_idx in range(chain_steps):
+            # Unit direction in the null space of the constraints
+            norm = 0
+            for j in range(num_free):
+                direction[j] = rng_normal(&rng)
+                norm += direction[j] * direction[j]
+            norm = sqrt(norm)
+            if norm == 0:
+                continue
+            for i in range(num_dof):
+                proj[i] = 0
+                for j in range(num_free):
+                    proj[i] += basis[i, j] * direction[j]
+                proj[i] /= norm
+            # Extent of the step that keeps every site fraction >= min_z
+            lower = -max_step
+            upper = max_step
+            for i in range(num_dof):
+                if proj[i] > MIN_DIRECTION_COMPONENT:
+                    lower = max(lower, (min_z - z[i]) / proj[i])
+                elif proj[i] < -MIN_DIRECTION_COMPONENT:
+                    upper = min(upper, (min_z - z[i]) / proj[i])
+            if (upper - lower < MIN_STEP_INTERVAL) or (upper - lower == INFINITY):
+                break
+            alpha = lower + rng_uniform(&rng) * (upper - lower)
+            for i in range(num_dof):
+                z[i] += alpha * proj[i]
+                out[num_written, i] = z[i]
+            num_written += 1
+    return num_written
+
+
+def hit_and_run(const double[:, ::1] basis, const double[::1] initial_point, double[:, ::1] out, int num_chains,
+                double max_step, double min_z, uint64_t seed):
+    """
+    hit_and_run(basis, initial_point, out, num_chains, max_step, min_z, seed)
+
+    Sample points with hit-and-run chains, writing them into out.
+
+    Parameters
+    ----------
+    basis : ndarray
+        Orthonormal basis of the null space of the constraints. Shape of (site fractions, free dof)
+    initial_point : ndarray
+        Feasible point where every chain starts.
+    out : ndarray
+        Buffer for the points. Shape of (points, site fractions)
+    num_chains : int
+        Number of independent chains. The points are split evenly between them.
+    max_step : float
+        Largest step length. May be infinite.
+    min_z : float
+        Lower bound of the site fractions.
+    seed : int
+        Seed of the random number generators.
+
+    Returns
+    -------
+    int
+        Number of points written to the start of out. Fewer than out.shape[0]
+        if chains stop because they make poor progress.
+    """
+    if (basis.shape[0] != initial_point.shape[0]) or (out.shape[0] > 0 and out.shape[1] != basis.shape[0]):
+        raise ValueError('Null space basis, initial point and output buffer have inconsistent shapes')
+    if basis.shape[1] == 0 or out.shape[0] == 0:
+        return 0
+    num_chains = max(1, min(num_chains, out.shape[0]))
+    cdef double[::1] z = np.empty(basis.shape[0])
+    cdef double[::1] direction = np.empty(basis.shape[1])
+    cdef double[::1] proj = np.empty(basis.shape[0])
+    cdef Py_ssize_t num_written
+    with nogil:
+        num_written = sample_chains(basis, initial_point, out, num_chains, max_step, min_z, seed,
+                                    z, direction, proj)
+    return num_written
@@ -8,3 +8,14 @@ cpdef double hyperplane(double[:,::1] compositions,
                         size_t[::1] fixed_comp_indices,
                         double[::1] result_fractions,
                         int[::1] result_simplex) nogil except *
+cpdef void hyperplane_batch(double[:, :, ::1] grid_compositions,
+                            double[:, ::1] grid_energies,
+                            int[::1] grid_indices,
+                            double[:, ::1] compositions,
+                            double[:, ::1] chemical_potentials,
+                            double total_moles,
+                            size_t[::1] fixed_chempot_indices,
+                            size_t[::1] fixed_comp_indices,
+                            double[::1] result_energies,
+                            double[:, ::1] result_fractions,
+                            int[:, ::1] result_simplices) nogil
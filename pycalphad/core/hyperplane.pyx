@@ -2,7 +2,9 @@
 cimport numpy as np
 import numpy as np
 cimport cython
+from cython.parallel cimport prange
 from libc.stdlib cimport malloc, free
+from libc.math cimport fabs, INFINITY
 cimport scipy.linalg.cython_lapack as cython_lapack
 
 
@@ -56,8 +58,85 @@ cdef int argmax(double* a, int a_shape) nogil:
             result = i
     return result
 
+# Consecutive grid points are grouped in blocks of this size. A block whose
+# bounds show that none of its points can lie below the candidate
+# hyperplane is skipped without computing any driving force.
+cdef enum: GRID_BLOCK_SIZE = 64
+# Entries of the bounds of a block: smallest energy, then the smallest and largest value of each composition
+cdef inline int block_bounds_stride(int num_components) nogil:
+    return 1 + 2 * num_components
+
+
+cdef inline int num_grid_blocks(int num_points) nogil:
+    return (num_points + GRID_BLOCK_SIZE - 1) // GRID_BLOCK_SIZE
+
+
 @cython.boundscheck(False)
-cpdef double hyperplane(double[:,::1] compositions,
+@cython.wraparound(False)
+cdef void compute_block_bounds(double[:,::1] compositions, double[::1] energies, double* block_bounds) nogil:
+    """
+    Compute the smallest energy and the composition bounding box of each block of points.
+    NaN values are ignored; they can never lie below a hyperplane.
+    block_bounds must have space for num_grid_blocks(M) * block_bounds_stride(N) values.
+    """
+    cdef int num_points = compositions.shape[0]
+    cdef int num_components = compositions.shape[1]
+    cdef int stride = block_bounds_stride(num_components)
+    cdef int block_idx, point_idx, comp_idx
+    cdef double* bounds
+    cdef double value
+    for block_idx in range(num_grid_blocks(num_points)):
+        bounds = &block_bounds[block_idx * stride]
+        bounds[0] = INFINITY
+        for comp_idx in range(num_components):
+            bounds[1 + comp_idx] = INFINITY
+            bounds[1 + num_components + comp_idx] = -INFINITY
+        for point_idx in range(block_idx * GRID_BLOCK_SIZE, min((block_idx + 1) * GRID_BLOCK_SIZE, num_points)):
+            if energies[point_idx] < bounds[0]:
+                bounds[0] = energies[point_idx]
+            for comp_idx in range(num_components):
+                value = compositions[point_idx, comp_idx]
+                if value < bounds[1 + comp_idx]:
+                    bounds[1 + comp_idx] = value
+                if value > bounds[1 + num_components + comp_idx]:
+                    bounds[1 + num_components + comp_idx] = value
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef bint block_above_threshold(double* bounds, int num_components, double threshold,
+                                int* free_chempot_indices, double* candidate_potentials, int simplex_size,
+                                double[::1] chemical_potentials, size_t[::1] fixed_chempot_indices) nogil:
+    """
+    Return True if every point of the block is guaranteed to have a driving force of at least threshold.
+    The bound is padded by a relative tolerance much larger than the rounding error of the driving
+    forces, so no point that the exhaustive search would keep is ever skipped.
+    Returns False for non-finite bounds.
+    """
+    cdef double lower_bound = bounds[0]
+    cdef double scale = fabs(bounds[0])
+    cdef double term, other_term
+    cdef int ici, chempot_idx
+    cdef double potential
+    for ici in range(simplex_size + fixed_chempot_indices.shape[0]):
+        if ici < simplex_size:
+            chempot_idx = free_chempot_indices[ici]
+            potential = candidate_potentials[ici]
+        else:
+            chempot_idx = fixed_chempot_indices[ici - simplex_size]
+            potential = chemical_potentials[chempot_idx]
+        # Largest value of potential * composition over the bounding box
+        term = potential * bounds[1 + chempot_idx]
+        other_term = potential * bounds[1 + num_components + chempot_idx]
+        if other_term > term:
+            term = other_term
+        lower_bound -= term
+        scale += fabs(term)
+    return (lower_bound - threshold) > 1e-9 * scale
+
+
+@cython.boundscheck(False)
+cdef double _hyperplane(double[:,::1] compositions,
                         double[::1] energies,
                         double[::1] composition,
                         double[::1] chemical_potentials,
@@ -65,7 +144,8 @@ cpdef double hyperplane(double[:,::1] compositions,
                         size_t[::1] fixed_chempot_indices,
                         size_t[::1] fixed_comp_indices,
                         double[::1] result_fractions,
-                        int[::1] result_simplex) nogil except *:
+                        int[::1] result_simplex,
+                        double* block_bounds) nogil:
     """
     Find chemical potentials which approximate the tangent hyperplane
     at the given composition.
@@ -98,6 +178,9 @@ cpdef double hyperplane(double[:,::1] compositions,
     result_simplex : ndarray
         Energies of the points making up the hyperplane simplex. Shape of (P,).
         Will be overwritten. Output*result_fractions sums to out_energy (return value).
+    block_bounds : double*
+        Bounds of the blocks of points, as computed by compute_block_bounds.
+        If NULL, they are computed here.
 
     Returns
     -------
@@ -113,6 +196,10 @@ cpdef double hyperplane(double[:,::1] compositions,
     M: number of energy points that have been sampled
     N: number of components
     P: N+1, max phases by gibbs phase rule that we can find in a point calculations
+
+    Points are only removed from the search when their driving force is at least 1,
+    so skipping blocks which are bounded above that threshold gives exactly the
+    same result as computing the driving force of every point.
     """
     # Scalars
     cdef int num_points = compositions.shape[0]
@@ -130,10 +217,26 @@ cpdef double hyperplane(double[:,::1] compositions,
     cdef bint skip_index = False
     cdef double lowest_df = 0
     cdef double out_energy = 0
+    cdef double driving_force
+    cdef int num_blocks = num_grid_blocks(num_points)
+    cdef int block_idx, num_remaining_blocks, block_first_point
+    cdef bint owns_block_bounds = block_bounds == NULL
+    cdef int bounds_stride = block_bounds_stride(num_components)
+    if owns_block_bounds:
+        block_bounds = <double*>malloc(num_blocks * bounds_stride * sizeof(double))
+        compute_block_bounds(compositions, energies, block_bounds)
     # 1-D
     cdef int* remaining_point_indices = <int*>malloc(num_points * sizeof(int))
     for i in range(num_points):
         remaining_point_indices[i] = i
+    # Remaining blocks span [block_starts[i], block_ends[i]) of remaining_point_indices
+    cdef int* block_starts = <int*>malloc(num_blocks * sizeof(int))
+    cdef int* block_ends = <int*>malloc(num_blocks * sizeof(int))
+    cdef int* block_ids = <int*>malloc(num_blocks * sizeof(int))
+    for i in range(num_blocks):
+        block_starts[i] = i * GRID_BLOCK_SIZE
+        block_ends[i] = min((i + 1) * GRID_BLOCK_SIZE, num_points)
+        block_ids[i] = i
     # composition index of -1 indicates total number of moles, i.e., N=1 condition
     cdef int* included_composition_indices = <int*>malloc((fixed_comp_indices.shape[0] + 1) * sizeof(int))
     for i in range(fixed_comp_indices.shape[0]):
@@ -158,7 +261,6 @@ cpdef double hyperplane(double[:,::1] compositions,
     cdef int* int_tmp = <int*>malloc(simplex_size * sizeof(int)) # np.empty(simplex_size, dtype=np.int32)
     cdef double* candidate_potentials = <double*>malloc(simplex_size * sizeof(double)) # np.empty(simplex_size)
     cdef double* smallest_fractions = <double*>malloc(simplex_size * sizeof(double)) # np.empty(simplex_size)
-    cdef double* driving_forces = <double*>malloc(num_points * sizeof(double)) # np.empty(compositions.shape[0])
     # 2-D
     cdef int* trial_simplices = <int*>malloc(simplex_size * simplex_size * sizeof(int)) # np.empty((simplex_size, simplex_size), dtype=np.int32)
     cdef double* fractions = <double*>malloc(simplex_size * simplex_size * sizeof(double)) # np.empty((simplex_size, simplex_size))
@@ -218,16 +320,6 @@ cpdef double hyperplane(double[:,::1] compositions,
         solve(f_candidate_tieline, simplex_size, candidate_potentials, int_tmp)
         if candidate_potentials[0] == -1e19:
             break
-        for i in range(num_points):
-            driving_forces[i] = energies[remaining_point_indices[i]]
-        for ici in range(simplex_size):
-            chempot_idx = free_chempot_indices[ici]
-            for idx in range(num_points):
-                driving_forces[idx] -= candidate_potentials[ici] * compositions[remaining_point_indices[idx], chempot_idx]
-        for ici in range(fixed_chempot_indices.shape[0]):
-            chempot_idx = fixed_chempot_indices[ici]
-            for idx in range(num_points):
-                driving_forces[idx] -= chemical_potentials[chempot_idx] * compositions[remaining_point_indices[idx], chempot_idx]
         for i in range(simplex_size):
             best_guess_simplex[i] = candidate_simplex[i]
         for i in range(simplex_size):
@@ -238,14 +330,35 @@ cpdef double hyperplane(double[:,::1] compositions,
         ici = 0
         lowest_df = 1e10
         min_df = -1
-        for i in range(num_points):
-            if driving_forces[i] < 1.0:
-                remaining_point_indices[ici] = remaining_point_indices[i]
-                if driving_forces[i] < lowest_df:
-                    lowest_df = driving_forces[i]
-                    min_df = ici
-                ici += 1
+        num_remaining_blocks = 0
+        for block_idx in range(num_blocks):
+            if block_above_threshold(&block_bounds[block_ids[block_idx] * bounds_stride], num_components, 1.0,
+                                     free_chempot_indices, candidate_potentials, simplex_size,
+                                     chemical_potentials, fixed_chempot_indices):
+                continue
+            block_first_point = ici
+            for i in range(block_starts[block_idx], block_ends[block_idx]):
+                idx = remaining_point_indices[i]
+                driving_force = energies[idx]
+                for j in range(simplex_size):
+                    chempot_idx = free_chempot_indices[j]
+                    driving_force -= candidate_potentials[j] * compositions[idx, chempot_idx]
+                for j in range(fixed_chempot_indices.shape[0]):
+                    chempot_idx = fixed_chempot_indices[j]
+                    driving_force -= chemical_potentials[chempot_idx] * compositions[idx, chempot_idx]
+                if driving_force < 1.0:
+                    remaining_point_indices[ici] = idx
+                    if driving_force < lowest_df:
+                        lowest_df = driving_force
+                        min_df = ici
+                    ici += 1
+            if ici > block_first_point:
+                block_starts[num_remaining_blocks] = block_first_point
+                block_ends[num_remaining_blocks] = ici
+                block_ids[num_remaining_blocks] = block_ids[block_idx]
+                num_remaining_blocks += 1
         num_points = ici
+        num_blocks = num_remaining_blocks
 
         # Trial simplices will be the current simplex with each vertex
         #     replaced by the trial point
@@ -279,7 +392,11 @@ cpdef double hyperplane(double[:,::1] compositions,
     free(int_tmp)
     free(candidate_potentials)
     free(smallest_fractions)
-    free(driving_forces)
+    free(block_starts)
+    free(block_ends)
+    free(block_ids)
+    if owns_block_bounds:
+        free(block_bounds)
     # 2-D
     free(trial_simplices)
     free(fractions)
@@ -289,3 +406,88 @@ cpdef double hyperplane(double[:,::1] compositions,
     free(f_trial_matrix)
 
     return out_energy
+
+
+@cython.boundscheck(False)
+cpdef double hyperplane(double[:,::1] compositions,
+                        double[::1] energies,
+                        double[::1] composition,
+                        double[::1] chemical_potentials,
+                        double total_moles,
+                        size_t[::1] fixed_chempot_indices,
+                        size_t[::1] fixed_comp_indices,
+                        double[::1] result_fractions,
+                        int[::1] result_simplex) nogil except *:
+    """
+    Find chemical potentials which approximate the tangent hyperplane
+    at the given composition.
+
+    See ``_hyperplane`` for details.
+    """
+    return _hyperplane(compositions, energies, composition, chemical_potentials, total_moles,
+                       fixed_chempot_indices, fixed_comp_indices, result_fractions, result_simplex, NULL)
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cpdef void hyperplane_batch(double[:, :, ::1] grid_compositions,
+                            double[:, ::1] grid_energies,
+                            int[::1] grid_indices,
+                            double[:, ::1] compositions,
+                            double[:, ::1] chemical_potentials,
+                            double total_moles,
+                            size_t[::1] fixed_chempot_indices,
+                            size_t[::1] fixed_comp_indices,
+                            double[::1] result_energies,
+                            double[:, ::1] result_fractions,
+                            int[:, ::1] result_simplices) nogil:
+    """
+    Find the tangent hyperplane for many target compositions in a single call.
+    Targets are independent, so they are solved in parallel when compiled with OpenMP.
+
+    Parameters
+    ----------
+    grid_compositions : ndarray
+        Samples of the energy surface at each set of state variables. Shape of (S, M, N)
+    grid_energies : ndarray
+        Energies of the samples. Shape of (S, M)
+    grid_indices : ndarray
+        Index of the set of state variables of each target. Shape of (K,)
+    compositions : ndarray
+        Target compositions. Shape of (K, N), or (K, 1) if there are no fixed compositions.
+    chemical_potentials : ndarray
+        Shape of (K, N). Fixed chemical potentials must be set on input.
+        Will be overwritten
+    total_moles : double
+        Total number of moles in the system.
+    fixed_chempot_indices : ndarray
+        Variable shape from (0,) to (N-1,)
+    fixed_comp_indices : ndarray
+        Variable shape from (0,) to (N-1,)
+    result_energies : ndarray
+        Energy of the hyperplane at each target. Shape of (K,)
+        Will be overwritten
+    result_fractions : ndarray
+        Shape of (K, P). Will be overwritten
+    result_simplices : ndarray
+        Shape of (K, P). Will be overwritten
+
+    Notes
+    -----
+    K: number of targets
+    S: number of sets of state variables
+    See ``_hyperplane`` for M, N and P.
+    """
+    cdef Py_ssize_t i
+    # Block bounds only depend on the grid, so they are shared by every target at the same state variables
+    cdef size_t grid_bounds_size = num_grid_blocks(grid_compositions.shape[1]) * block_bounds_stride(grid_compositions.shape[2])
+    cdef double* block_bounds = <double*>malloc(grid_compositions.shape[0] * grid_bounds_size * sizeof(double))
+    for i in prange(grid_compositions.shape[0]):
+        compute_block_bounds(grid_compositions[i], grid_energies[i], &block_bounds[i * grid_bounds_size])
+    for i in prange(grid_indices.shape[0], schedule='dynamic'):
+        result_energies[i] = _hyperplane(grid_compositions[grid_indices[i]], grid_energies[grid_indices[i]],
+                                         compositions[i], chemical_potentials[i], total_moles,
+                                         fixed_chempot_indices, fixed_comp_indices,
+                                         result_fractions[i], result_simplices[i],
+                                         &block_bounds[grid_indices[i] * grid_bounds_size])
+    free(block_bounds)
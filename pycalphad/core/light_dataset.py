@@ -1,7 +1,7 @@
 """Defines a class for internally representing arrays used in equilibrium calculations"""
 
 import numpy as np
-from xarray import Dataset
+from xarray import Dataset, Variable
 
 
 class LightDataset:
@@ -26,6 +26,9 @@ class LightDataset:
     "wraps" xarray Datasets in the sense that any LightDataset can be converted
     to an xarray Dataset by the getdataset method.
 
+    Arrays are never copied: variables are added and merged by reference, and
+    the Dataset returned by get_dataset shares the memory of the data variables.
+
     """
     def __init__(self, data_vars=None, coords=None, attrs=None):
         """
@@ -50,14 +53,24 @@ class LightDataset:
         self.data_vars = data_vars or dict()
         self.coords = coords or dict()
         self.attrs = attrs or dict()
-        for var, (coord, values) in data_vars.items():
+        for var, (coord, values) in self.data_vars.items():
             setattr(self, var, values)
-        for coord, values in coords.items():
+        for coord, values in self.coords.items():
             setattr(self, coord, values)
 
     def get_dataset(self):
-        """Build an xarray Dataset"""
-        return Dataset(self.data_vars, self.coords, self.attrs)
+        """
+        Build an xarray Dataset.
+
+        The data variables of the Dataset are views of the arrays of this
+        LightDataset, so modifying one modifies the other.
+
+        Returns
+        -------
+        Dataset
+        """
+        data_vars = {var: Variable(dims, np.asarray(values)) for var, (dims, values) in self.data_vars.items()}
+        return Dataset(data_vars, self.coords, self.attrs)
 
     def __getitem__(self, item):
         try:
@@ -69,28 +82,72 @@ class LightDataset:
         self.data_vars.pop(item)
         delattr(self, item)
 
+    def _check_dims(self, var, dims, value):
+        "Check (cheaply) that the shape of a variable matches the coordinates of its dimensions."
+        shape = np.shape(value)
+        if len(shape) != len(dims):
+            raise ValueError('Variable `{}` has {} dimensions, but {} were named'.format(var, len(shape), len(dims)))
+        for dim, size in zip(dims, shape):
+            if (dim in self.coords) and (np.size(self.coords[dim]) != size):
+                raise ValueError('Dimension `{}` of variable `{}` has size {}, but its coordinate has size {}'
+                                 .format(dim, var, size, np.size(self.coords[dim])))
+
     def merge(self, other, inplace=False, compat='no_conflicts'):
-        if compat != 'equals':
-            raise ValueError("Only `compat='equals'` is supported. Passed `compat={}`".format(compat))
-        if inplace:
-            for var, coords_vals in other.data_vars.items():
-                if var not in self.data_vars.keys():
-                    self.data_vars[var] = coords_vals
-                    setattr(self, var, coords_vals[1])
-                else:
-                    if np.all(self.data_vars[var] != coords_vals):
-                        raise ValueError("Cannot merge EquilibriumResults because data variable `{}` is not equal to preexisting variable".format(var))
-            for coord, values in other.coords.items():
-                if coord not in self.coords.keys():
-                    self.coords[var] = values
-                    setattr(self, coord, values)
-                else:
-                    if np.all(self.coords[coord] != values):
-                        raise ValueError("Cannot merge EquilibriumResults because coordinate `{}` is not equal to preexisting coordinate".format(coord))
-        else:
+        """
+        Add the variables and coordinates of another LightDataset to this one.
+
+        Parameters
+        ----------
+        other : LightDataset
+        inplace : bool
+            Only in-place merges are supported. Arrays of other are added by reference.
+        compat : str
+            Checks of the variables and coordinates present in both:
+
+            - 'equals': coordinates and data variables must be equal. Compares whole arrays.
+            - 'override': coordinates must be equal. Data variables of this LightDataset are
+              kept without comparing them, and the new ones only have their shapes checked.
+
+        Returns
+        -------
+        LightDataset
+        """
+        if compat not in ('equals', 'override'):
+            raise ValueError("Only `compat='equals'` and `compat='override'` are supported. "
+                             "Passed `compat={}`".format(compat))
+        if not inplace:
             raise NotImplementedError("Copy merges not implemented")
+        # Coordinates are small, so they are always compared
+        for coord, values in other.coords.items():
+            if coord not in self.coords.keys():
+                self.coords[coord] = values
+                setattr(self, coord, values)
+            elif not np.array_equal(self.coords[coord], values):
+                raise ValueError("Cannot merge EquilibriumResults because coordinate `{}` is not equal to preexisting coordinate".format(coord))
+        for var, (dims, values) in other.data_vars.items():
+            if var not in self.data_vars.keys():
+                self._check_dims(var, dims, values)
+                self.data_vars[var] = (dims, values)
+                setattr(self, var, values)
+            elif compat == 'equals':
+                self_dims, self_values = self.data_vars[var]
+                if (list(self_dims) != list(dims)) or \
+                        not np.array_equal(self_values, values, equal_nan=np.asarray(values).dtype.kind in 'fc'):
+                    raise ValueError("Cannot merge EquilibriumResults because data variable `{}` is not equal to preexisting variable".format(var))
         return self
 
     def add_variable(self, var, coord, value):
+        """
+        Add a data variable, or replace one, in place. The array is not copied.
+
+        Parameters
+        ----------
+        var : str
+            Name of the variable.
+        coord : List[str]
+            Dimensions of the variable.
+        value : ndarray
+        """
+        self._check_dims(var, coord, value)
         self.data_vars[var] = (coord, value)
         setattr(self, var, value)
@@ -4,10 +4,75 @@ equilibrium calculation.
 """
 from pycalphad.core.cartesian import cartesian
 from pycalphad.core.constants import MIN_SITE_FRACTION
-from .hyperplane import hyperplane
+from pycalphad.core.compact_grid import CompactGrid
+from .hyperplane import hyperplane_batch
 import numpy as np
 import itertools
 
+# Largest number of (condition, grid point) pairs whose transformed energies are held at once by the open-system hull
+OPEN_SYSTEM_CHUNK_SIZE = 2 ** 22
+
+
+def open_system_hull(grid_compositions, grid_energies, grid_indices, chemical_potentials, total_moles,
+                     fixed_chempot_indices, result_energies, result_fractions, result_simplices):
+    """
+    Find the tangent hyperplane of every condition in an open system, where
+    the chemical potentials of all but one component are fixed.
+
+    The tangent then touches a single point: the one with the smallest
+    Legendre-transformed energy, GM - MU.X over the fixed potentials, per mole
+    of the free component. It is found by an argmin over the grid for all
+    conditions at once, instead of the simplex search of `hyperplane_batch`,
+    which converges to the same point.
+
+    Parameters
+    ----------
+    grid_compositions : ndarray
+        Samples of the energy surface at each set of state variables. Shape of (S, M, N)
+    grid_energies : ndarray
+        Energies of the samples. Shape of (S, M)
+    grid_indices : ndarray
+        Index of the set of state variables of each condition. Shape of (K,)
+    chemical_potentials : ndarray
+        Shape of (K, N). Fixed chemical potentials must be set on input.
+        Will be overwritten
+    total_moles : float
+        Total number of moles in the system.
+    fixed_chempot_indices : ndarray
+        Shape of (N-1,)
+    result_energies : ndarray
+        Energy of the hyperplane at each condition. Shape of (K,)
+        Will be overwritten
+    result_fractions : ndarray
+        Shape of (K, P). Will be overwritten
+    result_simplices : ndarray
+        Shape of (K, P). Will be overwritten
+    """
+    num_comps = grid_compositions.shape[-1]
+    num_grid_points = grid_compositions.shape[-2]
+    fixed_chempot_indices = np.asarray(fixed_chempot_indices, dtype=np.intp)
+    free_index = sorted(set(range(num_comps)) - set(fixed_chempot_indices))[0]
+    chunk_size = max(1, OPEN_SYSTEM_CHUNK_SIZE // max(num_grid_points, 1))
+    for grid_idx in np.unique(grid_indices):
+        fixed_compositions = grid_compositions[grid_idx][:, fixed_chempot_indices]
+        free_compositions = grid_compositions[grid_idx][:, free_index]
+        # Points without the free component cannot be on the tangent, whose potential is per mole of it
+        usable = free_compositions > MIN_SITE_FRACTION
+        condition_indices = np.nonzero(grid_indices == grid_idx)[0]
+        for chunk_start in range(0, condition_indices.shape[0], chunk_size):
+            chunk = condition_indices[chunk_start:chunk_start+chunk_size]
+            fixed_potentials = chemical_potentials[chunk][:, fixed_chempot_indices]
+            transformed_energies = grid_energies[grid_idx][None, :] - fixed_potentials.dot(fixed_compositions.T)
+            free_potentials = np.where(usable, transformed_energies / np.where(usable, free_compositions, 1.), np.inf)
+            free_potentials[np.isnan(free_potentials)] = np.inf
+            tangent_points = np.argmin(free_potentials, axis=-1)
+            chemical_potentials[chunk, free_index] = free_potentials[np.arange(chunk.shape[0]), tangent_points]
+            result_energies[chunk] = total_moles * grid_energies[grid_idx][tangent_points]
+            result_simplices[chunk, 0] = tangent_points
+    result_fractions[:, 0] = total_moles
+    result_fractions[:, 1:] = 0
+    result_simplices[:, 1:] = 0
+
 
 def lower_convex_hull(global_grid, state_variables, result_array):
     """
@@ -16,7 +81,7 @@ def lower_convex_hull(global_grid, state_variables, result_array):
 
     Parameters
     ----------
-    global_grid : Dataset
+    global_grid : Dataset or CompactGrid
         A sample of the energy surface of the system.
     state_variables : List[v.StateVariable]
         A list of the state variables (e.g., P, T) used in this calculation.
@@ -83,66 +148,86 @@ def lower_convex_hull(global_grid, state_variables, result_array):
     result_array_Phase_values = result_array.Phase
     global_grid_GM_values = global_grid.GM
     global_grid_X_values = global_grid.X
-    global_grid_Y_values = global_grid.Y
-    global_grid_Phase_values = global_grid.Phase
     num_comps = len(result_array.coords['component'])
 
-    it = np.nditer(result_array_GM_values, flags=['multi_index'])
-    comp_coord_shape = tuple(len(result_array.coords[cond]) for cond in comp_conds)
-    pot_coord_shape = tuple(len(result_array.coords[cond]) for cond in pot_conds)
-    while not it.finished:
-        indep_idx = []
-        # Relies on being ordered
-        for sv in state_variables:
-            if str(sv) in result_array.coords.keys():
-                coord_idx = list(result_array.coords.keys()).index(str(sv))
-                indep_idx.append(it.multi_index[coord_idx])
-            else:
-                # free state variable
-                indep_idx.append(0)
-        indep_idx = tuple(indep_idx)
-        if len(comp_conds) > 0:
-            comp_idx = np.ravel_multi_index(tuple(idx for idx, key in zip(it.multi_index, result_array_GM_dims) if key in comp_conds), comp_coord_shape)
-            idx_comp_values = comp_values[comp_idx, :]
+    # Every condition point is solved by a single call, so flatten conditions and state variables
+    num_conditions = result_array_GM_values.size
+    condition_indices = np.unravel_index(np.arange(num_conditions), result_array_GM_values.shape)
+    grid_shape = global_grid_GM_values.shape[:-1]
+    num_grid_points = global_grid_GM_values.shape[-1]
+    indep_idx = []
+    # Relies on being ordered
+    for sv in state_variables:
+        if str(sv) in result_array.coords.keys():
+            coord_idx = list(result_array.coords.keys()).index(str(sv))
+            indep_idx.append(condition_indices[coord_idx])
         else:
-            idx_comp_values = np.atleast_1d(1.)
-        if len(pot_conds) > 0:
-            pot_idx = np.ravel_multi_index(tuple(idx for idx, key in zip(it.multi_index, result_array_GM_dims) if key in pot_conds), pot_coord_shape)
-            idx_pot_values = np.array(cart_pot_values[pot_idx, :])
-
-        idx_global_grid_X_values = global_grid_X_values[indep_idx]
-        idx_global_grid_GM_values = global_grid_GM_values[indep_idx]
-        idx_result_array_MU_values = result_array_MU_values[it.multi_index]
-        idx_result_array_MU_values[:] = 0
+            # free state variable
+            indep_idx.append(np.zeros(num_conditions, dtype=np.intp))
+    grid_indices = np.ascontiguousarray(np.ravel_multi_index(tuple(indep_idx), grid_shape), dtype=np.int32)
+    flat_grid_X_values = np.ascontiguousarray(global_grid_X_values.reshape((-1, num_grid_points, num_comps)))
+    flat_grid_GM_values = np.ascontiguousarray(global_grid_GM_values.reshape((-1, num_grid_points)))
+
+    if len(comp_conds) > 0:
+        comp_coord_shape = tuple(len(result_array.coords[cond]) for cond in comp_conds)
+        comp_idx = np.ravel_multi_index(tuple(idx for idx, key in zip(condition_indices, result_array_GM_dims) if key in comp_conds), comp_coord_shape)
+        target_comp_values = np.ascontiguousarray(comp_values[comp_idx, :])
+    else:
+        target_comp_values = np.ones((num_conditions, 1))
+    chemical_potentials = np.zeros((num_conditions, num_comps))
+    if len(pot_conds) > 0:
+        pot_coord_shape = tuple(len(result_array.coords[cond]) for cond in pot_conds)
+        pot_idx = np.ravel_multi_index(tuple(idx for idx, key in zip(condition_indices, result_array_GM_dims) if key in pot_conds), pot_coord_shape)
         for idx in range(len(pot_conds_indices)):
-            idx_result_array_MU_values[pot_conds_indices[idx]] = idx_pot_values[idx]
-        idx_result_array_NP_values = result_array_NP_values[it.multi_index]
-        idx_result_array_points_values = result_array_points_values[it.multi_index]
-        result_array_GM_values[it.multi_index] = \
-            hyperplane(idx_global_grid_X_values, idx_global_grid_GM_values,
-                       idx_comp_values, idx_result_array_MU_values, float(global_grid.coords['N'][0]),
-                       pot_conds_indices, comp_conds_indices,
-                       idx_result_array_NP_values, idx_result_array_points_values)
-        # Copy phase values out
-        points = result_array_points_values[it.multi_index]
-        result_array_Phase_values[it.multi_index][:num_comps] = global_grid_Phase_values[indep_idx].take(points, axis=0)[:num_comps]
-        result_array_X_values[it.multi_index][:num_comps] = global_grid_X_values[indep_idx].take(points, axis=0)[:num_comps]
-        result_array_Y_values[it.multi_index][:num_comps] = global_grid_Y_values[indep_idx].take(points, axis=0)[:num_comps]
-        # Special case: Sometimes fictitious points slip into the result
-        if '_FAKE_' in result_array_Phase_values[it.multi_index]:
-            new_energy = 0.
-            molesum = 0.
-            for idx in range(len(result_array_Phase_values[it.multi_index])):
-                midx = it.multi_index + (idx,)
-                if result_array_Phase_values[midx] == '_FAKE_':
-                    result_array_Phase_values[midx] = ''
-                    result_array_X_values[midx] = np.nan
-                    result_array_Y_values[midx] = np.nan
-                    idx_result_array_NP_values[idx] = np.nan
-                else:
-                    new_energy += idx_result_array_NP_values[idx] * global_grid.GM[np.index_exp[indep_idx + (points[idx],)]]
-                    molesum += idx_result_array_NP_values[idx]
-            result_array_GM_values[it.multi_index] = new_energy / molesum
-        it.iternext()
+            chemical_potentials[:, pot_conds_indices[idx]] = cart_pot_values[pot_idx, idx]
+
+    num_vertices = result_array_NP_values.shape[-1]
+    energies = np.empty(num_conditions)
+    fractions = np.empty((num_conditions, num_vertices))
+    points = np.empty((num_conditions, num_vertices), dtype=np.int32)
+    if len(pot_conds_indices) == num_comps - 1:
+        open_system_hull(flat_grid_X_values, flat_grid_GM_values, grid_indices, chemical_potentials,
+                         float(global_grid.coords['N'][0]), pot_conds_indices, energies, fractions, points)
+    else:
+        hyperplane_batch(flat_grid_X_values, flat_grid_GM_values, grid_indices, target_comp_values,
+                         chemical_potentials, float(global_grid.coords['N'][0]),
+                         pot_conds_indices, comp_conds_indices, energies, fractions, points)
+
+    # Copy phase values out
+    phases = result_array_Phase_values.reshape((num_conditions,) + result_array_Phase_values.shape[-1:]).copy()
+    compositions = result_array_X_values.reshape((num_conditions,) + result_array_X_values.shape[-2:]).copy()
+    site_fractions = result_array_Y_values.reshape((num_conditions,) + result_array_Y_values.shape[-2:]).copy()
+    simplex_points = points[:, :num_comps]
+    compositions[:, :num_comps] = flat_grid_X_values[grid_indices[:, None], simplex_points]
+    if isinstance(global_grid, CompactGrid):
+        # Site fractions and phases of a compact grid do not depend on state variables
+        phases[:, :num_comps] = global_grid.point_phases(simplex_points)
+        site_fractions[:, :num_comps] = global_grid.padded_site_fractions(simplex_points, site_fractions.shape[-1])
+    else:
+        flat_grid_Phase_values = global_grid.Phase.reshape((-1, num_grid_points))
+        flat_grid_Y_values = global_grid.Y.reshape((-1, num_grid_points, global_grid.Y.shape[-1]))
+        phases[:, :num_comps] = flat_grid_Phase_values[grid_indices[:, None], simplex_points]
+        site_fractions[:, :num_comps] = flat_grid_Y_values[grid_indices[:, None], simplex_points]
+    # Special case: Sometimes fictitious points slip into the result
+    fake_vertices = phases == '_FAKE_'
+    conditions_with_fake = np.nonzero(np.any(fake_vertices, axis=-1))[0]
+    if conditions_with_fake.shape[0] > 0:
+        fake = fake_vertices[conditions_with_fake]
+        vertex_fractions = fractions[conditions_with_fake]
+        vertex_energies = flat_grid_GM_values[grid_indices[conditions_with_fake, None], points[conditions_with_fake]]
+        new_energy = np.sum(np.where(fake, 0., vertex_fractions * vertex_energies), axis=-1)
+        molesum = np.sum(np.where(fake, 0., vertex_fractions), axis=-1)
+        energies[conditions_with_fake] = new_energy / molesum
+        phases[fake_vertices] = ''
+        compositions[fake_vertices] = np.nan
+        site_fractions[fake_vertices] = np.nan
+        fractions[fake_vertices] = np.nan
+    result_array_GM_values[...] = energies.reshape(result_array_GM_values.shape)
+    result_array_MU_values[...] = chemical_potentials.reshape(result_array_MU_values.shape)
+    result_array_NP_values[...] = fractions.reshape(result_array_NP_values.shape)
+    result_array_points_values[...] = points.reshape(result_array_points_values.shape)
+    result_array_Phase_values[...] = phases.reshape(result_array_Phase_values.shape)
+    result_array_X_values[...] = compositions.reshape(result_array_X_values.shape)
+    result_array_Y_values[...] = site_fractions.reshape(result_array_Y_values.shape)
     result_array.remove('points')
     return result_array
@@ -2,73 +2,182 @@ cimport cython
 import numpy as np
 cimport numpy as np
 from pycalphad.core.composition_set cimport CompositionSet
+from pycalphad.core.phase_rec cimport PhaseRecord
 from pycalphad.core.constants import MIN_SITE_FRACTION
 cimport scipy.linalg.cython_lapack as cython_lapack
 from libc.stdlib cimport malloc, free
+from libc.math cimport INFINITY
+from time import perf_counter
+
+# C-level copy of MIN_SITE_FRACTION, so it can be used without the GIL
+cdef double _MIN_SITE_FRACTION = MIN_SITE_FRACTION
+
+# Systems whose estimated reciprocal condition number (1-norm) is below this are
+# treated as rank-deficient and solved by SVD instead of LU factorization
+cdef double LU_MIN_RCOND = 1e-15
+
+# LAPACK workspace sizes (lwork, liwork) by the size of the system, from workspace queries
+_linear_system_workspace_sizes = {}
+_inverse_workspace_sizes = {}
+
+
+cdef tuple linear_system_workspace_size(int N):
+    """Return the (lwork, liwork) needed by solve_linear_system for an NxN system.
+
+    The workspace is shared by the SVD (dgelsd) fallback and the condition number estimate (dgecon).
+    """
+    cdef int NRHS = 1
+    cdef int lwork = -1
+    cdef int info = 0
+    cdef int rank = 0
+    cdef int iwork_query = 0
+    cdef double work_query = 0
+    cdef double dummy = 0
+    cdef double rcond = -1
+    if N not in _linear_system_workspace_sizes:
+        if N == 0:
+            _linear_system_workspace_sizes[N] = (1, 1)
+        else:
+            cython_lapack.dgelsd(&N, &N, &NRHS, &dummy, &N, &dummy, &N, &dummy, &rcond, &rank,
+                                 &work_query, &lwork, &iwork_query, &info)
+            _linear_system_workspace_sizes[N] = (max(<int>work_query, 4*N), max(iwork_query, N, 1))
+    return _linear_system_workspace_sizes[N]
+
+
+cdef int inverse_workspace_size(int N):
+    "Return the lwork needed by invert_matrix for an NxN matrix."
+    cdef int lwork = -1
+    cdef int info = 0
+    cdef int ipiv_query = 0
+    cdef double work_query = 0
+    cdef double dummy = 0
+    if N not in _inverse_workspace_sizes:
+        if N == 0:
+            _inverse_workspace_sizes[N] = 1
+        else:
+            cython_lapack.dgetri(&N, &dummy, &N, &ipiv_query, &work_query, &lwork, &info)
+            _inverse_workspace_sizes[N] = max(<int>work_query, N)
+    return _inverse_workspace_sizes[N]
+
 
 @cython.boundscheck(False)
-cdef void lstsq(double *A, int M, int N, double* x, double rcond) nogil:
+cdef void lstsq(double *A, int M, int N, int lda, double* x, int ldb, double rcond,
+                double* singular_values, double* work, int lwork, int* iwork) nogil:
+    """Minimum-norm least squares solution of Ax = b by SVD, overwriting x (holding b) and A.
+
+    singular_values must hold min(M, N) values. The work and iwork sizes are found by a workspace query.
+    """
     cdef int i
     cdef int NRHS = 1
-    cdef int iwork = 0
     cdef int info = 0
-    cdef int SMLSIZ = 50  # this is a guess
-    cdef int NLVL = 10  # this is also a guess
-    cdef int lwork = 12*N + 2*N*SMLSIZ + 8*N*NLVL + N*NRHS + (SMLSIZ+1)**2
     cdef int rank = 0
-    cdef double* work = <double*>malloc(lwork * sizeof(double))
-    cdef double* singular_values = <double*>malloc(N * sizeof(double))
 
-    cython_lapack.dgelsd(&M, &N, &NRHS, A, &N, x, &M, singular_values, &rcond, &rank,
-                         work, &lwork, &iwork, &info)
-    free(singular_values)
-    free(work)
+    cython_lapack.dgelsd(&M, &N, &NRHS, A, &lda, x, &ldb, singular_values, &rcond, &rank,
+                         work, &lwork, iwork, &info)
     if info != 0:
         for i in range(N):
             x[i] = -1e19
 
+
 @cython.boundscheck(False)
-cdef void invert_matrix(double *A, int N, int* ipiv) nogil:
-    "A will be overwritten."
+cdef void solve_linear_system(double* A, int N, int lda, double* x, double* lu, int* ipiv,
+                              double* singular_values, double* work, int lwork, int* iwork) nogil:
+    """Solve the square system Ax = b, overwriting x (holding b).
+
+    A is factorized by LU in lu, which has the same leading dimension lda. A rank-deficient
+    (or nearly so) system falls back to the minimum-norm solution by SVD, which overwrites A.
+    work and iwork must be at least the sizes given by linear_system_workspace_size(N).
+    """
+    cdef int i, j
+    cdef int NRHS = 1
+    cdef int info = 0
+    cdef double anorm
+    cdef double rcond = 0
+    cdef char norm = b'1'
+    cdef char trans = b'N'
+    for j in range(N):
+        for i in range(N):
+            lu[i + j*lda] = A[i + j*lda]
+    anorm = cython_lapack.dlange(&norm, &N, &N, lu, &lda, work)
+    cython_lapack.dgetrf(&N, &N, lu, &lda, ipiv, &info)
+    if info == 0:
+        cython_lapack.dgecon(&norm, &N, lu, &lda, &anorm, &rcond, work, iwork, &info)
+    # A NaN condition number also falls back, so the solution is flagged as failed
+    if (info == 0) and (rcond > LU_MIN_RCOND):
+        cython_lapack.dgetrs(&trans, &N, &NRHS, lu, &lda, ipiv, x, &lda, &info)
+        if info == 0:
+            return
+    lstsq(A, N, N, lda, x, lda, 1e-16, singular_values, work, lwork, iwork)
+
+
+@cython.boundscheck(False)
+cdef void invert_matrix(double *A, int N, int* ipiv, double* work, int lwork) nogil:
+    """A will be overwritten.
+
+    work must hold at least inverse_workspace_size(N) values.
+    """
+    cdef int i
     cdef int info = 0
-    cdef double* work = <double*>malloc(N * sizeof(double))
 
     cython_lapack.dgetrf(&N, &N, A, &N, ipiv, &info)
-    cython_lapack.dgetri(&N, A, &N, ipiv, work, &N, &info)
-    free(work)
+    if info == 0:
+        cython_lapack.dgetri(&N, A, &N, ipiv, work, &lwork, &info)
     if info != 0:
         for i in range(N**2):
             A[i] = -1e19
 
 @cython.boundscheck(False)
 cdef void compute_phase_matrix(double[:,::1] phase_matrix, double[:,::1] hess,
-                               double[:, ::1] cons_jac_tmp, CompositionSet compset,
+                               double[:, ::1] cons_jac_tmp, PhaseRecord prx,
                                int num_statevars, double[::1] chemical_potentials, double[::1] phase_dof,
                                int[::1] fixed_phase_dof_indices) nogil:
     "Compute the LHS of Eq. 41, Sundman 2015."
     cdef int comp_idx, i, j, cons_idx, fixed_dof_idx
     cdef int num_components = chemical_potentials.shape[0]
-    compset.phase_record.internal_cons_jac(cons_jac_tmp, phase_dof)
+    prx.internal_cons_jac(cons_jac_tmp, phase_dof)
 
-    for i in range(compset.phase_record.phase_dof):
-        for j in range(compset.phase_record.phase_dof):
+    for i in range(prx.phase_dof):
+        for j in range(prx.phase_dof):
             phase_matrix[i, j] = hess[num_statevars+i, num_statevars+j]
 
-    for i in range(compset.phase_record.num_internal_cons):
-        for j in range(compset.phase_record.phase_dof):
-            phase_matrix[compset.phase_record.phase_dof+i, j] = cons_jac_tmp[i, num_statevars+j]
-            phase_matrix[j, compset.phase_record.phase_dof+i] = cons_jac_tmp[i, num_statevars+j]
+    for i in range(prx.num_internal_cons):
+        for j in range(prx.phase_dof):
+            phase_matrix[prx.phase_dof+i, j] = cons_jac_tmp[i, num_statevars+j]
+            phase_matrix[j, prx.phase_dof+i] = cons_jac_tmp[i, num_statevars+j]
 
     for cons_idx in range(fixed_phase_dof_indices.shape[0]):
         fixed_dof_idx = fixed_phase_dof_indices[cons_idx]
-        phase_matrix[compset.phase_record.phase_dof + compset.phase_record.num_internal_cons + cons_idx, fixed_dof_idx] = 1
-        phase_matrix[fixed_dof_idx, compset.phase_record.phase_dof + compset.phase_record.num_internal_cons] = 1
+        phase_matrix[prx.phase_dof + prx.num_internal_cons + cons_idx, fixed_dof_idx] = 1
+        phase_matrix[fixed_dof_idx, prx.phase_dof + prx.num_internal_cons] = 1
+
+
+@cython.boundscheck(False)
+cdef void zero_1d(double[::1] a) nogil:
+    cdef int i
+    for i in range(a.shape[0]):
+        a[i] = 0
+
+
+@cython.boundscheck(False)
+cdef void zero_2d(double[:, ::1] a) nogil:
+    cdef int i, j
+    for i in range(a.shape[0]):
+        for j in range(a.shape[1]):
+            a[i, j] = 0
+
+
+cdef bint contains_index(int[::1] indices, int idx) nogil:
+    cdef int i
+    for i in range(indices.shape[0]):
+        if indices[i] == idx:
+            return True
+    return False
 
 
 cdef void write_row_stable_phase(double[:] out_row, double* out_rhs, int[::1] free_chemical_potential_indices,
                                  int[::1] free_stable_compset_indices, int[::1] free_statevar_indices,
                                  int[::1] fixed_chemical_potential_indices, double[::1] chemical_potentials,
-                                 double[:, ::1] masses, double[::1] grad, double energy):
+                                 double[:, ::1] masses, double[::1] grad, double energy) nogil:
     # 1a. This phase row: free chemical potentials
     cdef int free_variable_column_offset = 0
     cdef int chempot_idx, statevar_idx, i
@@ -96,7 +205,7 @@ cdef void write_row_fixed_mole_fraction(double[:] out_row, double* out_rhs, int
                                         double[:, ::1] mass_jac, double[:, ::1] c_component,
                                         double[:, ::1] c_statevars, double[::1] c_G, double[:, ::1] masses,
                                         double moles_normalization, double[::1] moles_normalization_grad,
-                                        double[::1] phase_amt, int idx):
+                                        double[::1] phase_amt, int idx) nogil:
     cdef int free_variable_column_offset = 0
     cdef int num_statevars = c_statevars.shape[1]
     cdef int chempot_idx, compset_idx, statevar_idx, i, j
@@ -151,7 +260,7 @@ cdef void write_row_fixed_mole_amount(double[:] out_row, double* out_rhs, int co
                                       double[::1] chemical_potentials,
                                       double[:, ::1] mass_jac, double[:, ::1] c_component,
                                       double[:, ::1] c_statevars, double[::1] c_G, double[:, ::1] masses,
-                                      double[::1] phase_amt, int idx):
+                                      double[::1] phase_amt, int idx) nogil:
     cdef int free_variable_column_offset = 0
     cdef int num_statevars = c_statevars.shape[1]
     cdef int i, j, chempot_idx, compset_idx, statevar_idx
@@ -187,97 +296,65 @@ cdef void write_row_fixed_mole_amount(double[:] out_row, double* out_rhs, int co
                 chempot_idx] * mass_jac[component_idx, num_statevars+j] * c_component[chempot_idx, j]
 
 
-cdef void fill_equilibrium_system(double[::1,:] equilibrium_matrix, double[::1] equilibrium_rhs,
-                                  SystemSpecification spec, SystemState state):
-    cdef int stable_idx, idx, component_row_offset, component_idx, fixed_idx, free_idx
-    cdef int fixed_component_idx, comp_idx, system_amount_index
-    cdef CompositionSet compset
-    cdef CompsetState csst
+cdef void write_compset_rows(double[::1,:] equilibrium_matrix, double[::1] equilibrium_rhs,
+                             SystemSpecification spec, SystemState state, CompsetState csst,
+                             int idx, int phase_row) nogil:
+    "Write the row of one composition set, and its contributions to the fixed component and N=1 rows."
+    cdef int component_idx, fixed_component_idx
     cdef int num_components = state.chemical_potentials.shape[0]
+    cdef int num_fixed_components = spec.prescribed_elemental_amounts.shape[0]
+    cdef int component_row_offset = state.free_stable_compset_indices.shape[0] + spec.fixed_stable_compset_indices.shape[0]
+    cdef int system_amount_index = component_row_offset + num_fixed_components
+
+    write_row_stable_phase(equilibrium_matrix[phase_row, :], &equilibrium_rhs[phase_row], spec.free_chemical_potential_indices,
+                           state.free_stable_compset_indices, spec.free_statevar_indices, spec.fixed_chemical_potential_indices,
+                           state.chemical_potentials, csst.masses, csst.grad, csst.energy)
+
+    # 2. Contribute to the row of all fixed components (fixed mole fraction)
+    for fixed_component_idx in range(num_fixed_components):
+        component_idx = spec.prescribed_element_indices[fixed_component_idx]
+        write_row_fixed_mole_fraction(equilibrium_matrix[component_row_offset + fixed_component_idx, :],
+                                      &equilibrium_rhs[component_row_offset + fixed_component_idx],
+                                      component_idx, spec.free_chemical_potential_indices,
+                                      state.free_stable_compset_indices,
+                                      spec.free_statevar_indices, spec.fixed_chemical_potential_indices,
+                                      state.chemical_potentials,
+                                      state.mole_fractions, state.system_amount, csst.mass_jac,
+                                      csst.c_component, csst.c_statevars,
+                                      csst.c_G, csst.masses, csst.moles_normalization,
+                                      csst.moles_normalization_grad, state.phase_amt, idx)
+
+    # 2X. Also handle the N=1 row
+    for component_idx in range(num_components):
+        write_row_fixed_mole_amount(equilibrium_matrix[system_amount_index, :],
+                                    &equilibrium_rhs[system_amount_index], component_idx,
+                                    spec.free_chemical_potential_indices, state.free_stable_compset_indices,
+                                    spec.free_statevar_indices, spec.fixed_chemical_potential_indices,
+                                    state.chemical_potentials, csst.mass_jac, csst.c_component,
+                                    csst.c_statevars, csst.c_G, csst.masses,
+                                    state.phase_amt, idx)
+
+
+cdef void fill_equilibrium_system(double[::1,:] equilibrium_matrix, double[::1] equilibrium_rhs,
+                                  SystemSpecification spec, SystemState state) nogil:
+    cdef int stable_idx, idx, component_row_offset, component_idx, fixed_idx
+    cdef int fixed_component_idx, system_amount_index
+    cdef double component_residual, system_residual
     cdef int num_stable_phases = state.free_stable_compset_indices.shape[0]
     cdef int num_fixed_phases = spec.fixed_stable_compset_indices.shape[0]
     cdef int num_fixed_components = spec.prescribed_elemental_amounts.shape[0]
 
-    for stable_idx in range(state.free_stable_compset_indices.shape[0]):
+    for stable_idx in range(num_stable_phases):
         idx = state.free_stable_compset_indices[stable_idx]
-        compset = state.compsets[idx]
-        csst = state.cs_states[idx]
-
-        write_row_stable_phase(equilibrium_matrix[stable_idx, :], &equilibrium_rhs[stable_idx], spec.free_chemical_potential_indices,
-                               state.free_stable_compset_indices, spec.free_statevar_indices, spec.fixed_chemical_potential_indices,
-                               state.chemical_potentials, csst.masses, csst.grad, csst.energy)
+        write_compset_rows(equilibrium_matrix, equilibrium_rhs, spec, state,
+                           <CompsetState>state._cs_states_ptr[idx], idx, stable_idx)
 
     # Handle phases which are fixed to be stable at some amount
     # Example shown in Eq. 60, Sundman et al 2015
-    for fixed_idx in range(spec.fixed_stable_compset_indices.shape[0]):
+    for fixed_idx in range(num_fixed_phases):
         idx = spec.fixed_stable_compset_indices[fixed_idx]
-        compset = state.compsets[idx]
-        csst = state.cs_states[idx]
-        write_row_stable_phase(equilibrium_matrix[num_stable_phases + fixed_idx, :],
-                               &equilibrium_rhs[num_stable_phases + fixed_idx], spec.free_chemical_potential_indices,
-                               state.free_stable_compset_indices, spec.free_statevar_indices, spec.fixed_chemical_potential_indices,
-                               state.chemical_potentials, csst.masses, csst.grad, csst.energy)
-
-    for stable_idx in range(state.free_stable_compset_indices.shape[0]):
-        idx = state.free_stable_compset_indices[stable_idx]
-        compset = state.compsets[idx]
-        csst = state.cs_states[idx]
-        # 2. Contribute to the row of all fixed components (fixed mole fraction)
-        component_row_offset = num_stable_phases + num_fixed_phases
-        for fixed_component_idx in range(num_fixed_components):
-            component_idx = spec.prescribed_element_indices[fixed_component_idx]
-            write_row_fixed_mole_fraction(equilibrium_matrix[component_row_offset + fixed_component_idx, :],
-                                          &equilibrium_rhs[component_row_offset + fixed_component_idx],
-                                          component_idx, spec.free_chemical_potential_indices,
-                                          state.free_stable_compset_indices,
-                                          spec.free_statevar_indices, spec.fixed_chemical_potential_indices,
-                                          state.chemical_potentials,
-                                          state.mole_fractions, state.system_amount, csst.mass_jac,
-                                          csst.c_component, csst.c_statevars,
-                                          csst.c_G, csst.masses, csst.moles_normalization,
-                                          csst.moles_normalization_grad, state.phase_amt, idx)
-
-        system_amount_index = component_row_offset + num_fixed_components
-        # 2X. Also handle the N=1 row
-        for component_idx in range(num_components):
-            write_row_fixed_mole_amount(equilibrium_matrix[system_amount_index, :],
-                                        &equilibrium_rhs[system_amount_index], component_idx,
-                                        spec.free_chemical_potential_indices, state.free_stable_compset_indices,
-                                        spec.free_statevar_indices, spec.fixed_chemical_potential_indices,
-                                        state.chemical_potentials, csst.mass_jac, csst.c_component,
-                                        csst.c_statevars, csst.c_G, csst.masses,
-                                        state.phase_amt, idx)
-
-    for fixed_idx in range(spec.fixed_stable_compset_indices.shape[0]):
-        idx = spec.fixed_stable_compset_indices[fixed_idx]
-        compset = state.compsets[idx]
-        csst = state.cs_states[idx]
-        # 2. Contribute to the row of all fixed components (fixed mole fraction)
-        component_row_offset = num_stable_phases + num_fixed_phases
-        for fixed_component_idx in range(num_fixed_components):
-            component_idx = spec.prescribed_element_indices[fixed_component_idx]
-            write_row_fixed_mole_fraction(equilibrium_matrix[component_row_offset + fixed_component_idx, :],
-                                          &equilibrium_rhs[component_row_offset + fixed_component_idx],
-                                          component_idx, spec.free_chemical_potential_indices,
-                                          state.free_stable_compset_indices,
-                                          spec.free_statevar_indices, spec.fixed_chemical_potential_indices,
-                                          state.chemical_potentials,
-                                          state.mole_fractions, state.system_amount, csst.mass_jac,
-                                          csst.c_component, csst.c_statevars,
-                                          csst.c_G, csst.masses, csst.moles_normalization,
-                                          csst.moles_normalization_grad, state.phase_amt, idx)
-
-        system_amount_index = component_row_offset + num_fixed_components
-        # 2X. Also handle the N=1 row
-        for component_idx in range(num_components):
-            write_row_fixed_mole_amount(equilibrium_matrix[system_amount_index, :],
-                                        &equilibrium_rhs[system_amount_index], component_idx,
-                                        spec.free_chemical_potential_indices, state.free_stable_compset_indices,
-                                        spec.free_statevar_indices, spec.fixed_chemical_potential_indices,
-                                        state.chemical_potentials, csst.mass_jac, csst.c_component,
-                                        csst.c_statevars, csst.c_G, csst.masses,
-                                        state.phase_amt, idx)
-
+        write_compset_rows(equilibrium_matrix, equilibrium_rhs, spec, state,
+                           <CompsetState>state._cs_states_ptr[idx], idx, num_stable_phases + fixed_idx)
 
     # Add mass residual to fixed component row RHS, plus N=1 row
     component_row_offset = num_stable_phases + num_fixed_phases
@@ -325,8 +402,12 @@ cdef class SystemSpecification:
         self.__init__(*state)
 
 cdef class CompsetState:
+    cdef PhaseRecord phase_record
+    cdef double[::1] dof
+    cdef double[::1] new_dof
     cdef double[::1] x
     cdef double energy
+    cdef double[::1] _energy_view
     cdef double[::1] grad
     cdef double[:,::1] hess
     cdef double[:,::1] masses
@@ -342,11 +423,16 @@ cdef class CompsetState:
     cdef double[::1] moles_normalization_grad
     cdef int[::1] fixed_phase_dof_indices
     cdef int[::1] ipiv
+    cdef double[::1] inverse_work
     cdef double[:, ::1] cons_jac_tmp
 
     def __init__(self, SystemSpecification spec, CompositionSet compset):
+        self.phase_record = compset.phase_record
+        self.dof = np.array(compset.dof)
+        self.new_dof = np.zeros(spec.num_statevars + compset.phase_record.phase_dof)
         self.x = np.zeros(spec.num_statevars + compset.phase_record.phase_dof)
         self.energy = 0
+        self._energy_view = <double[:1]>&self.energy
         self.grad = np.zeros(spec.num_statevars + compset.phase_record.phase_dof)
         self.hess = np.zeros((spec.num_statevars + compset.phase_record.phase_dof,
                              spec.num_statevars + compset.phase_record.phase_dof))
@@ -365,25 +451,111 @@ cdef class CompsetState:
         self.moles_normalization_grad = np.zeros(spec.num_statevars+compset.phase_record.phase_dof)
         self.fixed_phase_dof_indices = np.array([], dtype=np.int32)
         self.ipiv = np.empty(self.phase_matrix.shape[0], dtype=np.int32)
+        self.inverse_work = np.empty(inverse_workspace_size(self.phase_matrix.shape[0]))
         self.delta_y = np.zeros(compset.phase_record.phase_dof)
         self.cons_jac_tmp = np.zeros((compset.phase_record.num_internal_cons, spec.num_statevars + compset.phase_record.phase_dof))
 
     def __getstate__(self):
-        return (np.array(self.x), self.energy, np.array(self.grad), np.array(self.hess),
+        return (self.phase_record, np.array(self.dof), np.array(self.new_dof),
+                np.array(self.x), self.energy, np.array(self.grad), np.array(self.hess),
                 np.array(self.phase_matrix), np.array(self.full_e_matrix),
                 np.array(self.masses), np.array(self.mass_jac), np.array(self.c_G), np.array(self.c_statevars),
-                np.array(self.c_component), self.moles_normalization, np.array(self.internal_cons), np.array(self.moles_normalization_grad),
-                np.array(self.fixed_phase_dof_indices, dtype=np.int32), np.array(self.ipiv, dtype=np.int32))
+                np.array(self.c_component), np.array(self.delta_y), self.moles_normalization,
+                np.array(self.internal_cons), np.array(self.moles_normalization_grad),
+                np.array(self.fixed_phase_dof_indices, dtype=np.int32), np.array(self.ipiv, dtype=np.int32),
+                np.array(self.cons_jac_tmp))
     def __setstate__(self, state):
-        (self.x, self.energy, self.grad, self.hess, self.phase_matrix, self.full_e_matrix,
+        (self.phase_record, self.dof, self.new_dof,
+         self.x, self.energy, self.grad, self.hess, self.phase_matrix, self.full_e_matrix,
          self.masses, self.mass_jac, self.c_G, self.c_statevars,
-         self.c_component, self.moles_normalization, self.internal_cons, self.moles_normalization_grad, self.fixed_phase_dof_indices,
-         self.ipiv) = state
+         self.c_component, self.delta_y, self.moles_normalization,
+         self.internal_cons, self.moles_normalization_grad, self.fixed_phase_dof_indices,
+         self.ipiv, self.cons_jac_tmp) = state
+        self._energy_view = <double[:1]>&self.energy
+        self.inverse_work = np.empty(inverse_workspace_size(self.phase_matrix.shape[0]))
+
+
+@cython.boundscheck(False)
+cdef void compute_compset_masses(CompsetState csst, SystemState state, int idx, int num_components) nogil:
+    "Compute the moles of each component per formula unit and add them to the system totals."
+    cdef int comp_idx
+    zero_2d(csst.masses)
+    for comp_idx in range(num_components):
+        csst.phase_record.formulamole_obj(csst.masses[comp_idx, :], csst.dof, comp_idx)
+        if state.phase_amt[idx] > 0:
+            state.mole_fractions[comp_idx] += state.phase_amt[idx] * csst.masses[comp_idx, 0]
+            state.system_amount += state.phase_amt[idx] * csst.masses[comp_idx, 0]
+        state.phase_compositions[idx, comp_idx] = csst.masses[comp_idx, 0]
+
+
+@cython.boundscheck(False)
+cdef void compute_compset_state(CompsetState csst, SystemSpecification spec, double[::1] chemical_potentials,
+                                double[::1] delta_ms) nogil:
+    "Compute the energy, derivatives and phase matrix quantities of one composition set at its current dof."
+    cdef int num_components = spec.num_components
+    cdef int num_statevars = spec.num_statevars
+    cdef int num_phase_dof = csst.phase_record.phase_dof
+    cdef int comp_idx, statevar_idx, i, j
+    cdef double mu_c_sum
+    cdef double[::1] x = csst.dof
+    # Calculate key phase quantities starting here
+    csst.energy = 0
+    zero_2d(csst.mass_jac)
+    # Compute phase matrix (LHS of Eq. 41, Sundman 2015)
+    zero_2d(csst.phase_matrix)
+    zero_1d(csst.internal_cons)
+    zero_2d(csst.hess)
+    zero_1d(csst.grad)
+
+    csst.phase_record.formula_obj_grad_hess(csst._energy_view, csst.grad, csst.hess, x)
+    for comp_idx in range(num_components):
+        csst.phase_record.formulamole_grad(csst.mass_jac[comp_idx, :], x, comp_idx)
+    csst.phase_record.internal_cons_func(csst.internal_cons, x)
+
+    compute_phase_matrix(csst.phase_matrix, csst.hess, csst.cons_jac_tmp, csst.phase_record, num_statevars,
+                         chemical_potentials, x, csst.fixed_phase_dof_indices)
+    # Copy the phase matrix into the e matrix and invert the e matrix
+    for i in range(csst.full_e_matrix.shape[0]):
+        for j in range(csst.full_e_matrix.shape[1]):
+            csst.full_e_matrix[i,j] = csst.phase_matrix[i,j]
+    invert_matrix(&csst.full_e_matrix[0,0], csst.full_e_matrix.shape[0], &csst.ipiv[0],
+                  &csst.inverse_work[0], csst.inverse_work.shape[0])
+
+    zero_1d(csst.c_G)
+    zero_2d(csst.c_statevars)
+    zero_2d(csst.c_component)
+    csst.moles_normalization = 0
+    zero_1d(csst.moles_normalization_grad)
+    zero_1d(delta_ms)
+    for i in range(num_phase_dof):
+        for j in range(num_phase_dof):
+            csst.c_G[i] -= csst.full_e_matrix[i, j] * csst.grad[num_statevars+j]
+    for i in range(num_phase_dof):
+        for j in range(num_phase_dof):
+            for statevar_idx in range(num_statevars):
+                csst.c_statevars[i, statevar_idx] -= csst.full_e_matrix[i, j] * csst.hess[num_statevars + j, statevar_idx]
+    for comp_idx in range(num_components):
+        for i in range(num_phase_dof):
+            for j in range(num_phase_dof):
+                csst.c_component[comp_idx, i] += csst.mass_jac[comp_idx, num_statevars + j] * csst.full_e_matrix[i, j]
+    for comp_idx in range(num_components):
+        for i in range(num_phase_dof):
+            mu_c_sum = 0
+            for j in range(chemical_potentials.shape[0]):
+                mu_c_sum += csst.c_component[j, i] * chemical_potentials[j]
+            delta_ms[comp_idx] += csst.mass_jac[comp_idx, num_statevars + i] * (mu_c_sum + csst.c_G[i])
+    for comp_idx in range(num_components):
+        csst.moles_normalization += csst.masses[comp_idx, 0]
+        for i in range(num_phase_dof+num_statevars):
+            csst.moles_normalization_grad[i] += csst.mass_jac[comp_idx, i]
 
 
 cdef class SystemState:
     cdef list compsets
     cdef list cs_states
+    cdef np.ndarray _cs_states_array
+    cdef void** _cs_states_ptr
+    cdef int num_compsets
     cdef object dof
     cdef int iteration, num_statevars
     cdef double mass_residual
@@ -396,15 +568,33 @@ cdef class SystemState:
     cdef double[::1] _driving_forces
     cdef double[:, ::1] _phase_energies_per_mole_atoms
     cdef double[:, :, ::1] _phase_amounts_per_mole_atoms
+    # Workspace for the equilibrium system, sized for every composition set being free and stable
+    cdef double[::1, :] _equilibrium_matrix
+    cdef double[::1] _equilibrium_soln
+    # LAPACK workspace for solving the equilibrium system, which is not pickled
+    cdef double[::1, :] _lu_matrix
+    cdef int[::1] _lu_ipiv
+    cdef double[::1] _singular_values
+    cdef double[::1] _lapack_work
+    cdef int[::1] _lapack_iwork
+    # Diagnostics, which are not pickled
+    cdef bint collect_timings
+    cdef int num_step_reductions
+    cdef double solve_state_time, recompute_time
 
     def __init__(self, SystemSpecification spec, list compsets):
         cdef CompositionSet compset
-        cdef int idx, comp_idx
+        cdef CompsetState csst
+        cdef int idx, comp_idx, max_num_free_variables
         self.compsets = compsets
         self.cs_states = [CompsetState(spec, compset) for compset in compsets]
-        self.dof = [np.array(compset.dof) for compset in compsets]
+        self._link_compset_states()
         self.iteration = 0
         self.mass_residual = 1e10
+        self.collect_timings = False
+        self.num_step_reductions = 0
+        self.solve_state_time = 0
+        self.recompute_time = 0
         # Phase fractions need to be converted to moles of formula
         self.phase_amt = np.array([compset.NP for compset in compsets])
         self.chemical_potentials = np.zeros(spec.num_components)
@@ -421,6 +611,11 @@ cdef class SystemState:
         self._driving_forces = np.zeros(len(compsets))
         self._phase_energies_per_mole_atoms = np.zeros((len(compsets), 1))
         self._phase_amounts_per_mole_atoms = np.zeros((len(compsets), spec.num_components, 1))
+        max_num_free_variables = spec.free_chemical_potential_indices.shape[0] + len(compsets) + \
+                                 spec.free_statevar_indices.shape[0]
+        self._equilibrium_matrix = np.zeros((max_num_free_variables, max_num_free_variables), order='F')
+        self._equilibrium_soln = np.zeros(max_num_free_variables)
+        self._allocate_workspace()
 
         cdef double[:, ::1] masses_tmp = np.zeros((spec.num_components, 1))
         for idx in range(self.phase_amt.shape[0]):
@@ -432,41 +627,60 @@ cdef class SystemState:
                 masses_tmp[:,:] = 0
             # Convert phase fractions to formula units
             self.phase_amt[idx] /= np.sum(self.phase_compositions[idx])
+
+    def _allocate_workspace(self):
+        "Allocate the LAPACK workspace, sized for the largest equilibrium system."
+        cdef int max_num_free_variables = self._equilibrium_matrix.shape[0]
+        lwork, liwork = linear_system_workspace_size(max_num_free_variables)
+        self._lu_matrix = np.zeros((max_num_free_variables, max_num_free_variables), order='F')
+        self._lu_ipiv = np.zeros(max(max_num_free_variables, 1), dtype=np.int32)
+        self._singular_values = np.zeros(max(max_num_free_variables, 1))
+        self._lapack_work = np.zeros(lwork)
+        self._lapack_iwork = np.zeros(liwork, dtype=np.int32)
+
+    def _link_compset_states(self):
+        "Expose the CompsetStates as a C array so they can be used without the GIL."
+        cdef int idx
+        cdef CompsetState csst
+        self.num_compsets = len(self.cs_states)
+        self._cs_states_array = np.empty(self.num_compsets, dtype='object')
+        for idx in range(self.num_compsets):
+            self._cs_states_array[idx] = self.cs_states[idx]
+        self._cs_states_ptr = <void**> self._cs_states_array.data
+        # The dof of each composition set are owned by its CompsetState
+        self.dof = []
+        for idx in range(self.num_compsets):
+            csst = self.cs_states[idx]
+            self.dof.append(np.asarray(csst.dof))
+
     def __getstate__(self):
-        return (self.compsets, self.cs_states, self.dof, self.iteration, self.mass_residual,
+        return (self.compsets, self.cs_states, self.iteration, self.mass_residual,
                 np.array(self.phase_amt), np.array(self.chemical_potentials),
-                np.array(self.delta_ms), np.array(self.phase_compositions),
+                np.array(self.delta_ms), np.array(self.delta_statevars), np.array(self.phase_compositions),
                 self.largest_statevar_change[0], self.largest_phase_amt_change[0], self.largest_y_change[0],
-                np.array(self.free_stable_compset_indices), self.system_amount, np.array(self.mole_fractions))
+                np.array(self.free_stable_compset_indices), self.system_amount, np.array(self.mole_fractions),
+                np.array(self._driving_forces), np.array(self._phase_energies_per_mole_atoms),
+                np.array(self._phase_amounts_per_mole_atoms),
+                np.array(self._equilibrium_matrix, order='F'), np.array(self._equilibrium_soln))
     def __setstate__(self, state):
-        (self.compsets, self.cs_states, self.dof, self.iteration, self.mass_residual,
+        (self.compsets, self.cs_states, self.iteration, self.mass_residual,
          self.phase_amt, self.chemical_potentials,
-         self.delta_ms, self.phase_compositions, self.largest_statevar_change[0],
-         self.largest_phase_amt_change[0], self.largest_y_change[0], self.free_stable_compset_indices, self.system_amount, self.mole_fractions) = state
+         self.delta_ms, self.delta_statevars, self.phase_compositions, self.largest_statevar_change[0],
+         self.largest_phase_amt_change[0], self.largest_y_change[0], self.free_stable_compset_indices,
+         self.system_amount, self.mole_fractions, self._driving_forces, self._phase_energies_per_mole_atoms,
+         self._phase_amounts_per_mole_atoms, self._equilibrium_matrix, self._equilibrium_soln) = state
+        self._link_compset_states()
+        self._allocate_workspace()
 
     @cython.boundscheck(False)
-    cdef void recompute(self, SystemSpecification spec):
+    cdef void recompute(self, SystemSpecification spec) nogil:
         cdef int num_components = spec.num_components
-        cdef CompositionSet compset
-        cdef CompsetState csst
-        cdef double[::1] x
-        cdef int idx, comp_idx, cons_idx, i, j, stable_idx, fixed_idx, component_idx, fixed_component_idx, num_phase_dof
-        cdef double mu_c_sum
-        self.mole_fractions[:] = 0
-        self.delta_ms[:, :] = 0
+        cdef int idx, comp_idx, component_idx, fixed_component_idx
+        zero_1d(self.mole_fractions)
         self.system_amount = 0
         # Compute normalized global quantities
-        for idx in range(len(self.compsets)):
-            x = self.dof[idx]
-            compset = self.compsets[idx]
-            csst = self.cs_states[idx]
-            csst.masses[:,:] = 0
-            for comp_idx in range(num_components):
-                compset.phase_record.formulamole_obj(csst.masses[comp_idx, :], x, comp_idx)
-                if self.phase_amt[idx] > 0:
-                    self.mole_fractions[comp_idx] += self.phase_amt[idx] * csst.masses[comp_idx, 0]
-                    self.system_amount += self.phase_amt[idx] * csst.masses[comp_idx, 0]
-                self.phase_compositions[idx, comp_idx] = csst.masses[comp_idx, 0]
+        for idx in range(self.num_compsets):
+            compute_compset_masses(<CompsetState>self._cs_states_ptr[idx], self, idx, num_components)
         for comp_idx in range(self.mole_fractions.shape[0]):
             self.mole_fractions[comp_idx] /= self.system_amount
 
@@ -475,129 +689,152 @@ cdef class SystemState:
             component_idx = spec.prescribed_element_indices[fixed_component_idx]
             self.mass_residual += abs(self.mole_fractions[component_idx] - spec.prescribed_elemental_amounts[fixed_component_idx])
 
-        for idx in range(len(self.compsets)):
-            compset = self.compsets[idx]
-            csst = self.cs_states[idx]
-            # TODO: Use better dof storage
-            # Calculate key phase quantities starting here
-            x = self.dof[idx]
-            csst.energy = 0
-            csst.mass_jac[:,:] = 0
-            # Compute phase matrix (LHS of Eq. 41, Sundman 2015)
-            csst.phase_matrix[:,:] = 0
-            csst.internal_cons[:] = 0
-            csst.hess[:,:] = 0
-            csst.grad[:] = 0
-
-            compset.phase_record.formulaobj(<double[:1]>&csst.energy, x)
-            for comp_idx in range(num_components):
-                compset.phase_record.formulamole_grad(csst.mass_jac[comp_idx, :], x, comp_idx)
-            compset.phase_record.formulahess(csst.hess, x)
-            compset.phase_record.formulagrad(csst.grad, x)
-            compset.phase_record.internal_cons_func(csst.internal_cons, x)
-
-            compute_phase_matrix(csst.phase_matrix, csst.hess, csst.cons_jac_tmp, compset, spec.num_statevars, self.chemical_potentials, x,
-                                 csst.fixed_phase_dof_indices)
-            # Copy the phase matrix into the e matrix and invert the e matrix
-            for i in range(csst.full_e_matrix.shape[0]):
-                for j in range(csst.full_e_matrix.shape[1]):
-                    csst.full_e_matrix[i,j] = csst.phase_matrix[i,j]
-            invert_matrix(&csst.full_e_matrix[0,0], csst.full_e_matrix.shape[0], &csst.ipiv[0])
-
-            num_phase_dof = compset.phase_record.phase_dof
-            csst.c_G[:] = 0
-            csst.c_statevars[:,:] = 0
-            csst.c_component[:,:] = 0
-            csst.moles_normalization = 0
-            csst.moles_normalization_grad[:] = 0
-            for i in range(num_phase_dof):
-                for j in range(num_phase_dof):
-                    csst.c_G[i] -= csst.full_e_matrix[i, j] * csst.grad[spec.num_statevars+j]
-            for i in range(num_phase_dof):
-                for j in range(num_phase_dof):
-                    for statevar_idx in range(spec.num_statevars):
-                        csst.c_statevars[i, statevar_idx] -= csst.full_e_matrix[i, j] * csst.hess[spec.num_statevars + j, statevar_idx]
-            for comp_idx in range(num_components):
-                for i in range(num_phase_dof):
-                    for j in range(num_phase_dof):
-                        csst.c_component[comp_idx, i] += csst.mass_jac[comp_idx, spec.num_statevars + j] * csst.full_e_matrix[i, j]
-            for comp_idx in range(num_components):
-                for i in range(num_phase_dof):
-                    mu_c_sum = 0
-                    for j in range(self.chemical_potentials.shape[0]):
-                        mu_c_sum += csst.c_component[j, i] * self.chemical_potentials[j]
-                    self.delta_ms[idx, comp_idx] += csst.mass_jac[comp_idx, spec.num_statevars + i] * (mu_c_sum + csst.c_G[i])
-            for comp_idx in range(num_components):
-                csst.moles_normalization += csst.masses[comp_idx, 0]
-                for i in range(num_phase_dof+spec.num_statevars):
-                    csst.moles_normalization_grad[i] += csst.mass_jac[comp_idx, i]
+        for idx in range(self.num_compsets):
+            compute_compset_state(<CompsetState>self._cs_states_ptr[idx], spec, self.chemical_potentials,
+                                  self.delta_ms[idx, :])
 
     cdef double[::1] driving_forces(self):
         cdef int idx, comp_idx
-        cdef CompositionSet compset
-        cdef double[::1] x
+        cdef CompsetState csst
         cdef int num_components = self.chemical_potentials.shape[0]
         # This needs to be done per mole of atoms, not per formula unit, since we compare phases to each other
         self._driving_forces[:] = 0
-        for idx in range(len(self.compsets)):
-            compset = self.compsets[idx]
-            x = self.dof[idx]
+        for idx in range(self.num_compsets):
+            csst = self.cs_states[idx]
             for comp_idx in range(num_components):
-                compset.phase_record.mass_obj(self._phase_amounts_per_mole_atoms[idx, comp_idx, :], x, comp_idx)
+                csst.phase_record.mass_obj(self._phase_amounts_per_mole_atoms[idx, comp_idx, :], csst.dof, comp_idx)
                 self._driving_forces[idx] += self.chemical_potentials[comp_idx] * self._phase_amounts_per_mole_atoms[idx, comp_idx, 0]
-            compset.phase_record.obj(self._phase_energies_per_mole_atoms[idx, :], x)
+            csst.phase_record.obj(self._phase_energies_per_mole_atoms[idx, :], csst.dof)
             self._driving_forces[idx] -= self._phase_energies_per_mole_atoms[idx, 0]
         return self._driving_forces
 
 
-cpdef solve_state(SystemSpecification spec, SystemState state):
-    cdef double[::1,:] equilibrium_matrix  # Fortran ordering required by call into lapack
-    cdef double[::1] equilibrium_soln
-    cdef int chempot_idx, comp_idx, num_stable_phases, num_fixed_phases, num_fixed_components, num_free_variables
+def solve_state(SystemSpecification spec, SystemState state):
+    """Solve the equilibrium system of state and return a copy of the solution."""
+    return np.array(_solve_state(spec, state))
+
 
-    state.recompute(spec)
+cdef double[::1] _solve_state(SystemSpecification spec, SystemState state):
+    """Solve the equilibrium system of state.
+
+    The returned solution is a view of the workspace of state, which the next call overwrites.
+    """
+    cdef double[::1,:] equilibrium_matrix = state._equilibrium_matrix  # Fortran ordering required by call into lapack
+    cdef double[::1] equilibrium_soln = state._equilibrium_soln
+    cdef int i, j, chempot_idx, comp_idx, num_stable_phases, num_fixed_phases, num_fixed_components, num_free_variables
+    cdef int num_rows
+    cdef double start_time = 0, recomputed_time = 0
 
     num_stable_phases = state.free_stable_compset_indices.shape[0]
     num_fixed_phases = spec.fixed_stable_compset_indices.shape[0]
-    num_fixed_components = len(spec.prescribed_elemental_amounts)
+    num_fixed_components = spec.prescribed_elemental_amounts.shape[0]
     num_free_variables = spec.free_chemical_potential_indices.shape[0] + num_stable_phases + \
                          spec.free_statevar_indices.shape[0]
-
-    equilibrium_matrix = np.zeros((num_stable_phases + num_fixed_phases + num_fixed_components + 1, num_free_variables), order='F')
-    equilibrium_soln = np.zeros(num_stable_phases + num_fixed_phases + num_fixed_components + 1)
+    num_rows = num_stable_phases + num_fixed_phases + num_fixed_components + 1
     # TODO: can we move this error check outside?
-    if (num_stable_phases + num_fixed_phases + num_fixed_components + 1) != num_free_variables:
+    if num_rows != num_free_variables:
         raise ValueError('Conditions do not obey Gibbs Phase Rule')
 
-    equilibrium_matrix[:,:] = 0
-    equilibrium_soln[:] = 0
-    fill_equilibrium_system(equilibrium_matrix, equilibrium_soln, spec, state)
+    if state.collect_timings:
+        start_time = perf_counter()
+    with nogil:
+        state.recompute(spec)
+    if state.collect_timings:
+        recomputed_time = perf_counter()
+        state.recompute_time += recomputed_time - start_time
+    with nogil:
+        # Only the leading (num_rows, num_free_variables) block of the workspace is used
+        for j in range(num_free_variables):
+            for i in range(num_rows):
+                equilibrium_matrix[i, j] = 0
+        for i in range(num_rows):
+            equilibrium_soln[i] = 0
+        fill_equilibrium_system(equilibrium_matrix, equilibrium_soln, spec, state)
+
+        # The system is square, as the Gibbs phase rule is obeyed
+        solve_linear_system(&equilibrium_matrix[0,0], num_rows, equilibrium_matrix.shape[0],
+                            &equilibrium_soln[0], &state._lu_matrix[0,0], &state._lu_ipiv[0],
+                            &state._singular_values[0], &state._lapack_work[0],
+                            state._lapack_work.shape[0], &state._lapack_iwork[0])
+
+        # set the chemical potentials from the solution
+        for i in range(spec.free_chemical_potential_indices.shape[0]):
+            chempot_idx = spec.free_chemical_potential_indices[i]
+            state.chemical_potentials[chempot_idx] = equilibrium_soln[i]
+
+        # Force some chemical potentials to adopt their fixed values
+        for chempot_idx in range(spec.fixed_chemical_potential_indices.shape[0]):
+            comp_idx = spec.fixed_chemical_potential_indices[chempot_idx]
+            state.chemical_potentials[comp_idx] = spec.initial_chemical_potentials[comp_idx]
+
+    if state.collect_timings:
+        state.solve_state_time += perf_counter() - recomputed_time
+    return equilibrium_soln[:num_rows]
 
-    lstsq(&equilibrium_matrix[0,0], equilibrium_matrix.shape[0], equilibrium_matrix.shape[1],
-          &equilibrium_soln[0], 1e-16)
 
-    # set the chemical potentials from the solution
-    for i in range(spec.free_chemical_potential_indices.shape[0]):
-        chempot_idx = spec.free_chemical_potential_indices[i]
-        state.chemical_potentials[chempot_idx] = equilibrium_soln[i]
+@cython.boundscheck(False)
+cdef double advance_compset(CompsetState csst, SystemSpecification spec, SystemState state, double step_size) nogil:
+    """Step the internal degrees of freedom of one composition set, staying within site fraction bounds.
+
+    Returns the step size, which is reduced if a full step would exceed the bounds.
+    """
+    cdef bint exceeded_bounds
+    cdef double minimum_step_size
+    cdef int i, statevar_idx, chempot_idx, cons_idx
+    cdef double[::1] x = csst.dof
+    cdef double[::1] new_y = csst.new_dof
 
-    # Force some chemical potentials to adopt their fixed values
-    for chempot_idx in range(spec.fixed_chemical_potential_indices.shape[0]):
-        comp_idx = spec.fixed_chemical_potential_indices[chempot_idx]
-        state.chemical_potentials[comp_idx] = spec.initial_chemical_potentials[comp_idx]
+    # Construct delta_y from Eq. 43 in Sundman 2015
+    zero_1d(csst.delta_y)
 
-    return equilibrium_soln
+    for i in range(csst.delta_y.shape[0]):
+        csst.delta_y[i] += csst.c_G[i]
+        for statevar_idx in range(state.delta_statevars.shape[0]):
+            csst.delta_y[i] += csst.c_statevars[i, statevar_idx] * state.delta_statevars[statevar_idx]
+        for chempot_idx in range(state.chemical_potentials.shape[0]):
+            csst.delta_y[i] += csst.c_component[chempot_idx, i] * state.chemical_potentials[chempot_idx]
+        for cons_idx in range(csst.internal_cons.shape[0]):
+            csst.delta_y[i] -= csst.full_e_matrix[csst.delta_y.shape[0] + cons_idx, i] * csst.internal_cons[cons_idx]
+
+    for i in range(x.shape[0]):
+        new_y[i] = x[i]
+    minimum_step_size = 1e-20 * step_size
+    while step_size >= minimum_step_size:
+        exceeded_bounds = False
+        for i in range(spec.num_statevars, new_y.shape[0]):
+            new_y[i] = x[i] + step_size * csst.delta_y[i - spec.num_statevars]
+            if new_y[i] > 1:
+                if (new_y[i] - 1) > 1e-11:
+                    # Allow some tolerance in the name of progress
+                    exceeded_bounds = True
+                new_y[i] = 1
+            elif new_y[i] < _MIN_SITE_FRACTION:
+                if (_MIN_SITE_FRACTION - new_y[i]) > 1e-11:
+                    # Allow some tolerance in the name of progress
+                    exceeded_bounds = True
+                # Reduce by two orders of magnitude, or MIN_SITE_FRACTION, whichever is larger
+                new_y[i] = max(x[i]/100, _MIN_SITE_FRACTION)
+        if exceeded_bounds:
+            step_size *= 0.5
+            state.num_step_reductions += 1
+            continue
+        break
+    state.largest_y_change[0] = 0.0
+    for i in range(spec.num_statevars, new_y.shape[0]):
+        state.largest_y_change[0] = max(state.largest_y_change[0], abs(x[i] - new_y[i]))
+    for i in range(x.shape[0]):
+        x[i] = new_y[i]
+    return step_size
 
 
 # TODO: should we store equilibrium_soln in the state(?)
-cpdef advance_state(SystemSpecification spec, SystemState state, double[::1] equilibrium_soln, double step_size):
+@cython.boundscheck(False)
+cpdef void advance_state(SystemSpecification spec, SystemState state, double[::1] equilibrium_soln, double step_size) nogil:
     # Apply linear corrections in phase amounts, state variables and site fractions
-    cdef bint exceeded_bounds
-    cdef double minimum_step_size, psc, phase_amt_step_size
-    cdef int i, idx, cons_idx, compset_idx, statevar_idx, chempot_idx
+    cdef double psc, phase_amt_step_size
+    cdef int i, idx, compset_idx, statevar_idx
     cdef int soln_index_offset = spec.free_chemical_potential_indices.shape[0]  # Chemical potentials handled after solving
-    cdef double[::1] new_y, x
-    cdef CompsetState csst
+    cdef double[::1] x
 
     cdef double MIN_PHASE_AMOUNT = 1e-16
 
@@ -612,6 +849,8 @@ cpdef advance_state(SystemSpecification spec, SystemState state, double[::1] equ
             # 2. delta_NP<0 (must be true if assumption #1 is true and this condition is true)
             # The largest allowable step size satisfies the equation: (NP + step_size * delta_NP = MIN_PHASE_AMOUNT)
             phase_amt_step_size = min(phase_amt_step_size, (MIN_PHASE_AMOUNT - state.phase_amt[compset_idx]) / equilibrium_soln[soln_index_offset + i])
+    if phase_amt_step_size < step_size:
+        state.num_step_reductions += 1
     # Update the phase amounts using the largest allowable step size
     state.largest_phase_amt_change[0] = 0
     for i in range(state.free_stable_compset_indices.shape[0]):
@@ -621,66 +860,28 @@ cpdef advance_state(SystemSpecification spec, SystemState state, double[::1] equ
     soln_index_offset += state.free_stable_compset_indices.shape[0]
 
     # 2. Step in state variables
+    # All composition sets share the same state variables, so the first one is used as the reference
+    x = (<CompsetState>state._cs_states_ptr[0]).dof
     state.largest_statevar_change[0] = 0
-    state.delta_statevars[:] = 0
+    zero_1d(state.delta_statevars)
     for i in range(spec.free_statevar_indices.shape[0]):
         statevar_idx = spec.free_statevar_indices[i]
         state.delta_statevars[statevar_idx] = equilibrium_soln[soln_index_offset + i]
-        if state.dof[0][statevar_idx] == 0:
-            psc = np.inf
+        if x[statevar_idx] == 0:
+            psc = INFINITY
         else:
-            psc = abs(state.delta_statevars[statevar_idx] / state.dof[0][statevar_idx])
+            psc = abs(state.delta_statevars[statevar_idx] / x[statevar_idx])
         state.largest_statevar_change[0] = max(state.largest_statevar_change[0], psc)
     # Update state variables in the `x` array
-    for idx in range(len(state.compsets)):
-        x = state.dof[idx]
+    for idx in range(state.num_compsets):
+        x = (<CompsetState>state._cs_states_ptr[idx]).dof
         for statevar_idx in range(state.delta_statevars.shape[0]):
             x[statevar_idx] += state.delta_statevars[statevar_idx]
         # We need real state variable bounds support
 
     # 3. Step in phase internal degrees of freedom
-    for idx in range(len(state.compsets)):
-        # TODO: Use better dof storage
-        x = state.dof[idx]
-        csst = state.cs_states[idx]
-
-        # Construct delta_y from Eq. 43 in Sundman 2015
-        csst.delta_y[:] = 0
-
-        for i in range(csst.delta_y.shape[0]):
-            csst.delta_y[i] += csst.c_G[i]
-            for statevar_idx in range(state.delta_statevars.shape[0]):
-                csst.delta_y[i] += csst.c_statevars[i, statevar_idx] * state.delta_statevars[statevar_idx]
-            for chempot_idx in range(state.chemical_potentials.shape[0]):
-                csst.delta_y[i] += csst.c_component[chempot_idx, i] * state.chemical_potentials[chempot_idx]
-            for cons_idx in range(csst.internal_cons.shape[0]):
-                csst.delta_y[i] -= csst.full_e_matrix[csst.delta_y.shape[0] + cons_idx, i] * csst.internal_cons[cons_idx]
-
-        new_y = np.array(x)
-        minimum_step_size = 1e-20 * step_size
-        while step_size >= minimum_step_size:
-            exceeded_bounds = False
-            for i in range(spec.num_statevars, new_y.shape[0]):
-                new_y[i] = x[i] + step_size * csst.delta_y[i - spec.num_statevars]
-                if new_y[i] > 1:
-                    if (new_y[i] - 1) > 1e-11:
-                        # Allow some tolerance in the name of progress
-                        exceeded_bounds = True
-                    new_y[i] = 1
-                elif new_y[i] < MIN_SITE_FRACTION:
-                    if (MIN_SITE_FRACTION - new_y[i]) > 1e-11:
-                        # Allow some tolerance in the name of progress
-                        exceeded_bounds = True
-                    # Reduce by two orders of magnitude, or MIN_SITE_FRACTION, whichever is larger
-                    new_y[i] = max(x[i]/100, MIN_SITE_FRACTION)
-            if exceeded_bounds:
-                step_size *= 0.5
-                continue
-            break
-        state.largest_y_change[0] = 0.0
-        for i in range(spec.num_statevars, new_y.shape[0]):
-            state.largest_y_change[0] = max(state.largest_y_change[0], abs(x[i] - new_y[i]))
-        x[:] = new_y
+    for idx in range(state.num_compsets):
+        step_size = advance_compset(<CompsetState>state._cs_states_ptr[idx], spec, state, step_size)
 
 
 cdef bint remove_and_consolidate_phases(SystemSpecification spec, SystemState state):
@@ -691,6 +892,7 @@ cdef bint remove_and_consolidate_phases(SystemSpecification spec, SystemState st
     cdef int i, j, idx, idx2, cp_idx, comp_idx, dof_idx, phase_idx
     cdef CompositionSet compset, compset2
     cdef bint phases_changed = False
+    cdef bint compsets_coincide
 
     compset_indices_to_remove = set()
     for i in range(len(state.free_stable_compset_indices)):
@@ -717,10 +919,14 @@ cdef bint remove_and_consolidate_phases(SystemSpecification spec, SystemState st
             if idx2 in compset_indices_to_remove:
                 continue
             # Detect if these compsets describe the same internal configuration inside a miscibility gap
-            compset_distances = np.abs(np.array(state.phase_compositions[idx]) - np.array(state.phase_compositions[idx2]))
-            if np.all(compset_distances < 1e-4):
+            compsets_coincide = True
+            for comp_idx in range(state.phase_compositions.shape[1]):
+                if abs(state.phase_compositions[idx, comp_idx] - state.phase_compositions[idx2, comp_idx]) >= 1e-4:
+                    compsets_coincide = False
+                    break
+            if compsets_coincide:
                 compset_indices_to_remove.add(idx2)
-                if idx not in spec.fixed_stable_compset_indices:
+                if not contains_index(spec.fixed_stable_compset_indices, idx):
                     # ensure that the consolidated phase is stable
                     state.phase_amt[idx] = max(state.phase_amt[idx] + state.phase_amt[idx2], 1e-8)
                 state.phase_amt[idx2] = 0
@@ -795,8 +1001,16 @@ cpdef find_solution(list compsets, int num_statevars, int num_components,
                     double prescribed_system_amount, double[::1] initial_chemical_potentials,
                     int[::1] free_chemical_potential_indices, int[::1] fixed_chemical_potential_indices,
                     int[::1] prescribed_element_indices, double[::1] prescribed_elemental_amounts,
-                    int[::1] free_statevar_indices, int[::1] fixed_statevar_indices):
+                    int[::1] free_statevar_indices, int[::1] fixed_statevar_indices, dict diagnostics=None):
+    """
+    Find the equilibrium of the composition sets under the given conditions.
+
+    If diagnostics is a dict, the number of Newton 'iterations', 'phase_changes'
+    and 'step_reductions', and the 'solve_state_time' and 'recompute_time', are
+    written to it.
+    """
     cdef int iteration, idx, comp_idx, iterations_since_last_phase_change
+    cdef int num_phase_changes = 0
     cdef CompositionSet compset
     cdef double allowed_mass_residual, largest_chemical_potential_difference, step_size
     cdef double[::1] x, eq_soln
@@ -813,6 +1027,7 @@ cpdef find_solution(list compsets, int num_statevars, int num_components,
                                                         fixed_chemical_potential_indices, fixed_statevar_indices,
                                                         fixed_stable_compset_indices)
     cdef SystemState state = SystemState(spec, compsets)
+    state.collect_timings = diagnostics is not None
 
     # convergence criteria
     cdef double ALLOWED_DELTA_Y = 5e-09
@@ -830,12 +1045,15 @@ cpdef find_solution(list compsets, int num_statevars, int num_components,
     step_size = 1.0
     for iteration in range(1000):
         state.iteration = iteration
-        if (state.mass_residual > 10) and (np.any(np.abs(state.chemical_potentials) > 1.0e10)):
-            state.chemical_potentials[:] = spec.initial_chemical_potentials
+        if state.mass_residual > 10:
+            for comp_idx in range(num_components):
+                if abs(state.chemical_potentials[comp_idx]) > 1.0e10:
+                    state.chemical_potentials[:] = spec.initial_chemical_potentials
+                    break
 
         previous_chemical_potentials[:] = state.chemical_potentials[:]
 
-        eq_soln = solve_state(spec, state)
+        eq_soln = _solve_state(spec, state)
 
         # In most cases, the chemical potentials should be decreasing and the
         # largest_chemical_potential_difference could be negative. The following check
@@ -868,10 +1086,12 @@ cpdef find_solution(list compsets, int num_statevars, int num_components,
             else:
                 converged = True
                 break
+        if phases_changed:
+            num_phase_changes += 1
         iterations_since_last_phase_change += 1
 
         for idx in range(len(state.compsets)):
-            if idx in state.free_stable_compset_indices:
+            if contains_index(state.free_stable_compset_indices, idx):
                 metastable_phase_iterations[idx] = 0
             else:
                 metastable_phase_iterations[idx] += 1
@@ -888,4 +1108,10 @@ cpdef find_solution(list compsets, int num_statevars, int num_components,
     for cs_dof in state.dof[1:]:
         x = np.r_[x, cs_dof[num_statevars:]]
     x = np.r_[x, phase_amt]
+    if diagnostics is not None:
+        diagnostics['iterations'] = state.iteration + 1
+        diagnostics['phase_changes'] = num_phase_changes
+        diagnostics['step_reductions'] = state.num_step_reductions
+        diagnostics['solve_state_time'] = state.solve_state_time
+        diagnostics['recompute_time'] = state.recompute_time
     return converged, x, np.array(state.chemical_potentials)
@@ -0,0 +1,339 @@
+"""
+The parallel module distributes the points of an equilibrium condition grid
+over a pool of worker processes, or over the nodes of a cluster with the Dask
+and MPI executor backends.
+"""
+import os
+from concurrent.futures import ProcessPoolExecutor, as_completed
+import numpy as np
+from pycalphad.core.eqsolver import _solve_eq_at_conditions
+from pycalphad.core.light_dataset import LightDataset
+from pycalphad.core.solver import add_diagnostic_variables
+
+# Number of tasks per worker. More tasks balance the uneven per-point cost
+# near phase boundaries at the price of more inter-process communication.
+CHUNKS_PER_WORKER = 4
+
+# Objects shared by every chunk solved in a worker process.
+# They are sent once per process by the pool initializer instead of once per chunk.
+_worker_state = {}
+
+
+def _init_worker(*shared_state):
+    _worker_state['shared_state'] = shared_state
+
+
+def _solve_points(shared_state, task):
+    "Solve the points of a task made by _slice_points and return the new values at those points."
+    phase_records, grid, conds_keys, state_variables, verbose, solver, continuation = shared_state
+    point_indices, properties, local_indices, condition_offset = task
+    properties = _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_variables, verbose,
+                                         solver=solver, point_indices=local_indices, continuation=continuation,
+                                         condition_offset=condition_offset)
+    return point_indices, _gather_points(properties, local_indices)
+
+
+def _solve_chunk(task):
+    "Solve a chunk of the condition grid in a worker process initialized by _init_worker."
+    return _solve_points(_worker_state['shared_state'], task)
+
+
+def _slice_points(properties, conds_keys, point_indices):
+    """
+    Copy the smallest box of the condition grid containing some points, to be solved as one task.
+
+    Returns the flat indices of the points, the copied starting point, the flat
+    indices of the points in the copy and the index of the first point of the
+    copy in the condition grid. Adjacent points of the condition grid are still
+    adjacent in the copy, so `continuation` is unaffected.
+    """
+    grid_shape = properties.GM.shape
+    multi_index = np.unravel_index(point_indices, grid_shape)
+    box = tuple(slice(int(np.min(idx)), int(np.max(idx)) + 1) for idx in multi_index)
+    box_shape = tuple(s.stop - s.start for s in box)
+    local_indices = np.ravel_multi_index(tuple(idx - s.start for idx, s in zip(multi_index, box)), box_shape)
+    data_vars = {var: (dims, np.array(vals[box])) for var, (dims, vals) in properties.data_vars.items()}
+    coords = dict(properties.coords)
+    coords.update({key: np.atleast_1d(properties.coords[key])[s] for key, s in zip(conds_keys, box)})
+    condition_offset = tuple(s.start for s in box)
+    return point_indices, LightDataset(data_vars, coords=coords, attrs=properties.attrs), local_indices, condition_offset
+
+
+def _gather_points(properties, point_indices):
+    "Extract the values of every data variable at the given flat indices of the condition grid."
+    grid_shape = properties.GM.shape
+    multi_index = np.unravel_index(point_indices, grid_shape)
+    return {var: vals[multi_index] for var, (dims, vals) in properties.data_vars.items()}
+
+
+def _scatter_points(properties, point_indices, point_values):
+    "Write values computed by _gather_points back into the condition grid at the given flat indices."
+    grid_shape = properties.GM.shape
+    multi_index = np.unravel_index(point_indices, grid_shape)
+    for var, vals in point_values.items():
+        properties.data_vars[var][1][multi_index] = vals
+
+
+def resolve_workers(workers):
+    """
+    Convert a `workers` argument to a number of worker processes.
+
+    Parameters
+    ----------
+    workers : Optional[int]
+        Number of worker processes. None means one and -1 means one per CPU.
+
+    Returns
+    -------
+    int
+    """
+    if workers is None:
+        return 1
+    workers = int(workers)
+    if workers == -1:
+        return os.cpu_count() or 1
+    if workers < 1:
+        raise ValueError('workers must be a positive integer or -1, got workers={}'.format(workers))
+    return workers
+
+
+def partition_conditions(properties, num_tasks, point_indices=None):
+    """
+    Split the points of a condition grid into contiguous tasks of similar cost.
+
+    Points whose starting point has several phases, i.e., near phase boundaries,
+    take more solver iterations than single-phase points. Each point is weighted
+    by its number of stable phases, and tasks are cut where the cumulative weight
+    crosses multiples of the mean task weight. Tasks are contiguous, so points
+    with `continuation` are still started from neighbors in the same task.
+
+    Parameters
+    ----------
+    properties : LightDataset
+        Starting point of the calculation.
+    num_tasks : int
+        Largest number of tasks.
+    point_indices : Optional[ArrayLike[int]]
+        Flat indices of the points to split. Defaults to every point of the condition grid.
+
+    Returns
+    -------
+    List[ndarray]
+        Flat indices of the points of each non-empty task.
+    """
+    if point_indices is None:
+        point_indices = np.arange(properties.GM.size, dtype=np.intp)
+    point_indices = np.asarray(point_indices, dtype=np.intp)
+    if point_indices.shape[0] == 0:
+        return []
+    num_tasks = max(1, min(num_tasks, point_indices.shape[0]))
+    phase_amounts = np.asarray(properties.NP).reshape(properties.GM.size, -1)[point_indices]
+    weights = np.maximum(np.sum(phase_amounts > 0, axis=-1), 1)
+    cumulative_weights = np.cumsum(weights)
+    cuts = np.searchsorted(cumulative_weights, cumulative_weights[-1] * np.arange(1, num_tasks) / num_tasks,
+                           side='right')
+    tasks = np.split(point_indices, cuts)
+    return [task for task in tasks if task.shape[0] > 0]
+
+
+class EquilibriumExecutor(object):
+    """
+    Base class of backends that solve the points of a condition grid concurrently.
+
+    A backend receives the state shared by every point (PhaseRecords, grid,
+    condition keys and solver) once. Each task carries its own slice of the
+    starting point, which the backend solves with `_solve_points`, returning
+    the values to be written into the result. Subclasses implement
+    `num_workers` and `run`.
+
+    Attributes
+    ----------
+    tasks_per_worker : int
+        Number of tasks the condition grid is split into for each worker.
+    """
+    tasks_per_worker = CHUNKS_PER_WORKER
+
+    def num_workers(self):
+        "Return the number of workers solving tasks concurrently."
+        raise NotImplementedError
+
+    def run(self, shared_state, tasks):
+        """
+        Solve every task, yielding results in any order.
+
+        Parameters
+        ----------
+        shared_state : tuple
+            Arguments of `_solve_points` shared by every task.
+        tasks : List[tuple]
+            Flat indices of the points of each task, with the slice of the starting point they are solved on.
+
+        Yields
+        ------
+        Tuple[ndarray, dict]
+            Flat indices of the points of a task and the values of each data variable at those points.
+        """
+        raise NotImplementedError
+
+
+class ProcessPoolEquilibriumExecutor(EquilibriumExecutor):
+    """
+    Solve tasks in a local pool of worker processes.
+
+    Parameters
+    ----------
+    workers : Optional[int]
+        Number of worker processes, see `resolve_workers`.
+    """
+    def __init__(self, workers=-1):
+        self.workers = resolve_workers(workers)
+
+    def num_workers(self):
+        return self.workers
+
+    def _create_executor(self, max_workers, shared_state):
+        return ProcessPoolExecutor(max_workers=max_workers, initializer=_init_worker, initargs=shared_state)
+
+    def run(self, shared_state, tasks):
+        with self._create_executor(min(self.num_workers(), len(tasks)), shared_state) as executor:
+            # Tasks are handed out as workers become free, which balances tasks of uneven cost
+            futures = [executor.submit(_solve_chunk, task) for task in tasks]
+            for future in as_completed(futures):
+                yield future.result()
+
+
+class MPIEquilibriumExecutor(ProcessPoolEquilibriumExecutor):
+    """
+    Solve tasks on the processes of an MPI job, with mpi4py.
+
+    Run the calculation with, e.g., ``mpiexec -n 65 python -m mpi4py.futures script.py``.
+    The root process builds the calculation and hands out tasks, and the other
+    processes (possibly on many nodes) solve them.
+
+    Parameters
+    ----------
+    workers : Optional[int]
+        Number of worker processes. Defaults to the size of the MPI universe, minus the root process.
+    """
+    def __init__(self, workers=None):
+        try:
+            from mpi4py import MPI
+        except ImportError:
+            raise ImportError('MPIEquilibriumExecutor requires mpi4py')
+        if workers is None:
+            universe_size = MPI.COMM_WORLD.Get_attr(MPI.UNIVERSE_SIZE) or MPI.COMM_WORLD.Get_size()
+            workers = max(universe_size - 1, 1)
+        self.workers = resolve_workers(workers)
+
+    def _create_executor(self, max_workers, shared_state):
+        from mpi4py.futures import MPIPoolExecutor
+        return MPIPoolExecutor(max_workers=max_workers, initializer=_init_worker, initargs=shared_state)
+
+
+class DaskEquilibriumExecutor(EquilibriumExecutor):
+    """
+    Solve tasks on a Dask cluster, with dask.distributed.
+
+    The shared state is scattered to every worker once, and tasks (with their
+    slice of the starting point) are submitted individually, so the scheduler
+    balances them across workers.
+
+    Parameters
+    ----------
+    client : Optional[distributed.Client]
+        Client of the cluster. Defaults to the current client.
+    tasks_per_worker : Optional[int]
+        Number of tasks per worker of the cluster.
+    """
+    def __init__(self, client=None, tasks_per_worker=None):
+        try:
+            import distributed
+        except ImportError:
+            raise ImportError('DaskEquilibriumExecutor requires dask.distributed')
+        self.client = client if client is not None else distributed.get_client()
+        if tasks_per_worker is not None:
+            self.tasks_per_worker = tasks_per_worker
+
+    def num_workers(self):
+        return max(len(self.client.scheduler_info()['workers']), 1)
+
+    def run(self, shared_state, tasks):
+        from distributed import as_completed as dask_as_completed
+        # A list is scattered element-wise, so the state is wrapped to scatter it as one object
+        [shared_future] = self.client.scatter([shared_state], broadcast=True, hash=False)
+        futures = [self.client.submit(_solve_points, shared_future, task, pure=False) for task in tasks]
+        try:
+            for future in dask_as_completed(futures):
+                yield future.result()
+        finally:
+            self.client.cancel(futures + [shared_future])
+
+
+def _solve_eq_at_conditions_parallel(properties, phase_records, grid, conds_keys, state_variables, verbose,
+                                     solver=None, workers=None, continuation=False, executor=None,
+                                     point_indices=None):
+    """
+    Compute equilibrium for the given conditions, splitting the condition grid
+    into tasks that are solved concurrently by a pool of worker processes or
+    another executor backend.
+
+    Parameters
+    ----------
+    properties : LightDataset
+        Will be modified! Thermodynamic properties and conditions.
+    phase_records : dict of PhaseRecord
+        Details on phase callables.
+    grid : LightDataset
+        Sample of energy landscape of the system.
+    conds_keys : List[str]
+        List of conditions sorted in dimension order.
+    state_variables : List[v.StateVariable]
+        List of state variables sorted in dimension order.
+    verbose : bool
+        Print details.
+    solver : pycalphad.core.solver.SolverBase
+        Instance of a SolverBase subclass. If None is supplied, defaults to a Solver.
+        Must be picklable.
+    workers : Optional[int]
+        Number of worker processes. None means one and -1 means one per CPU.
+        Ignored if executor is given.
+    continuation : Optional[bool]
+        If True, warm-start each point from a converged neighbor.
+        Neighbors are only taken from the same task.
+    executor : Optional[EquilibriumExecutor]
+        Backend solving the tasks, e.g., a `DaskEquilibriumExecutor` or `MPIEquilibriumExecutor`.
+        Defaults to a `ProcessPoolEquilibriumExecutor` with `workers` processes.
+    point_indices : Optional[ArrayLike[int]]
+        Flat (C-order) indices into the condition grid of the points to solve.
+        If None is supplied, every point in the condition grid is solved.
+
+    Returns
+    -------
+    properties : LightDataset
+        Modified with equilibrium values.
+
+    Notes
+    -----
+    PhaseRecords and the grid are pickled once per worker process, so the
+    callables must have been built with a picklable backend (the default LLVM
+    backend is picklable). Each task only carries the part of the starting
+    point that contains its points.
+    """
+    if executor is None:
+        workers = resolve_workers(workers)
+        executor = ProcessPoolEquilibriumExecutor(workers) if workers > 1 else None
+    num_points = properties.GM.size if point_indices is None else len(point_indices)
+    if (executor is None) or (num_points <= 1):
+        return _solve_eq_at_conditions(properties, phase_records, grid, conds_keys, state_variables,
+                                       verbose, solver=solver, point_indices=point_indices,
+                                       continuation=continuation)
+    if (solver is not None) and solver.diagnostics:
+        # Workers return the diagnostics of their points, which are scattered into these variables
+        add_diagnostic_variables(properties, conds_keys)
+    tasks = partition_conditions(properties, executor.num_workers() * executor.tasks_per_worker,
+                                 point_indices=point_indices)
+    tasks = [_slice_points(properties, conds_keys, task) for task in tasks]
+    shared_state = (phase_records, grid, conds_keys, state_variables, verbose, solver, continuation)
+    for point_indices, point_values in executor.run(shared_state, tasks):
+        _scatter_points(properties, point_indices, point_values)
+    return properties
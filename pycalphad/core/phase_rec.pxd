@@ -11,6 +11,7 @@ cdef class FastFunction:
     cdef math_function_t f_ptr
     cdef void *func_data
     cdef void call(self, double *out, double *inp) nogil
+    cdef void call_2d(self, double *out, size_t out_stride, double *inp, size_t inp_stride, size_t num_points) nogil
 
 @cython.final
 cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordObject]:
@@ -18,6 +19,7 @@ cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordOb
     cdef FastFunction _formulaobj
     cdef FastFunction _formulagrad
     cdef FastFunction _formulahess
+    cdef FastFunction _formulafused
     cdef FastFunction _internal_cons_func
     cdef FastFunction _internal_cons_jac
     cdef FastFunction _internal_cons_hess
@@ -44,20 +46,28 @@ cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordOb
     cpdef void obj_2d(self, double[::1] out, double[:, ::1] dof) nogil
     cpdef void obj_parameters_2d(self, double[:, ::1] out, double[:, ::1] dof, double[:, ::1] parameters) nogil
     cpdef void formulagrad(self, double[::1] out, double[::1] dof) nogil
+    cpdef void formulagrad_2d(self, double[:, ::1] out, double[:, ::1] dof) nogil
     cpdef void formulahess(self, double[:,::1] out, double[::1] dof) nogil
+    cpdef void formulahess_2d(self, double[:, :, ::1] out, double[:, ::1] dof) nogil
+    cpdef void formula_obj_grad_hess(self, double[::1] obj_out, double[::1] grad_out, double[:, ::1] hess_out, double[::1] dof) nogil
+    cdef void _call_fused(self, double* obj_out, double* grad_out, double* hess_out, double* inp) nogil
     cpdef void internal_cons_func(self, double[::1] out, double[::1] dof) nogil
     cpdef void internal_cons_jac(self, double[:,::1] out, double[::1] dof) nogil
+    cpdef void internal_cons_jac_2d(self, double[:, :, ::1] out, double[:, ::1] dof) nogil
     cpdef void internal_cons_hess(self, double[:,:,::1] out, double[::1] dof) nogil
     cpdef void mass_obj(self, double[::1] out, double[::1] dof, int comp_idx) nogil
     cpdef void mass_obj_2d(self, double[::1] out, double[:, ::1] dof, int comp_idx) nogil
     cpdef void formulamole_obj(self, double[::1] out, double[::1] dof, int comp_idx) nogil
     cpdef void formulamole_grad(self, double[::1] out, double[::1] dof, int comp_idx) nogil
+    cpdef void formulamole_grad_2d(self, double[:, ::1] out, double[:, ::1] dof, int comp_idx) nogil
     cpdef void formulamole_hess(self, double[:,::1] out, double[::1] dof, int comp_idx) nogil
+    cpdef void formulamole_hess_2d(self, double[:, :, ::1] out, double[:, ::1] dof, int comp_idx) nogil
     # Used only to reconstitute if pickled (i.e. via __reduce__)
     cdef public object ofunc_
     cdef public object formulaofunc_
     cdef public object formulagfunc_
     cdef public object formulahfunc_
+    cdef public object formulafusedfunc_
     cdef public object internal_cons_func_
     cdef public object internal_cons_jac_
     cdef public object internal_cons_hess_
@@ -2,6 +2,8 @@
 
 cimport cython
 from libc.stdlib cimport malloc, free
+from libc.string cimport memcpy
+from libc.math cimport NAN
 import numpy as np
 cimport numpy as np
 import pycalphad.variables as v
@@ -27,43 +29,49 @@ cdef class FastFunction:
     cdef void call(self, double *out, double *inp) nogil:
         if self.f_ptr != NULL:
             self.f_ptr(out, inp, self.func_data)
+    cdef void call_2d(self, double *out, size_t out_stride, double *inp, size_t inp_stride, size_t num_points) nogil:
+        """Evaluate num_points inputs stored inp_stride apart, writing outputs out_stride apart.
+        Points are evaluated one at a time by the scalar kernel. The 2-D PhaseRecord methods
+        all dispatch through here, so this is the single place a vectorized backend would go."""
+        # TODO: Evaluate blocks of points with a SIMD (structure-of-arrays) kernel.
+        # That needs the code generator to emit a batched entry point, which it does not yet do.
+        cdef size_t i
+        if self.f_ptr == NULL:
+            return
+        for i in range(num_points):
+            self.f_ptr(&out[i * out_stride], &inp[i * inp_stride], self.func_data)
 
-@cython.boundscheck(False)
-@cython.wraparound(False)
-cdef double* alloc_dof_with_parameters(double[::1] dof, double[::1] parameters) nogil:
-    """Remember to free() if parameters.shape[0] > 0"""
-    cdef double* dof_concat
-    cdef int j
-    cdef int num_dof = dof.shape[0] + parameters.shape[0]
+cdef enum:
+    # Inputs (dof followed by parameters) up to this size are assembled in a buffer on the stack
+    DOF_SCRATCH_SIZE = 512
+    # Outputs of the fused function (objective, gradient and Hessian) up to this size are written on the stack
+    FUSED_SCRATCH_SIZE = 2048
+
+cdef inline double* acquire_scratch(size_t num_vars, double[::1] parameters, double* stack_scratch) nogil:
+    """Return a buffer large enough for dof followed by parameters, or NULL if there are no parameters.
+    stack_scratch (of size DOF_SCRATCH_SIZE) is used when it is large enough; otherwise the buffer is allocated.
+    Release with release_scratch()."""
+    cdef size_t num_inps = num_vars + parameters.shape[0]
     if parameters.shape[0] == 0:
-        dof_concat = &dof[0]
-    else:
-        dof_concat = <double *> malloc(num_dof * sizeof(double))
-        for j in range(0,dof.shape[0]):
-            dof_concat[j] = dof[j]
-        for j in range(dof.shape[0], num_dof):
-            dof_concat[j] = parameters[j - dof.shape[0]]
-    return dof_concat
+        return NULL
+    if num_inps <= DOF_SCRATCH_SIZE:
+        return stack_scratch
+    return <double *> malloc(num_inps * sizeof(double))
+
+cdef inline void release_scratch(double* scratch, double* stack_scratch) nogil:
+    if (scratch != NULL) and (scratch != stack_scratch):
+        free(scratch)
 
 @cython.boundscheck(False)
 @cython.wraparound(False)
-cdef double* alloc_dof_with_parameters_vectorized(double[:, ::1] dof, double[::1] parameters) nogil:
-    """Remember to free() if parameters.shape[0] > 0"""
-    cdef double* dof_concat
-    cdef int i, j
-    cdef int num_inps = dof.shape[0]
-    cdef int num_dof = dof.shape[1] + parameters.shape[0]
-
+cdef inline double* dof_with_parameters(double* dof, size_t num_vars, double[::1] parameters, double* scratch) nogil:
+    """Return a pointer to dof followed by parameters.
+    If there are parameters, both are copied into scratch from acquire_scratch()."""
     if parameters.shape[0] == 0:
-        dof_concat = &dof[0, 0]
-    else:
-        dof_concat = <double *> malloc(num_inps * num_dof * sizeof(double))
-        for i in range(num_inps):
-            for j in range(0,dof.shape[1]):
-                dof_concat[i * num_dof + j] = dof[i, j]
-            for j in range(dof.shape[1], num_dof):
-                dof_concat[i * num_dof + j] = parameters[j - dof.shape[1]]
-    return dof_concat
+        return dof
+    memcpy(scratch, dof, num_vars * sizeof(double))
+    memcpy(&scratch[num_vars], &parameters[0], parameters.shape[0] * sizeof(double))
+    return scratch
 
 
 cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordObject]:
@@ -78,7 +86,7 @@ cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordOb
                                  self.massfuncs_,
                                  self.formulamolefuncs_, self.formulamolegradfuncs_, self.formulamolehessianfuncs_,
                                  self.internal_cons_func_, self.internal_cons_jac_, self.internal_cons_hess_,
-                                 self.num_internal_cons)
+                                 self.num_internal_cons, self.formulafusedfunc_)
 
     def __cinit__(self, object comps, object state_variables, object variables,
                   double[::1] parameters, object ofunc,
@@ -86,7 +94,7 @@ cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordOb
                   object massfuncs,
                   object formulamolefuncs, object formulamolegradfuncs, object formulamolehessianfuncs,
                   object internal_cons_func, object internal_cons_jac, object internal_cons_hess,
-                  size_t num_internal_cons):
+                  size_t num_internal_cons, object formulafusedfunc=None):
         cdef:
             int var_idx, el_idx
         self.components = comps
@@ -115,6 +123,7 @@ cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordOb
         self.formulaofunc_ = formulaofunc
         self.formulagfunc_ = formulagfunc
         self.formulahfunc_ = formulahfunc
+        self.formulafusedfunc_ = formulafusedfunc
         self.internal_cons_func_ = internal_cons_func
         self.internal_cons_jac_ = internal_cons_jac
         self.internal_cons_hess_ = internal_cons_hess
@@ -127,10 +136,10 @@ cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordOb
             self._obj = FastFunction(ofunc)
         if formulaofunc is not None:
             self._formulaobj = FastFunction(formulaofunc)
-        if formulagfunc is not None:
-            self._formulagrad = FastFunction(formulagfunc)
-        if formulahfunc is not None:
-            self._formulahess = FastFunction(formulahfunc)
+        # Always set (with a NULL function pointer if missing), so methods can fall back to the fused function
+        self._formulagrad = FastFunction(formulagfunc)
+        self._formulahess = FastFunction(formulahfunc)
+        self._formulafused = FastFunction(formulafusedfunc)
         if internal_cons_func is not None:
             self._internal_cons_func = FastFunction(internal_cons_func)
         if internal_cons_jac is not None:
@@ -158,38 +167,60 @@ cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordOb
                 self._formulamolehessians[el_idx] = FastFunction(formulamolehessianfuncs[el_idx])
             self._formulamolehessians_ptr = <void**> self._formulamolehessians.data
 
+    def with_objective(self, object ofunc):
+        """
+        Return a PhaseRecord with ofunc as its objective function.
+        Every other function is shared with this PhaseRecord, so only the objective needs to be compiled.
+        """
+        return PhaseRecord(self.components, self.state_variables, self.variables, np.array(self.parameters),
+                           ofunc,
+                           self.formulaofunc_, self.formulagfunc_, self.formulahfunc_,
+                           self.massfuncs_,
+                           self.formulamolefuncs_, self.formulamolegradfuncs_, self.formulamolehessianfuncs_,
+                           self.internal_cons_func_, self.internal_cons_jac_, self.internal_cons_hess_,
+                           self.num_internal_cons, self.formulafusedfunc_)
+
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void obj(self, double[::1] outp, double[::1] dof) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        cdef int num_dof = self.num_statevars + self.phase_dof + self.parameters.shape[0]
-        self._obj.call(&outp[0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        self._obj.call(&outp[0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void formulaobj(self, double[::1] outp, double[::1] dof) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        cdef int num_dof = self.num_statevars + self.phase_dof + self.parameters.shape[0]
-        self._formulaobj.call(&outp[0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        self._formulaobj.call(&outp[0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void obj_2d(self, double[::1] outp, double[:, ::1] dof) nogil:
+        """
+        Calculate the objective function at each row of dof.
+        Rows are evaluated one after another by the scalar kernel (see FastFunction.call_2d).
+        """
         # dof.shape[1] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters_vectorized(dof[:, :self.num_statevars+self.phase_dof], self.parameters)
-        cdef int i
-        cdef int num_inps = dof.shape[0]
-        cdef int num_dof = self.num_statevars + self.phase_dof + self.parameters.shape[0]
-        for i in range(num_inps):
-            self._obj.call(&outp[i], &dof_concat[i * num_dof])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t i
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch
+        if dof.shape[0] == 0:
+            return
+        if self.parameters.shape[0] == 0:
+            self._obj.call_2d(&outp[0], 1, &dof[0, 0], dof.shape[1], dof.shape[0])
+            return
+        scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        for i in range(<size_t>dof.shape[0]):
+            self._obj.call(&outp[i], dof_with_parameters(&dof[i, 0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
@@ -201,118 +232,321 @@ cdef public class PhaseRecord(object)[type PhaseRecordType, object PhaseRecordOb
         Then outp.shape = (M,N)
         """
         # dof.shape[1] may be oversized by the caller; do not trust it
-        cdef size_t i, j, dof_idx, param_idx
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t i, j
         cdef size_t num_dof_inps = dof.shape[0]
         cdef size_t num_param_inps = parameters.shape[0]
         # We are trusting parameters.shape[1] to be sized correctly here
         cdef size_t num_params = parameters.shape[1]
-        cdef size_t num_dof = self.num_statevars + self.phase_dof + num_params
         cdef size_t dof_offset = self.num_statevars + self.phase_dof
-        cdef double* dof_concat = <double *> malloc(num_param_inps * num_dof * sizeof(double))
+        cdef size_t num_dof = dof_offset + num_params
+        cdef double* dof_concat = stack_scratch
+        if num_dof > DOF_SCRATCH_SIZE:
+            dof_concat = <double *> malloc(num_dof * sizeof(double))
         for i in range(num_dof_inps):
-            # Initialize all parameter arrays with current dof
+            memcpy(dof_concat, &dof[i, 0], dof_offset * sizeof(double))
             for j in range(num_param_inps):
-                for dof_idx in range(num_dof-num_params):
-                    dof_concat[j * num_dof + dof_idx] = dof[i, dof_idx]
-                for param_idx in range(num_params):
-                    dof_concat[j * num_dof + dof_offset + param_idx] = parameters[j, param_idx]
-            for j in range(num_param_inps):
-                self._obj.call(&outp[i,j], &dof_concat[j * num_dof])
-        free(dof_concat)
+                if num_params > 0:
+                    memcpy(&dof_concat[dof_offset], &parameters[j, 0], num_params * sizeof(double))
+                self._obj.call(&outp[i,j], dof_concat)
+        if dof_concat != stack_scratch:
+            free(dof_concat)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void formulagrad(self, double[::1] out, double[::1] dof) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        self._formulagrad.call(&out[0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        if self._formulagrad.f_ptr == NULL:
+            self._call_fused(NULL, &out[0], NULL, dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        else:
+            self._formulagrad.call(&out[0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cpdef void formulagrad_2d(self, double[:, ::1] out, double[:, ::1] dof) nogil:
+        """
+        Calculate the gradient of the objective per formula unit for each row of dof.
+        out.shape = (dof.shape[0], num_statevars+phase_dof)
+        """
+        # dof.shape[1] may be oversized by the caller; do not trust it
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t i
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch
+        if dof.shape[0] == 0:
+            return
+        if self._formulagrad.f_ptr == NULL:
+            scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+            for i in range(<size_t>dof.shape[0]):
+                self._call_fused(NULL, &out[i, 0], NULL, dof_with_parameters(&dof[i, 0], num_vars, self.parameters, scratch))
+            release_scratch(scratch, stack_scratch)
+            return
+        if self.parameters.shape[0] == 0:
+            self._formulagrad.call_2d(&out[0, 0], out.shape[1], &dof[0, 0], dof.shape[1], dof.shape[0])
+            return
+        scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        for i in range(<size_t>dof.shape[0]):
+            self._formulagrad.call(&out[i, 0], dof_with_parameters(&dof[i, 0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void formulahess(self, double[:, ::1] out, double[::1] dof) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        self._formulahess.call(&out[0,0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        if self._formulahess.f_ptr == NULL:
+            self._call_fused(NULL, NULL, &out[0, 0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        else:
+            self._formulahess.call(&out[0,0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cpdef void formula_obj_grad_hess(self, double[::1] obj_out, double[::1] grad_out, double[:, ::1] hess_out,
+                                     double[::1] dof) nogil:
+        """
+        Calculate the objective per formula unit, its gradient and its Hessian together.
+        With a fused function, this is a single call sharing all common subexpressions.
+        """
+        # dof.shape[0] may be oversized by the caller; do not trust it
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        cdef double* inp = dof_with_parameters(&dof[0], num_vars, self.parameters, scratch)
+        if self._formulafused.f_ptr != NULL:
+            self._call_fused(&obj_out[0], &grad_out[0], &hess_out[0, 0], inp)
+        else:
+            self._formulaobj.call(&obj_out[0], inp)
+            self._formulagrad.call(&grad_out[0], inp)
+            self._formulahess.call(&hess_out[0, 0], inp)
+        release_scratch(scratch, stack_scratch)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cdef void _call_fused(self, double* obj_out, double* grad_out, double* hess_out, double* inp) nogil:
+        """Evaluate the fused function at inp (dof followed by parameters), copying the outputs that are not NULL.
+        The outputs are first written to a buffer of this call (on the stack when small enough, as for the
+        inputs), so concurrent calls, e.g., from threads solving different points, do not share state."""
+        cdef double stack_out[FUSED_SCRATCH_SIZE]
+        cdef size_t i
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef size_t num_outs = 1 + num_vars + num_vars * num_vars
+        cdef double* fused_out = stack_out
+        if self._formulafused.f_ptr == NULL:
+            return
+        if num_outs > FUSED_SCRATCH_SIZE:
+            fused_out = <double *> malloc(num_outs * sizeof(double))
+            if fused_out == NULL:
+                # No exception can be raised without the GIL; make the failure visible in the outputs
+                if obj_out != NULL:
+                    obj_out[0] = NAN
+                for i in range(num_vars):
+                    if grad_out != NULL:
+                        grad_out[i] = NAN
+                for i in range(num_vars * num_vars):
+                    if hess_out != NULL:
+                        hess_out[i] = NAN
+                return
+        self._formulafused.call(fused_out, inp)
+        if obj_out != NULL:
+            obj_out[0] = fused_out[0]
+        if grad_out != NULL:
+            memcpy(grad_out, &fused_out[1], num_vars * sizeof(double))
+        if hess_out != NULL:
+            memcpy(hess_out, &fused_out[1 + num_vars], num_vars * num_vars * sizeof(double))
+        if fused_out != stack_out:
+            free(fused_out)
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cpdef void formulahess_2d(self, double[:, :, ::1] out, double[:, ::1] dof) nogil:
+        """
+        Calculate the Hessian of the objective per formula unit for each row of dof.
+        out.shape = (dof.shape[0], num_statevars+phase_dof, num_statevars+phase_dof)
+        """
+        # dof.shape[1] may be oversized by the caller; do not trust it
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t i
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch
+        if dof.shape[0] == 0:
+            return
+        if self._formulahess.f_ptr == NULL:
+            scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+            for i in range(<size_t>dof.shape[0]):
+                self._call_fused(NULL, NULL, &out[i, 0, 0], dof_with_parameters(&dof[i, 0], num_vars, self.parameters, scratch))
+            release_scratch(scratch, stack_scratch)
+            return
+        if self.parameters.shape[0] == 0:
+            self._formulahess.call_2d(&out[0, 0, 0], out.shape[1] * out.shape[2], &dof[0, 0], dof.shape[1], dof.shape[0])
+            return
+        scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        for i in range(<size_t>dof.shape[0]):
+            self._formulahess.call(&out[i, 0, 0], dof_with_parameters(&dof[i, 0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void internal_cons_func(self, double[::1] out, double[::1] dof) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        self._internal_cons_func.call(&out[0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        self._internal_cons_func.call(&out[0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void internal_cons_jac(self, double[:, ::1] out, double[::1] dof) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        self._internal_cons_jac.call(&out[0, 0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        self._internal_cons_jac.call(&out[0, 0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cpdef void internal_cons_jac_2d(self, double[:, :, ::1] out, double[:, ::1] dof) nogil:
+        """
+        Calculate the Jacobian of the internal constraints for each row of dof.
+        out.shape = (dof.shape[0], num_internal_cons, num_statevars+phase_dof)
+        """
+        # dof.shape[1] may be oversized by the caller; do not trust it
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t i
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch
+        if self.num_internal_cons == 0:
+            return
+        if dof.shape[0] == 0:
+            return
+        if self.parameters.shape[0] == 0:
+            self._internal_cons_jac.call_2d(&out[0, 0, 0], out.shape[1] * out.shape[2], &dof[0, 0], dof.shape[1], dof.shape[0])
+            return
+        scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        for i in range(<size_t>dof.shape[0]):
+            self._internal_cons_jac.call(&out[i, 0, 0], dof_with_parameters(&dof[i, 0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void internal_cons_hess(self, double[:, :, ::1] out, double[::1] dof) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        self._internal_cons_hess.call(&out[0, 0, 0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        self._internal_cons_hess.call(&out[0, 0, 0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void mass_obj(self, double[::1] out, double[::1] dof, int comp_idx) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        (<FastFunction>self._masses_ptr[comp_idx]).call(&out[0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        (<FastFunction>self._masses_ptr[comp_idx]).call(&out[0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void mass_obj_2d(self, double[::1] out, double[:, ::1] dof, int comp_idx) nogil:
+        """
+        Calculate the moles of component comp_idx at each row of dof.
+        Rows are evaluated one after another by the scalar kernel (see FastFunction.call_2d).
+        """
         # dof.shape[1] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters_vectorized(dof[:, :self.num_statevars+self.phase_dof], self.parameters)
-        cdef int i
-        cdef int num_inps = dof.shape[0]
-        cdef int num_dof = self.num_statevars + self.phase_dof + self.parameters.shape[0]
-        for i in range(num_inps):
-            (<FastFunction>self._masses_ptr[comp_idx]).call(&out[i], &dof_concat[i * num_dof])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t i
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch
+        if dof.shape[0] == 0:
+            return
+        if self.parameters.shape[0] == 0:
+            (<FastFunction>self._masses_ptr[comp_idx]).call_2d(&out[0], 1, &dof[0, 0], dof.shape[1], dof.shape[0])
+            return
+        scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        for i in range(<size_t>dof.shape[0]):
+            (<FastFunction>self._masses_ptr[comp_idx]).call(&out[i], dof_with_parameters(&dof[i, 0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void formulamole_obj(self, double[::1] out, double[::1] dof, int comp_idx) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        (<FastFunction>self._formulamoles_ptr[comp_idx]).call(&out[0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        (<FastFunction>self._formulamoles_ptr[comp_idx]).call(&out[0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void formulamole_grad(self, double[::1] out, double[::1] dof, int comp_idx) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        (<FastFunction>self._formulamolegrads_ptr[comp_idx]).call(&out[0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        (<FastFunction>self._formulamolegrads_ptr[comp_idx]).call(&out[0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cpdef void formulamole_grad_2d(self, double[:, ::1] out, double[:, ::1] dof, int comp_idx) nogil:
+        """
+        Calculate the gradient of the moles of a component per formula unit for each row of dof.
+        out.shape = (dof.shape[0], num_statevars+phase_dof)
+        """
+        # dof.shape[1] may be oversized by the caller; do not trust it
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t i
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch
+        if dof.shape[0] == 0:
+            return
+        if self.parameters.shape[0] == 0:
+            (<FastFunction>self._formulamolegrads_ptr[comp_idx]).call_2d(&out[0, 0], out.shape[1], &dof[0, 0], dof.shape[1], dof.shape[0])
+            return
+        scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        for i in range(<size_t>dof.shape[0]):
+            (<FastFunction>self._formulamolegrads_ptr[comp_idx]).call(&out[i, 0], dof_with_parameters(&dof[i, 0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
     @cython.boundscheck(False)
     @cython.wraparound(False)
     cpdef void formulamole_hess(self, double[:,::1] out, double[::1] dof, int comp_idx) nogil:
         # dof.shape[0] may be oversized by the caller; do not trust it
-        cdef double* dof_concat = alloc_dof_with_parameters(dof[:self.num_statevars+self.phase_dof], self.parameters)
-        (<FastFunction>self._formulamolehessians_ptr[comp_idx]).call(&out[0,0], &dof_concat[0])
-        if self.parameters.shape[0] > 0:
-            free(dof_concat)
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        (<FastFunction>self._formulamolehessians_ptr[comp_idx]).call(&out[0,0], dof_with_parameters(&dof[0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cpdef void formulamole_hess_2d(self, double[:, :, ::1] out, double[:, ::1] dof, int comp_idx) nogil:
+        """
+        Calculate the Hessian of the moles of a component per formula unit for each row of dof.
+        out.shape = (dof.shape[0], num_statevars+phase_dof, num_statevars+phase_dof)
+        """
+        # dof.shape[1] may be oversized by the caller; do not trust it
+        cdef double stack_scratch[DOF_SCRATCH_SIZE]
+        cdef size_t i
+        cdef size_t num_vars = self.num_statevars + self.phase_dof
+        cdef double* scratch
+        if dof.shape[0] == 0:
+            return
+        if self.parameters.shape[0] == 0:
+            (<FastFunction>self._formulamolehessians_ptr[comp_idx]).call_2d(&out[0, 0, 0], out.shape[1] * out.shape[2], &dof[0, 0], dof.shape[1], dof.shape[0])
+            return
+        scratch = acquire_scratch(num_vars, self.parameters, stack_scratch)
+        for i in range(<size_t>dof.shape[0]):
+            (<FastFunction>self._formulamolehessians_ptr[comp_idx]).call(&out[i, 0, 0], dof_with_parameters(&dof[i, 0], num_vars, self.parameters, scratch))
+        release_scratch(scratch, stack_scratch)
@@ -0,0 +1,294 @@
+"""
+The prepared_system module contains a container for repeatedly evaluating a
+system whose only changes between calculations are numeric parameter values,
+e.g., inside an optimizer loop of a parameter fitting workflow.
+"""
+
+import warnings
+from collections import OrderedDict
+from datetime import datetime
+import numpy as np
+import pycalphad.variables as v
+from pycalphad import ConditionError
+from pycalphad.codegen.callables import build_phase_records
+from pycalphad.core.calculate import _compute_phase_values, _concatenate_phase_values, \
+    _sample_phase_constitution
+from pycalphad.core.equilibrium import _adjust_conditions, _eqcalculate_outputs
+from pycalphad.core.light_dataset import LightDataset
+from pycalphad.core.parallel import _solve_eq_at_conditions_parallel
+from pycalphad.core.solver import Solver
+from pycalphad.core.starting_point import starting_point
+from pycalphad.core.utils import extract_parameters, filter_phases, get_pure_elements, get_state_variables, \
+    instantiate_models, point_sample, unpack_components, unpack_condition, unpack_kwarg, unpack_phases
+
+
+def _sample_grid(grid, sample_idx):
+    "Return the grid of one parameter vector of a batched grid from `PreparedSystem.calculate`, as views."
+    data_vars = {}
+    for var, (dims, values) in grid.data_vars.items():
+        if var == 'param_values':
+            continue
+        if 'samples' in dims:
+            values = values[(slice(None),) * list(dims).index('samples') + (sample_idx,)]
+            dims = [dim for dim in dims if dim != 'samples']
+        data_vars[var] = (dims, values)
+    coords = {key: values for key, values in grid.coords.items() if key != 'param_symbols'}
+    return LightDataset(data_vars, coords=coords, attrs=dict(grid.attrs))
+
+
+class PreparedSystem(object):
+    """
+    Models, PhaseRecords and sampled internal degrees of freedom of a system,
+    built once so that energies and equilibria can be recomputed for new
+    parameter values without re-instantiating models, rebuilding callables or
+    resampling the grid.
+
+    Parameters
+    ----------
+    dbf : Database
+        Thermodynamic database containing the relevant parameters.
+    comps : list
+        Names of components to consider in the calculation.
+    phases : list
+        Names of phases to consider in the calculation.
+    parameters : dict
+        Maps SymEngine Symbol (or str) to the initial value of each parameter
+        that will be changed between calculations.
+    model : Model, a dict of phase names to Model, or a seq of both, optional
+        Model class to use for each phase.
+    state_variables : Optional[Iterable[v.StateVariable]]
+        State variables of the callables, in addition to those of the models. Defaults to N, P and T.
+    pdens : int, a dict of phase names to int, or a seq of both, optional
+        Number of points to sample per degree of freedom. Default: 60, the
+        same as the grid used by `equilibrium`.
+    points : ndarray or a dict of phase names to ndarray, optional
+        Columns of ndarrays must be internal degrees of freedom (site fractions), sorted.
+        If this is not specified, points will be generated automatically.
+    sampler : callable, a dict of phase names to callable, or a seq of both, optional
+        Function to sample phase constitution space.
+    grid_points : bool, a dict of phase names to bool, or a seq of both, optional (Default: True)
+        Whether to add evenly spaced points between end-members.
+    verbose : bool, optional
+        Print the name of each phase when its callables are built.
+
+    Attributes
+    ----------
+    parameter_symbols : List[symengine.Symbol]
+        Parameters, sorted. Parameter vectors passed to the methods follow this order.
+    state_variables : List[v.StateVariable]
+        State variables of the PhaseRecords, sorted.
+    models : Dict[str, Model]
+    phase_records : Dict[str, PhaseRecord]
+    points : Dict[str, ndarray]
+        Sampled internal degrees of freedom of each phase.
+
+    Examples
+    --------
+    >>> from pycalphad import Database, variables as v  # doctest: +SKIP
+    >>> from pycalphad.core.prepared_system import PreparedSystem  # doctest: +SKIP
+    >>> dbf = Database('cumg_parameters.tdb')  # doctest: +SKIP
+    >>> prepared = PreparedSystem(dbf, ['CU', 'MG'], ['HCP_A3'], {'VV0000': -32539.5})  # doctest: +SKIP
+    >>> res = prepared.calculate([[-33000.0], [-32000.0]], T=743.15, P=1e5)  # doctest: +SKIP
+    """
+    def __init__(self, dbf, comps, phases, parameters, model=None, state_variables=None,
+                 pdens=60, points=None, sampler=None, grid_points=True, verbose=False):
+        comps = sorted(unpack_components(dbf, comps))
+        phases = unpack_phases(phases) or sorted(dbf.phases.keys())
+        active_phases = sorted(filter_phases(dbf, comps, phases))
+        if len(active_phases) == 0:
+            raise ConditionError('None of the passed phases ({0}) are active. List of possible phases: {1}.'
+                                 .format(phases, filter_phases(dbf, comps)))
+        if len(parameters) == 0:
+            raise ValueError('At least one parameter must be given to prepare a system')
+        parameters = OrderedDict(sorted(parameters.items(), key=str))
+        self.parameter_symbols, param_values = extract_parameters(parameters)
+        if param_values.shape[0] != 1:
+            raise ValueError('Initial parameters must have a single value each')
+        state_variables = state_variables if state_variables is not None else {v.N, v.P, v.T}
+        self.dbf = dbf
+        self.components = comps
+        self.phases = active_phases
+        self.nonvacant_components = [x for x in comps if x.number_of_atoms > 0]
+        self.nonvacant_elements = get_pure_elements(dbf, comps)
+        self.models = instantiate_models(dbf, comps, active_phases, model=model, parameters=parameters)
+        self.phase_records = build_phase_records(dbf, comps, active_phases, state_variables, self.models,
+                                                 output='GM', parameters=parameters, verbose=verbose,
+                                                 build_gradients=True, build_hessians=True)
+        # Includes any state variables of the models, in the order of the callables' inputs
+        self.state_variables = list(self.phase_records[active_phases[0]].state_variables)
+        pdens_dict = unpack_kwarg(pdens, default_arg=60)
+        points_dict = unpack_kwarg(points, default_arg=None)
+        sampler_dict = unpack_kwarg(sampler, default_arg=None)
+        fixedgrid_dict = unpack_kwarg(grid_points, default_arg=True)
+        self.points = {}
+        for phase_name in active_phases:
+            phase_points = points_dict[phase_name]
+            if phase_points is None:
+                phase_points = _sample_phase_constitution(self.models[phase_name],
+                                                          sampler_dict[phase_name] or point_sample,
+                                                          fixedgrid_dict[phase_name], pdens_dict[phase_name])
+            self.points[phase_name] = np.atleast_2d(phase_points)
+        self._maximum_internal_dof = max(len(self.models[phase_name].site_fractions) for phase_name in active_phases)
+        self.parameter_values = param_values[0]
+
+    def _parameter_array(self, parameter_values):
+        "Convert a parameter vector or a batch of parameter vectors to a C-contiguous 2-D array."
+        parameter_values = np.atleast_2d(np.ascontiguousarray(parameter_values, dtype=np.float64))
+        if (parameter_values.ndim != 2) or (parameter_values.shape[1] != len(self.parameter_symbols)):
+            raise ValueError('Parameter values must have shape ({0},) or (N, {0}), got {1}'
+                             .format(len(self.parameter_symbols), parameter_values.shape))
+        return parameter_values
+
+    def set_parameters(self, parameter_values):
+        """
+        Set the parameter values used by the PhaseRecords, e.g., by the equilibrium solver.
+
+        Parameters
+        ----------
+        parameter_values : ArrayLike
+            One value per parameter, in the order of `parameter_symbols`.
+        """
+        parameter_values = self._parameter_array(parameter_values)
+        if parameter_values.shape[0] != 1:
+            raise ValueError('Only a single parameter vector can be set at a time')
+        self.parameter_values = np.array(parameter_values[0])
+        for phase_record in self.phase_records.values():
+            phase_record.parameters = np.array(self.parameter_values)
+
+    def calculate(self, parameter_values, fake_points=False, **statevars):
+        """
+        Evaluate the Gibbs energy of the sampled points for one or more parameter vectors.
+
+        Parameters
+        ----------
+        parameter_values : ArrayLike
+            Parameter vector of shape (num_parameters,) or a batch of shape
+            (num_samples, num_parameters), in the order of `parameter_symbols`.
+            A batch is evaluated in a single pass over the points.
+        fake_points : bool, optional (Default: False)
+            If True, the first few points of the output surface will be fictitious
+            points used to define an equilibrium hyperplane guaranteed to be above
+            all the other points.
+        statevars
+            Values of the state variables, e.g. T=1000, P=101325.
+            They are broadcast against each other. N defaults to 1.
+
+        Returns
+        -------
+        LightDataset
+            Same structure as the result of `calculate` with `to_xarray=False`.
+            For a batch, GM has a trailing 'samples' dimension.
+        """
+        parameter_values = self._parameter_array(parameter_values)
+        statevars.setdefault('N', 1)
+        statevar_names = [str(x) for x in self.state_variables]
+        if set(statevars.keys()) != set(statevar_names):
+            raise ConditionError('State variables must be exactly {}, got {}'
+                                 .format(statevar_names, sorted(statevars.keys())))
+        str_statevar_dict = OrderedDict((name, unpack_condition(statevars[name])) for name in statevar_names)
+        parameters = OrderedDict(zip([str(x) for x in self.parameter_symbols], parameter_values.T))
+        all_phase_data = []
+        for phase_name in self.phases:
+            fp = fake_points and (phase_name == self.phases[0])
+            phase_ds = _compute_phase_values(self.nonvacant_components, str_statevar_dict,
+                                             self.points[phase_name], self.phase_records[phase_name], 'GM',
+                                             self._maximum_internal_dof, parameters=parameters,
+                                             largest_energy=1e10, fake_points=fp)
+            all_phase_data.append(phase_ds)
+        fp_offset = len(self.nonvacant_elements) if fake_points else 0
+        return _concatenate_phase_values(all_phase_data, self.phases, fp_offset)
+
+    def equilibrium(self, conditions, parameter_values, output=None, solver=None, verbose=False,
+                    to_xarray=True, workers=None, executor=None, **kwargs):
+        """
+        Compute equilibrium for one or more parameter vectors, reusing the
+        prepared models, PhaseRecords and sampled points.
+
+        The conditions are validated once, and the energies of the sampled
+        points are computed for every parameter vector in a single pass, as in
+        `calculate`. Only the starting point and the solver are run per vector.
+
+        Parameters
+        ----------
+        conditions : dict
+            StateVariables and their corresponding value. Every state variable
+            of the system must be given.
+        parameter_values : ArrayLike
+            Parameter vector of shape (num_parameters,) or a batch of shape
+            (num_samples, num_parameters), in the order of `parameter_symbols`.
+        output : str or list of str, optional
+            Additional equilibrium model properties (e.g., CPM, HM, etc.) to compute.
+        solver : pycalphad.core.solver.SolverBase, optional
+        verbose : bool, optional
+        to_xarray : bool, optional
+            If True (the default), return xarray Datasets rather than LightDatasets.
+        workers : int, optional
+            Number of worker processes solving the condition grid of each vector. See `equilibrium`.
+        executor : pycalphad.core.parallel.EquilibriumExecutor, optional
+            See `equilibrium`.
+
+        Returns
+        -------
+        Equilibrium result for a parameter vector, or a list of them for a batch.
+
+        Notes
+        -----
+        The PhaseRecords are set to each parameter vector while it is solved,
+        and are restored to their previous values afterwards.
+        """
+        batched = np.ndim(parameter_values) == 2
+        parameter_values = self._parameter_array(parameter_values)
+        if len(kwargs.pop('calc_opts', None) or {}) > 0:
+            raise ValueError('The grid of a PreparedSystem is fixed when it is prepared; calc_opts cannot be given')
+        solver = solver if solver is not None else Solver(verbose=verbose)
+        conditions = dict(conditions)
+        if conditions.get(v.N) is None:
+            conditions[v.N] = 1
+        if np.any(np.array(conditions[v.N]) != 1):
+            raise ConditionError('N!=1 is not yet supported, got N={}'.format(conditions[v.N]))
+        conds = _adjust_conditions(conditions)
+        for cond in conds.keys():
+            if isinstance(cond, (v.MoleFraction, v.ChemicalPotential)) and cond.species not in self.components:
+                raise ConditionError('{} refers to non-existent component'.format(cond))
+        str_conds = OrderedDict((str(key), value) for key, value in conds.items())
+        conds_keys = list(str_conds.keys())
+        state_variables = sorted(get_state_variables(models=self.models, conds=conds), key=str)
+        missing_statevars = sorted(str(x) for x in self.state_variables if str(x) not in str_conds)
+        if len(missing_statevars) > 0:
+            raise ConditionError('Conditions must include every state variable, missing {}'.format(missing_statevars))
+        output = output if output is not None else 'GM'
+        output = output if isinstance(output, (list, tuple, set)) else [output]
+        output = sorted(set(output) - {'GM', 'MU'})
+        output = [(out, out in ('degree_of_ordering', 'DOO')) for out in output if (out is not None) and (len(out) > 0)]
+        # Energies of every vector, in one pass over the points
+        batch_grid = self.calculate(parameter_values, fake_points=True,
+                                    **{str(x): str_conds[str(x)] for x in self.state_variables})
+        if parameter_values.shape[0] == 1:
+            grids = [batch_grid]
+        else:
+            grids = [_sample_grid(batch_grid, sample_idx) for sample_idx in range(parameter_values.shape[0])]
+        previous_values = np.array(self.parameter_values)
+        results = []
+        try:
+            for sample_values, grid in zip(parameter_values, grids):
+                self.set_parameters(sample_values)
+                properties = starting_point(conds, state_variables, self.phase_records, grid)
+                properties = _solve_eq_at_conditions_parallel(properties, self.phase_records, grid, conds_keys,
+                                                              state_variables, verbose, solver=solver,
+                                                              workers=workers, executor=executor)
+                if len(output) > 0:
+                    parameters = OrderedDict(zip([str(x) for x in self.parameter_symbols], sample_values))
+                    eqcal = _eqcalculate_outputs(output, properties, self.models, self.phase_records,
+                                                 parameters=parameters)
+                    properties = properties.merge(eqcal, inplace=True, compat='override')
+                if to_xarray:
+                    properties = properties.get_dataset()
+                properties.attrs['created'] = datetime.utcnow().isoformat()
+                results.append(properties)
+        finally:
+            self.set_parameters(previous_values)
+        if len(kwargs) > 0:
+            warnings.warn('The following equilibrium keyword arguments were passed, but unused:\n{}'.format(kwargs))
+        if batched:
+            return results
+        return results[0]
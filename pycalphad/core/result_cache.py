@@ -0,0 +1,351 @@
+"""
+The result_cache module reuses the equilibrium of condition points across
+calls to ``equilibrium``.
+
+Plots, fitting residuals and screening scripts often recompute the same points
+of the same system. A cache holds the solved values of every data variable of
+each point, keyed by a fingerprint of the system and the rounded values of
+the conditions at the point. Points of a condition grid found in the cache
+are not solved again, so overlapping grids only solve their new points::
+
+    from pycalphad.core.result_cache import EquilibriumResultCache
+    cache = EquilibriumResultCache(cache_dir='~/.cache/pycalphad-equilibria')
+    eq = equilibrium(dbf, comps, phases, conds, result_cache=cache)
+
+The in-memory cache is bounded and evicts the least recently used points.
+If a cache directory is given, the points solved by each call are also
+written to it, and are read back the first time their system is looked up
+(e.g., in a later process). The directory is bounded too: when a system has
+too many files or points, its files are compacted into one, keeping the most
+recently solved points.
+"""
+import itertools
+import os
+import pickle
+import tempfile
+import time
+import uuid
+from collections import OrderedDict
+import numpy as np
+from pycalphad.codegen import disk_cache
+
+# Increment when the layout of the cached entries changes
+RESULT_CACHE_FORMAT_VERSION = 1
+# Condition values are rounded to this many decimals in keys
+DEFAULT_CONDITION_DECIMALS = 10
+_BATCH_FILE_SUFFIX = '.pkl'
+# Batch files of a system are compacted into one when there are more than this many
+MAX_BATCH_FILES = 16
+
+
+def _solver_signature(solver):
+    "Return the class and options of a solver, which change the solution it converges to."
+    if solver is None:
+        return 'default'
+    # Private attributes (e.g., caches) do not change the solution
+    options = sorted((key, str(value)) for key, value in getattr(solver, '__dict__', {}).items()
+                     if (key != 'verbose') and not key.startswith('_'))
+    return [type(solver).__module__, type(solver).__qualname__, options]
+
+
+def system_fingerprint(comps, phases, models, conds_keys, parameters=None, solver=None, calc_opts=None,
+                       phase_records=None, **options):
+    """
+    Compute a stable key of everything, except the condition values, that the equilibrium of a point depends on.
+
+    Parameters
+    ----------
+    comps : list
+        Components of the calculation.
+    phases : list
+        Names of the active phases.
+    models : Dict[str, Model]
+        Instantiated models of every active phase. Their Gibbs energies include the Database parameters.
+    conds_keys : List[str]
+        Names of the conditions, in dimension order.
+    parameters : dict, optional
+        Maps SymEngine Symbol to numbers, for overriding the values of parameters in the Database.
+    solver : SolverBase, optional
+    calc_opts : dict, optional
+        Options of the grid the starting point is found on.
+    phase_records : Optional[Mapping[str, PhaseRecord]]
+        PhaseRecords passed by the caller. Their parameter values are part of the key,
+        because they can be changed in place without changing the models.
+    options
+        Other options of the calculation, e.g., continuation=True.
+
+    Returns
+    -------
+    str
+    """
+    parameters = parameters if parameters is not None else {}
+    calc_opts = calc_opts if calc_opts is not None else {}
+    phases = sorted(phases)
+    model_parts = [(name, type(models[name]).__module__, type(models[name]).__qualname__, models[name].GM)
+                   for name in phases]
+    parameter_parts = sorted((str(key), np.atleast_1d(value).tolist()) for key, value in parameters.items())
+    record_parts = None
+    if phase_records is not None:
+        record_parts = [(name, np.asarray(phase_records[name].parameters).tolist()) for name in phases]
+    calc_parts = sorted((str(key), str(value)) for key, value in calc_opts.items())
+    option_parts = sorted((str(key), str(value)) for key, value in options.items())
+    return disk_cache.make_key('equilibrium-result', RESULT_CACHE_FORMAT_VERSION, sorted(str(c) for c in comps),
+                               phases, model_parts, list(conds_keys), parameter_parts, record_parts,
+                               _solver_signature(solver), calc_parts, option_parts)
+
+
+class EquilibriumResultCache(object):
+    """
+    Bounded cache of the equilibria of condition points, in memory and optionally on disk.
+
+    Parameters
+    ----------
+    maxsize : int, optional
+        Maximum number of points held in memory.
+    cache_dir : Optional[str]
+        Directory the solved points are also written to. It is created if it does not exist.
+    max_disk_points : int, optional
+        Maximum number of points of each system kept in the cache directory.
+        The least recently solved points are removed when the batch files of a system are compacted.
+    decimals : int, optional
+        Condition values are rounded to this many decimals, so points of
+        grids constructed differently (e.g., with np.arange and np.linspace) match.
+
+    Attributes
+    ----------
+    hits : int
+        Number of points found in the cache.
+    misses : int
+        Number of points not found in the cache.
+    """
+    def __init__(self, maxsize=1000000, cache_dir=None, decimals=DEFAULT_CONDITION_DECIMALS,
+                 max_disk_points=1000000):
+        self.maxsize = maxsize
+        self.max_disk_points = max_disk_points
+        self.decimals = decimals
+        self.cache_dir = None
+        if cache_dir is not None:
+            self.cache_dir = os.path.abspath(os.path.expanduser(str(cache_dir)))
+            os.makedirs(self.cache_dir, exist_ok=True)
+        self._entries = OrderedDict()
+        self._loaded_systems = set()
+        self.hits = 0
+        self.misses = 0
+
+    def __len__(self):
+        return len(self._entries)
+
+    def _point_keys(self, properties, conds_keys):
+        "Keys of the points of a condition grid, in flat (C-order) index order."
+        coords = [np.round(np.asarray(properties.coords[key], dtype=np.float64), self.decimals).tolist()
+                  for key in conds_keys]
+        return list(itertools.product(*coords))
+
+    def _insert(self, key, values):
+        self._entries[key] = values
+        self._entries.move_to_end(key)
+        while len(self._entries) > self.maxsize:
+            self._entries.popitem(last=False)
+
+    def _system_dir(self, fingerprint):
+        return os.path.join(self.cache_dir, fingerprint)
+
+    def _batch_paths(self, fingerprint):
+        "Paths of the batch files of a system, oldest first."
+        system_dir = self._system_dir(fingerprint)
+        try:
+            names = [name for name in os.listdir(system_dir) if name.endswith(_BATCH_FILE_SUFFIX)]
+        except OSError:
+            return []
+        paths = []
+        for name in names:
+            path = os.path.join(system_dir, name)
+            try:
+                paths.append((os.path.getmtime(path), name, path))
+            except OSError:
+                # Removed by a concurrent compaction
+                continue
+        return [path for _, _, path in sorted(paths)]
+
+    @staticmethod
+    def _batch_size(path):
+        "Number of points of a batch file, from its name, or None if the name does not record it."
+        try:
+            return int(os.path.basename(path)[:-len(_BATCH_FILE_SUFFIX)].rsplit('-', 1)[1])
+        except (IndexError, ValueError):
+            return None
+
+    @staticmethod
+    def _read_batches(paths):
+        "Yield the point keys and values of each readable batch file, in order."
+        for path in paths:
+            try:
+                with open(path, 'rb') as fp:
+                    batch = pickle.load(fp)
+            except FileNotFoundError:
+                continue
+            except Exception:
+                # Unreadable batches (e.g., truncated) are removed, as in the callable cache
+                try:
+                    os.remove(path)
+                except OSError:
+                    pass
+                continue
+            yield batch['keys'], batch['values']
+
+    def _load_system(self, fingerprint):
+        "Read the points of a system written to the cache directory, once per system."
+        if (self.cache_dir is None) or (fingerprint in self._loaded_systems):
+            return
+        self._loaded_systems.add(fingerprint)
+        # Oldest batches first, so the most recently solved points are the most recently used
+        for point_keys, point_values in self._read_batches(self._batch_paths(fingerprint)):
+            for idx, point_key in enumerate(point_keys):
+                self._insert((fingerprint, tuple(point_key)),
+                             {var: vals[idx] for var, vals in point_values.items()})
+
+    def _write_batch(self, fingerprint, point_keys, point_values):
+        "Write points to a new file of the system directory, atomically. Return whether it was written."
+        system_dir = self._system_dir(fingerprint)
+        try:
+            os.makedirs(system_dir, exist_ok=True)
+            fd, tmp_path = tempfile.mkstemp(dir=system_dir, suffix='.tmp')
+        except OSError:
+            return False
+        try:
+            with os.fdopen(fd, 'wb') as fp:
+                pickle.dump({'keys': point_keys, 'values': point_values}, fp, protocol=pickle.HIGHEST_PROTOCOL)
+            # Names start with the time, which orders batches written within the resolution of mtime,
+            # and end with the number of points, so the size of the store is known without reading it
+            name = '{:020d}-{}-{}{}'.format(time.time_ns(), uuid.uuid4().hex, len(point_keys), _BATCH_FILE_SUFFIX)
+            os.replace(tmp_path, os.path.join(system_dir, name))
+        except OSError:
+            try:
+                os.remove(tmp_path)
+            except OSError:
+                pass
+            return False
+        return True
+
+    def _compact_system(self, fingerprint):
+        """
+        Merge the batch files of a system into one if there are too many files or points.
+
+        Points solved again are only kept once, and only the `max_disk_points`
+        most recently solved points are kept.
+        """
+        paths = self._batch_paths(fingerprint)
+        sizes = [self._batch_size(path) for path in paths]
+        if (len(paths) <= MAX_BATCH_FILES) and (None not in sizes) and (sum(sizes) <= self.max_disk_points):
+            return
+        points = OrderedDict()
+        for point_keys, point_values in self._read_batches(paths):
+            for idx, point_key in enumerate(point_keys):
+                point_key = tuple(point_key)
+                points[point_key] = {var: vals[idx] for var, vals in point_values.items()}
+                points.move_to_end(point_key)
+        while len(points) > self.max_disk_points:
+            points.popitem(last=False)
+        if len(points) > 0:
+            point_keys = list(points.keys())
+            point_values = {var: np.array([values[var] for values in points.values()])
+                            for var in next(iter(points.values())).keys()}
+            if not self._write_batch(fingerprint, point_keys, point_values):
+                return
+        # Only the files that were merged are removed; batches written concurrently are kept
+        for path in paths:
+            try:
+                os.remove(path)
+            except OSError:
+                pass
+
+    def lookup(self, fingerprint, properties, conds_keys):
+        """
+        Write the cached values of the points of a condition grid into properties.
+
+        Parameters
+        ----------
+        fingerprint : str
+            See `system_fingerprint`.
+        properties : LightDataset
+            Will be modified! Starting point of the calculation.
+        conds_keys : List[str]
+            Names of the conditions, in dimension order.
+
+        Returns
+        -------
+        ndarray
+            Flat indices of the points that were not found, and must be solved.
+        """
+        self._load_system(fingerprint)
+        grid_shape = properties.GM.shape
+        missing = []
+        for flat_idx, point_key in enumerate(self._point_keys(properties, conds_keys)):
+            values = self._entries.get((fingerprint, point_key))
+            if values is None:
+                missing.append(flat_idx)
+                continue
+            self._entries.move_to_end((fingerprint, point_key))
+            multi_index = np.unravel_index(flat_idx, grid_shape)
+            for var, vals in values.items():
+                properties.data_vars[var][1][multi_index] = vals
+        self.hits += properties.GM.size - len(missing)
+        self.misses += len(missing)
+        return np.array(missing, dtype=np.intp)
+
+    def store(self, fingerprint, properties, conds_keys, point_indices=None):
+        """
+        Add solved points of a condition grid to the cache.
+
+        Parameters
+        ----------
+        fingerprint : str
+            See `system_fingerprint`.
+        properties : LightDataset
+            Equilibrium result.
+        conds_keys : List[str]
+            Names of the conditions, in dimension order.
+        point_indices : Optional[ArrayLike[int]]
+            Flat indices of the points to add. Defaults to every point.
+        """
+        grid_shape = properties.GM.shape
+        if point_indices is None:
+            point_indices = np.arange(properties.GM.size, dtype=np.intp)
+        point_indices = np.asarray(point_indices, dtype=np.intp)
+        if point_indices.shape[0] == 0:
+            return
+        all_keys = self._point_keys(properties, conds_keys)
+        point_keys = [all_keys[flat_idx] for flat_idx in point_indices]
+        multi_index = np.unravel_index(point_indices, grid_shape)
+        # Copies, so cached values are not changed by later modifications of the result
+        point_values = {var: np.array(vals[multi_index]) for var, (dims, vals) in properties.data_vars.items()}
+        for idx, point_key in enumerate(point_keys):
+            self._insert((fingerprint, point_key), {var: vals[idx] for var, vals in point_values.items()})
+        if self.cache_dir is not None:
+            if self._write_batch(fingerprint, point_keys, point_values):
+                self._compact_system(fingerprint)
+
+    def clear(self, disk=False):
+        """
+        Remove every point from the cache.
+
+        Parameters
+        ----------
+        disk : bool, optional
+            If True, also remove the points written to the cache directory.
+        """
+        self._entries.clear()
+        self._loaded_systems.clear()
+        self.hits = 0
+        self.misses = 0
+        if disk and (self.cache_dir is not None):
+            for fingerprint in os.listdir(self.cache_dir):
+                system_dir = self._system_dir(fingerprint)
+                if not os.path.isdir(system_dir):
+                    continue
+                for name in os.listdir(system_dir):
+                    if name.endswith(_BATCH_FILE_SUFFIX):
+                        try:
+                            os.remove(os.path.join(system_dir, name))
+                        except OSError:
+                            pass
@@ -0,0 +1,252 @@
+"""
+The result_store module writes equilibrium results to disk in chunks of
+conditions as they are computed. Only the chunk being solved is held in
+memory, and an interrupted calculation can be resumed by skipping the
+chunks that are already stored.
+
+A store is a directory of .npy files, one per data variable, with the same
+dimensions and coordinates as the result of ``equilibrium``, and a JSON
+manifest recording the coordinates and the completed chunks::
+
+    from pycalphad.core.result_store import stream_equilibrium
+    eq = stream_equilibrium('AlZn_map', dbf, ['AL', 'ZN', 'VA'], ['LIQUID', 'FCC_A1'],
+                            {v.X('ZN'): (0, 1, 0.001), v.T: (300, 1000, 1), v.P: 101325},
+                            chunk_size=10)
+"""
+import json
+import os
+import tempfile
+from collections import OrderedDict
+from collections.abc import Mapping
+import numpy as np
+import pycalphad.variables as v
+from pycalphad.codegen.callables import build_phase_records
+from pycalphad.core.equilibrium import _adjust_conditions, equilibrium
+from pycalphad.core.light_dataset import LightDataset
+from pycalphad.core.utils import filter_phases, get_pure_elements, instantiate_models, \
+    unpack_components, unpack_phases
+
+STORE_FORMAT_VERSION = 1
+_MANIFEST_NAME = 'manifest.json'
+
+
+def _coord_to_json(values):
+    "Convert coordinate values to a list of Python scalars, which round-trip through JSON exactly."
+    return np.atleast_1d(values).tolist()
+
+
+class EquilibriumResultStore(object):
+    """
+    Directory holding the data variables of an equilibrium result, written chunk by chunk.
+
+    Parameters
+    ----------
+    path : str
+        Directory of the store. It is created if it does not exist.
+    coords : OrderedDict
+        Mapping of {Dimension: Values} of the complete result, in the dimension
+        order of `equilibrium` (conditions, then 'vertex' and 'component').
+    chunk_dim : str
+        Condition dimension along which the result is split into chunks.
+    chunk_size : int
+        Number of values of chunk_dim in each chunk.
+
+    Attributes
+    ----------
+    path : str
+    coords : OrderedDict
+    chunk_dim : str
+    chunk_size : int
+    num_chunks : int
+
+    Notes
+    -----
+    Opening an existing store checks that its coordinates and chunking match,
+    so a store is never resumed with different conditions.
+    """
+    def __init__(self, path, coords, chunk_dim, chunk_size):
+        self.path = os.path.abspath(os.path.expanduser(str(path)))
+        self.coords = OrderedDict((key, _coord_to_json(values)) for key, values in coords.items())
+        if chunk_dim not in self.coords:
+            raise ValueError('Chunk dimension {} is not a coordinate'.format(chunk_dim))
+        if int(chunk_size) < 1:
+            raise ValueError('chunk_size must be a positive integer, got {}'.format(chunk_size))
+        self.chunk_dim = chunk_dim
+        self.chunk_size = int(chunk_size)
+        self.num_chunks = -(-len(self.coords[chunk_dim]) // self.chunk_size)
+        os.makedirs(self.path, exist_ok=True)
+        manifest_path = os.path.join(self.path, _MANIFEST_NAME)
+        if os.path.exists(manifest_path):
+            with open(manifest_path, 'r') as fp:
+                manifest = json.load(fp)
+            if (manifest.get('version') != STORE_FORMAT_VERSION) or (manifest['coords'] != self.coords) or \
+                    (manifest['chunk_dim'] != self.chunk_dim) or (manifest['chunk_size'] != self.chunk_size):
+                raise ValueError('The store at {} was created for different conditions or chunking'.format(self.path))
+            self._variables = manifest['variables']
+            self._attrs = manifest['attrs']
+            self._completed = set(manifest['completed'])
+        else:
+            self._variables = OrderedDict()
+            self._attrs = {}
+            self._completed = set()
+            self._write_manifest()
+
+    def _write_manifest(self):
+        manifest = {'version': STORE_FORMAT_VERSION, 'coords': self.coords, 'chunk_dim': self.chunk_dim,
+                    'chunk_size': self.chunk_size, 'variables': self._variables, 'attrs': self._attrs,
+                    'completed': sorted(self._completed)}
+        # Written atomically, so an interrupted write never loses the record of completed chunks
+        fd, tmp_path = tempfile.mkstemp(dir=self.path, suffix='.tmp')
+        with os.fdopen(fd, 'w') as fp:
+            json.dump(manifest, fp)
+        os.replace(tmp_path, os.path.join(self.path, _MANIFEST_NAME))
+
+    def _variable_path(self, var):
+        return os.path.join(self.path, var + '.npy')
+
+    def chunk_slice(self, chunk_idx):
+        "Return the slice of chunk_dim values in the chunk."
+        return slice(chunk_idx * self.chunk_size, min((chunk_idx + 1) * self.chunk_size,
+                                                      len(self.coords[self.chunk_dim])))
+
+    def is_complete(self, chunk_idx):
+        "Return True if the chunk has been stored."
+        return chunk_idx in self._completed
+
+    @property
+    def complete(self):
+        "True if every chunk has been stored."
+        return len(self._completed) == self.num_chunks
+
+    def write_chunk(self, chunk_idx, result):
+        """
+        Store the result of a chunk and mark it complete.
+
+        Parameters
+        ----------
+        chunk_idx : int
+        result : LightDataset
+            Equilibrium result at the conditions of the chunk.
+        """
+        chunk_slice = self.chunk_slice(chunk_idx)
+        for var, (dims, values) in result.data_vars.items():
+            dims = list(dims)
+            if self.chunk_dim not in dims:
+                raise ValueError('Data variable {} does not have the chunk dimension {}'.format(var, self.chunk_dim))
+            chunk_axis = dims.index(self.chunk_dim)
+            values = np.asarray(values)
+            if var not in self._variables:
+                shape = list(values.shape)
+                shape[chunk_axis] = len(self.coords[self.chunk_dim])
+                arr = np.lib.format.open_memmap(self._variable_path(var), mode='w+', dtype=values.dtype,
+                                                shape=tuple(shape))
+                # Values of chunks that are not stored yet
+                arr[...] = np.nan if arr.dtype.kind == 'f' else np.zeros((), dtype=arr.dtype)
+                self._variables[var] = dims
+            else:
+                arr = np.load(self._variable_path(var), mmap_mode='r+')
+            arr[(slice(None),) * chunk_axis + (chunk_slice,)] = values
+            arr.flush()
+            del arr
+        self._attrs.update({key: str(value) for key, value in result.attrs.items()})
+        self._completed.add(chunk_idx)
+        self._write_manifest()
+
+    def to_light_dataset(self):
+        """
+        Return the stored result. Data variables are read-only memory maps of the store.
+
+        Returns
+        -------
+        LightDataset
+        """
+        data_vars = OrderedDict((var, (dims, np.load(self._variable_path(var), mmap_mode='r')))
+                                for var, dims in self._variables.items())
+        coords = OrderedDict((key, np.asarray(values)) for key, values in self.coords.items())
+        return LightDataset(data_vars, coords=coords, attrs=dict(self._attrs))
+
+
+def stream_equilibrium(path, dbf, comps, phases, conditions, chunk_size=1, chunk_dim=None,
+                       model=None, phase_records=None, parameters=None, to_xarray=True, verbose=False, **kwargs):
+    """
+    Calculate equilibrium chunk by chunk, writing each chunk of conditions to a store on disk.
+
+    Chunks that are already in the store are skipped, so calling this again
+    with the same path and conditions resumes an interrupted calculation.
+
+    Parameters
+    ----------
+    path : str
+        Directory of the store.
+    dbf : Database
+        Thermodynamic database containing the relevant parameters.
+    comps : list
+        Names of components to consider in the calculation.
+    phases : list or dict
+        Names of phases to consider in the calculation.
+    conditions : dict
+        StateVariables and their corresponding value.
+    chunk_size : int, optional
+        Number of values of chunk_dim solved in each chunk. Default: 1
+    chunk_dim : Optional[StateVariable or str]
+        Condition along which the calculation is split. Defaults to the first
+        condition (in dimension order) with more than one value.
+    model : Model, a dict of phase names to Model, or a seq of both, optional
+        Model class to use for each phase.
+    phase_records : Optional[Mapping[str, PhaseRecord]]
+        Mapping of phase names to PhaseRecord objects, as for `equilibrium`.
+        If None, PhaseRecords are built once and shared by every chunk.
+    parameters : dict, optional
+        Maps SymEngine Symbol to numbers, for overriding the values of parameters in the Database.
+    to_xarray : bool
+        Whether to return an xarray Dataset (True, default) or a LightDataset.
+    verbose : bool, optional
+        Print the progress of the chunks.
+    kwargs
+        Passed to `equilibrium`, e.g. `output`, `calc_opts`, `solver` or `workers`.
+
+    Returns
+    -------
+    Structured equilibrium calculation with the coordinates of `equilibrium`,
+    whose data variables are read from the store.
+    """
+    comps = sorted(unpack_components(dbf, comps))
+    active_phases = filter_phases(dbf, comps, unpack_phases(phases) or sorted(dbf.phases.keys()))
+    conditions = dict(conditions)
+    if conditions.get(v.N) is None:
+        conditions[v.N] = 1
+    conds = _adjust_conditions(conditions)
+    str_conds = OrderedDict((str(key), value) for key, value in conds.items())
+    if chunk_dim is None:
+        chunk_dim = next((key for key, value in str_conds.items() if len(value) > 1), next(iter(str_conds)))
+    chunk_dim = str(chunk_dim)
+    if chunk_dim not in str_conds:
+        raise ValueError('Chunk dimension {} is not a condition'.format(chunk_dim))
+    chunk_cond = next(key for key in conds.keys() if str(key) == chunk_dim)
+    if phase_records is None:
+        model = instantiate_models(dbf, comps, active_phases, model=model, parameters=parameters)
+        phase_records = build_phase_records(dbf, comps, active_phases, conds, model, output='GM',
+                                            parameters=parameters, verbose=verbose,
+                                            build_gradients=True, build_hessians=True)
+    elif not isinstance(model, Mapping):
+        raise ValueError("A dictionary of instantiated models must be passed with the `model` argument if the `phase_records` argument is used.")
+    coords = OrderedDict(str_conds)
+    pure_elements = get_pure_elements(dbf, comps)
+    coords['vertex'] = np.arange(len(pure_elements) + 1)
+    coords['component'] = pure_elements
+    store = EquilibriumResultStore(path, coords, chunk_dim, chunk_size)
+    for chunk_idx in range(store.num_chunks):
+        if store.is_complete(chunk_idx):
+            continue
+        if verbose:
+            print('Solving chunk {} of {}'.format(chunk_idx + 1, store.num_chunks))
+        chunk_conds = OrderedDict(conds)
+        chunk_conds[chunk_cond] = conds[chunk_cond][store.chunk_slice(chunk_idx)]
+        result = equilibrium(dbf, comps, active_phases, chunk_conds, model=model, phase_records=phase_records,
+                             parameters=parameters, to_xarray=False, verbose=verbose, **kwargs)
+        store.write_chunk(chunk_idx, result)
+        del result
+    result = store.to_light_dataset()
+    if to_xarray:
+        return result.get_dataset()
+    return result
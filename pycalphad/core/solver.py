@@ -1,13 +1,105 @@
 import numpy as np
-from collections import namedtuple
+from collections import namedtuple, OrderedDict
 from pycalphad.core.constants import MIN_SITE_FRACTION
 from pycalphad.core.minimizer import find_solution
 
-SolverResult = namedtuple('SolverResult', ['converged', 'x', 'chemical_potentials'])
+SolverResult = namedtuple('SolverResult', ['converged', 'x', 'chemical_potentials', 'diagnostics'],
+                          defaults=(None,))
+
+# Data variables added to the equilibrium result by solvers with `diagnostics` enabled.
+# Counts are summed, and times (in seconds) accumulated, over all solver calls at a point.
+SOLVER_DIAGNOSTICS = OrderedDict([
+    ('solver_calls', np.int32),  # Calls to Solver.solve
+    ('solver_iterations', np.int32),  # Newton iterations
+    ('solver_phase_changes', np.int32),  # Iterations changing the set of stable phases, and phases added from the grid
+    ('solver_step_reductions', np.int32),  # Steps shortened to keep site fractions and phase amounts within bounds
+    ('solver_solve_state_time', np.float64),  # Building and solving the equilibrium system, excluding recompute
+    ('solver_recompute_time', np.float64),  # Computing the state of every composition set
+    ('solver_add_new_phases_time', np.float64),
+    ('solver_point_time', np.float64),  # Total time of the point
+])
+
+
+def add_diagnostic_variables(properties, conds_keys):
+    """
+    Add the SOLVER_DIAGNOSTICS data variables, zeroed, to an equilibrium result that does not have them.
+
+    Parameters
+    ----------
+    properties : LightDataset
+        Will be modified! Thermodynamic properties and conditions.
+    conds_keys : List[str]
+        List of conditions sorted in dimension order.
+    """
+    grid_shape = properties.GM.shape
+    for var, dtype in SOLVER_DIAGNOSTICS.items():
+        if var not in properties.data_vars:
+            properties.add_variable(var, list(conds_keys), np.zeros(grid_shape, dtype=dtype))
+
+
+class SystemSpecification(object):
+    """
+    Indices of the prescribed quantities of a system, which only depend on the
+    names of the conditions, so they are shared by every point of a condition grid.
+
+    Parameters
+    ----------
+    state_variables : List[v.StateVariable]
+        State variables of the phase records, in order.
+    nonvacant_elements : List[str]
+        Components of the phase records, in order.
+    conds_keys : List[str]
+        Names of the conditions, e.g., 'T', 'X_AL' or 'MU_O'.
+    """
+    def __init__(self, state_variables, nonvacant_elements, conds_keys):
+        nonvacant_elements = list(nonvacant_elements)
+        conds_keys = [str(key) for key in conds_keys]
+        self.num_statevars = len(state_variables)
+        self.num_components = len(nonvacant_elements)
+        self.composition_keys = [key for key in conds_keys if key.startswith('X_')]
+        self.prescribed_element_indices = np.array([nonvacant_elements.index(key[2:])
+                                                    for key in self.composition_keys], dtype=np.int32)
+        self.chemical_potential_keys = [key for key in conds_keys if key.startswith('MU_')]
+        self.fixed_chemical_potential_indices = np.array([nonvacant_elements.index(key[3:])
+                                                          for key in self.chemical_potential_keys], dtype=np.int32)
+        self.free_chemical_potential_indices = np.array(sorted(set(range(self.num_components)) -
+                                                               set(self.fixed_chemical_potential_indices)),
+                                                        dtype=np.int32)
+        conds_keys = set(conds_keys)
+        self.fixed_statevar_indices = np.array([statevar_idx for statevar_idx, statevar in enumerate(state_variables)
+                                                if str(statevar) in conds_keys], dtype=np.int32)
+        self.free_statevar_indices = np.array(sorted(set(range(self.num_statevars)) -
+                                                     set(self.fixed_statevar_indices)), dtype=np.int32)
+
+    def prescribed_values(self, conditions):
+        """
+        Return the prescribed quantities of a point.
+
+        Parameters
+        ----------
+        conditions : OrderedDict[str, float]
+            Conditions of the point.
+
+        Returns
+        -------
+        Tuple[ndarray, ndarray, float]
+            Chemical potentials (with the fixed ones set), prescribed mole fractions
+            (aligned with prescribed_element_indices) and prescribed system amount.
+        """
+        chemical_potentials = np.zeros(self.num_components)
+        chemical_potentials[self.fixed_chemical_potential_indices] = [float(conditions[key])
+                                                                      for key in self.chemical_potential_keys]
+        prescribed_elemental_amounts = np.array([float(conditions[key]) for key in self.composition_keys])
+        prescribed_system_amount = conditions.get('N', 1.0)
+        return chemical_potentials, prescribed_elemental_amounts, prescribed_system_amount
+
 
 class SolverBase(object):
     """"Base class for solvers."""
     ignore_convergence = False
+    # If True, `solve` returns a SolverResult with diagnostics, and
+    # equilibrium results have the SOLVER_DIAGNOSTICS data variables
+    diagnostics = False
     def solve(self, composition_sets, conditions):
         """
         *Implement this method.*
@@ -28,8 +120,46 @@ class SolverBase(object):
 
 
 class Solver(SolverBase):
-    def __init__(self, verbose=False, **options):
+    """
+    Parameters
+    ----------
+    verbose : bool, optional
+        Print details of each solution.
+    diagnostics : bool, optional
+        Record the Newton iterations, phase changes, step reductions and
+        the time spent in each part of the solver. Off by default, as the
+        timings add overhead to every iteration.
+    """
+    def __init__(self, verbose=False, diagnostics=False, **options):
         self.verbose = verbose
+        self.diagnostics = diagnostics
+        # SystemSpecification of each set of condition names solved, so it is built once per condition grid
+        self._system_specifications = {}
+
+    def get_system_specification(self, composition_sets, conditions):
+        """
+        Return the SystemSpecification of the conditions, building it the first time they are solved.
+
+        Parameters
+        ----------
+        composition_sets : List[pycalphad.core.composition_set.CompositionSet]
+        conditions : OrderedDict[str, float]
+
+        Returns
+        -------
+        SystemSpecification
+        """
+        phase_record = composition_sets[0].phase_record
+        key = (tuple(conditions.keys()), tuple(str(sv) for sv in phase_record.state_variables),
+               tuple(phase_record.nonvacant_elements))
+        # Subclasses may not call Solver.__init__
+        system_specifications = self.__dict__.setdefault('_system_specifications', {})
+        spec = system_specifications.get(key)
+        if spec is None:
+            spec = SystemSpecification(phase_record.state_variables, phase_record.nonvacant_elements,
+                                       conditions.keys())
+            system_specifications[key] = spec
+        return spec
 
     def solve(self, composition_sets, conditions):
         """
@@ -48,40 +178,19 @@ class Solver(SolverBase):
 
         """
         compsets = composition_sets
-        state_variables = compsets[0].phase_record.state_variables
-        nonvacant_elements = compsets[0].phase_record.nonvacant_elements
-        num_statevars = len(state_variables)
-        num_components = len(nonvacant_elements)
-        chemical_potentials = np.zeros(num_components)
-        prescribed_elemental_amounts = []
-        prescribed_element_indices = []
-        for cond, value in conditions.items():
-            if str(cond).startswith('X_'):
-                el = str(cond)[2:]
-                el_idx = list(nonvacant_elements).index(el)
-                prescribed_elemental_amounts.append(float(value))
-                prescribed_element_indices.append(el_idx)
-        prescribed_element_indices = np.array(prescribed_element_indices, dtype=np.int32)
-        prescribed_elemental_amounts = np.array(prescribed_elemental_amounts)
-        prescribed_system_amount = conditions.get('N', 1.0)
-        fixed_chemical_potential_indices = np.array([nonvacant_elements.index(key[3:]) for key in conditions.keys() if key.startswith('MU_')], dtype=np.int32)
-        free_chemical_potential_indices = np.array(sorted(set(range(num_components)) - set(fixed_chemical_potential_indices)), dtype=np.int32)
-        for fixed_chempot_index in fixed_chemical_potential_indices:
-            el = nonvacant_elements[fixed_chempot_index]
-            chemical_potentials[fixed_chempot_index] = conditions.get('MU_' + str(el))
-        fixed_statevar_indices = []
-        for statevar_idx, statevar in enumerate(state_variables):
-            if str(statevar) in [str(k) for k in conditions.keys()]:
-                fixed_statevar_indices.append(statevar_idx)
-        free_statevar_indices = np.array(sorted(set(range(num_statevars)) - set(fixed_statevar_indices)), dtype=np.int32)
-        fixed_statevar_indices = np.array(fixed_statevar_indices, dtype=np.int32)
+        spec = self.get_system_specification(compsets, conditions)
+        chemical_potentials, prescribed_elemental_amounts, prescribed_system_amount = \
+            spec.prescribed_values(conditions)
+        diagnostics = {} if self.diagnostics else None
         converged, x, chemical_potentials = \
-            find_solution(compsets, num_statevars, num_components, prescribed_system_amount,
-                          chemical_potentials, free_chemical_potential_indices, fixed_chemical_potential_indices,
-                          prescribed_element_indices, prescribed_elemental_amounts,
-                          free_statevar_indices, fixed_statevar_indices)
+            find_solution(compsets, spec.num_statevars, spec.num_components, prescribed_system_amount,
+                          chemical_potentials, spec.free_chemical_potential_indices,
+                          spec.fixed_chemical_potential_indices, spec.prescribed_element_indices,
+                          prescribed_elemental_amounts, spec.free_statevar_indices, spec.fixed_statevar_indices,
+                          diagnostics=diagnostics)
 
         if self.verbose:
             print('Chemical Potentials', chemical_potentials)
             print(np.asarray(x))
-        return SolverResult(converged=converged, x=x, chemical_potentials=chemical_potentials)
+        return SolverResult(converged=converged, x=x, chemical_potentials=chemical_potentials,
+                            diagnostics=diagnostics)
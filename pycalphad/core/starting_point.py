@@ -35,9 +35,9 @@ def global_min_is_possible(conditions, state_variables):
     return global_min
 
 
-def starting_point(conditions, state_variables, phase_records, grid):
+def empty_result(conditions, state_variables, phase_names, nonvacant_elements, maximum_internal_dof):
     """
-    Find a starting point for the solution using a sample of the system energy surface.
+    Allocate the equilibrium result of a condition grid, without computing any of its values.
 
     Parameters
     ----------
@@ -45,38 +45,26 @@ def starting_point(conditions, state_variables, phase_records, grid):
         Mapping of StateVariable to array of condition values.
     state_variables : list
         A list of the state variables (e.g., N, P, T) used in this calculation.
-    phase_records : dict
-        Mapping of phase names (strings) to PhaseRecords.
-    grid : Dataset
-        A sample of the energy surface of the system. The sample should at least
-        cover the same state variable space as specified in the conditions.
+    phase_names : list
+        Names of the active phases.
+    nonvacant_elements : list
+        Names of the pure elements of the calculation, excluding vacancies.
+    maximum_internal_dof : int
+        Largest number of internal degrees of freedom of the active phases.
 
     Returns
     -------
-    Dataset
+    LightDataset
     """
-    global_min_enabled = global_min_is_possible(conditions, state_variables)
     from pycalphad import __version__ as pycalphad_version
-    active_phases = sorted(phase_records.keys())
     # Ensure that '_FAKE_' will fit in the phase name array
-    max_phase_name_len = max(max([len(x) for x in active_phases]), 6)
-    maximum_internal_dof = max(prx.phase_dof for prx in phase_records.values())
-    nonvacant_elements = phase_records[active_phases[0]].nonvacant_elements
+    max_phase_name_len = max(max([len(x) for x in phase_names]), 6)
     coord_dict = OrderedDict([(str(key), value) for key, value in conditions.items()])
     grid_shape = tuple(len(x) for x in coord_dict.values())
     coord_dict['vertex'] = np.arange(
         len(nonvacant_elements) + 1)  # +1 is to accommodate the degenerate degree of freedom at the invariant reactions
     coord_dict['component'] = nonvacant_elements
     conds_as_strings = [str(k) for k in conditions.keys()]
-    specified_elements = set()
-    for i in conditions.keys():
-        # Assume that a condition specifying a species contributes to constraining it
-        if not hasattr(i, 'species'):
-            continue
-        specified_elements |= set(i.species.constituents.keys()) - {'VA'}
-    dependent_comp = set(nonvacant_elements) - specified_elements
-    if len(dependent_comp) != 1:
-        raise ValueError('Number of dependent components different from one')
 
     ds_vars = {'NP':     (conds_as_strings + ['vertex'], np.empty(grid_shape + (len(nonvacant_elements)+1,))),
                'GM':     (conds_as_strings, np.empty(grid_shape)),
@@ -96,7 +84,44 @@ def starting_point(conditions, state_variables, phase_records, grid):
     for f_sv in free_statevars:
         ds_vars.update({str(f_sv): (conds_as_strings, np.empty(grid_shape))})
 
-    result = LightDataset(ds_vars, coords=coord_dict, attrs={'engine': 'pycalphad %s' % pycalphad_version})
+    return LightDataset(ds_vars, coords=coord_dict, attrs={'engine': 'pycalphad %s' % pycalphad_version})
+
+
+def starting_point(conditions, state_variables, phase_records, grid):
+    """
+    Find a starting point for the solution using a sample of the system energy surface.
+
+    Parameters
+    ----------
+    conditions : OrderedDict
+        Mapping of StateVariable to array of condition values.
+    state_variables : list
+        A list of the state variables (e.g., N, P, T) used in this calculation.
+    phase_records : dict
+        Mapping of phase names (strings) to PhaseRecords.
+    grid : Dataset or CompactGrid
+        A sample of the energy surface of the system. The sample should at least
+        cover the same state variable space as specified in the conditions.
+
+    Returns
+    -------
+    Dataset
+    """
+    global_min_enabled = global_min_is_possible(conditions, state_variables)
+    active_phases = sorted(phase_records.keys())
+    maximum_internal_dof = max(prx.phase_dof for prx in phase_records.values())
+    nonvacant_elements = phase_records[active_phases[0]].nonvacant_elements
+    specified_elements = set()
+    for i in conditions.keys():
+        # Assume that a condition specifying a species contributes to constraining it
+        if not hasattr(i, 'species'):
+            continue
+        specified_elements |= set(i.species.constituents.keys()) - {'VA'}
+    dependent_comp = set(nonvacant_elements) - specified_elements
+    if len(dependent_comp) != 1:
+        raise ValueError('Number of dependent components different from one')
+
+    result = empty_result(conditions, state_variables, active_phases, nonvacant_elements, maximum_internal_dof)
     if global_min_enabled:
         result = lower_convex_hull(grid, state_variables, result)
     else:
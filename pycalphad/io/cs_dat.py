@@ -7,6 +7,7 @@ import re
 import warnings
 import numpy as np
 import itertools
+import functools
 from dataclasses import dataclass
 from collections import deque
 from symengine import S, log, Piecewise, And
@@ -41,48 +42,71 @@ class TokenParserError(Exception):
     pass
 
 class TokenParser():
+    """
+    Cursor over the whitespace-separated tokens of a string.
+
+    The string is split into tokens once, up front, so parsing and looking
+    ahead are constant time per token. Line numbers are only computed for
+    error messages.
+    """
     def __init__(self, string):
-        self._line_number = 1  # user facing, so make it one-indexed
-        self._lines_deque = deque(string.split("\n"))
-        self._current_line = self._lines_deque.popleft()
-        self._tokens_deque = deque(self._current_line.split())
-    
+        self._string = string
+        self._tokens = string.split()
+        self._position = 0
+
     def __getitem__(self, i: int):
-        # Instantiate a new TokenParser for the current state so we can look ahead without messing up our line numbers
-        lines = "\n".join(deque([" ".join(self._tokens_deque)]) + self._lines_deque)
-        tmp_parser = TokenParser(lines)
-        if i > 0:
-            for _ in range(i - 1):
-                token = tmp_parser._next()
-        return tmp_parser._next()
+        # Look ahead without consuming tokens. As before, toks[0] and toks[1] are both the next token.
+        try:
+            return self._tokens[self._position + max(i - 1, 0)]
+        except IndexError:
+            raise IndexError('No more tokens') from None
 
     def _next(self):
         try:
-            token = self._tokens_deque.popleft()
-        except IndexError as e:
-            # If we're out of tokens, get the next line and try to grab a token again
-            self._current_line = self._lines_deque.popleft()
-            self._line_number += 1
-            self._tokens_deque.extend(self._current_line.split())
-            # call next instead of popleft() on the deque in case self._current_line has no tokens
-            token = self._next()
+            token = self._tokens[self._position]
+        except IndexError:
+            raise IndexError('No more tokens') from None
+        self._position += 1
         return token
 
+    def _location(self):
+        "Return the (line_number, line) of the next token, with one-indexed line numbers."
+        lines = self._string.splitlines() or ['']
+        num_tokens = 0
+        for line_number, line in enumerate(lines, start=1):
+            num_tokens += len(line.split())
+            if num_tokens > self._position:
+                return line_number, line
+        return len(lines), lines[-1]
+
+    def _error(self, e):
+        line_number, line = self._location()
+        return TokenParserError(f"Error at line number {line_number + 1}: {e.args} for line:\n    {line}")
+
     def parse(self, cls: type):
         next_token = self._next()
         try:
             obj = cls(next_token)
         except ValueError as e:
-            # Return the token and re-raise with a ParseError 
-            self._tokens_deque.appendleft(next_token)
-            raise TokenParserError(f"Error at line number {self._line_number + 1}: {e.args} for line:\n    {self._current_line}") from e
+            # Return the token and re-raise with a ParseError
+            self._position -= 1
+            raise self._error(e) from e
         else:
             return obj
 
     def parseN(self, N: int, cls: type):
         if N < 1:
             raise ValueError(f'N must be >=1, got {N}')
-        return [self.parse(cls) for _ in range(N)]
+        tokens = self._tokens[self._position:self._position + N]
+        if len(tokens) < N:
+            raise IndexError('No more tokens')
+        try:
+            result = [cls(token) for token in tokens]
+        except ValueError:
+            # Parse one at a time to stop at (and report) the invalid token
+            return [self.parse(cls) for _ in range(N)]
+        self._position += N
+        return result
 
 
 @dataclass
@@ -95,6 +119,16 @@ class Header:
     excess_coefficient_idxs: List[int]
 
 
+@functools.lru_cache(maxsize=None)
+def _interval_condition(T_min, T_max):
+    "Temperature condition of an interval. Most endmembers of a file share the same temperature breakpoints."
+    if T_min == T_max:
+        # To avoid an impossible, always False condition an open interval
+        # is assumed. We choose 10000 K as the dummy (as in TDBs).
+        return And((T_min <= v.T), (v.T < 10000))
+    return And((T_min <= v.T), (v.T < T_max))
+
+
 @dataclass
 class AdditionalCoefficientPair:
     coefficient: float
@@ -123,11 +157,7 @@ class IntervalBase:
         raise NotImplementedError("Subclasses of IntervalBase must define an expression for the energy")
 
     def cond(self, T_min=DEFAULT_T_MIN):
-        if T_min == self.T_max:
-            # To avoid an impossible, always False condition an open interval
-            # is assumed. We choose 10000 K as the dummy (as in TDBs).
-            return And((T_min <= v.T), (v.T < 10000))
-        return And((T_min <= v.T), (v.T < self.T_max))
+        return _interval_condition(T_min, self.T_max)
 
     def expr_cond_pair(self, *args, T_min=DEFAULT_T_MIN, **kwargs):
         """Return an (expr, cond) tuple used to construct Piecewise expressions"""
@@ -407,7 +437,9 @@ class PhaseBase:
         * `dbf.add_phase`
         * `dbf.structure_entry`
         * `dbf.add_phase_constituents`
-        * `dbf.add_parameter` for all parameters
+        * `dbf.defer_parameters` with a function that calls `dbf.add_parameter`
+          for all parameters, so their expressions are only built if a Model of
+          the phase searches them
 
         """
         raise NotImplementedError(f"Subclass {type(self).__name__} of PhaseBase must implement `insert` to add the phase, constituents and parameters to the Database.")
@@ -443,7 +475,10 @@ class Phase_Stoichiometric(PhaseBase):
         dbf.add_phase(self.phase_name, model_hints=model_hints, sublattices=subl_stoich_ratios)
         dbf.add_structure_entry(self.phase_name, self.phase_name)
         dbf.add_phase_constituents(self.phase_name, constituent_array)
-        self.endmembers[0].insert(dbf, self.phase_name, constituent_array, gibbs_coefficient_idxs)
+
+        def insert_parameters(dbf):
+            self.endmembers[0].insert(dbf, self.phase_name, constituent_array, gibbs_coefficient_idxs)
+        dbf.defer_parameters(self.phase_name, insert_parameters)
 
 
 @dataclass
@@ -523,19 +558,21 @@ class Phase_CEF(PhaseBase):
         dbf.add_phase_constituents(self.phase_name, self.constituent_array)
 
         # Now that all the species are in the database, we are free to add the parameters
-        if self.endmember_constituent_idxs is None:
-            # we have to guess at the constituent array
-            for endmember in self.endmembers:
-                endmember.insert(dbf, self.phase_name, endmember.constituent_array(), gibbs_coefficient_idxs)
-        else:
-            # we know the constituent array from the indices and we don't have
-            # to guess
-            for endmember, const_idxs in zip(self.endmembers, self.endmember_constituent_idxs):
-                em_const_array = [[self.constituent_array[i][sp_idx - 1]] for i, sp_idx in enumerate(const_idxs)]
-                endmember.insert(dbf, self.phase_name, em_const_array, gibbs_coefficient_idxs)
+        def insert_parameters(dbf):
+            if self.endmember_constituent_idxs is None:
+                # we have to guess at the constituent array
+                for endmember in self.endmembers:
+                    endmember.insert(dbf, self.phase_name, endmember.constituent_array(), gibbs_coefficient_idxs)
+            else:
+                # we know the constituent array from the indices and we don't have
+                # to guess
+                for endmember, const_idxs in zip(self.endmembers, self.endmember_constituent_idxs):
+                    em_const_array = [[self.constituent_array[i][sp_idx - 1]] for i, sp_idx in enumerate(const_idxs)]
+                    endmember.insert(dbf, self.phase_name, em_const_array, gibbs_coefficient_idxs)
 
-        for excess_param in self.excess_parameters:
-            excess_param.insert(dbf, self.phase_name, self.constituent_array, excess_coefficient_idxs)
+            for excess_param in self.excess_parameters:
+                excess_param.insert(dbf, self.phase_name, self.constituent_array, excess_coefficient_idxs)
+        dbf.defer_parameters(self.phase_name, insert_parameters)
 
 
 def rename_element_charge(element, charge):
@@ -740,17 +777,19 @@ class Phase_SUBQ(PhaseBase):
         num_pairs = len(list(itertools.product(cations, anions)))
         assert len(self.endmembers) == num_pairs
 
-        # Endmember pairs came in order of the specified subl_const_idx_pairs labels.
-        for (i, j), endmember in zip(self.subl_const_idx_pairs, self.endmembers):
-            endmember.insert(dbf, self.phase_name, [[cations[i-1]], [anions[j-1]]], gibbs_coefficient_idxs)
+        def insert_parameters(dbf):
+            # Endmember pairs came in order of the specified subl_const_idx_pairs labels.
+            for (i, j), endmember in zip(self.subl_const_idx_pairs, self.endmembers):
+                endmember.insert(dbf, self.phase_name, [[cations[i-1]], [anions[j-1]]], gibbs_coefficient_idxs)
 
-        # Fourth: add parameters for coordinations
-        for quadruplet in self.quadruplets:
-            quadruplet.insert(dbf, self.phase_name, cations, anions)
+            # Fourth: add parameters for coordinations
+            for quadruplet in self.quadruplets:
+                quadruplet.insert(dbf, self.phase_name, cations, anions)
 
-        # Fifth: add excess parameters
-        for excess_param in self.excess_parameters:
-            excess_param.insert(dbf, self.phase_name, cations, anions, excess_coefficient_idxs)
+            # Fifth: add excess parameters
+            for excess_param in self.excess_parameters:
+                excess_param.insert(dbf, self.phase_name, cations, anions, excess_coefficient_idxs)
+        dbf.defer_parameters(self.phase_name, insert_parameters)
 
         # Process chemical group overrides - for now we simply warn with the affected species if any overrides are detected.
         for override_string in self.chemical_group_overrides:
@@ -777,9 +816,10 @@ class Phase_Aqueous(PhaseBase):
 
 def tokenize(instring, startline=0, force_upper=False):
     if force_upper:
-        return TokenParser('\n'.join(instring.upper().splitlines()[startline:]))
-    else:
-        return TokenParser('\n'.join(instring.splitlines()[startline:]))
+        instring = instring.upper()
+    # Only the skipped lines are split off; the rest of the string is tokenized in one pass
+    lines = re.split(r'\r\n|\r|\n', instring, maxsplit=startline)
+    return TokenParser(lines[startline] if len(lines) > startline else '')
 
 
 def parse_header(toks: TokenParser) -> Header:
@@ -1179,7 +1219,8 @@ def read_cs_dat(dbf: Database, fd):
                 'S298': 0.0,
             }
     # Each phase subclass knows how to insert itself into the database.
-    # The insert method will appropriately insert all endmembers as well.
+    # The insert method defers inserting the endmembers and excess parameters,
+    # so expressions are only built for phases that are searched by a Model.
     processed_phases = []
     for parsed_phase in (*solution_phases, *stoichiometric_phases):
         if parsed_phase.phase_name in processed_phases:
@@ -1189,7 +1230,7 @@ def read_cs_dat(dbf: Database, fd):
         parsed_phase.insert(dbf, header.pure_elements, header.gibbs_coefficient_idxs, header.excess_coefficient_idxs)
         processed_phases.append(parsed_phase.phase_name)
 
-    # process all the parameters that got added with dbf.add_parameter
+    # process any parameters that got added with dbf.add_parameter directly
     dbf.process_parameter_queue()
 
 Database.register_format("dat", read=read_cs_dat, write=None)
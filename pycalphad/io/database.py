@@ -8,6 +8,7 @@ from tinydb.storages import MemoryStorage
 from datetime import datetime
 from collections import namedtuple
 import os
+import weakref
 from pycalphad.variables import Species
 from pycalphad.core.cache import fhash
 
@@ -22,6 +23,50 @@ def _to_tuple(lst):
     return tuple(_to_tuple(i) if isinstance(i, list) else i for i in lst)
 
 
+class _ParameterIndex(object): #pylint: disable=R0903
+    """
+    Hash index of the parameters of a TinyDB table.
+
+    Maps (phase_name, parameter_type) to a mapping of the set of species in
+    the constituent array to the document ids of the matching parameters.
+    """
+    def __init__(self, table=None):
+        self.buckets = {}
+        self.size = 0
+        if table is not None:
+            for param in table.all():
+                self.add(param, param.doc_id)
+
+    def add(self, param, doc_id):
+        constituents = frozenset(species for sublattice in param['constituent_array'] for species in sublattice)
+        phase_buckets = self.buckets.setdefault((param['phase_name'], param['parameter_type']), {})
+        phase_buckets.setdefault(constituents, []).append(doc_id)
+        self.size += 1
+
+    def remapped(self, doc_ids):
+        "Return a copy of the index with each document id i replaced by doc_ids[i]."
+        index = _ParameterIndex()
+        index.buckets = {key: {constituents: [doc_ids[doc_id] for doc_id in bucket_ids]
+                               for constituents, bucket_ids in phase_buckets.items()}
+                         for key, phase_buckets in self.buckets.items()}
+        index.size = self.size
+        return index
+
+    def doc_ids(self, phase_name, parameter_types, constituents=None):
+        "Return the sorted document ids of candidate parameters."
+        result = []
+        for parameter_type in parameter_types:
+            for param_constituents, doc_ids in self.buckets.get((phase_name, parameter_type), {}).items():
+                if (constituents is None) or param_constituents.issubset(constituents):
+                    result.extend(doc_ids)
+        return sorted(result)
+
+
+# Parameter indices of the TinyDB tables of Databases, built on first use. They are
+# kept outside of Database instances so hashing, equality and pickling are unaffected.
+_parameter_indices = weakref.WeakKeyDictionary()
+
+
 class Phase(object): #pylint: disable=R0903
     """
     Phase in the database.
@@ -56,7 +101,8 @@ class Phase(object): #pylint: disable=R0903
         return hash((self.name, self.constituents, tuple(self.sublattices),
                      tuple(sorted(_to_tuple(self.model_hints.items())))))
 
-DatabaseFormat = namedtuple('DatabaseFormat', ['read', 'write'])
+# Binary formats are read from and written to files opened in binary mode
+DatabaseFormat = namedtuple('DatabaseFormat', ['read', 'write', 'binary'], defaults=(False,))
 format_registry = {}
 
 
@@ -95,6 +141,7 @@ class Database(object): #pylint: disable=R0902
             obj._structure_dict = {} # System-local phase names to global IDs
             obj._parameters = TinyDB(storage=MemoryStorage)
             obj._parameter_queue = []
+            obj._deferred_parameters = {}
             obj.symbols = {}
             obj.references = {}
             # Note: No public typedefs here (from TDB files)
@@ -124,10 +171,21 @@ class Database(object): #pylint: disable=R0902
             raise ValueError('Invalid number of parameters: '+len(args))
 
     def __hash__(self):
+        self._insert_deferred_parameters()
         return fhash(self.__dict__)
 
+    @property
+    def _parameters(self):
+        "TinyDB of all parameters. Deferred parameters of every phase are inserted first."
+        self._insert_deferred_parameters()
+        return self.__dict__['_parameters']
+
+    @_parameters.setter
+    def _parameters(self, value):
+        self.__dict__['_parameters'] = value
 
     def __getstate__(self):
+        self._insert_deferred_parameters()
         pickle_dict = {}
         for key, value in self.__dict__.items():
             if key == '_parameters':
@@ -137,6 +195,8 @@ class Database(object): #pylint: disable=R0902
         return pickle_dict
 
     def __setstate__(self, state):
+        # Pickles written before parameters could be deferred do not store the attribute
+        self._deferred_parameters = {}
         for key, value in state.items():
             if key == '_parameters':
                 self._parameters = TinyDB(storage=MemoryStorage)
@@ -145,18 +205,21 @@ class Database(object): #pylint: disable=R0902
                 setattr(self, key, value)
 
     def __deepcopy__(self, memo):
+        self._insert_deferred_parameters()
         copy = type(self)()
         memo[id(self)] = copy
         for key, value in self.__dict__.items():
             if key == '_parameters':
                 copy._parameters = TinyDB(storage=MemoryStorage)
                 copy._parameters.insert_multiple(value.all())
+            elif key == '_deferred_parameters':
+                copy._deferred_parameters = {}
             else:
                 setattr(copy, key, value)
         return copy
 
     @staticmethod
-    def register_format(fmt, read=None, write=None):
+    def register_format(fmt, read=None, write=None, binary=False):
         """
         Add support for reading and/or writing the specified format.
 
@@ -168,12 +231,14 @@ class Database(object): #pylint: disable=R0902
             Read function with arguments (Database, file_descriptor)
         write : callable, optional
             Write function with arguments (Database, file_descriptor)
+        binary : bool, optional
+            If True, files are opened in binary mode. Default: False
 
         Examples
         --------
         None yet.
         """
-        format_registry[fmt.lower()] = DatabaseFormat(read=read, write=write)
+        format_registry[fmt.lower()] = DatabaseFormat(read=read, write=write, binary=binary)
 
     @staticmethod
     def from_file(fname, fmt=None):
@@ -218,7 +283,7 @@ class Database(object): #pylint: disable=R0902
         else:
             # It's not file-like, so it's probably a filename
             need_to_close = True
-            fd = open(fname, mode='r')
+            fd = open(fname, mode='rb' if format_registry[fmt].binary else 'r')
         try:
             dbf = Database()
             format_registry[fmt.lower()].read(dbf, fd)
@@ -299,7 +364,7 @@ class Database(object): #pylint: disable=R0902
                 else:
                     # equivalent to 'raise'
                     raise FileExistsError('File {} already exists'.format(fname))
-            with open(fname, mode='w') as fd:
+            with open(fname, mode='wb' if format_registry[fmt].binary else 'w') as fd:
                 format_registry[fmt].write(self, fd, **write_kwargs)
 
     def to_string(self, **kwargs):
@@ -334,7 +399,9 @@ class Database(object): #pylint: disable=R0902
             return True
         elif type(self) != type(other):
             return False
-        elif sorted(self.__dict__.keys()) != sorted(other.__dict__.keys()):
+        self._insert_deferred_parameters()
+        other._insert_deferred_parameters()
+        if sorted(self.__dict__.keys()) != sorted(other.__dict__.keys()):
             return False
         else:
             def param_sort_key(x):
@@ -419,7 +486,10 @@ class Database(object): #pylint: disable=R0902
         }
         new_parameter.update(kwargs)
         if force_insert:
-            self._parameters.insert(new_parameter)
+            index = self._parameter_index(build=False)
+            doc_id = self.__dict__['_parameters'].insert(new_parameter)
+            if index is not None:
+                index.add(new_parameter, doc_id)
         else:
             self._parameter_queue.append(new_parameter)
 
@@ -488,11 +558,113 @@ class Database(object): #pylint: disable=R0902
         """
         return self._parameters.search(query)
 
+    def _parameter_index(self, build=True):
+        """
+        Return the parameter index of this Database, or None if build is False and the index is missing or stale.
+
+        The index is rebuilt whenever the number of parameters differs from the
+        number of indexed parameters, e.g., after parameters were removed from
+        the TinyDB directly. Changes to the phase name, type or constituents of
+        stored parameters must be made by removing and adding parameters.
+
+        A stale index is discarded even if build is False. Parameters added
+        afterwards are then not added to it, and it cannot look up to date
+        again once the table is back to the indexed size.
+        """
+        table = self.__dict__['_parameters']
+        index = _parameter_indices.get(table)
+        if (index is not None) and (index.size == len(table)):
+            return index
+        if index is not None:
+            del _parameter_indices[table]
+        if not build:
+            return None
+        index = _ParameterIndex(table)
+        _parameter_indices[table] = index
+        return index
+
+    def defer_parameters(self, phase_name, insert_parameters):
+        """
+        Defer adding the parameters of a phase until they are first searched.
+
+        Parameters
+        ----------
+        phase_name : str
+            Name of the phase.
+        insert_parameters : callable
+            Called with this Database to add the parameters of the phase with
+            `add_parameter`. It is called once, when the parameters of the phase
+            are searched with `search_parameters`, or when all parameters of the
+            Database are accessed.
+
+        Examples
+        --------
+        >>>> db.defer_parameters('LIQUID', lambda dbf: dbf.add_parameter('G', 'LIQUID', [['AL']], 0, G_AL_LIQ))
+        """
+        self._deferred_parameters.setdefault(phase_name, []).append(insert_parameters)
+
+    def _insert_deferred_parameters(self, phase_name=None):
+        "Add the deferred parameters of phase_name, or of all phases if phase_name is None."
+        deferred = self.__dict__.get('_deferred_parameters')
+        if not deferred:
+            return
+        if phase_name is None:
+            pending = [func for phase in list(deferred.keys()) for func in deferred.pop(phase)]
+        else:
+            pending = deferred.pop(phase_name, [])
+        if len(pending) == 0:
+            return
+        for insert_parameters in pending:
+            insert_parameters(self)
+        self.process_parameter_queue()
+
+    def search_parameters(self, query, phase_name, parameter_types, constituents=None):
+        """
+        Search for parameters of a phase matching the specified query, using an
+        index instead of testing every parameter in the Database.
+
+        Parameters
+        ----------
+        query : object
+            Structured database query in TinyDB format. It is applied to the candidate parameters.
+        phase_name : str
+            Name of the phase. Only parameters of this phase are candidates.
+        parameter_types : str or Sequence[str]
+            Types of parameters, e.g., G or L. Only parameters of these types are candidates.
+        constituents : Optional[Set[Species]]
+            If given, only parameters whose constituent arrays contain no other species are candidates.
+
+        Returns
+        -------
+        List[Document]
+            Matching parameters, in the same order as `search`.
+
+        Examples
+        --------
+        >>>> from tinydb import where
+        >>>> db.search_parameters(where('parameter_order') == 0, 'LIQUID', ['G', 'L'])
+        """
+        if isinstance(parameter_types, str):
+            parameter_types = [parameter_types]
+        self._insert_deferred_parameters(phase_name)
+        table = self.__dict__['_parameters']
+        index = self._parameter_index()
+        result = []
+        for doc_id in index.doc_ids(phase_name, parameter_types, constituents):
+            param = table.get(doc_id=doc_id)
+            if (param is not None) and query(param):
+                result.append(param)
+        return result
+
     def process_parameter_queue(self):
         """
         Process the queue of parameters so they are added to the TinyDB in one transaction.
         This avoids repeated (expensive) calls to insert().
         """
-        result = self._parameters.insert_multiple(self._parameter_queue)
+        index = self._parameter_index(build=False)
+        result = self.__dict__['_parameters'].insert_multiple(self._parameter_queue)
+        if index is not None:
+            for param, doc_id in zip(self._parameter_queue, result):
+                index.add(param, doc_id)
         self._parameter_queue = []
         return result
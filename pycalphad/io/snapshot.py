@@ -0,0 +1,216 @@
+"""
+The snapshot module supports a binary format for parsed Databases.
+
+Parsing a large TDB file and converting every FUNCTION and PARAMETER to a
+SymEngine expression can take tens of seconds. A snapshot stores the parsed
+Database, so it is reloaded without parsing. A snapshot records the hash of
+the file it was parsed from, and ``load_database`` regenerates it whenever
+that file changes::
+
+    from pycalphad.io.snapshot import load_database
+    dbf = load_database('alcrni.tdb')  # parses alcrni.tdb and writes alcrni.tdbc
+    dbf = load_database('alcrni.tdb')  # reads alcrni.tdbc
+
+Snapshots can also be read and written directly like other formats, e.g.,
+``Database('alcrni.tdbc')`` or ``dbf.to_file('alcrni.tdbc')``.
+
+Besides the parsed objects, a snapshot stores the parameter search index
+(see `Database.search_parameters`), so it is not rebuilt by the first Model
+instantiated after loading.
+"""
+import hashlib
+import os
+import pickle
+import tempfile
+import warnings
+import symengine
+from pycalphad.io.database import Database, Phase, _ParameterIndex, _parameter_indices
+
+SNAPSHOT_MAGIC = b'PYCALPHAD-DATABASE-SNAPSHOT\n'
+# Incremented whenever the layout of the payload changes
+SNAPSHOT_VERSION = 2
+SNAPSHOT_EXTENSION = 'tdbc'
+
+# Attributes of a Database stored in a snapshot. _parameters and phases are stored separately.
+_DATABASE_ATTRIBUTES = ('elements', 'species', 'refstates', '_structure_dict', 'symbols', 'references')
+
+
+def file_hash(fname):
+    """
+    Return the SHA-256 hash of the contents of a file.
+
+    Parameters
+    ----------
+    fname : str
+
+    Returns
+    -------
+    str
+        Hexadecimal digest.
+    """
+    digest = hashlib.sha256()
+    with open(fname, mode='rb') as fd:
+        for block in iter(lambda: fd.read(1 << 20), b''):
+            digest.update(block)
+    return digest.hexdigest()
+
+
+def snapshot_path(fname):
+    "Return the default path of the snapshot of a database file, next to the file."
+    return os.path.splitext(fname)[0] + '.' + SNAPSHOT_EXTENSION
+
+
+def write_snapshot(dbf, fd, source_hash=None, source_format=None):
+    """
+    Write a snapshot of a Database.
+
+    Parameters
+    ----------
+    dbf : Database
+        A pycalphad Database.
+    fd : file-like
+        File descriptor opened in binary mode.
+    source_hash : str, optional
+        Hash of the file the Database was read from, see `file_hash`.
+    source_format : str, optional
+        Format of the file the Database was read from.
+    """
+    header = {'version': SNAPSHOT_VERSION, 'symengine_version': symengine.__version__,
+              'source_hash': source_hash, 'source_format': source_format}
+    # Phases are stored as plain data, so snapshots do not depend on the layout of Phase
+    phases = [(phase.name, phase.constituents, phase.sublattices, phase.model_hints)
+              for _, phase in sorted(dbf.phases.items())]
+    parameters = [dict(param) for param in dbf._parameters.all()]
+    # Indexed by position in parameters, since document ids are assigned again on reading
+    parameter_index = _ParameterIndex()
+    for position, param in enumerate(parameters):
+        parameter_index.add(param, position)
+    payload = {'attributes': {attr: getattr(dbf, attr) for attr in _DATABASE_ATTRIBUTES},
+               'phases': phases, 'parameters': parameters, 'parameter_index': parameter_index}
+    fd.write(SNAPSHOT_MAGIC)
+    pickle.dump(header, fd, protocol=pickle.HIGHEST_PROTOCOL)
+    pickle.dump(payload, fd, protocol=pickle.HIGHEST_PROTOCOL)
+
+
+def read_snapshot_header(fd):
+    """
+    Read the header of a snapshot, leaving fd at the start of the payload.
+
+    Parameters
+    ----------
+    fd : file-like
+        File descriptor opened in binary mode.
+
+    Returns
+    -------
+    dict
+        Header with 'version', 'symengine_version', 'source_hash' and 'source_format' entries.
+    """
+    if fd.read(len(SNAPSHOT_MAGIC)) != SNAPSHOT_MAGIC:
+        raise ValueError('Not a pycalphad Database snapshot')
+    return pickle.load(fd)
+
+
+def is_current(header, source_hash=None):
+    """
+    Return True if a snapshot with the given header can be read by this
+    installation and, if source_hash is given, was written from that source.
+    """
+    if (header.get('version') != SNAPSHOT_VERSION) or (header.get('symengine_version') != symengine.__version__):
+        return False
+    return (source_hash is None) or (header.get('source_hash') == source_hash)
+
+
+def read_snapshot(dbf, fd):
+    """
+    Read a snapshot into a pycalphad Database object.
+
+    Parameters
+    ----------
+    dbf : Database
+        A pycalphad Database.
+    fd : file-like
+        File descriptor opened in binary mode.
+    """
+    header = read_snapshot_header(fd)
+    if not is_current(header):
+        raise ValueError('Snapshot was written by an incompatible version (snapshot version {}, SymEngine {})'
+                         .format(header.get('version'), header.get('symengine_version')))
+    _read_payload(dbf, fd)
+
+
+def _read_payload(dbf, fd):
+    "Read the payload of a snapshot, after its header, into a Database."
+    payload = pickle.load(fd)
+    for attr, value in payload['attributes'].items():
+        setattr(dbf, attr, value)
+    dbf.phases = {}
+    for name, constituents, sublattices, model_hints in payload['phases']:
+        phase = Phase()
+        phase.name = name
+        phase.constituents = constituents
+        phase.sublattices = sublattices
+        phase.model_hints = model_hints
+        dbf.phases[name] = phase
+    doc_ids = dbf._parameters.insert_multiple(payload['parameters'])
+    _parameter_indices[dbf._parameters] = payload['parameter_index'].remapped(list(doc_ids))
+
+
+def _write_snapshot_atomic(dbf, path, source_hash, source_format):
+    "Write a snapshot so that readers never see a partially written file."
+    directory = os.path.dirname(os.path.abspath(path))
+    fd, tmp_path = tempfile.mkstemp(dir=directory, suffix='.tmp')
+    try:
+        with os.fdopen(fd, 'wb') as fp:
+            write_snapshot(dbf, fp, source_hash=source_hash, source_format=source_format)
+        os.replace(tmp_path, path)
+    except BaseException:
+        if os.path.exists(tmp_path):
+            os.remove(tmp_path)
+        raise
+
+
+def load_database(fname, fmt=None, snapshot=None):
+    """
+    Read a Database from a file through its snapshot, regenerating the
+    snapshot if it is missing or the file has changed since it was written.
+
+    Parameters
+    ----------
+    fname : str
+        Path of the database file, e.g., a TDB file.
+    fmt : str, optional
+        Format of fname. If not specified, it is detected from the file extension.
+    snapshot : str, optional
+        Path of the snapshot. Defaults to fname with a .tdbc extension.
+
+    Returns
+    -------
+    dbf : Database
+
+    Notes
+    -----
+    If the snapshot cannot be written, e.g., in a read-only directory,
+    a warning is raised and the parsed Database is returned.
+    """
+    snapshot = snapshot if snapshot is not None else snapshot_path(fname)
+    source_hash = file_hash(fname)
+    if os.path.exists(snapshot):
+        with open(snapshot, mode='rb') as fd:
+            try:
+                current = is_current(read_snapshot_header(fd), source_hash=source_hash)
+            except (ValueError, EOFError, pickle.UnpicklingError):
+                current = False
+            if current:
+                dbf = Database()
+                _read_payload(dbf, fd)
+                return dbf
+    dbf = Database.from_file(fname, fmt=fmt)
+    try:
+        _write_snapshot_atomic(dbf, snapshot, source_hash, fmt)
+    except OSError as e:
+        warnings.warn('Could not write the Database snapshot {}: {}'.format(snapshot, e))
+    return dbf
+
+
+Database.register_format(SNAPSHOT_EXTENSION, read=read_snapshot, write=write_snapshot, binary=True)
@@ -4,6 +4,7 @@ calculations under specified conditions.
 """
 import copy
 import warnings
+from functools import partial
 from symengine import exp, log, Abs, Add, And, Float, Mul, Piecewise, Pow, S, sin, StrictGreaterThan, Symbol, zoo, oo
 from tinydb import where
 import pycalphad.variables as v
@@ -17,6 +18,96 @@ from collections import OrderedDict
 # other symbols
 _MAX_PARAM_NESTING = 32
 
+# Number of symbol dictionaries (e.g., one per Database and set of parameters) with cached expansions
+_SYMBOL_RESOLVER_CACHE_SIZE = 8
+_symbol_resolvers = OrderedDict()
+
+
+class _SymbolResolver(object):
+    """
+    Substitutes the values of symbols into expressions.
+
+    The value of each symbol is expanded, i.e., the symbols it references are
+    substituted, the first time it is needed. Expanded values are shared by
+    every Model built from the same symbols, so common subexpressions such as
+    the functions in the pure element reference energies of many phases are
+    built once and are the same SymEngine objects, whose hashes are computed
+    once by ``cacheit`` functions.
+    """
+    def __init__(self, symbols):
+        self.symbols = symbols
+        self._expanded = {}
+
+    def _expand(self, symbol, depth=0):
+        expanded = self._expanded.get(symbol)
+        if expanded is not None:
+            return expanded
+        value = self.symbols[symbol]
+        references = [x for x in getattr(value, 'free_symbols', ()) if x in self.symbols]
+        if (len(references) > 0) and (depth < _MAX_PARAM_NESTING):
+            value = value.xreplace({x: self._expand(x, depth + 1) for x in references})
+        self._expanded[symbol] = value
+        return value
+
+    def replace(self, obj):
+        """
+        Substitute the expanded values of symbols into 'obj'.
+
+        Parameters
+        ----------
+        obj : SymEngine object
+
+        Returns
+        -------
+        SymEngine object
+        """
+        try:
+            references = [x for x in obj.free_symbols if x in self.symbols]
+        except AttributeError:
+            # Can't use xreplace on a float
+            return obj
+        if len(references) == 0:
+            return obj
+        return obj.xreplace({x: self._expand(x) for x in references})
+
+
+def _symbol_resolver(symbols):
+    """
+    Return the _SymbolResolver for a mapping of symbols, shared by every mapping with the same keys and values.
+    """
+    # Values are compared by identity. The cached resolver keeps them alive, so their ids are not reused.
+    key = tuple((name, id(value)) for name, value in symbols.items())
+    resolver = _symbol_resolvers.get(key)
+    if resolver is None:
+        resolver = _SymbolResolver(dict(symbols))
+        _symbol_resolvers[key] = resolver
+        if len(_symbol_resolvers) > _SYMBOL_RESOLVER_CACHE_SIZE:
+            _symbol_resolvers.popitem(last=False)
+    else:
+        _symbol_resolvers.move_to_end(key)
+    return resolver
+
+
+class _ContributionAttribute(object):
+    """
+    Model attribute, e.g., the Curie temperature, that is set while the energy contributions are built.
+
+    Reading it builds the contributions of the Model first, so that it does not
+    return the default value because the contributions were not accessed yet.
+    """
+    def __init__(self, name, default):
+        self.name = name
+        self.default = default
+
+    def __get__(self, instance, owner=None):
+        if instance is None:
+            return self.default
+        instance.models
+        return instance.__dict__.get(self.name, self.default)
+
+    def __set__(self, instance, value):
+        instance.__dict__[self.name] = value
+
 
 def _toop_filter(chemical_group_dict, symmetric_species, asymmetric_species):
     """
@@ -251,15 +342,80 @@ class Model(object):
 
         self._symbols = {wrap_symbol(key): value for key, value in symbols.items()}
 
-        self.models = OrderedDict()
-        self.build_phase(dbe)
+        # Invalid phases raise here; only building the contributions is deferred
+        self._validate_phase(dbe)
+        # Contributions are built by build_phase when they are first accessed
+        self._models = None
 
-        for name, value in self.models.items():
+    @property
+    def models(self):
+        """
+        Energy contributions to this phase, indexed by name.
+
+        The contributions are built with `build_phase` the first time they are
+        accessed, e.g., through `ast` or an output such as `GM`, so a Model whose
+        energy is never used does not build them or search the Database.
+        """
+        models = self.__dict__.get('_models')
+        if models is None:
+            models = self._build_models()
+        return models
+
+    @models.setter
+    def models(self, value):
+        self.__dict__['_models'] = value
+
+    def _build_models(self):
+        "Build the contributions with build_phase and substitute the database symbols into them."
+        # Contributions such as the atomic ordering energy read self.models while it is being built
+        models = self.__dict__['_models'] = OrderedDict()
+        try:
+            self.build_phase(self._dbe)
+        except Exception:
+            self.__dict__['_models'] = None
+            raise
+        # build_phase may also assign self.models
+        models = self.__dict__['_models']
+        resolver = _symbol_resolver(self._symbols)
+        for name, value in models.items():
             # XXX: xreplace hack because SymEngine seems to let Symbols slip in somehow
-            self.models[name] = self.symbol_replace(value, symbols).xreplace(v.supported_variables_in_databases)
+            models[name] = resolver.replace(value).xreplace(v.supported_variables_in_databases)
+        variables = self.variables
+        self.__dict__.setdefault('_site_fractions', sorted([x for x in variables if isinstance(x, v.SiteFraction)], key=str))
+        self.__dict__.setdefault('_state_variables', sorted([x for x in variables if not isinstance(x, v.SiteFraction)], key=str))
+        return models
 
-        self.site_fractions = sorted([x for x in self.variables if isinstance(x, v.SiteFraction)], key=str)
-        self.state_variables = sorted([x for x in self.variables if not isinstance(x, v.SiteFraction)], key=str)
+    @property
+    def site_fractions(self):
+        "Sorted site fractions in the contributions, as they were built."
+        site_fractions = self.__dict__.get('_site_fractions')
+        if site_fractions is None:
+            self.models
+            site_fractions = self.__dict__.get('_site_fractions')
+        if site_fractions is None:
+            # Contributions were assigned instead of built
+            site_fractions = sorted([x for x in self.variables if isinstance(x, v.SiteFraction)], key=str)
+        return site_fractions
+
+    @site_fractions.setter
+    def site_fractions(self, value):
+        self.__dict__['_site_fractions'] = value
+
+    @property
+    def state_variables(self):
+        "Sorted state variables, other than site fractions, in the contributions, as they were built."
+        state_variables = self.__dict__.get('_state_variables')
+        if state_variables is None:
+            self.models
+            state_variables = self.__dict__.get('_state_variables')
+        if state_variables is None:
+            # Contributions were assigned instead of built
+            state_variables = sorted([x for x in self.variables if not isinstance(x, v.SiteFraction)], key=str)
+        return state_variables
+
+    @state_variables.setter
+    def state_variables(self, value):
+        self.__dict__['_state_variables'] = value
 
     @staticmethod
     def symbol_replace(obj, symbols):
@@ -279,7 +435,11 @@ class Model(object):
             # Need to do more substitutions to catch symbols that are functions
             # of other symbols
             for iteration in range(_MAX_PARAM_NESTING):
-                obj = obj.xreplace(symbols)
+                new_obj = obj.xreplace(symbols)
+                if new_obj == obj:
+                    # Remaining symbols are not in symbols, e.g., parameters that are kept symbolic
+                    break
+                obj = new_obj
                 undefs = [x for x in obj.free_symbols if not isinstance(x, v.StateVariable)]
                 if len(undefs) == 0:
                     break
@@ -294,6 +454,9 @@ class Model(object):
         elif type(self) != type(other):
             return False
         else:
+            # Build the contributions, so Models compare equal whether or not they were accessed
+            self.models
+            other.models
             return self.__dict__ == other.__dict__
 
     def __ne__(self, other):
@@ -370,9 +533,12 @@ class Model(object):
     gradient = None
 
     # Note: In order-disorder phases, TC will always be the *disordered* value of TC
-    curie_temperature = TC = S.Zero
-    beta = BMAG = S.Zero
-    neel_temperature = NT = S.Zero
+    curie_temperature = _ContributionAttribute('curie_temperature', S.Zero)
+    TC = _ContributionAttribute('TC', S.Zero)
+    beta = _ContributionAttribute('beta', S.Zero)
+    BMAG = _ContributionAttribute('BMAG', S.Zero)
+    neel_temperature = _ContributionAttribute('neel_temperature', S.Zero)
+    NT = _ContributionAttribute('NT', S.Zero)
 
     #pylint: disable=C0103
     # These are standard abbreviations from Thermo-Calc for these quantities
@@ -461,9 +627,9 @@ class Model(object):
         return constraints
 
 
-    def build_phase(self, dbe):
+    def _validate_phase(self, dbe):
         """
-        Generate the symbolic form of all the contributions to this phase.
+        Check that the contributions of this phase can be built, without building them.
 
         Parameters
         ----------
@@ -475,6 +641,16 @@ class Model(object):
                 # Check for a common mistake in custom models
                 # Users that need to override this behavior should override build_phase
                 raise ValueError('\'atomic_ordering_energy\' must be the final contribution')
+            self._ordering_sublattice_indices(dbe)
+
+    def build_phase(self, dbe):
+        """
+        Generate the symbolic form of all the contributions to this phase.
+
+        Parameters
+        ----------
+        dbe : Database
+        """
         self.models.clear()
         for key, value in self.__class__.contributions:
             self.models[key] = S(getattr(self, value)(dbe))
@@ -499,6 +675,21 @@ class Model(object):
                 return False
         return True
 
+    def _parameter_search(self, dbe, parameter_types):
+        """
+        Return a search function for parameters of the current phase with the given types.
+
+        The function takes a TinyDB query, like ``dbe.search``, but only tests
+        parameters found through the parameter index of the Database whose
+        constituents are active species of the current Model instance (or '*').
+        The query must therefore only match such parameters, as any query
+        using ``_array_validity`` does.
+        """
+        constituents = {species for sublattice in self.constituents for species in sublattice}
+        constituents.add(v.Species('*'))
+        return partial(dbe.search_parameters, phase_name=self.phase_name, parameter_types=parameter_types,
+                       constituents=frozenset(constituents))
+
     def _purity_test(self, constituent_array):
         """
         Return True if the constituent_array is valid and has exactly one
@@ -609,7 +800,7 @@ class Model(object):
             (where("parameter_type") == "QKT") &
             (where('constituent_array').test(self._array_validity))
         )
-        param_search = dbe.search
+        param_search = self._parameter_search(dbe, ['QKT'])
 
         params = param_search(param_query)
         kohler_toop_xs = S.Zero
@@ -797,7 +988,7 @@ class Model(object):
             (where('constituent_array').test(self._purity_test))
         )
         phase = dbe.phases[self.phase_name]
-        param_search = dbe.search
+        param_search = self._parameter_search(dbe, ['G'])
         pure_energy_term = self.redlich_kister_sum(phase, param_search,
                                                    pure_param_query)
         return pure_energy_term / self._site_ratio_normalization
@@ -835,7 +1026,7 @@ class Model(object):
         where m is the arity of the interaction parameter
         """
         phase = dbe.phases[self.phase_name]
-        param_search = dbe.search
+        param_search = self._parameter_search(dbe, ['G', 'L'])
         param_query = (
             (where('phase_name') == self.phase_name) & \
                 ((where('parameter_type') == 'G') |
@@ -854,7 +1045,7 @@ class Model(object):
         The approach follows from the background of W. Xiong et al, Calphad, 2012.
         """
         phase = dbe.phases[self.phase_name]
-        param_search = dbe.search
+        param_search = self._parameter_search(dbe, ['BMAGN', 'TC'])
         self.TC = self.curie_temperature = S.Zero
         self.BMAG = self.beta = S.Zero
         if 'ihj_magnetic_structure_factor' not in phase.model_hints:
@@ -887,7 +1078,7 @@ class Model(object):
             (afm_factor, mean_magnetic_moment <= 0),
             (1., True)
             )
-        self.BMAG = self.beta = self.symbol_replace(beta, self._symbols)
+        self.BMAG = self.beta = _symbol_resolver(self._symbols).replace(beta)
 
         curie_temp = \
             self.redlich_kister_sum(phase, param_search, tc_param_query)
@@ -895,7 +1086,7 @@ class Model(object):
             (afm_factor, curie_temp <= 0),
             (1., True)
             )
-        self.TC = self.curie_temperature = self.symbol_replace(tc, self._symbols)
+        self.TC = self.curie_temperature = _symbol_resolver(self._symbols).replace(tc)
 
         # Used to prevent singularity
         tau_positive_tc = v.T / (curie_temp + 1e-9)
@@ -935,7 +1126,7 @@ class Model(object):
         The approach follows W. Xiong et al, Calphad, 2012.
         """
         phase = dbe.phases[self.phase_name]
-        param_search = dbe.search
+        param_search = self._parameter_search(dbe, ['NT', 'BMAGN', 'TC'])
         self.TC = self.curie_temperature = S.Zero
         if 'ihj_magnetic_structure_factor' not in phase.model_hints:
             return S.Zero
@@ -975,9 +1166,9 @@ class Model(object):
         neel_temp = \
             self.redlich_kister_sum(phase, param_search, nt_param_query)
 
-        self.TC = self.curie_temperature = self.symbol_replace(curie_temp, self._symbols)
-        self.NT = self.neel_temperature = self.symbol_replace(neel_temp, self._symbols)
-        self.BMAG = self.beta = self.symbol_replace(beta, self._symbols)
+        self.TC = self.curie_temperature = _symbol_resolver(self._symbols).replace(curie_temp)
+        self.NT = self.neel_temperature = _symbol_resolver(self._symbols).replace(neel_temp)
+        self.BMAG = self.beta = _symbol_resolver(self._symbols).replace(beta)
 
         tau_curie = v.T / curie_temp
         tau_curie = tau_curie.xreplace({zoo: 1.0e10})
@@ -1014,7 +1205,7 @@ class Model(object):
         Return the energy from liquid-amorphous two-state model.
         """
         phase = dbe.phases[self.phase_name]
-        param_search = dbe.search
+        param_search = self._parameter_search(dbe, ['GD'])
         site_ratio_normalization = self._site_ratio_normalization
         gd_param_query = (
             (where('phase_name') == phase.name) & \
@@ -1034,7 +1225,7 @@ class Model(object):
         then exp() is called on the result.
         """
         phase = dbe.phases[self.phase_name]
-        param_search = dbe.search
+        param_search = self._parameter_search(dbe, ['THETA'])
         theta_param_query = (
             (where('phase_name') == phase.name) & \
             (where('parameter_type') == 'THETA') & \
@@ -1116,6 +1307,47 @@ class Model(object):
         ordering_expr = ord_expr - ord_expr.xreplace(ordered_mole_fraction_dict)
         return disord_expr + ordering_expr
 
+    def _ordering_sublattice_indices(self, dbe):
+        """
+        Return the indices of the substitutional sublattices of the ordered phase,
+        or None if this phase is not the ordered phase of an order/disorder model.
+
+        Assumes the first sublattice of the disordered phase is the sublattice that
+        can become ordered, and validates that the number of interstitial sublattices
+        is consistent with the disordered phase.
+        """
+        phase = dbe.phases[self.phase_name]
+        ordered_phase_name = phase.model_hints.get('ordered_phase', None)
+        disordered_phase_name = phase.model_hints.get('disordered_phase', None)
+        if phase.name != ordered_phase_name:
+            return None
+        ordered_phase = dbe.phases[ordered_phase_name]
+        disordered_phase = dbe.phases[disordered_phase_name]
+        disordered_subl_constituents = disordered_phase.constituents[0]
+        ordered_constituents = ordered_phase.constituents
+        substitutional_sublattice_idxs = []
+        for idx, subl_constituents in enumerate(ordered_constituents):
+            # Assumes that the ordered phase sublattice describes the ordering
+            # if it has exactly the same constituents. Could be a source of
+            # false positives if any interstitial sublattices have the same
+            # constituents as the disordered sublattice, but there's not an
+            # explicit way to specify which sublattices are ordering. We try to
+            # compensate for this assumption by validating (next).
+            if len(disordered_subl_constituents.symmetric_difference(subl_constituents)) == 0:
+                substitutional_sublattice_idxs.append(idx)
+        # validate
+        num_substitutional_sublattice_idxs = len(substitutional_sublattice_idxs)
+        num_ordered_interstitial_subls = len(ordered_phase.sublattices) - num_substitutional_sublattice_idxs
+        num_disordered_interstitial_subls = len(disordered_phase.sublattices) - 1
+        if num_ordered_interstitial_subls != num_disordered_interstitial_subls:
+            raise ValueError(
+                f'Number of interstitial sublattices for the disordered phase '
+                f'({num_disordered_interstitial_subls}) and the ordered phase '
+                f'({num_ordered_interstitial_subls}) do not match. Got '
+                f'substitutional sublattice indices of {substitutional_sublattice_idxs}.'
+                )
+        return substitutional_sublattice_idxs
+
     def atomic_ordering_energy(self, dbe):
         """
         Return the atomic ordering contribution in symbolic form.
@@ -1173,34 +1405,9 @@ class Model(object):
         disordered_phase = dbe.phases[disordered_phase_name]
         disordered_model = self.__class__(dbe, sorted(self.components), disordered_phase_name)
 
-        # Get substitutional sublattice indices (for the ordered phase) and
-        # validate that the number of interstitial sublattices is consistent
-        # with the disordered phase.
-        # Assumes first sublattice of the disordered phase is the sublattice
-        # that can be come ordered:
-        disordered_subl_constituents = disordered_phase.constituents[0]
-        ordered_constituents = ordered_phase.constituents
-        substitutional_sublattice_idxs = []
-        for idx, subl_constituents in enumerate(ordered_constituents):
-            # Assumes that the ordered phase sublattice describes the ordering
-            # if it has exactly the same constituents. Could be a source of
-            # false positives if any interstitial sublattices have the same
-            # constituents as the disordered sublattice, but there's not an
-            # explicit way to specify which sublattices are ordering. We try to
-            # compensate for this assumption by validating (next).
-            if len(disordered_subl_constituents.symmetric_difference(subl_constituents)) == 0:
-                substitutional_sublattice_idxs.append(idx)
-        # validate
+        # Get substitutional sublattice indices (for the ordered phase), validated in __init__
+        substitutional_sublattice_idxs = self._ordering_sublattice_indices(dbe)
         num_substitutional_sublattice_idxs = len(substitutional_sublattice_idxs)
-        num_ordered_interstitial_subls = len(ordered_phase.sublattices) - num_substitutional_sublattice_idxs
-        num_disordered_interstitial_subls = len(disordered_phase.sublattices) - 1
-        if num_ordered_interstitial_subls != num_disordered_interstitial_subls:
-            raise ValueError(
-                f'Number of interstitial sublattices for the disordered phase '
-                f'({num_disordered_interstitial_subls}) and the ordered phase '
-                f'({num_ordered_interstitial_subls}) do not match. Got '
-                f'substitutional sublattice indices of {substitutional_sublattice_idxs}.'
-                )
         # We also validate that no physical properties have ordered
         # contributions because the underlying physical property needs to
         # paritioned and substituted for the physical property in the disordered
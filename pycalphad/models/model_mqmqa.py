@@ -4,7 +4,7 @@ from collections import OrderedDict
 from functools import partial
 from symengine import log, S, Symbol
 from tinydb import where
-from pycalphad.model import _MAX_PARAM_NESTING
+from pycalphad.model import _MAX_PARAM_NESTING, _symbol_resolver
 import pycalphad.variables as v
 from pycalphad.core.utils import unpack_components, wrap_symbol
 from pycalphad import Model
@@ -130,11 +130,23 @@ class ModelMQMQA(Model):
 
         self._symbols = {wrap_symbol(key): value for key, value in symbols.items()}
 
-        self.models = OrderedDict()
-        self.build_phase(dbe)
+        # Contributions are built by build_phase when they are first accessed
+        self._models = None
 
-        for name, value in self.models.items():
-            self.models[name] = self.symbol_replace(value, symbols)
+    def _build_models(self):
+        "Build the contributions with build_phase and substitute the database symbols into them."
+        models = self.__dict__['_models'] = OrderedDict()
+        try:
+            self.build_phase(self._dbe)
+        except Exception:
+            self.__dict__['_models'] = None
+            raise
+        # build_phase may also assign self.models
+        models = self.__dict__['_models']
+        resolver = _symbol_resolver(self._symbols)
+        for name, value in models.items():
+            models[name] = resolver.replace(value)
+        return models
 
     def __eq__(self, other):
         if self is other:
@@ -142,6 +154,9 @@ class ModelMQMQA(Model):
         elif type(self) != type(other):
             return False
         else:
+            # Build the contributions, so Models compare equal whether or not they were accessed
+            self.models
+            other.models
             return self.__dict__ == other.__dict__
 
     def __ne__(self, other):
@@ -193,7 +208,7 @@ class ModelMQMQA(Model):
             (where("parameter_type") == "MQMG") & \
             (where("constituent_array").test(lambda x: x == ((i,), (k,))))
         )
-        params = list(self._dbe._parameters.search(pair_query))
+        params = self._dbe.search_parameters(pair_query, self.phase_name, "MQMG")
         assert len(params) == 1, f"Expected exactly one pair parameter for ({i, k}), got {len(params)}: {params}"
         param = params[0]
         return param["zeta"]
@@ -494,10 +509,11 @@ class ModelMQMQA(Model):
         # Canonicalize the order of cations and anions in alphabetical order
         A, B = sorted((A, B))
         X, Y = sorted((X, Y))
-        Zs = dbe._parameters.search(
+        Zs = dbe.search_parameters(
             (where("phase_name") == self.phase_name) & \
             (where("parameter_type") == "MQMZ") & \
-            (where("constituent_array").test(lambda x: x == ((A, B), (X, Y))))
+            (where("constituent_array").test(lambda x: x == ((A, B), (X, Y)))),
+            self.phase_name, "MQMZ"
         )
         if len(Zs) == 0:
             return self._calc_Z(dbe, species, A, B, X, Y)
@@ -565,7 +581,7 @@ class ModelMQMQA(Model):
             (where("parameter_type") == "MQMG") & \
             (where("constituent_array").test(self._pair_test))
         )
-        params = dbe._parameters.search(pair_query)
+        params = dbe.search_parameters(pair_query, self.phase_name, "MQMG")
         terms = S.Zero
         for param in params:
             a = i = param["constituent_array"][0][0]
@@ -614,10 +630,11 @@ class ModelMQMQA(Model):
         return Sid * v.T * v.R
 
     def excess_mixing_energy(self, dbe):
-        params = dbe._parameters.search(
+        params = dbe.search_parameters(
             (where("phase_name") == self.phase_name) &
             (where("parameter_type") == "MQMX") &
-            (where("constituent_array").test(self._array_validity))
+            (where("constituent_array").test(self._array_validity)),
+            self.phase_name, "MQMX"
         )
 
         cations = self.cations
@@ -741,7 +758,11 @@ class ModelMQMQA(Model):
             # Need to do more substitutions to catch symbols that are functions
             # of other symbols
             for iteration in range(_MAX_PARAM_NESTING):
-                obj = obj.xreplace(symbols)
+                new_obj = obj.xreplace(symbols)
+                if new_obj == obj:
+                    # Remaining symbols are not in symbols, e.g., parameters that are kept symbolic
+                    break
+                obj = new_obj
                 undefs = [x for x in obj.free_symbols if not isinstance(x, v.StateVariable)]
                 if len(undefs) == 0:
                     break
@@ -1,19 +1,144 @@
-
 import time
+from concurrent.futures import ProcessPoolExecutor
 from copy import deepcopy
 import numpy as np
 from pycalphad import calculate, variables as v
 from pycalphad.codegen.callables import build_phase_records
 from pycalphad.core.eqsolver import _solve_eq_at_conditions
 from pycalphad.core.equilibrium import _adjust_conditions
+from pycalphad.core.parallel import resolve_workers
 from pycalphad.core.starting_point import starting_point
 from pycalphad.core.utils import instantiate_models, get_state_variables, \
     unpack_components, unpack_condition, filter_phases, get_pure_elements
 from .compsets import get_compsets, find_two_phase_region_compsets
 from .zpf_boundary_sets import ZPFBoundarySets
 
+# Objects shared by every temperature slice mapped in a worker process.
+# They are sent once per process by the pool initializer instead of once per slice.
+_worker_state = {}
+
+
+def _init_worker(state):
+    _worker_state.update(state)
+
+
+def _map_slice_in_worker(T_idx):
+    return _map_temperature_slice(_worker_state, T_idx)
+
+
+def _map_temperature_slice(state, T_idx):
+    """
+    Map the two phase regions at one temperature, in order of increasing composition.
+
+    Parameters
+    ----------
+    state : dict
+        Objects shared by all slices: PhaseRecords, the grid at every temperature, conditions, etc.
+    T_idx : int
+        Index of the temperature in the grid.
+
+    Returns
+    -------
+    Tuple[List[CompsetPair], int, float, float]
+        Composition sets found, number of equilibria calculated, and the time
+        spent calculating equilibria and the convex hull.
+    """
+    prxs = state['phase_records']
+    statevars = state['state_variables']
+    str_conds = state['str_conds']
+    comp_cond = state['comp_cond']
+    indep_comp = state['indep_comp']
+    indep_comp_idx = state['indep_comp_idx']
+    dX = state['dX']
+    Xmax = state['Xmax']
+    verbose = state['verbose']
+    T = state['temperatures'][T_idx]
+    slice_compsets = []
+    equilibria_calculated = 0
+    equilibrium_time = 0
+    if verbose:
+        print("=== T = {} ===".format(float(T)))
+    eq_conds = deepcopy(state['conditions'])
+    eq_conds[v.T] = [float(T)]
+    Xmax_visited = 0.0
+    hull_time = time.time()
+    grid = state['grid'].select_state(T=T_idx)
+    hull = starting_point(eq_conds, statevars, prxs, grid)
+    convex_hull_time = time.time() - hull_time
+    while Xmax_visited < Xmax:
+        hull_compsets = find_two_phase_region_compsets(hull, T, indep_comp, indep_comp_idx, minimum_composition=Xmax_visited, misc_gap_tol=2*dX)
+        if hull_compsets is None:
+            if verbose:
+                print("== Convex hull: max visited = {} - no multiphase phase compsets found ==".format(Xmax_visited, hull_compsets))
+            break
+        Xeq = hull_compsets.mean_composition
+        eq_conds[comp_cond] = [float(Xeq)]
+        eq_time = time.time()
+        start_point = starting_point(eq_conds, statevars, prxs, grid)
+        eq_ds = _solve_eq_at_conditions(start_point, prxs, grid, str_conds, statevars, False)
+        equilibrium_time += time.time() - eq_time
+        equilibria_calculated += 1
+        # composition sets in the plane of the calculation:
+        # even for isopleths, this should always be two.
+        compsets = get_compsets(eq_ds, indep_comp, indep_comp_idx)
+        if verbose:
+            print("== Convex hull: max visited = {:0.4f} - hull compsets: {} equilibrium compsets: {} ==".format(Xmax_visited, hull_compsets, compsets))
+        if compsets is None:
+            # equilibrium calculation, didn't find a valid multiphase composition set
+            # we need to find the next feasible one from the convex hull.
+            Xmax_visited += dX
+            continue
+        else:
+            slice_compsets.append(compsets)
+            if compsets.max_composition > Xmax_visited:
+                Xmax_visited = compsets.max_composition
+        # this seems kind of sloppy, but captures the effect that we want to
+        # keep doing equilibrium calculations, if possible.
+        while Xmax_visited < Xmax and compsets is not None:
+            eq_conds[comp_cond] = [float(Xmax_visited + dX)]
+            eq_time = time.time()
+            # TODO: starting point could be improved by basing it off the previous calculation
+            start_point = starting_point(eq_conds, statevars, prxs, grid)
+            eq_ds = _solve_eq_at_conditions(start_point, prxs, grid, str_conds, statevars, False)
+            equilibrium_time += time.time() - eq_time
+            equilibria_calculated += 1
+            compsets = get_compsets(eq_ds, indep_comp, indep_comp_idx)
+            if compsets is not None:
+                Xmax_visited = compsets.max_composition
+                slice_compsets.append(compsets)
+            else:
+                Xmax_visited += dX
+            if verbose:
+                print("Equilibrium: at X = {:0.4f}, found compsets {}".format(Xmax_visited, compsets))
+    if verbose:
+        print(equilibria_calculated, 'equilibria calculated in this iteration.')
+    return slice_compsets, equilibria_calculated, equilibrium_time, convex_hull_time
+
+
+def _slice_pair_tolerance(temperatures, default_step):
+    """
+    Return the temperature tolerance between two mapped slices, as used by TwoPhaseRegion.
+
+    The tolerance of a slice is twice the distance to its nearest mapped neighbor
+    (twice default_step if it has none), and the tolerance between two slices is
+    the larger of theirs. Regions therefore only join adjacent slices, whether
+    they were mapped coarsely or refined later, and never join slices of
+    separately mapped ranges.
+    """
+    temperatures = np.sort(np.asarray(temperatures, dtype=np.float64))
+    gaps = np.diff(temperatures)
+    nearest_gaps = np.minimum(np.append(gaps, np.inf), np.insert(gaps, 0, np.inf))
+    tolerances = 2 * np.where(np.isfinite(nearest_gaps), nearest_gaps, default_step)
+
+    def pair_tolerance(T1, T2):
+        idx1 = np.argmin(np.abs(temperatures - T1))
+        idx2 = np.argmin(np.abs(temperatures - T2))
+        return max(tolerances[idx1], tolerances[idx2])
+    return pair_tolerance
+
+
 def map_binary(dbf, comps, phases, conds, eq_kwargs=None, calc_kwargs=None,
-               boundary_sets=None, verbose=False, summary=False,):
+               boundary_sets=None, verbose=False, summary=False, workers=None):
     """
     Map a binary T-X phase diagram
 
@@ -30,7 +155,11 @@ def map_binary(dbf, comps, phases, conds, eq_kwargs=None, calc_kwargs=None,
     verbose : bool
         Print verbose output for mapping
     boundary_sets : ZPFBoundarySets
-        Existing ZPFBoundarySets
+        Existing ZPFBoundarySets. Temperatures it was already mapped at, with
+        the same or a smaller composition step, are not mapped again.
+    workers : Optional[int]
+        Number of worker processes mapping temperatures concurrently.
+        None (default) maps in the current process and -1 uses one process per CPU.
 
     Returns
     -------
@@ -46,11 +175,11 @@ def map_binary(dbf, comps, phases, conds, eq_kwargs=None, calc_kwargs=None,
     potential two phase region.
 
     For each temperature, proceed along increasing composition, skipping two
-    over two phase regions, once calculated.
+    over two phase regions, once calculated. Models, PhaseRecords and the grid
+    (at every temperature) are built once and shared by all temperatures.
     [1] J. Snider, I. Griva, X. Sun, M. Emelianenko, Set based framework for Gibbs energy minimization, Calphad. 48 (2015) 18-26. doi: 10.1016/j.calphad.2014.09.005
 
     """
-
     eq_kwargs = eq_kwargs or {}
     calc_kwargs = calc_kwargs or {}
     # implicitly add v.N to conditions
@@ -88,6 +217,9 @@ def map_binary(dbf, comps, phases, conds, eq_kwargs=None, calc_kwargs=None,
     dT = temperature_grid[1] - temperature_grid[0]
 
     boundary_sets = boundary_sets or ZPFBoundarySets(comps, comp_cond)
+    # Slices already mapped at least as finely are skipped
+    T_indices = [T_idx for T_idx, T in enumerate(temperature_grid)
+                 if boundary_sets.mapped_slices.get(float(T), np.inf) > dX + 1e-12]
 
     equilibria_calculated = 0
     equilibrium_time = 0
@@ -96,69 +228,38 @@ def map_binary(dbf, comps, phases, conds, eq_kwargs=None, calc_kwargs=None,
     curr_conds = {key: unpack_condition(val) for key, val in conds.items()}
     str_conds = sorted([str(k) for k in curr_conds.keys()])
     grid_conds = _adjust_conditions(curr_conds)
-    for T_idx in range(temperature_grid.size):
-        T = temperature_grid[T_idx]
-        iter_equilibria = 0
-        if verbose:
-            print("=== T = {} ===".format(float(T)))
-        curr_conds[v.T] = [float(T)]
-        eq_conds = deepcopy(curr_conds)
-        Xmax_visited = 0.0
-        hull_time = time.time()
+    if len(T_indices) > 0:
+        temperatures = temperature_grid[T_indices]
         grid = calculate(dbf, comps, phases, fake_points=True, output='GM',
-                         T=T, P=grid_conds[v.P], N=1, model=models,
-                         parameters=parameters, to_xarray=False, **calc_kwargs)
-        hull = starting_point(eq_conds, statevars, prxs, grid)
-        convex_hull_time += time.time() - hull_time
-        convex_hulls_calculated += 1
-        while Xmax_visited < Xmax:
-            hull_compsets = find_two_phase_region_compsets(hull, T, indep_comp, indep_comp_idx, minimum_composition=Xmax_visited, misc_gap_tol=2*dX)
-            if hull_compsets is None:
-                if verbose:
-                    print("== Convex hull: max visited = {} - no multiphase phase compsets found ==".format(Xmax_visited, hull_compsets))
-                break
-            Xeq = hull_compsets.mean_composition
-            eq_conds[comp_cond] = [float(Xeq)]
-            eq_time = time.time()
-            start_point = starting_point(eq_conds, statevars, prxs, grid)
-            eq_ds = _solve_eq_at_conditions(start_point, prxs, grid, str_conds, statevars, False)
-            equilibrium_time += time.time() - eq_time
-            equilibria_calculated += 1
-            iter_equilibria += 1
-            # composition sets in the plane of the calculation:
-            # even for isopleths, this should always be two.
-            compsets = get_compsets(eq_ds, indep_comp, indep_comp_idx)
-            if verbose:
-                print("== Convex hull: max visited = {:0.4f} - hull compsets: {} equilibrium compsets: {} ==".format(Xmax_visited, hull_compsets, compsets))
-            if compsets is None:
-                # equilibrium calculation, didn't find a valid multiphase composition set
-                # we need to find the next feasible one from the convex hull.
-                Xmax_visited += dX
-                continue
-            else:
-                boundary_sets.add_compsets(compsets, Xtol=0.10, Ttol=2*dT)
-                if compsets.max_composition > Xmax_visited:
-                    Xmax_visited = compsets.max_composition
-            # this seems kind of sloppy, but captures the effect that we want to
-            # keep doing equilibrium calculations, if possible.
-            while Xmax_visited < Xmax and compsets is not None:
-                eq_conds[comp_cond] = [float(Xmax_visited + dX)]
-                eq_time = time.time()
-                # TODO: starting point could be improved by basing it off the previous calculation
-                start_point = starting_point(eq_conds, statevars, prxs, grid)
-                eq_ds = _solve_eq_at_conditions(start_point, prxs, grid, str_conds, statevars, False)
-                equilibrium_time += time.time() - eq_time
-                equilibria_calculated += 1
-                compsets = get_compsets(eq_ds, indep_comp, indep_comp_idx)
-                if compsets is not None:
-                    Xmax_visited = compsets.max_composition
-                    boundary_sets.add_compsets(compsets, Xtol=0.10, Ttol=2*dT)
-                else:
-                    Xmax_visited += dX
-                if verbose:
-                    print("Equilibrium: at X = {:0.4f}, found compsets {}".format(Xmax_visited, compsets))
-        if verbose:
-            print(iter_equilibria, 'equilibria calculated in this iteration.')
+                         T=temperatures, P=grid_conds[v.P], N=1, model=models, phase_records=prxs,
+                         parameters=parameters, to_xarray=False, compact=True, **calc_kwargs)
+        state = {'phase_records': prxs, 'grid': grid, 'state_variables': statevars, 'str_conds': str_conds,
+                 'conditions': curr_conds, 'comp_cond': comp_cond, 'indep_comp': indep_comp,
+                 'indep_comp_idx': indep_comp_idx, 'dX': dX, 'Xmax': Xmax, 'verbose': verbose,
+                 'temperatures': temperatures}
+        workers = min(resolve_workers(workers), len(T_indices))
+        if workers > 1:
+            executor = ProcessPoolExecutor(max_workers=workers, initializer=_init_worker, initargs=(state,))
+            # Slices are submitted one at a time, so slices crossing many two phase regions do not hold up a chunk
+            slice_results = executor.map(_map_slice_in_worker, range(len(T_indices)))
+        else:
+            executor = None
+            slice_results = (_map_temperature_slice(state, idx) for idx in range(len(T_indices)))
+        try:
+            new_compsets = {}
+            for T, (slice_compsets, slice_equilibria, slice_eq_time, slice_hull_time) in zip(temperatures, slice_results):
+                new_compsets[float(T)] = slice_compsets
+                equilibria_calculated += slice_equilibria
+                equilibrium_time += slice_eq_time
+                convex_hull_time += slice_hull_time
+                convex_hulls_calculated += 1
+        finally:
+            if executor is not None:
+                executor.shutdown()
+        # Regions may span slices mapped by earlier calls, so the tolerance depends on the local spacing of the slices
+        mapped_temperatures = sorted(set(boundary_sets.mapped_slices.keys()) | set(new_compsets.keys()))
+        Ttol = _slice_pair_tolerance(mapped_temperatures, dT)
+        boundary_sets.update_slices(new_compsets, dX, Xtol=0.10, Ttol=Ttol)
     if verbose or summary:
         print("{} Convex hulls calculated ({:0.1f}s)".format(convex_hulls_calculated, convex_hull_time))
         print("{} Equilbria calculated ({:0.1f}s)".format(equilibria_calculated, equilibrium_time))
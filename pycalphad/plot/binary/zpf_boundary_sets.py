@@ -33,8 +33,9 @@ class TwoPhaseRegion():
         compsets : CompsetPair
         Xtol : float
             Composition discrepancy tolerance
-        Ttol : float
-            Temperature discrepancy tolerance
+        Ttol : float or callable
+            Temperature discrepancy tolerance. If callable, it is called with the
+            temperatures of the two CompsetPairs and returns the tolerance between them.
 
         Returns
         -------
@@ -51,6 +52,8 @@ class TwoPhaseRegion():
         """
         if compsets.unique_phases == self.phases:
             last_compsets = self.compsets[-1]
+            if callable(Ttol):
+                Ttol = Ttol(last_compsets.temperature, compsets.temperature)
             if np.all(last_compsets.pairwise_xdiscrepancy(compsets) < Xtol) and \
                np.abs(last_compsets.temperature - compsets.temperature) < Ttol:
                 return True
@@ -88,6 +91,8 @@ class ZPFBoundarySets():
         Condition for the independent component
     all_compsets : list of CompsetPair
     two_phase_regions : list of TwoPhaseRegion
+    mapped_slices : dict
+        Maps each temperature that has been mapped to the composition step it was mapped with.
 
     """
     def __init__(self, comps, indep_composition_condition):
@@ -95,6 +100,7 @@ class ZPFBoundarySets():
         self.indep_comp_cond = indep_composition_condition
         self.all_compsets = []
         self.two_phase_regions = []
+        self.mapped_slices = {}
 
     def get_phases(self):
         """
@@ -146,6 +152,38 @@ class ZPFBoundarySets():
         for cs in previous_all_compsets:
             self.add_compsets(cs, Xtol=Xtol, Ttol=Ttol)
 
+    def update_slices(self, slice_compsets, composition_step, Xtol=0.05, Ttol=10):
+        """
+        Replace the composition sets of some temperature slices and rebuild the two phase regions.
+
+        Parameters
+        ----------
+        slice_compsets : dict
+            Maps temperatures to the list of CompsetPairs found at that temperature, in order of composition.
+            Composition sets previously found at these temperatures are removed.
+        composition_step : float
+            Composition step the slices were mapped with.
+        Xtol : float
+            See TwoPhaseRegion.compsets_belong_in_region
+        Ttol : float
+            See TwoPhaseRegion.compsets_belong_in_region
+
+        Notes
+        -----
+        Regions are rebuilt from all composition sets sorted by temperature, so
+        slices between previously mapped temperatures join the existing regions.
+
+        """
+        temperatures = np.array(sorted(slice_compsets.keys()), dtype=np.float64)
+        kept_compsets = [cs for cs in self.all_compsets
+                         if not np.any(np.isclose(cs.temperature, temperatures, rtol=0, atol=1e-8))]
+        new_compsets = [cs for temperature in temperatures for cs in slice_compsets[temperature]]
+        # Sorting is stable, so composition sets at one temperature stay in order of composition
+        self.all_compsets = sorted(kept_compsets + new_compsets, key=lambda cs: cs.temperature)
+        for temperature in temperatures:
+            self.mapped_slices[float(temperature)] = composition_step
+        self.rebuild_two_phase_regions(Xtol=Xtol, Ttol=Ttol)
+
     def get_scatter_plot_boundaries(self, tieline_color=(0, 1, 0, 1), legend_generator=phase_legend):
         """
         Get the ZPF boundaries to plot from each two phase region.
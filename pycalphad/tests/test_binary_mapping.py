@@ -1,6 +1,6 @@
 from pycalphad import variables as v
 from pycalphad.plot.binary.compsets import BinaryCompset, CompsetPair
-from pycalphad.plot.binary.map import map_binary
+from pycalphad.plot.binary.map import map_binary, _slice_pair_tolerance
 from pycalphad.plot.binary.zpf_boundary_sets import TwoPhaseRegion, ZPFBoundarySets
 from pycalphad.tests.fixtures import select_database, load_database
 
@@ -18,9 +18,73 @@ def test_binary_mapping(load_database):
     zpf_boundaries = map_binary(dbf, comps, my_phases, conds)
     num_boundaries = len(zpf_boundaries.all_compsets)
     assert num_boundaries > 0
-    # calling binplot again can add more boundaries
+    assert sorted(zpf_boundaries.mapped_slices.keys()) == [1200., 1250.]
+    # calling binplot again does not map the same temperatures twice
     map_binary(dbf, comps, my_phases, conds, boundary_sets=zpf_boundaries)
-    assert len(zpf_boundaries.all_compsets) == 2*num_boundaries
+    assert len(zpf_boundaries.all_compsets) == num_boundaries
+
+
+@select_database("alfe.tdb")
+def test_binary_mapping_incremental_refinement(load_database):
+    """
+    Refining existing boundary sets only maps the new temperatures, and matches mapping them all at once.
+    """
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'HCP_A3', 'AL5FE2',
+                 'AL2FE', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    coarse_conds = {v.T: (1200, 1300, 50), v.P: 101325, v.X('AL'): (0, 1, 0.2)}
+    fine_conds = {v.T: (1200, 1300, 25), v.P: 101325, v.X('AL'): (0, 1, 0.2)}
+    zpf_boundaries = map_binary(dbf, comps, my_phases, coarse_conds)
+    coarse_temperatures = {cs.temperature for cs in zpf_boundaries.all_compsets}
+    map_binary(dbf, comps, my_phases, fine_conds, boundary_sets=zpf_boundaries)
+    assert sorted(zpf_boundaries.mapped_slices.keys()) == [1200., 1225., 1250., 1275.]
+    assert coarse_temperatures.issubset({cs.temperature for cs in zpf_boundaries.all_compsets})
+    # Temperatures are mapped in worker processes when workers are given
+    all_at_once = map_binary(dbf, comps, my_phases, fine_conds, workers=2)
+    assert [cs.temperature for cs in all_at_once.all_compsets] == \
+        [cs.temperature for cs in zpf_boundaries.all_compsets]
+    assert len(all_at_once.two_phase_regions) == len(zpf_boundaries.two_phase_regions)
+
+
+@select_database("alfe.tdb")
+def test_binary_mapping_separate_ranges_are_not_joined(load_database):
+    """
+    Mapping two separate temperature ranges one after the other does not join their two phase regions.
+    """
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'HCP_A3', 'AL5FE2',
+                 'AL2FE', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    low_conds = {v.T: (1000, 1100, 50), v.P: 101325, v.X('AL'): (0, 1, 0.2)}
+    high_conds = {v.T: (1300, 1400, 50), v.P: 101325, v.X('AL'): (0, 1, 0.2)}
+    zpf_boundaries = map_binary(dbf, comps, my_phases, low_conds)
+    map_binary(dbf, comps, my_phases, high_conds, boundary_sets=zpf_boundaries)
+    assert sorted(zpf_boundaries.mapped_slices.keys()) == [1000., 1050., 1300., 1350.]
+    for tpr in zpf_boundaries.two_phase_regions:
+        region_temperatures = [cs.temperature for cs in tpr.compsets]
+        assert (max(region_temperatures) < 1200) or (min(region_temperatures) > 1200)
+
+
+def test_slice_pair_tolerance_follows_local_slice_spacing():
+    "Slices refined after a coarse map are joined with the fine tolerance, and separate ranges are not joined."
+    def compsets(T, phases=('P1', 'P2')):
+        return CompsetPair([
+            BinaryCompset(phases[0], T, 'B', 0.5, [0.5, 0.5]),
+            BinaryCompset(phases[1], T, 'B', 0.8, [0.2, 0.8]),
+        ])
+    temperatures = [1000., 1050., 1100., 1300., 1310., 1320., 1330.]
+    Ttol = _slice_pair_tolerance(temperatures, 50)
+    assert Ttol(1000., 1050.) == 100
+    assert Ttol(1310., 1320.) == 20
+    assert Ttol(1100., 1300.) == 100
+    zpfbs = ZPFBoundarySets(['A', 'B'], v.X('B'))
+    # The P1/P2 region is missing from the 1320 K slice of the refinement
+    slices = {T: [compsets(T)] for T in temperatures if T != 1320.}
+    slices[1320.] = [compsets(1320., ('P2', 'P3'))]
+    zpfbs.update_slices(slices, 0.1, Xtol=0.10, Ttol=Ttol)
+    region_temperatures = sorted(sorted(cs.temperature for cs in tpr.compsets) for tpr in zpfbs.two_phase_regions)
+    assert region_temperatures == [[1000., 1050., 1100.], [1300., 1310.], [1320.], [1330.]]
 
 
 def test_two_phase_region_usage():
@@ -4,11 +4,12 @@ Model quantities correctly.
 """
 
 import pytest
-from pycalphad import Database, calculate, Model, variables as v
+from pycalphad import Database, calculate, equilibrium, Model, variables as v
 import numpy as np
 from numpy.testing import assert_allclose
 from pycalphad.codegen.callables import build_phase_records
 from pycalphad.core.utils import instantiate_models
+from pycalphad.core.prepared_system import PreparedSystem
 from pycalphad import ConditionError
 from pycalphad.tests.fixtures import select_database, load_database
 
@@ -240,3 +241,140 @@ def test_charged_infeasible_minimum_norm():
     # Check that the point sample didn't get 'stuck' in part of the space
     assert np.any(np.logical_and(output[:, 1] > 0.05, output[:, 1] < 0.15))
     assert np.any(np.logical_and(output[:, 1] > 0.25, output[:, 1] < 0.35))
+
+
+@select_database("cumg_parameters.tdb")
+def test_prepared_system_calculate_matches_calculate(load_database):
+    "A batch of parameter vectors evaluated by a PreparedSystem gives the same energies as calculate"
+    dbf = load_database()
+    prepared = PreparedSystem(dbf, ['CU', 'MG'], ['HCP_A3'], {'VV0000': -32539.5, 'VV0001': 8236.3})
+    batch = np.array([[-33134.699474175846, 7734.114029426941], [-32539.5, 8236.3]])
+    res = prepared.calculate(batch, T=743.15, P=1e5)
+    assert res.GM.shape[-1] == 2
+    for sample_idx, sample_values in enumerate(batch):
+        parameters = dict(zip(['VV0000', 'VV0001'], sample_values))
+        res_calculate = calculate(dbf, ['CU', 'MG'], ['HCP_A3'], parameters=parameters, T=743.15, P=1e5,
+                                  points=prepared.points['HCP_A3'], to_xarray=False)
+        assert_allclose(res.GM[..., sample_idx], res_calculate.GM)
+
+
+@select_database("al_parameter.tdb")
+def test_prepared_system_equilibrium_uses_new_parameters(load_database):
+    "Equilibria of a PreparedSystem follow the parameter values passed to each call"
+    dbf = load_database()
+    prepared = PreparedSystem(dbf, ['AL'], ['FCC_A1'], {'VV0000': 5000})
+    conds = {v.P: 101325, v.T: 500, v.N: 1}
+    eq_res = prepared.equilibrium(conds, [10000])
+    assert_allclose(eq_res.GM.values.squeeze(), 10000.0)
+    eq_results = prepared.equilibrium(conds, [[2000], [3000]])
+    assert_allclose([eq_res.GM.values.squeeze() for eq_res in eq_results], [2000.0, 3000.0])
+
+
+@pytest.mark.solver
+@select_database("cumg_parameters.tdb")
+def test_prepared_system_batched_equilibrium_matches_equilibrium(load_database):
+    "A batch of parameter vectors solved by a PreparedSystem matches separate equilibrium calls, and restores the PhaseRecords"
+    dbf = load_database()
+    comps = ['CU', 'MG']
+    # VV0000 is in CUMG2 and VV0001 in FCC_A1
+    phases = ['CUMG2', 'FCC_A1', 'LIQUID']
+    prepared = PreparedSystem(dbf, comps, phases, {'VV0000': -32539.5, 'VV0001': 8236.3})
+    conds = {v.P: 101325, v.T: [743.15, 1000], v.X('MG'): [0.1, 0.5]}
+    batch = np.array([[-33134.699474175846, 7734.114029426941], [-32539.5, 8236.3]])
+    previous_values = {name: np.array(prx.parameters) for name, prx in prepared.phase_records.items()}
+    eq_results = prepared.equilibrium(conds, batch, output='HM')
+    for name, prx in prepared.phase_records.items():
+        assert_allclose(prx.parameters, previous_values[name])
+    for sample_values, eq_res in zip(batch, eq_results):
+        parameters = dict(zip(['VV0000', 'VV0001'], sample_values))
+        expected = equilibrium(dbf, comps, phases, conds, parameters=parameters, output='HM',
+                               calc_opts={'points': prepared.points})
+        assert_allclose(eq_res.GM.values, expected.GM.values)
+        assert_allclose(eq_res.MU.values, expected.MU.values)
+        assert_allclose(eq_res.HM.values, expected.HM.values)
+
+
+@select_database("alcrni.tdb")
+def test_compact_grid_matches_dense_grid(load_database):
+    "A compact grid stores the same points as the dense, NaN-padded grid."
+    dbf = load_database()
+    comps = ['AL', 'CR', 'NI', 'VA']
+    phases = ['L12_FCC', 'LIQUID']
+    dense = calculate(dbf, comps, phases, T=[1273., 1373.], P=101325, fake_points=True,
+                      pdens=20, to_xarray=False)
+    compact = calculate(dbf, comps, phases, T=[1273., 1373.], P=101325, fake_points=True,
+                        pdens=20, to_xarray=False, compact=True)
+    num_points = dense.GM.shape[-1]
+    assert compact.num_points == num_points
+    assert_allclose(compact.GM, dense.GM)
+    assert_allclose(compact.X, dense.X)
+    for T_idx in range(2):
+        np.testing.assert_array_equal(compact.point_phases(), dense.Phase[0, 0, T_idx])
+        assert_allclose(compact.padded_site_fractions(np.arange(num_points), dense.Y.shape[-1]),
+                        dense.Y[0, 0, T_idx])
+    assert compact.attrs['phase_indices'] == dense.attrs['phase_indices']
+    assert compact.nbytes < dense.GM.nbytes + dense.X.nbytes + dense.Y.nbytes
+
+
+@select_database("alcrni.tdb")
+def test_memmap_compact_grid_matches_in_memory_grid(load_database, tmp_path):
+    "A memory-mapped compact grid holds the same values as an in-memory one, and pickles by file name."
+    import pickle
+    dbf = load_database()
+    comps = ['AL', 'CR', 'NI', 'VA']
+    phases = ['L12_FCC', 'LIQUID']
+    in_memory = calculate(dbf, comps, phases, T=[1273., 1373.], P=101325, fake_points=True,
+                          pdens=20, to_xarray=False, compact=True)
+    mapped = calculate(dbf, comps, phases, T=[1273., 1373.], P=101325, fake_points=True,
+                       pdens=20, to_xarray=False, compact=True, memmap_dir=str(tmp_path))
+    assert mapped.memmap_dir == str(tmp_path)
+    assert isinstance(mapped.GM, np.memmap)
+    unpickled = pickle.loads(pickle.dumps(mapped))
+    assert isinstance(unpickled.GM, np.memmap)
+    for grid in (mapped, unpickled):
+        assert_allclose(grid.GM, in_memory.GM)
+        assert_allclose(grid.X, in_memory.X)
+        assert_allclose(grid.site_fractions, in_memory.site_fractions)
+        np.testing.assert_array_equal(grid.offsets, in_memory.offsets)
+        np.testing.assert_array_equal(grid.point_phases(), in_memory.point_phases())
+    # Another process without the directory, or after it was reused for another grid, cannot read the files
+    pickled = pickle.dumps(mapped)
+    calculate(dbf, comps, phases, T=1273., P=101325, pdens=20, to_xarray=False, compact=True,
+              memmap_dir=str(tmp_path))
+    with pytest.raises(ValueError):
+        pickle.loads(pickled)
+    with pytest.raises(ValueError):
+        calculate(dbf, comps, phases, T=1273., P=101325, pdens=20, to_xarray=False, memmap_dir=str(tmp_path))
+
+
+def test_hr_point_sample_max_step_stays_in_neighborhood():
+    "Hit-and-run steps limited by max_step stay feasible and near the initial point."
+    from pycalphad.core.calculate import hr_point_sample, _linear_site_fraction_constraints
+    constraint_jac, constraint_rhs = _linear_site_fraction_constraints([3, 2])
+    initial_point = np.array([0.2, 0.3, 0.5, 0.6, 0.4])
+    points = hr_point_sample(constraint_jac, constraint_rhs, initial_point, 50, max_step=0.01)
+    assert points.shape == (50, 5)
+    assert_allclose(constraint_jac.dot(points.T).T, np.broadcast_to(constraint_rhs, (50, 2)), atol=1e-10)
+    steps = np.linalg.norm(np.diff(np.vstack([initial_point, points]), axis=0), axis=1)
+    assert np.all(steps <= 0.01 + 1e-12)
+    assert np.all(points >= 0)
+
+
+def test_hr_point_sample_chains_write_into_buffer():
+    "Hit-and-run chains write feasible, reproducible points into the given buffer."
+    from pycalphad.core.calculate import hr_point_sample, _linear_site_fraction_constraints, \
+        _cached_null_space_basis
+    constraint_jac, constraint_rhs = _linear_site_fraction_constraints([3, 2, 2])
+    initial_point = np.array([0.2, 0.3, 0.5, 0.6, 0.4, 0.5, 0.5])
+    buffer = np.full((110, 7), np.nan)
+    _cached_null_space_basis.cache_clear()
+    points = hr_point_sample(constraint_jac, constraint_rhs, initial_point, 100, num_chains=4, out=buffer[10:])
+    assert points.shape == (100, 7)
+    assert np.shares_memory(points, buffer)
+    assert np.all(np.isnan(buffer[:10]))
+    assert_allclose(constraint_jac.dot(points.T).T, np.broadcast_to(constraint_rhs, (100, 3)), atol=1e-10)
+    assert np.all(points >= 0)
+    # Same seed gives the same points, and the null space basis is reused
+    points_again = hr_point_sample(constraint_jac, constraint_rhs, initial_point, 100, num_chains=4)
+    assert_allclose(points_again, points)
+    assert _cached_null_space_basis.cache_info().hits == 1
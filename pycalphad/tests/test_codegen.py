@@ -6,10 +6,11 @@ import pickle
 import pytest
 import numpy as np
 from symengine.lib.symengine_wrapper import LambdaDouble, LLVMDouble
-from symengine import zoo
+from symengine import zoo, Symbol
 from pycalphad import Model, variables as v
 from pycalphad.codegen.callables import build_phase_records
 from pycalphad.codegen.sympydiff_utils import build_functions, build_constraint_functions
+from pycalphad.codegen import disk_cache
 from pycalphad.tests.fixtures import select_database, load_database
 
 
@@ -94,3 +95,149 @@ def test_complex_infinity_can_build_callables_successfully(load_database):
 
     int_cons = mod.get_internal_constraints()
     build_constraint_functions(mod_vars, int_cons)
+
+
+@select_database("alnipt.tdb")
+def test_phase_record_batched_derivatives_match_single_point(load_database):
+    "Batched PhaseRecord derivative methods agree with evaluating one point at a time"
+    dbf = load_database()
+    comps = [v.Species('AL'), v.Species('NI'), v.Species('VA')]
+    mod = Model(dbf, comps, 'LIQUID')
+    prxs = build_phase_records(dbf, comps, ['LIQUID'], [v.P, v.T], {'LIQUID': mod},
+                               build_gradients=True, build_hessians=True)
+    prx = prxs['LIQUID']
+    dof = np.array([[101325, 300, 0.3, 0.7],
+                    [101325, 1000, 0.5, 0.5],
+                    [101325, 1500, 0.9, 0.1]])
+    num_points, num_vars = dof.shape
+
+    grads = np.zeros((num_points, num_vars))
+    hessians = np.zeros((num_points, num_vars, num_vars))
+    cons_jacs = np.zeros((num_points, prx.num_internal_cons, num_vars))
+    mole_grads = np.zeros((num_points, num_vars))
+    mole_hessians = np.zeros((num_points, num_vars, num_vars))
+    prx.formulagrad_2d(grads, dof)
+    prx.formulahess_2d(hessians, dof)
+    prx.internal_cons_jac_2d(cons_jacs, dof)
+    prx.formulamole_grad_2d(mole_grads, dof, 0)
+    prx.formulamole_hess_2d(mole_hessians, dof, 0)
+
+    for i in range(num_points):
+        grad = np.zeros(num_vars)
+        hess = np.zeros((num_vars, num_vars))
+        cons_jac = np.zeros((prx.num_internal_cons, num_vars))
+        mole_grad = np.zeros(num_vars)
+        mole_hess = np.zeros((num_vars, num_vars))
+        prx.formulagrad(grad, dof[i])
+        prx.formulahess(hess, dof[i])
+        prx.internal_cons_jac(cons_jac, dof[i])
+        prx.formulamole_grad(mole_grad, dof[i], 0)
+        prx.formulamole_hess(mole_hess, dof[i], 0)
+        np.testing.assert_array_equal(grads[i], grad)
+        np.testing.assert_array_equal(hessians[i], hess)
+        np.testing.assert_array_equal(cons_jacs[i], cons_jac)
+        np.testing.assert_array_equal(mole_grads[i], mole_grad)
+        np.testing.assert_array_equal(mole_hessians[i], mole_hess)
+
+
+def test_build_functions_disk_cache(tmp_path):
+    "Compiled callables are reused from the disk cache and unreadable entries are discarded"
+    x, y = Symbol('X'), Symbol('Y')
+    graph = x**2 * y + 3 * x
+    disk_cache.set_cache_dir(tmp_path)
+    try:
+        built = build_functions.__wrapped__(graph, (x, y), include_grad=True)
+        cache_files = list(tmp_path.glob('*.pkl'))
+        assert len(cache_files) == 1
+        loaded = build_functions.__wrapped__(graph, (x, y), include_grad=True)
+        inp = np.array([2.0, 5.0])
+        assert np.all(np.asarray(built.func(inp)) == np.asarray(loaded.func(inp)))
+        assert np.all(np.asarray(built.grad(inp)) == np.asarray(loaded.grad(inp)))
+        # A different expression must not reuse the entry
+        build_functions.__wrapped__(graph + 1, (x, y), include_grad=True)
+        assert len(list(tmp_path.glob('*.pkl'))) == 2
+        # Corrupted entries are removed and rebuilt
+        cache_files[0].write_bytes(b'not a pickle')
+        rebuilt = build_functions.__wrapped__(graph, (x, y), include_grad=True)
+        assert np.all(np.asarray(built.func(inp)) == np.asarray(rebuilt.func(inp)))
+        assert cache_files[0].read_bytes() != b'not a pickle'
+    finally:
+        disk_cache.set_cache_dir(None)
+
+
+def test_disk_cache_directory_from_environment(tmp_path, monkeypatch):
+    "The environment variable is normalized like set_cache_dir, and an unusable directory is not an error"
+    x, y = Symbol('X'), Symbol('Y')
+    monkeypatch.setenv('HOME', str(tmp_path))
+    monkeypatch.setenv(disk_cache.CACHE_DIR_ENV_VAR, '~/callables')
+    try:
+        disk_cache._set_cache_dir_from_env()
+        assert disk_cache.get_cache_dir() == str(tmp_path / 'callables')
+        assert (tmp_path / 'callables').is_dir()
+        # The directory disappears (or is not writable); functions are still built, without caching
+        (tmp_path / 'callables').rmdir()
+        built = build_functions.__wrapped__(x**2 * y, (x, y), include_grad=True)
+        assert np.all(np.asarray(built.func(np.array([2.0, 5.0]))) == 20.0)
+        disk_cache.clear()
+    finally:
+        disk_cache.set_cache_dir(None)
+
+
+@select_database("alnipt.tdb")
+def test_fused_derivatives_match_separate_callables(load_database):
+    "PhaseRecords with a fused function, gradient and Hessian agree with separately built callables"
+    dbf = load_database()
+    comps = [v.Species('AL'), v.Species('NI'), v.Species('VA')]
+    mod = Model(dbf, comps, 'LIQUID')
+    separate = build_phase_records(dbf, comps, ['LIQUID'], [v.P, v.T], {'LIQUID': mod},
+                                   build_gradients=True, build_hessians=True)['LIQUID']
+    fused = build_phase_records(dbf, comps, ['LIQUID'], [v.P, v.T], {'LIQUID': mod},
+                                build_gradients=True, build_hessians=True, fused_derivatives=True)['LIQUID']
+    # Only the fused function is compiled; the gradient and Hessian are taken from it
+    assert fused.formulagfunc_ is None and fused.formulahfunc_ is None
+    assert fused.formulafusedfunc_ is not None
+    fused = pickle.loads(pickle.dumps(fused))
+    dof = np.array([[101325, 300, 0.3, 0.7],
+                    [101325, 1500, 0.9, 0.1]])
+    num_points, num_vars = dof.shape
+    for prx in (separate, fused):
+        energy, grad, hess = np.zeros(1), np.zeros(num_vars), np.zeros((num_vars, num_vars))
+        prx.formula_obj_grad_hess(energy, grad, hess, dof[0])
+        expected_energy, expected_grad, expected_hess = np.zeros(1), np.zeros(num_vars), np.zeros((num_vars, num_vars))
+        separate.formulaobj(expected_energy, dof[0])
+        separate.formulagrad(expected_grad, dof[0])
+        separate.formulahess(expected_hess, dof[0])
+        np.testing.assert_allclose(energy, expected_energy, rtol=1e-12)
+        np.testing.assert_allclose(grad, expected_grad, rtol=1e-10, atol=1e-8)
+        np.testing.assert_allclose(hess, expected_hess, rtol=1e-10, atol=1e-8)
+    grads, expected_grads = np.zeros((num_points, num_vars)), np.zeros((num_points, num_vars))
+    hessians, expected_hessians = np.zeros((num_points, num_vars, num_vars)), np.zeros((num_points, num_vars, num_vars))
+    fused.formulagrad_2d(grads, dof)
+    fused.formulahess_2d(hessians, dof)
+    separate.formulagrad_2d(expected_grads, dof)
+    separate.formulahess_2d(expected_hessians, dof)
+    np.testing.assert_allclose(grads, expected_grads, rtol=1e-10, atol=1e-8)
+    np.testing.assert_allclose(hessians, expected_hessians, rtol=1e-10, atol=1e-8)
+
+
+@select_database("alnipt.tdb")
+def test_phase_records_compiled_by_workers_match_serial(load_database):
+    "PhaseRecords compiled in worker processes give the same values as PhaseRecords compiled serially"
+    dbf = load_database()
+    comps = [v.Species('AL'), v.Species('NI'), v.Species('VA')]
+    phases = ['LIQUID', 'FCC_A1']
+    models = {name: Model(dbf, comps, name) for name in phases}
+    serial = build_phase_records(dbf, comps, phases, [v.P, v.T], models,
+                                 build_gradients=True, build_hessians=True)
+    parallel = build_phase_records(dbf, comps, phases, [v.P, v.T], models,
+                                   build_gradients=True, build_hessians=True, workers=2)
+    dof = np.array([101325, 1000, 0.3, 0.7, 1.0])
+    for name in phases:
+        num_vars = 2 + serial[name].phase_dof
+        assert parallel[name].num_internal_cons == serial[name].num_internal_cons
+        for prx_method, shape in (('obj', (1,)), ('formulagrad', (num_vars,)), ('formulahess', (num_vars, num_vars)),
+                                  ('internal_cons_func', (serial[name].num_internal_cons,))):
+            expected, result = np.zeros(shape), np.zeros(shape)
+            getattr(serial[name], prx_method)(expected, dof[:num_vars])
+            getattr(parallel[name], prx_method)(result, dof[:num_vars])
+            np.testing.assert_allclose(result, expected)
@@ -843,3 +843,100 @@ def test_tc_printer_exp():
     test_expr = S('exp(-300T**(-1))')
     result = TCPrinter()._stringify_expr(test_expr)
     assert result == 'exp(-300 * T**(-1))'
+
+
+@select_database("alcrni.tdb")
+def test_search_parameters_matches_search(load_database):
+    "Indexed parameter search finds the same parameters as a full search, also after adding and removing parameters."
+    from tinydb import where
+    # The fixture Database is shared between tests, so modify a copy
+    dbf = deepcopy(load_database())
+    query = (where('phase_name') == 'L12_FCC') & (where('parameter_type') == 'G')
+    constituents = {Species('AL'), Species('NI'), Species('VA')}
+    subset_query = query & where('constituent_array').test(
+        lambda arr: all(set(subl).issubset(constituents) for subl in arr))
+    assert dbf.search_parameters(query, 'L12_FCC', 'G') == dbf.search(query)
+    assert dbf.search_parameters(subset_query, 'L12_FCC', ['G'], constituents=constituents) == dbf.search(subset_query)
+    num_params = len(dbf.search(query))
+    dbf.add_parameter('G', 'L12_FCC', [['AL'], ['NI']], 0, S(1.0))
+    dbf.add_parameter('G', 'L12_FCC', [['NI'], ['NI']], 0, S(2.0), force_insert=False)
+    dbf.process_parameter_queue()
+    assert len(dbf.search_parameters(query, 'L12_FCC', 'G')) == num_params + 2
+    assert dbf.search_parameters(query, 'L12_FCC', 'G') == dbf.search(query)
+    # Removing parameters from the TinyDB directly is detected
+    dbf._parameters.remove(where('parameter') == S(1.0))
+    assert dbf.search_parameters(query, 'L12_FCC', 'G') == dbf.search(query)
+    # Parameters added after a removal that the index did not see are still found
+    dbf._parameters.remove(where('parameter') == S(2.0))
+    dbf.add_parameter('G', 'L12_FCC', [['AL'], ['AL']], 0, S(3.0), force_insert=True)
+    assert len(dbf.search_parameters(query, 'L12_FCC', 'G')) == num_params + 1
+    assert dbf.search_parameters(query, 'L12_FCC', 'G') == dbf.search(query)
+    # Index is not part of the Database state
+    assert deepcopy(dbf) == dbf
+    assert pickle.loads(pickle.dumps(dbf)).search_parameters(query, 'L12_FCC', 'G') == dbf.search(query)
+
+
+def test_snapshot_roundtrip_and_regenerates_when_source_changes(tmp_path):
+    "Database snapshots reload the parsed Database and are regenerated when the source file changes."
+    from pycalphad.io import snapshot
+    tdb_path = tmp_path / "alcrni.tdb"
+    tdb_path.write_text(files(pycalphad.tests.databases).joinpath("alcrni.tdb").read_text())
+    snapshot_path = tmp_path / "alcrni.tdbc"
+    dbf = snapshot.load_database(str(tdb_path))
+    assert dbf == REFERENCE_DBF
+    assert snapshot_path.exists()
+    with open(snapshot_path, 'rb') as fd:
+        header = snapshot.read_snapshot_header(fd)
+    assert header['source_hash'] == snapshot.file_hash(str(tdb_path))
+    # Snapshots are a registered format
+    assert Database(str(snapshot_path)) == REFERENCE_DBF
+    assert snapshot.load_database(str(tdb_path)) == REFERENCE_DBF
+    # The parameter index is read from the snapshot, not rebuilt
+    from tinydb import where
+    from pycalphad.io.database import _parameter_indices
+    snapshot_dbf = Database(str(snapshot_path))
+    assert snapshot_dbf._parameters in _parameter_indices
+    query = (where('phase_name') == 'L12_FCC') & (where('parameter_type') == 'G')
+    assert snapshot_dbf.search_parameters(query, 'L12_FCC', 'G') == REFERENCE_DBF.search(query)
+    # Changing the source invalidates the snapshot
+    tdb_path.write_text(tdb_path.read_text() + "\nFUNCTION SNAPTEST 298.15 +42; 6000 N !\n")
+    changed_dbf = snapshot.load_database(str(tdb_path))
+    assert 'SNAPTEST' in changed_dbf.symbols
+    assert 'SNAPTEST' in Database(str(snapshot_path)).symbols
+    written_path = tmp_path / "written.tdbc"
+    changed_dbf.to_file(str(written_path))
+    assert Database(str(written_path)) == changed_dbf
+    with pytest.raises(ValueError):
+        Database.from_file(str(tdb_path), fmt='tdbc')
+
+
+def test_cs_dat_token_parser():
+    "DAT file tokens are parsed in order, looking ahead does not consume tokens and errors report the line."
+    from pycalphad.io.cs_dat import tokenize, TokenParserError
+    toks = tokenize("TITLE LINE\n 2 1.5 -3.0\n\n  ABC\r\n  # 7\n", startline=1)
+    assert toks.parse(int) == 2
+    assert toks[0] == '1.5'
+    assert toks.parseN(2, float) == [1.5, -3.0]
+    with pytest.raises(TokenParserError, match='line number 4'):
+        toks.parse(float)
+    assert toks.parse(str) == 'ABC'
+    assert toks[0] == '#'
+    assert toks.parseN(2, str) == ['#', '7']
+    with pytest.raises(IndexError):
+        toks.parse(str)
+
+
+def test_cs_dat_parameters_are_deferred():
+    "Parameters of a DAT phase are only inserted when a Model of the phase searches them."
+    dat_path = str(files(pycalphad.tests.databases).joinpath("Kaye_Pd-Ru-Tc-Mo.dat"))
+    dbf = Database(dat_path)
+    assert 'LIQN' in dbf.phases
+    assert 'LIQN' in dbf._deferred_parameters
+    assert 'FCCN' in dbf._deferred_parameters
+    Model(dbf, ['RU', 'PD'], 'LIQN')
+    assert 'LIQN' not in dbf._deferred_parameters
+    assert 'FCCN' in dbf._deferred_parameters
+    # Accessing all parameters inserts those of the remaining phases
+    assert len(dbf._parameters) == len(Database(dat_path)._parameters)
+    assert len(dbf._deferred_parameters) == 0
+    assert dbf == Database(dat_path)
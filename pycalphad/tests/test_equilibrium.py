@@ -62,6 +62,356 @@ def test_phase_records_passed_to_equilibrium(load_database):
     assert_allclose(eqx.GM.values.flat[0], -9.608807e4)
 
 
+@pytest.mark.solver
+@select_database("alfe.tdb")
+def test_eq_workers_matches_serial(load_database):
+    "Solving the condition grid with worker processes gives the same result as the serial solve."
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    conds = {v.T: [1300, 1400], v.P: 101325, v.X('AL'): [0.2, 0.4, 0.55, 0.7]}
+    serial = equilibrium(dbf, comps, my_phases, conds)
+    parallel = equilibrium(dbf, comps, my_phases, conds, workers=2)
+    assert_allclose(parallel.GM.values, serial.GM.values)
+    assert_allclose(parallel.MU.values, serial.MU.values)
+    np.testing.assert_array_equal(parallel.Phase.values, serial.Phase.values)
+
+
+@pytest.mark.solver
+@select_database("alfe.tdb")
+def test_eq_custom_executor_matches_serial(load_database):
+    "Results of an executor backend are gathered into the condition grid, whatever order tasks finish in."
+    from pycalphad.core.parallel import EquilibriumExecutor, _solve_points
+
+    class ReversedExecutor(EquilibriumExecutor):
+        tasks_per_worker = 3
+
+        def __init__(self):
+            self.num_tasks = 0
+
+        def num_workers(self):
+            return 1
+
+        def run(self, shared_state, tasks):
+            self.num_tasks = len(tasks)
+            # Only the tasks carry (their part of) the starting point
+            assert not any(hasattr(state, 'NP') for state in shared_state)
+            for task in reversed(tasks):
+                yield _solve_points(shared_state, task)
+
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    conds = {v.T: [1300, 1400], v.P: 101325, v.X('AL'): [0.2, 0.4, 0.55, 0.7]}
+    serial = equilibrium(dbf, comps, my_phases, conds)
+    executor = ReversedExecutor()
+    distributed = equilibrium(dbf, comps, my_phases, conds, executor=executor)
+    assert executor.num_tasks == 3
+    assert_allclose(distributed.GM.values, serial.GM.values)
+    assert_allclose(distributed.MU.values, serial.MU.values)
+    np.testing.assert_array_equal(distributed.Phase.values, serial.Phase.values)
+
+
+def test_partition_conditions_balances_multiphase_points():
+    "Tasks are contiguous, cover every point once and have similar numbers of stable phases."
+    from pycalphad.core.light_dataset import LightDataset
+    from pycalphad.core.parallel import partition_conditions
+    # Single-phase points, then points with three phases
+    phase_amounts = np.full((12, 3), np.nan)
+    phase_amounts[:8, 0] = 1
+    phase_amounts[8:] = 1/3
+    properties = LightDataset({'GM': (['T'], np.zeros(12)), 'NP': (['T', 'vertex'], phase_amounts)},
+                              coords={'T': np.arange(12), 'vertex': np.arange(3)})
+    tasks = partition_conditions(properties, 4)
+    np.testing.assert_array_equal(np.concatenate(tasks), np.arange(12))
+    weights = [np.sum(np.maximum(np.sum(phase_amounts[task] > 0, axis=-1), 1)) for task in tasks]
+    assert len(tasks) == 4
+    assert max(weights) - min(weights) <= 3
+
+
+def test_slice_points_copies_only_the_box_of_a_task():
+    "A task carries the smallest box of the starting point containing its points, and where it is in the grid."
+    from pycalphad.core.light_dataset import LightDataset
+    from pycalphad.core.parallel import _slice_points
+    GM = np.arange(12, dtype=np.float64).reshape(3, 4)
+    NP = np.stack([GM, -GM], axis=-1)
+    properties = LightDataset({'GM': (['T', 'X_AL'], GM), 'NP': (['T', 'X_AL', 'vertex'], NP)},
+                              coords={'T': np.array([300., 400., 500.]), 'X_AL': np.linspace(0.1, 0.4, 4),
+                                      'vertex': np.arange(2)})
+    point_indices, task_properties, local_indices, condition_offset = \
+        _slice_points(properties, ['T', 'X_AL'], np.arange(5, 9))
+    np.testing.assert_array_equal(point_indices, np.arange(5, 9))
+    assert condition_offset == (1, 0)
+    assert task_properties.GM.shape == (2, 4)
+    np.testing.assert_array_equal(task_properties.coords['T'], [400., 500.])
+    np.testing.assert_array_equal(task_properties.GM.flat[local_indices], GM.flat[5:9])
+    np.testing.assert_array_equal(task_properties.NP, NP[1:3])
+    # The task owns its copy
+    task_properties.GM[...] = np.nan
+    assert not np.any(np.isnan(GM))
+
+
+def test_light_dataset_shares_memory_and_checks_coordinates_on_merge():
+    "Variables are added and converted to xarray by reference; merges compare coordinates, not whole variables."
+    from pycalphad.core.light_dataset import LightDataset
+    GM = np.zeros((2, 3))
+    properties = LightDataset({'GM': (['T', 'X_AL'], GM)}, coords={'T': np.array([300., 400.]), 'X_AL': np.arange(3)})
+    HM = np.ones((2, 3))
+    properties.add_variable('HM', ['T', 'X_AL'], HM)
+    with pytest.raises(ValueError):
+        properties.add_variable('SM', ['T', 'X_AL'], np.ones((3, 2)))
+    other = LightDataset({'GM': (['T', 'X_AL'], np.ones((2, 3))), 'CPM': (['T', 'X_AL'], np.full((2, 3), 2.))},
+                         coords={'T': np.array([300., 400.])})
+    properties.merge(other, inplace=True, compat='override')
+    assert properties.GM is GM
+    with pytest.raises(ValueError):
+        properties.merge(other, inplace=True, compat='equals')
+    with pytest.raises(ValueError):
+        properties.merge(LightDataset({}, coords={'T': np.array([300., 500.])}), inplace=True, compat='override')
+    ds = properties.get_dataset()
+    assert np.shares_memory(ds.GM.values, GM)
+    assert np.shares_memory(ds.HM.values, HM)
+    assert np.shares_memory(ds.CPM.values, properties.CPM)
+
+
+@select_database("alfe.tdb")
+def test_eq_continuation_matches_hull_start(load_database):
+    "Warm-starting points from converged neighbors finds the same equilibria as starting from the hull."
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    conds = {v.T: [1300, 1310, 1320], v.P: 101325, v.X('AL'): [0.2, 0.25, 0.3, 0.55, 0.6, 0.7]}
+    hull_start = equilibrium(dbf, comps, my_phases, conds)
+    warm_start = equilibrium(dbf, comps, my_phases, conds, continuation=True)
+    assert_allclose(warm_start.GM.values, hull_start.GM.values, rtol=1e-6)
+    assert_allclose(warm_start.MU.values, hull_start.MU.values, atol=1e-2)
+    np.testing.assert_array_equal(np.sort(warm_start.Phase.values, axis=-1), np.sort(hull_start.Phase.values, axis=-1))
+
+
+@pytest.mark.solver
+@select_database("alfe.tdb")
+def test_eq_result_cache_reuses_overlapping_points(load_database, tmp_path):
+    "Points of overlapping condition grids are solved once, in memory and across cache instances on disk."
+    from pycalphad.core.result_cache import EquilibriumResultCache
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    cache = EquilibriumResultCache(cache_dir=tmp_path)
+    first_conds = {v.T: [1300, 1400], v.P: 101325, v.X('AL'): [0.2, 0.4]}
+    equilibrium(dbf, comps, my_phases, first_conds, result_cache=cache)
+    assert (cache.hits, cache.misses) == (0, 4)
+    # np.linspace values of X(AL) differ from the literals in the last bits, but are the same points
+    conds = {v.T: [1300, 1400], v.P: 101325, v.X('AL'): np.linspace(0.2, 0.7, 6)[[0, 2, 5]]}
+    cached = equilibrium(dbf, comps, my_phases, conds, result_cache=cache)
+    assert (cache.hits, cache.misses) == (4, 6)
+    uncached = equilibrium(dbf, comps, my_phases, conds)
+    assert_allclose(cached.GM.values, uncached.GM.values)
+    assert_allclose(cached.MU.values, uncached.MU.values)
+    np.testing.assert_array_equal(cached.Phase.values, uncached.Phase.values)
+    # A new cache reads every point back from the cache directory
+    reloaded_cache = EquilibriumResultCache(cache_dir=tmp_path)
+    reloaded = equilibrium(dbf, comps, my_phases, conds, result_cache=reloaded_cache)
+    assert (reloaded_cache.hits, reloaded_cache.misses) == (6, 0)
+    assert_allclose(reloaded.GM.values, uncached.GM.values)
+    # Other phases are another system, so no point is reused
+    equilibrium(dbf, comps, ['LIQUID', 'FCC_A1'], conds, result_cache=reloaded_cache)
+    assert (reloaded_cache.hits, reloaded_cache.misses) == (6, 6)
+
+
+@pytest.mark.solver
+@select_database("alfe.tdb")
+def test_eq_result_cache_hits_skip_grid(load_database, monkeypatch):
+    "When every point is found in the cache, neither the PhaseRecords nor the starting point are computed."
+    import sys
+    from pycalphad.core.result_cache import EquilibriumResultCache
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1']
+    comps = ['AL', 'FE', 'VA']
+    conds = {v.T: [1300, 1400], v.P: 101325, v.X('AL'): [0.2, 0.4]}
+    cache = EquilibriumResultCache()
+    solved = equilibrium(dbf, comps, my_phases, conds, result_cache=cache)
+
+    def fail(*args, **kwargs):
+        raise AssertionError('Points found in the cache must not be recomputed')
+    eq_module = sys.modules['pycalphad.core.equilibrium']
+    for name in ('build_phase_records', 'calculate', 'starting_point', '_solve_eq_at_conditions_parallel'):
+        monkeypatch.setattr(eq_module, name, fail)
+    cached = equilibrium(dbf, comps, my_phases, conds, result_cache=cache)
+    assert (cache.hits, cache.misses) == (4, 4)
+    assert_allclose(cached.GM.values, solved.GM.values)
+    np.testing.assert_array_equal(cached.Phase.values, solved.Phase.values)
+
+
+@select_database("alfe.tdb")
+def test_result_cache_fingerprint_includes_phase_record_parameters(load_database):
+    "Changing the parameters of caller-supplied PhaseRecords in place changes the system fingerprint."
+    from pycalphad.core.result_cache import system_fingerprint
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1']
+    comps = ['AL', 'FE', 'VA']
+    conds = {v.T: 1400, v.P: 101325, v.N: 1.0, v.X('AL'): 0.55}
+    parameters = {Symbol('VV0000'): 1.0}
+    models = instantiate_models(dbf, comps, my_phases, parameters=parameters)
+    phase_records = build_phase_records(dbf, comps, my_phases, conds, models, parameters=parameters)
+    conds_keys = ['N', 'P', 'T', 'X_AL']
+    before = system_fingerprint(comps, my_phases, models, conds_keys, parameters=parameters,
+                                phase_records=phase_records)
+    assert system_fingerprint(comps, my_phases, models, conds_keys, parameters=parameters,
+                              phase_records=phase_records) == before
+    phase_records['LIQUID'].parameters[0] = 2.0
+    assert system_fingerprint(comps, my_phases, models, conds_keys, parameters=parameters,
+                              phase_records=phase_records) != before
+
+
+def test_result_cache_directory_is_bounded(tmp_path, monkeypatch):
+    "Batch files of a system are compacted into one, keeping at most max_disk_points of the latest points."
+    from pycalphad.core import result_cache
+    from pycalphad.core.light_dataset import LightDataset
+    monkeypatch.setattr(result_cache, 'MAX_BATCH_FILES', 2)
+    cache = result_cache.EquilibriumResultCache(cache_dir=tmp_path, max_disk_points=7)
+
+    def solved_points(temperatures):
+        temperatures = np.array(temperatures, dtype=np.float64)
+        return LightDataset({'GM': (['T'], -temperatures), 'NP': (['T', 'vertex'], np.ones((len(temperatures), 2)))},
+                            coords={'T': temperatures, 'vertex': np.arange(2)})
+
+    for batch_idx in range(5):
+        cache.store('system', solved_points(300 + 10 * batch_idx + np.arange(3)), ['T'])
+        batch_files = [name for name in os.listdir(tmp_path / 'system') if name.endswith('.pkl')]
+        assert len(batch_files) <= 2
+        num_points = sum(len(batch['keys']) for batch in cache._read_batches(cache._batch_paths('system')))
+        assert num_points <= 7
+    # The latest points are kept
+    reloaded_cache = result_cache.EquilibriumResultCache(cache_dir=tmp_path)
+    latest = solved_points([322, 330, 340, 341, 342])
+    latest.GM[:] = np.nan
+    assert len(reloaded_cache.lookup('system', latest, ['T'])) == 0
+    assert_allclose(latest.GM, [-322, -330, -340, -341, -342])
+
+
+@select_database("alfe.tdb")
+def test_eq_continuation_retries_failed_warm_start(load_database):
+    "A warm start across a large jump in conditions that fails to converge is solved again from the hull."
+    class DistantStartSolver(Solver):
+        "Does not converge from starting points far from the target composition, as a warm start across a jump."
+        def __init__(self, *args, **kwargs):
+            super().__init__(*args, **kwargs)
+            self.num_failures = 0
+
+        def solve(self, composition_sets, conditions):
+            phase_amounts = np.array([compset.NP for compset in composition_sets])
+            compositions = np.array([np.asarray(compset.X) for compset in composition_sets])
+            start_X_AL = np.dot(phase_amounts, compositions[:, 0]) / np.sum(phase_amounts)
+            if abs(start_X_AL - conditions['X_AL']) < 0.3:
+                return super().solve(composition_sets, conditions)
+            self.num_failures += 1
+            # Leave the composition sets where they started
+            num_statevars = len(composition_sets[0].phase_record.state_variables)
+            x = np.concatenate([np.asarray(composition_sets[0].dof[:num_statevars])] +
+                               [np.asarray(compset.dof[num_statevars:]) for compset in composition_sets] +
+                               [phase_amounts])
+            # Potentials far below the energy surface, so no phase has a positive driving force,
+            # and only the failure to converge can trigger the retry
+            return SolverResult(converged=False, x=x, chemical_potentials=np.full(compositions.shape[1], -1e6))
+
+    from pycalphad.core.solver import SolverResult
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    # X(AL)=0.6 is warm-started from X(AL)=0.1
+    conds = {v.T: 1300, v.P: 101325, v.X('AL'): [0.05, 0.1, 0.6, 0.65]}
+    cold_start = equilibrium(dbf, comps, my_phases, conds)
+    solver = DistantStartSolver()
+    warm_start = equilibrium(dbf, comps, my_phases, conds, continuation=True, solver=solver)
+    assert solver.num_failures > 0
+    assert not np.any(np.isnan(warm_start.GM.values))
+    assert_allclose(warm_start.GM.values, cold_start.GM.values, rtol=1e-6)
+    assert_allclose(warm_start.MU.values, cold_start.MU.values, atol=1e-2)
+
+
+@select_database("alfe.tdb")
+def test_eq_diagnostics(load_database):
+    "Solver diagnostics are returned per condition point and do not change the result."
+    from pycalphad.core.solver import SOLVER_DIAGNOSTICS
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    conds = {v.T: [1300, 1400], v.P: 101325, v.X('AL'): [0.2, 0.55, 0.7]}
+    eq = equilibrium(dbf, comps, my_phases, conds)
+    eq_diagnostics = equilibrium(dbf, comps, my_phases, conds, diagnostics=True)
+    assert all(var not in eq.data_vars for var in SOLVER_DIAGNOSTICS)
+    assert_allclose(eq_diagnostics.GM.values, eq.GM.values)
+    for var in SOLVER_DIAGNOSTICS:
+        assert eq_diagnostics[var].dims == eq.GM.dims
+        assert np.all(eq_diagnostics[var].values >= 0)
+    assert np.all(eq_diagnostics.solver_calls.values >= 1)
+    assert np.all(eq_diagnostics.solver_iterations.values >= eq_diagnostics.solver_calls.values)
+    assert np.all(eq_diagnostics.solver_point_time.values >= eq_diagnostics.solver_solve_state_time.values)
+    with pytest.raises(ValueError):
+        equilibrium(dbf, comps, my_phases, conds, diagnostics=True, solver=Solver())
+
+
+@select_database("alfe.tdb")
+def test_eq_adaptive_grid_matches_uniform_grid(load_database):
+    "Equilibrium started from an adaptively refined coarse grid matches the default uniform grid."
+    from pycalphad.core.adaptive_grid import adaptive_starting_point
+    from pycalphad.core.equilibrium import _adjust_conditions
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    conds = {v.T: [1300, 1400], v.P: 101325, v.X('AL'): [0.2, 0.55, 0.7]}
+    uniform = equilibrium(dbf, comps, my_phases, conds)
+    adaptive = equilibrium(dbf, comps, my_phases, conds, adaptive_grid=True)
+    assert_allclose(adaptive.GM.values, uniform.GM.values, rtol=1e-6)
+    np.testing.assert_array_equal(np.sort(adaptive.Phase.values, axis=-1), np.sort(uniform.Phase.values, axis=-1))
+    # The refined grid is smaller than the uniform one
+    models = instantiate_models(dbf, comps, my_phases)
+    adj_conds = _adjust_conditions(dict(conds, **{v.N: 1}))
+    phase_records = build_phase_records(dbf, comps, my_phases, adj_conds, models, output='GM',
+                                        build_gradients=True, build_hessians=True)
+    state_variables = sorted(get_state_variables(models=models, conds=adj_conds), key=str)
+    grid_opts = {'T': adj_conds[v.T], 'P': adj_conds[v.P], 'N': adj_conds[v.N]}
+    grid, properties = adaptive_starting_point(dbf, comps, my_phases, adj_conds, state_variables, models,
+                                               phase_records, grid_opts=grid_opts)
+    uniform_grid = calculate(dbf, comps, my_phases, model=models, phase_records=phase_records, fake_points=True,
+                             output='GM', to_xarray=False, compact=True, pdens=60, **grid_opts)
+    assert grid.num_points < uniform_grid.num_points
+    assert properties.GM.shape == (1, 1, 2, 3)
+    # Only the added points are calculated in each iteration, which gives the same grid as calculating all of them
+    phase_points = {phase_name: grid.site_fractions[grid.offsets[indices.start]:grid.offsets[indices.stop]]
+                    .reshape(indices.stop - indices.start, -1)
+                    for phase_name, indices in grid.attrs['phase_indices'].items()}
+    full_grid = calculate(dbf, comps, my_phases, model=models, phase_records=phase_records, fake_points=True,
+                          output='GM', to_xarray=False, compact=True, points=phase_points, **grid_opts)
+    np.testing.assert_array_equal(grid.phase_ids, full_grid.phase_ids)
+    np.testing.assert_array_equal(grid.offsets, full_grid.offsets)
+    assert_allclose(grid.GM, full_grid.GM)
+    assert_allclose(grid.X, full_grid.X)
+
+
+@select_database("alfe.tdb")
+def test_stream_equilibrium_matches_equilibrium_and_resumes(load_database, tmp_path):
+    "Equilibrium written chunk by chunk to a store matches a single calculation, and completed chunks are skipped."
+    from pycalphad.core.result_store import EquilibriumResultStore, stream_equilibrium
+    dbf = load_database()
+    my_phases = ['LIQUID', 'FCC_A1', 'AL13FE4', 'AL5FE4']
+    comps = ['AL', 'FE', 'VA']
+    conds = {v.T: [1300, 1310, 1320], v.P: 101325, v.X('AL'): [0.2, 0.55, 0.7]}
+    eq = equilibrium(dbf, comps, my_phases, conds)
+    store_path = str(tmp_path / 'store')
+    streamed = stream_equilibrium(store_path, dbf, comps, my_phases, conds, chunk_size=2, chunk_dim=v.T)
+    assert streamed.GM.dims == eq.GM.dims
+    assert_allclose(streamed.GM.values, eq.GM.values)
+    assert_allclose(streamed.MU.values, eq.MU.values)
+    np.testing.assert_array_equal(streamed.Phase.values, eq.Phase.values)
+    # Every chunk is complete, so resuming solves nothing; a solver that fails on use proves it
+    resumed = stream_equilibrium(store_path, dbf, comps, my_phases, conds, chunk_size=2, chunk_dim=v.T,
+                                 solver=object())
+    assert_allclose(resumed.GM.values, eq.GM.values)
+    with pytest.raises(ValueError):
+        EquilibriumResultStore(store_path, {'T': [1.0]}, 'T', 2)
+
+
 @select_database("alfe.tdb")
 def test_missing_models_with_phase_records_passed_to_equilibrium_raises(load_database):
     dbf = load_database()
@@ -227,6 +577,44 @@ def test_eq_output_property(load_database):
                 output=['heat_capacity', 'degree_of_ordering'])
 
 
+@select_database("alfe.tdb")
+def test_eq_output_properties_match_calculate(load_database):
+    """
+    Extra properties evaluated together match calculate() at the equilibrium site fractions.
+    """
+    from pycalphad.core.equilibrium import _eqcalculate_outputs
+    dbf = load_database()
+    comps = ['AL', 'FE', 'VA']
+    phases = ['LIQUID', 'B2_BCC']
+    conds = {v.X('AL'): [0.25, 0.5], v.T: (300, 2000, 500), v.P: 101325, v.N: 1}
+    outputs = [('HM', False), ('SM', False), ('DOO', True)]
+    eq = equilibrium(dbf, comps, phases, conds, output=[out for out, _ in outputs], to_xarray=False)
+    models = instantiate_models(dbf, comps, phases)
+    phase_dims = list(eq.data_vars['Phase'][0])
+    for out, per_phase in outputs:
+        expected = np.full(eq.Phase.shape, np.nan)
+        for phase in phases:
+            phase_indices = np.nonzero(eq.Phase == phase)
+            if len(phase_indices[0]) == 0:
+                continue
+            statevars = {str(sv): np.asarray(eq.coords[str(sv)])[phase_indices[phase_dims.index(str(sv))]]
+                         for sv in (v.N, v.P, v.T)}
+            points = eq.Y[phase_indices][:, :len(models[phase].site_fractions)]
+            calcres = calculate(dbf, comps, [phase], output=out, points=points, broadcast=False,
+                                model=models, to_xarray=False, **statevars)
+            expected[phase_indices] = calcres[out]
+        if not per_phase:
+            expected = np.nansum(expected * eq.NP, axis=-1)
+        assert_allclose(eq[out], expected)
+    # Options of calculate are passed through; the sampling ones do not change the values
+    phase_records = build_phase_records(dbf, comps, phases, get_state_variables(models=models, conds=conds), models)
+    eqcal = _eqcalculate_outputs(outputs, eq, models, phase_records,
+                                 calc_opts={'pdens': 10, 'fake_points': False, 'points': {}})
+    for out, _ in outputs:
+        assert eq.data_vars[out][0] == eqcal.data_vars[out][0]
+        assert_allclose(eq[out], eqcal[out])
+
+
 @select_database("alfe.tdb")
 def test_eq_on_endmember(load_database):
     """
@@ -672,6 +1060,63 @@ def test_eq_magnetic_chempot_cond(load_database):
     assert_allclose(np.squeeze(eq.MU.values), [-8490.6849, -123110], atol=0.1)
 
 
+def test_open_system_hull_matches_hyperplane():
+    "The argmin of the transformed energy finds the same tangent as the simplex search when one potential is free."
+    from pycalphad.core.hyperplane import hyperplane_batch
+    from pycalphad.core.lower_convex_hull import open_system_hull
+    rng = np.random.RandomState(1769)
+    num_comps = 3
+    # Pure components first, as in grids with fake points
+    compositions = np.concatenate((np.eye(num_comps), rng.dirichlet(np.ones(num_comps), size=500)))
+    energies = 8.3145 * 1000 * np.sum(compositions * np.log(np.maximum(compositions, 1e-12)), axis=-1) + \
+        rng.uniform(-5000, 0, size=compositions.shape[0])
+    energies[:num_comps] = 0
+    grid_compositions = compositions[None, ...]
+    grid_energies = energies[None, :]
+    fixed_chempot_indices = np.array([0, 1], dtype=np.uint64)
+    fixed_potentials = np.stack(np.meshgrid(np.linspace(-20000, -2000, 5), np.linspace(-15000, -1000, 4)),
+                                axis=-1).reshape(-1, 2)
+    num_conditions = fixed_potentials.shape[0]
+    grid_indices = np.zeros(num_conditions, dtype=np.int32)
+    results = []
+    for method in ('hyperplane', 'open_system'):
+        chemical_potentials = np.zeros((num_conditions, num_comps))
+        chemical_potentials[:, :2] = fixed_potentials
+        result_energies = np.empty(num_conditions)
+        result_fractions = np.empty((num_conditions, num_comps + 1))
+        result_simplices = np.empty((num_conditions, num_comps + 1), dtype=np.int32)
+        if method == 'hyperplane':
+            hyperplane_batch(grid_compositions, grid_energies, grid_indices, np.ones((num_conditions, 1)),
+                             chemical_potentials, 1.0, fixed_chempot_indices, np.array([], dtype=np.uint64),
+                             result_energies, result_fractions, result_simplices)
+        else:
+            open_system_hull(grid_compositions, grid_energies, grid_indices, chemical_potentials, 1.0,
+                             fixed_chempot_indices, result_energies, result_fractions, result_simplices)
+        results.append((chemical_potentials, result_energies, result_fractions, result_simplices))
+    (hyperplane_mu, hyperplane_GM, hyperplane_NP, hyperplane_points), (mu, GM, NP, points) = results
+    assert_allclose(mu, hyperplane_mu)
+    assert_allclose(GM, hyperplane_GM)
+    assert_allclose(NP, hyperplane_NP)
+    np.testing.assert_array_equal(points, hyperplane_points)
+
+
+@pytest.mark.solver
+@select_database("alfe.tdb")
+def test_eq_chempot_grid_matches_single_points(load_database):
+    "A grid of fixed chemical potentials gives the same equilibria as solving its points separately."
+    dbf = load_database()
+    comps = ['AL', 'FE', 'VA']
+    phases = ['FCC_A1', 'AL13FE4', 'B2_BCC']
+    mu_values = [-123110, -110000, -95000]
+    eq = equilibrium(dbf, comps, phases, {v.MU('FE'): mu_values, v.T: [300, 600], v.P: 1e5})
+    for T_idx, T in enumerate([300, 600]):
+        for mu_idx, mu in enumerate(mu_values):
+            single = equilibrium(dbf, comps, phases, {v.MU('FE'): mu, v.T: T, v.P: 1e5})
+            # Dimensions are MU_FE, N, P, T
+            assert_allclose(eq.GM.values[mu_idx, 0, 0, T_idx], single.GM.values.squeeze())
+            assert_allclose(eq.MU.values[mu_idx, 0, 0, T_idx], single.MU.values.squeeze())
+
+
 @select_database("cumg_parameters.tdb")
 def test_eq_calculation_with_parameters(load_database):
     dbf = load_database()
@@ -162,3 +162,37 @@ def test_order_disorder_interstital_sublattice_validation():
     # as the substitutional and cannot be distinguished
     with pytest.raises(ValueError):
         Model(DBF_OrderDisorder_broken, ["A", "B", "VA"], "ORD_SUBS_INSTL")
+
+
+@select_database("alcrni.tdb")
+def test_model_contributions_are_built_on_first_access(load_database):
+    "Contributions of a Model are built when they, or attributes set while building them, are first accessed."
+    dbf = load_database()
+    mod = Model(dbf, ['AL', 'NI', 'VA'], 'FCC_A1')
+    mod.moles('AL')
+    mod.get_internal_constraints()
+    assert mod._models is None
+    built_mod = Model(dbf, ['AL', 'NI', 'VA'], 'FCC_A1')
+    built_mod.GM
+    assert built_mod._models is not None
+    # Reading the Curie temperature builds the contributions that set it
+    assert mod.TC == built_mod.TC
+    assert mod._models is not None
+    assert mod.site_fractions == sorted([x for x in mod.GM.free_symbols if isinstance(x, v.SiteFraction)], key=str)
+    assert mod == built_mod
+
+
+@select_database("alcrni.tdb")
+def test_models_share_expanded_database_symbols(load_database):
+    "Models built from the same Database substitute the same, fully expanded symbol values."
+    from pycalphad.model import _symbol_resolver
+    dbf = load_database()
+    mod_liquid = Model(dbf, ['AL', 'NI', 'VA'], 'LIQUID')
+    mod_fcc = Model(dbf, ['AL', 'NI', 'VA'], 'FCC_A1')
+    resolver = _symbol_resolver(mod_liquid._symbols)
+    assert resolver is _symbol_resolver(mod_fcc._symbols)
+    for mod in (mod_liquid, mod_fcc):
+        assert not any(str(x) in dbf.symbols for x in mod.GM.free_symbols)
+        # Same result as substituting the symbols level by level
+        reference = Model.symbol_replace(mod.GM, mod._symbols)
+        assert reference == mod.GM
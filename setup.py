@@ -22,6 +22,7 @@ CYTHON_EXTENSION_MODULES = [
     Extension('pycalphad.core.phase_rec', sources=['pycalphad/core/phase_rec.pyx']),
     Extension('pycalphad.core.composition_set', sources=['pycalphad/core/composition_set.pyx']),
     Extension('pycalphad.core.minimizer', sources=['pycalphad/core/minimizer.pyx']),
+    Extension('pycalphad.core.hr_sampler', sources=['pycalphad/core/hr_sampler.pyx']),
 ]
 
 setup(